@@ -602,6 +602,15 @@ VipsBlob *dzsave_buffer( VOption *options = 0 ) const;
  */
 VImage embed( int x, int y, int width, int height, VOption *options = 0 ) const;
 
+/**
+ * Enlarge an image.
+ * @param hscale Horizontal scale factor.
+ * @param vscale Vertical scale factor.
+ * @param options Optional options.
+ * @return Output image.
+ */
+VImage enlarge( double hscale, double vscale, VOption *options = 0 ) const;
+
 /**
  * Extract an area from an image.
  * @param left Left edge of extract area.
@@ -1427,6 +1436,15 @@ VImage msb( VOption *options = 0 ) const;
  */
 VImage multiply( VImage right, VOption *options = 0 ) const;
 
+/**
+ * Load a pyramidal image at any scale.
+ * @param filename Filename to read from.
+ * @param scale Scale image by this factor.
+ * @param options Optional options.
+ * @return Output image.
+ */
+static VImage multires( const char *filename, double scale, VOption *options = 0 );
+
 /**
  * Load a nifti image.
  * @param filename Filename to load from.
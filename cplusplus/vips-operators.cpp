@@ -939,6 +939,20 @@ VImage VImage::embed( int x, int y, int width, int height, VOption *options ) co
     return( out );
 }
 
+VImage VImage::enlarge( double hscale, double vscale, VOption *options ) const
+{
+    VImage out;
+
+    call( "enlarge",
+        (options ? options : VImage::option())->
+            set( "in", *this )->
+            set( "out", &out )->
+            set( "hscale", hscale )->
+            set( "vscale", vscale ) );
+
+    return( out );
+}
+
 VImage VImage::extract_area( int left, int top, int width, int height, VOption *options ) const
 {
     VImage out;
@@ -2188,6 +2202,19 @@ VImage VImage::multiply( VImage right, VOption *options ) const
     return( out );
 }
 
+VImage VImage::multires( const char *filename, double scale, VOption *options )
+{
+    VImage out;
+
+    call( "multires",
+        (options ? options : VImage::option())->
+            set( "out", &out )->
+            set( "filename", filename )->
+            set( "scale", scale ) );
+
+    return( out );
+}
+
 VImage VImage::niftiload( const char *filename, VOption *options )
 {
     VImage out;
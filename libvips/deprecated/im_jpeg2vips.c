@@ -117,7 +117,7 @@ jpeg2vips( const char *name, IMAGE *out, gboolean header_only )
 	if( !(streami = vips_streami_new_from_file( filename )) ) 
 		return( -1 );
 	if( vips__jpeg_read_stream( streami, out,
-		header_only, shrink, fail_on_warn, FALSE ) ) {
+		header_only, shrink, 0, fail_on_warn, FALSE ) ) {
 		VIPS_UNREF( streami );
 		return( -1 );
 	}
@@ -90,9 +90,9 @@ png2vips( const char *name, IMAGE *out, gboolean header_only )
 	if( !(streami = vips_streami_new_from_file( filename )) ) 
 		return( -1 );
 	if( header_only ) 
-		result = vips__png_header_stream( streami, out );
+		result = vips__png_header_stream( streami, out, 1 );
 	else 
-		result = vips__png_read_stream( streami, out, TRUE );
+		result = vips__png_read_stream( streami, out, 1, 0, TRUE );
 	VIPS_UNREF( streami );
 
 	if( result )
@@ -32,6 +32,10 @@
  * 	  linebreaks
  * 12/8/16
  * 	- allow missing offset and scale in matrix header
+ * 19/10/19
+ * 	- read the body in chunks split at line boundaries, parse the lines
+ * 	  in each chunk in parallel, and support sequential access
+ * 	- faster number parsing
  */
 
 /*
@@ -74,9 +78,571 @@
 #include <math.h>
 
 #include <vips/vips.h>
+#include <vips/internal.h>
 
 #include "pforeign.h"
 
+/* We read the body of text files in chunks of about this many bytes. Chunks 
+ * always end on a line boundary, so the lines in a chunk can be parsed in 
+ * parallel, and memory use depends on the chunk size, not the file size.
+ */
+#define CHUNK_SIZE (1024 * 1024)
+
+/* Give each parse thread at least this many lines.
+ */
+#define CHUNK_MIN_LINES (256)
+
+typedef struct _Chunk Chunk;
+
+/* A range of lines in a chunk, and the worker thread which parses it. 
+ */
+typedef struct _ChunkSlice {
+	Chunk *chunk;
+	int first;
+	int last;
+	int result;
+
+	/* Up this to get the worker to parse the slice. 
+	 */
+	VipsSemaphore go;
+	GThread *thread;
+} ChunkSlice;
+
+/* Parse a line of text to @width doubles. @lineno is the line number, for
+ * error messages. This can be called from several threads at once.
+ */
+typedef int (*ChunkParseFn)( void *a, 
+	const char *line, int lineno, int width, double *out );
+
+struct _Chunk {
+	FILE *fp;
+	const char *domain;
+
+	/* Parse lines with this, making @width doubles per line.
+	 */
+	ChunkParseFn parse;
+	void *a;
+	int width;
+
+	/* Line number of the first line in the chunk.
+	 */
+	int lineno;
+
+	/* The text we've read. @used bytes of this have been split into lines.
+	 * The buffer is one byte larger than @size so we can always add a \0.
+	 */
+	char *buf;
+	size_t size;
+	size_t length;
+	size_t used;
+	gboolean eof;
+
+	/* The lines in this chunk, \0 terminated inside @buf.
+	 */
+	char **line;
+	int n_lines;
+	int max_lines;
+
+	/* The parsed lines. @top is the output line of the first of them.
+	 */
+	double *values;
+	size_t values_size;
+	int top;
+	int height;
+
+	/* Lines are parsed by up to vips_concurrency_get() slices. The
+	 * calling thread does slice 0, the others have a worker which we 
+	 * start the first time we need it and keep until the chunk is freed.
+	 * Workers up @done when they finish a slice.
+	 */
+	ChunkSlice *slice;
+	int n_slices;
+	int n_workers;
+	VipsSemaphore done;
+	gboolean exit;
+};
+
+static Chunk *
+chunk_new( FILE *fp, const char *domain, 
+	int width, ChunkParseFn parse, void *a, int lineno )
+{
+	Chunk *chunk;
+
+	chunk = g_new0( Chunk, 1 );
+	chunk->fp = fp;
+	chunk->domain = domain;
+	chunk->parse = parse;
+	chunk->a = a;
+	chunk->width = width;
+	chunk->lineno = lineno;
+	chunk->size = CHUNK_SIZE;
+	chunk->buf = g_new( char, chunk->size + 1 );
+	chunk->n_slices = VIPS_MAX( 1, vips_concurrency_get() );
+	chunk->slice = g_new0( ChunkSlice, chunk->n_slices );
+	vips_semaphore_init( &chunk->done, 0, "done" );
+
+	return( chunk );
+}
+
+static void
+chunk_free( Chunk *chunk )
+{
+	int i;
+
+	/* Workers are 1 .. n_workers.
+	 */
+	chunk->exit = TRUE;
+	for( i = 1; i <= chunk->n_workers; i++ ) 
+		vips_semaphore_up( &chunk->slice[i].go );
+	for( i = 1; i <= chunk->n_workers; i++ ) {
+		(void) vips_g_thread_join( chunk->slice[i].thread );
+		vips_semaphore_destroy( &chunk->slice[i].go );
+	}
+	vips_semaphore_destroy( &chunk->done );
+	VIPS_FREEF( g_free, chunk->slice );
+
+	VIPS_FREEF( g_free, chunk->buf );
+	VIPS_FREEF( g_free, chunk->line );
+	VIPS_FREEF( g_free, chunk->values );
+	g_free( chunk );
+}
+
+static void
+chunk_close_cb( VipsImage *image, Chunk *chunk )
+{
+	VIPS_FREEF( fclose, chunk->fp );
+	chunk_free( chunk );
+}
+
+/* Split the buffer into at most @max_lines lines. We can only use an
+ * unterminated line if it's the last one in the file.
+ */
+static void
+chunk_split( Chunk *chunk, int max_lines )
+{
+	char *p = chunk->buf;
+	char *end = chunk->buf + chunk->length;
+
+	while( chunk->n_lines < max_lines && 
+		p < end ) {
+		char *q;
+
+		if( !(q = memchr( p, '\n', end - p )) ) {
+			if( !chunk->eof )
+				break;
+			q = end;
+		}
+
+		/* Files can have \r\n linebreaks, see vips__fgetc().
+		 */
+		*q = '\0';
+		if( q > p && 
+			q[-1] == '\r' )
+			q[-1] = '\0';
+
+		if( chunk->n_lines >= chunk->max_lines ) {
+			chunk->max_lines = 2 * chunk->max_lines + 1024;
+			chunk->line = g_renew( char *, 
+				chunk->line, chunk->max_lines );
+		}
+		chunk->line[chunk->n_lines++] = p;
+
+		p = q + 1;
+	}
+
+	chunk->used = VIPS_MIN( p - chunk->buf, chunk->length );
+}
+
+static void
+chunk_parse_slice( ChunkSlice *slice )
+{
+	Chunk *chunk = slice->chunk;
+
+	int i;
+
+	slice->result = 0;
+	for( i = slice->first; i < slice->last; i++ ) 
+		if( chunk->parse( chunk->a, 
+			chunk->line[i], chunk->lineno + i, chunk->width,
+			chunk->values + (size_t) i * chunk->width ) ) {
+			slice->result = -1;
+			break;
+		}
+}
+
+static void *
+chunk_worker( void *a )
+{
+	ChunkSlice *slice = (ChunkSlice *) a;
+	Chunk *chunk = slice->chunk;
+
+	for(;;) {
+		vips_semaphore_down( &slice->go );
+		if( chunk->exit )
+			break;
+
+		chunk_parse_slice( slice );
+		vips_semaphore_up( &chunk->done );
+	}
+
+	return( NULL );
+}
+
+/* Parse the lines in the chunk, sharing them out between the slices.
+ */
+static int
+chunk_parse( Chunk *chunk )
+{
+	int n_slices;
+	int result;
+	int i;
+
+	n_slices = VIPS_CLIP( 1, 
+		chunk->n_lines / CHUNK_MIN_LINES, chunk->n_slices );
+
+	/* Start any workers we've not needed before. If we can't make a 
+	 * thread, just use fewer slices. Leave the error buffer alone, other
+	 * threads may be using it.
+	 */
+	while( chunk->n_workers < n_slices - 1 ) {
+		ChunkSlice *slice = &chunk->slice[chunk->n_workers + 1];
+
+		slice->chunk = chunk;
+		vips_semaphore_init( &slice->go, 0, "go" );
+		if( !(slice->thread = vips_g_thread_new( "textload", 
+			chunk_worker, slice )) ) {
+			vips_semaphore_destroy( &slice->go );
+			g_info( "textload: unable to start worker, "
+				"using %d threads", chunk->n_workers + 1 );
+			chunk->n_slices = chunk->n_workers + 1;
+			n_slices = chunk->n_slices;
+			break;
+		}
+		chunk->n_workers += 1;
+	}
+
+	for( i = 0; i < n_slices; i++ ) {
+		ChunkSlice *slice = &chunk->slice[i];
+
+		slice->chunk = chunk;
+		slice->first = (gint64) chunk->n_lines * i / n_slices;
+		slice->last = (gint64) chunk->n_lines * (i + 1) / n_slices;
+	}
+
+	/* The calling thread does the first slice.
+	 */
+	for( i = 1; i < n_slices; i++ ) 
+		vips_semaphore_up( &chunk->slice[i].go );
+	chunk_parse_slice( &chunk->slice[0] );
+	vips_semaphore_downn( &chunk->done, n_slices - 1 );
+
+	result = 0;
+	for( i = 0; i < n_slices; i++ ) 
+		if( chunk->slice[i].result )
+			result = -1;
+
+	return( result );
+}
+
+/* Read and parse the next set of lines, at most @max_lines of them. At EOF, 
+ * ->height is zero.
+ */
+static int
+chunk_read( Chunk *chunk, int max_lines )
+{
+	size_t values_size;
+
+	chunk->top += chunk->height;
+	chunk->lineno += chunk->n_lines;
+	chunk->height = 0;
+	chunk->n_lines = 0;
+
+	/* Move any partial line down to the start of the buffer.
+	 */
+	memmove( chunk->buf, chunk->buf + chunk->used, 
+		chunk->length - chunk->used );
+	chunk->length -= chunk->used;
+	chunk->used = 0;
+
+	for(;;) {
+		while( !chunk->eof && 
+			chunk->length < chunk->size ) {
+			size_t bytes_read;
+
+			bytes_read = fread( chunk->buf + chunk->length, 
+				1, chunk->size - chunk->length, chunk->fp );
+			if( bytes_read == 0 ) {
+				if( ferror( chunk->fp ) ) {
+					vips_error_system( errno, 
+						chunk->domain, 
+						"%s", _( "read error" ) );
+					return( -1 );
+				}
+
+				chunk->eof = TRUE;
+			}
+
+			chunk->length += bytes_read;
+		}
+
+		chunk_split( chunk, max_lines );
+
+		if( chunk->n_lines > 0 ||
+			chunk->eof ||
+			max_lines <= 0 )
+			break;
+
+		/* A line longer than the whole buffer. Make the buffer 
+		 * larger and try again.
+		 */
+		chunk->size *= 2;
+		chunk->buf = g_renew( char, chunk->buf, chunk->size + 1 );
+	}
+
+	if( chunk->n_lines == 0 )
+		return( 0 );
+
+	values_size = (size_t) chunk->n_lines * chunk->width;
+	if( values_size > chunk->values_size ) {
+		chunk->values = g_renew( double, chunk->values, values_size );
+		chunk->values_size = values_size;
+	}
+
+	if( chunk_parse( chunk ) )
+		return( -1 );
+
+	chunk->height = chunk->n_lines;
+
+	return( 0 );
+}
+
+static int
+chunk_generate( VipsRegion *or, 
+	void *seq, void *a, void *b, gboolean *stop )
+{
+	Chunk *chunk = (Chunk *) a;
+	VipsRect *r = &or->valid;
+	size_t sizeof_line = chunk->width * sizeof( double );
+
+	int y;
+
+	/* We're inside a vips_sequential(), so we should always be asked for
+	 * full-width strips, moving down the image.
+	 */
+	g_assert( r->left == 0 );
+	g_assert( r->width == or->im->Xsize );
+
+	if( r->top < chunk->top ) {
+		vips_error( chunk->domain, 
+			_( "out of order read at line %d" ), chunk->top );
+		return( -1 );
+	}
+
+	for( y = r->top; y < VIPS_RECT_BOTTOM( r ); y++ ) {
+		while( y >= chunk->top + chunk->height ) {
+			if( chunk_read( chunk, 
+				or->im->Ysize - chunk->top - chunk->height ) )
+				return( -1 );
+
+			if( chunk->height == 0 ) {
+				vips_error( chunk->domain, 
+					_( "unexpected EOF, line %d" ), 
+					chunk->lineno );
+				return( -1 );
+			}
+		}
+
+		memcpy( VIPS_REGION_ADDR( or, 0, y ),
+			chunk->values + 
+				(size_t) (y - chunk->top) * chunk->width,
+			sizeof_line );
+	}
+
+	return( 0 );
+}
+
+/* Generate @in from @fp with a chunk reader, and write to @out. @fp is
+ * closed when @out closes.
+ */
+static int
+chunk_read_image( VipsImage *out, VipsImage *in, 
+	FILE *fp, const char *domain,
+	ChunkParseFn parse, void *a, int lineno )
+{
+	VipsImage **t = (VipsImage **) 
+		vips_object_local_array( VIPS_OBJECT( out ), 1 );
+
+	Chunk *chunk;
+
+	chunk = chunk_new( fp, domain, in->Xsize, parse, a, lineno );
+	g_signal_connect( out, "close", 
+		G_CALLBACK( chunk_close_cb ), chunk ); 
+
+	if( vips_image_generate( in, 
+		NULL, chunk_generate, NULL, 
+		chunk, NULL ) ||
+		vips_sequential( in, &t[0], 
+			"tile_height", VIPS__FATSTRIP_HEIGHT, 
+			NULL ) ||
+		vips_image_write( t[0], out ) )
+		return( -1 );
+
+	return( 0 );
+}
+
+/* Powers of ten which can be represented exactly as doubles.
+ */
+static const double exact_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Parse a number in the C locale. 
+ *
+ * The common case of a decimal number whose digits make an integer mantissa
+ * of at most 2^53, with an exponent of at most 22, is parsed directly. This 
+ * is exact, since the mantissa and the power of ten can both be represented 
+ * exactly and we then do a single rounded multiply or divide. Anything else, 
+ * including longer mantissas, falls back to g_ascii_strtod(). We stop 
+ * collecting digits after 19 significant ones, so the mantissa can't 
+ * overflow.
+ *
+ * Return a pointer to the char after the number, or NULL for no number.
+ */
+static const char *
+parse_number( const char *p, double *out )
+{
+	const char *start = p;
+
+	gboolean negative;
+	guint64 mantissa;
+	int n_digits;
+	int n_significant;
+	int exponent;
+	double value;
+	char *end;
+
+	negative = FALSE;
+	if( *p == '-' ) {
+		negative = TRUE;
+		p++;
+	}
+	else if( *p == '+' )
+		p++;
+
+	mantissa = 0;
+	n_digits = 0;
+	n_significant = 0;
+	exponent = 0;
+	for( ; isdigit( (unsigned char) *p ); p++ ) {
+		mantissa = mantissa * 10 + (*p - '0');
+		n_digits += 1;
+		if( mantissa > 0 )
+			n_significant += 1;
+		if( n_significant > 19 )
+			goto slow;
+	}
+	if( *p == '.' ) 
+		for( p++; isdigit( (unsigned char) *p ); p++ ) {
+			mantissa = mantissa * 10 + (*p - '0');
+			n_digits += 1;
+			exponent -= 1;
+			if( mantissa > 0 )
+				n_significant += 1;
+			if( n_significant > 19 )
+				goto slow;
+		}
+
+	/* Things like inf, nan and hex floats.
+	 */
+	if( n_digits == 0 ||
+		*p == 'x' || 
+		*p == 'X' )
+		goto slow;
+
+	if( *p == 'e' || 
+		*p == 'E' ) {
+		const char *q = p + 1;
+		gboolean negative_exponent;
+		int e;
+
+		negative_exponent = FALSE;
+		if( *q == '-' ) {
+			negative_exponent = TRUE;
+			q++;
+		}
+		else if( *q == '+' )
+			q++;
+
+		/* A bare 'e' is not part of the number.
+		 */
+		if( isdigit( (unsigned char) *q ) ) {
+			for( e = 0; isdigit( (unsigned char) *q ); q++ ) {
+				e = e * 10 + (*q - '0');
+				if( e > 1000 )
+					goto slow;
+			}
+
+			exponent += negative_exponent ? -e : e;
+			p = q;
+		}
+	}
+
+	if( mantissa > ((guint64) 1 << 53) ||
+		exponent < -22 ||
+		exponent > 22 )
+		goto slow;
+
+	value = mantissa;
+	if( exponent < 0 )
+		value /= exact_pow10[-exponent];
+	else
+		value *= exact_pow10[exponent];
+	*out = negative ? -value : value;
+
+	return( p );
+
+slow:
+	*out = g_ascii_strtod( start, &end );
+	if( end == start ) {
+		*out = 0.0;
+		return( NULL );
+	}
+
+	return( end );
+}
+
+/* Count the remaining lines in a file. A final line with no \n still counts.
+ */
+static int
+count_lines( FILE *fp )
+{
+	char buf[16384];
+	size_t bytes_read;
+	int lines;
+	int last;
+
+	lines = 0;
+	last = '\n';
+	while( (bytes_read = fread( buf, 1, sizeof( buf ), fp )) > 0 ) {
+		const char *p = buf;
+		const char *end = buf + bytes_read;
+		const char *q;
+
+		while( (q = memchr( p, '\n', end - p )) ) {
+			lines += 1;
+			p = q + 1;
+		}
+
+		last = buf[bytes_read - 1];
+	}
+
+	if( last != '\n' )
+		lines += 1;
+
+	return( lines );
+}
+
 /* Skip to the start of the next line (ie. read until we see a '\n'), return
  * zero if we are at EOF. 
  *
@@ -218,35 +784,123 @@ read_double( FILE *fp, const char whitemap[256], const char sepmap[256],
 	return( 0 );
 }
 
+typedef struct _Csv {
+	char whitemap[256];
+	char sepmap[256];
+	gboolean fail;
+
+	/* Number of fields we read from each line.
+	 */
+	int columns;
+} Csv;
+
+/* Parse a line of csv. This is the same as read_double() above, but working
+ * on a string rather than a FILE, so we can parse many lines at once.
+ */
+static int
+csv_parse_line( void *a, const char *line, int lineno, int width, double *out )
+{
+	Csv *csv = (Csv *) a;
+	const char *whitemap = csv->whitemap;
+	const char *sepmap = csv->sepmap;
+	const char *p = line;
+
+	int x;
+
+	for( x = 0; x < width; x++ ) {
+		const char *q;
+
+		out[x] = 0;
+
+		while( *p && 
+			whitemap[(unsigned char) *p] )
+			p++;
+		if( !*p ) {
+			vips_error( "csv2vips", 
+				_( "unexpected EOL, line %d col %d" ), 
+				lineno, x + 1 );
+			return( -1 );
+		}
+
+		if( *p == '"' ) {
+			for( p++; *p && *p != '"'; p++ ) 
+				/* Ignore \" in strings.
+				 */
+				if( *p == '\\' &&
+					p[1] )
+					p++;
+			if( *p )
+				p++;
+		}
+		else if( !sepmap[(unsigned char) *p] ) {
+			if( (q = parse_number( p, &out[x] )) )
+				p = q;
+			else {
+				/* Only a warning, since (for example) 
+				 * exported spreadsheets will often have text 
+				 * or date fields.
+				 */
+				g_warning( _( "error parsing number, "
+					"line %d, column %d" ), lineno, x + 1 );
+				if( csv->fail ) {
+					vips_error( "csv2vips", 
+						_( "error parsing number, "
+						"line %d, column %d" ), 
+						lineno, x + 1 );
+					return( -1 );
+				}
+
+				/* Step over the bad data to the next 
+				 * separator.
+				 */
+				while( *p && 
+					!sepmap[(unsigned char) *p] )
+					p++;
+			}
+		}
+
+		while( *p && 
+			whitemap[(unsigned char) *p] )
+			p++;
+
+		/* If it's a separator, we have to step over it. 
+		 */
+		if( *p &&
+			sepmap[(unsigned char) *p] ) 
+			p++;
+	}
+
+	/* Deliberately don't check for line too long.
+	 */
+
+	return( 0 );
+}
+
 static int
-read_csv( FILE *fp, VipsImage *out, 
+read_csv_header( Csv *csv, FILE *fp, VipsImage *out, 
 	int skip, 
 	int lines,
 	const char *whitespace, const char *separator,
-	gboolean read_image,
 	gboolean fail )
 {
 	int i;
-	char whitemap[256];
-	char sepmap[256];
 	const char *p;
 	fpos_t pos;
 	int columns;
 	int ch;
 	double d;
-	double *buf;
-	int y;
 
 	/* Make our char maps. 
 	 */
 	for( i = 0; i < 256; i++ ) {
-		whitemap[i] = 0;
-		sepmap[i] = 0;
+		csv->whitemap[i] = 0;
+		csv->sepmap[i] = 0;
 	}
 	for( p = whitespace; *p; p++ )
-		whitemap[(int) *p] = 1;
+		csv->whitemap[(int) *p] = 1;
 	for( p = separator; *p; p++ )
-		sepmap[(int) *p] = 1;
+		csv->sepmap[(int) *p] = 1;
+	csv->fail = fail;
 
 	/* Skip first few lines.
 	 */
@@ -266,7 +920,7 @@ read_csv( FILE *fp, VipsImage *out,
 		return( -1 );
 	}
 	for( columns = 0; 
-		(ch = read_double( fp, whitemap, sepmap, 
+		(ch = read_double( fp, csv->whitemap, csv->sepmap, 
 			skip + 1, columns + 1, &d, fail )) == 0; 
 		columns++ )
 		;
@@ -276,14 +930,14 @@ read_csv( FILE *fp, VipsImage *out,
 		vips_error( "csv2vips", "%s", _( "empty line" ) );
 		return( -1 );
 	}
+	csv->columns = columns;
 
 	/* If lines is -1, we have to scan the whole file to get the
 	 * number of lines out.
 	 */
 	if( lines == -1 ) {
 		(void) fgetpos( fp, &pos );
-		for( lines = 0; skip_line( fp ); lines++ )
-			;
+		lines = count_lines( fp );
 		(void) fsetpos( fp, &pos );
 	}
 
@@ -293,52 +947,6 @@ read_csv( FILE *fp, VipsImage *out,
 		VIPS_FORMAT_DOUBLE, 
 		VIPS_CODING_NONE, VIPS_INTERPRETATION_B_W, 1.0, 1.0 );
 
-	/* Just reading the header? We are done.
-	 */
-	if( !read_image )
-		return( 0 );
-
-	if( !(buf = VIPS_ARRAY( out, 
-		VIPS_IMAGE_N_ELEMENTS( out ), double )) )
-		return( -1 );
-
-	for( y = 0; y < lines; y++ ) {
-		int x;
-
-		for( x = 0; x < columns; x++ ) {
-			int lineno = y + skip + 1;
-			int colno = x + 1;
-
-			ch = read_double( fp, whitemap, sepmap,
-				lineno, colno, &d, fail );
-			if( ch == EOF ) {
-				vips_error( "csv2vips", 
-					_( "unexpected EOF, line %d col %d" ), 
-					lineno, colno );
-				return( -1 );
-			}
-			else if( ch == '\n' ) {
-				vips_error( "csv2vips", 
-					_( "unexpected EOL, line %d col %d" ), 
-					lineno, colno );
-				return( -1 );
-			}
-			else if( ch )
-				/* Parse error.
-				 */
-				return( -1 );
-
-			buf[x] = d;
-		}
-
-		if( vips_image_write_line( out, y, (VipsPel *) buf ) )
-			return( -1 );
-
-		/* Skip over the '\n' to the next line.
-		 */
-		skip_line( fp );
-	}
-
 	return( 0 );
 }
 
@@ -347,16 +955,26 @@ vips__csv_read( const char *filename, VipsImage *out,
 	int skip, int lines, const char *whitespace, const char *separator, 
 	gboolean fail )
 {
+	VipsImage **t = (VipsImage **) 
+		vips_object_local_array( VIPS_OBJECT( out ), 1 );
+
+	Csv *csv;
 	FILE *fp;
 
-	if( !(fp = vips__file_open_read( filename, NULL, TRUE )) ) 
+	if( !(csv = VIPS_NEW( out, Csv )) ||
+		!(fp = vips__file_open_read( filename, NULL, TRUE )) ) 
 		return( -1 );
-	if( read_csv( fp, out, 
-		skip, lines, whitespace, separator, TRUE, fail ) ) {
+
+	t[0] = vips_image_new();
+	if( read_csv_header( csv, fp, t[0], 
+		skip, lines, whitespace, separator, fail ) ) {
 		fclose( fp );
 		return( -1 );
 	}
-	fclose( fp );
+
+	if( chunk_read_image( out, t[0], fp, "csv2vips", 
+		csv_parse_line, csv, skip + 1 ) )
+		return( -1 );
 
 	return( 0 );
 }
@@ -366,12 +984,13 @@ vips__csv_read_header( const char *filename, VipsImage *out,
 	int skip, int lines, const char *whitespace, const char *separator, 
 	gboolean fail )
 {
+	Csv csv;
 	FILE *fp;
 
 	if( !(fp = vips__file_open_read( filename, NULL, TRUE )) ) 
 		return( -1 );
-	if( read_csv( fp, out, 
-		skip, lines, whitespace, separator, FALSE, fail ) ) {
+	if( read_csv_header( &csv, fp, out, 
+		skip, lines, whitespace, separator, fail ) ) {
 		fclose( fp );
 		return( -1 );
 	}
@@ -518,7 +1137,7 @@ read_ascii_double( FILE *fp, const char whitemap[256], double *out )
 	 * getting zero.
 	 */
 	for( p = buf; *p; p++ )
-		if( isdigit( *p ) )
+		if( isdigit( (unsigned char) *p ) )
 			break;
 	if( !*p ) 
 		return( *buf ); 
@@ -653,32 +1272,83 @@ vips__matrix_ismatrix( const char *filename )
 	return( result == 0 ); 
 }
 
+/* Parse a line of a matrix file. This is the same as read_ascii_double() 
+ * above, but working on a string.
+ */
+static int
+matrix_parse_line( void *a, 
+	const char *line, int lineno, int width, double *out )
+{
+	const char *whitemap = (const char *) a;
+	const char *p = line;
+
+	int x;
+
+	for( x = 0; x < width; x++ ) {
+		const char *q;
+		const char *r;
+
+		out[x] = 0.0;
+
+		while( *p && 
+			whitemap[(unsigned char) *p] )
+			p++;
+		if( !*p ) {
+			vips_error( "mask2vips", 
+				_( "line %d too short" ), lineno );
+			return( -1 );
+		}
+
+		for( q = p; *q && !whitemap[(unsigned char) *q]; q++ )
+			;
+
+		/* The item must contain at least 1 digit. This helps stop
+		 * us trying to convert "MATLAB" (for example) to a number and 
+		 * getting zero.
+		 */
+		for( r = p; r < q; r++ )
+			if( isdigit( (unsigned char) *r ) )
+				break;
+		if( r < q ) 
+			(void) parse_number( p, &out[x] );
+
+		p = q;
+
+		/* Deliberately don't check for line too long.
+		 */
+	}
+
+	return( 0 );
+}
+
 static int
 vips__matrix_body( char *whitemap, VipsImage *out, FILE *fp )
 {
-	int x, y;
+	Chunk *chunk;
+	int y;
 
-	for( y = 0; y < out->Ysize; y++ ) {
-		for( x = 0; x < out->Xsize; x++ ) {
-			int ch;
-			double d;
+	chunk = chunk_new( fp, "mask2vips", 
+		out->Xsize, matrix_parse_line, whitemap, 1 );
 
-			ch = read_ascii_double( fp, whitemap, &d );
-			if( ch == EOF ||
-				ch == '\n' ) {
-				vips_error( "mask2vips", 
-					_( "line %d too short" ), y + 1 );
-				return( -1 );
-			}
-			*VIPS_MATRIX( out, x, y ) = d; 
+	for( y = 0; y < out->Ysize; y += chunk->height ) {
+		if( chunk_read( chunk, out->Ysize - y ) ) {
+			chunk_free( chunk );
+			return( -1 );
+		}
 
-			/* Deliberately don't check for line too long.
-			 */
+		if( chunk->height == 0 ) {
+			vips_error( "mask2vips", 
+				_( "line %d too short" ), y + 1 );
+			chunk_free( chunk );
+			return( -1 );
 		}
 
-		skip_line( fp );
+		memcpy( VIPS_MATRIX( out, 0, y ), chunk->values, 
+			(size_t) chunk->height * out->Xsize * sizeof( double ) );
 	}
 
+	chunk_free( chunk );
+
 	return( 0 );
 }
 
@@ -730,6 +1400,54 @@ vips__matrix_read( const char *filename )
 	return( out );
 }
 
+/* Read a matrix file to @out, supporting sequential access. 
+ */
+int
+vips__matrix_read_sequential( const char *filename, VipsImage *out )
+{
+	VipsImage **t = (VipsImage **) 
+		vips_object_local_array( VIPS_OBJECT( out ), 1 );
+
+	char *whitemap;
+	int i;
+	char *p;
+	FILE *fp;
+	int width;
+	int height;
+	double scale;
+	double offset;
+
+	if( !(whitemap = VIPS_ARRAY( out, 256, char )) )
+		return( -1 );
+	for( i = 0; i < 256; i++ ) 
+		whitemap[i] = 0;
+	for( p = WHITESPACE; *p; p++ )
+		whitemap[(int) *p] = 1;
+
+	if( !(fp = vips__file_open_read( filename, NULL, TRUE )) ) 
+		return( -1 );
+	if( vips__matrix_header( whitemap, fp,
+		&width, &height, &scale, &offset ) ) {
+		fclose( fp );
+		return( -1 );
+	}
+
+	t[0] = vips_image_new();
+	vips_image_pipelinev( t[0], VIPS_DEMAND_STYLE_THINSTRIP, NULL );
+	vips_image_init_fields( t[0],
+		width, height, 1, 
+		VIPS_FORMAT_DOUBLE, 
+		VIPS_CODING_NONE, VIPS_INTERPRETATION_B_W, 1.0, 1.0 );
+	vips_image_set_double( t[0], "scale", scale ); 
+	vips_image_set_double( t[0], "offset", offset ); 
+
+	if( chunk_read_image( out, t[0], fp, "mask2vips", 
+		matrix_parse_line, whitemap, 1 ) )
+		return( -1 );
+
+	return( 0 );
+}
+
 int
 vips__matrix_write_file( VipsImage *in, FILE *fp )
 {
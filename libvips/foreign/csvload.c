@@ -2,6 +2,8 @@
  *
  * 5/12/11
  * 	- from csvload.c
+ * 19/10/19
+ * 	- support sequential access
  */
 
 /*
@@ -72,7 +74,7 @@ G_DEFINE_TYPE( VipsForeignLoadCsv, vips_foreign_load_csv,
 static VipsForeignFlags
 vips_foreign_load_csv_get_flags_filename( const char *filename )
 {
-	return( 0 );
+	return( VIPS_FOREIGN_SEQUENTIAL );
 }
 
 static VipsForeignFlags
@@ -103,8 +105,11 @@ vips_foreign_load_csv_load( VipsForeignLoad *load )
 {
 	VipsForeignLoadCsv *csv = (VipsForeignLoadCsv *) load;
 
+	/* header() has already counted the lines, there's no need to scan
+	 * the file again.
+	 */
 	if( vips__csv_read( csv->filename, load->real, 
-		csv->skip, csv->lines, csv->whitespace, csv->separator,
+		csv->skip, load->out->Ysize, csv->whitespace, csv->separator,
 		load->fail ) )
 		return( -1 );
 
@@ -204,6 +209,11 @@ vips_foreign_load_csv_init( VipsForeignLoadCsv *csv )
  * short lines, or if the file is too short. It will ignore lines that are 
  * too long.
  *
+ * The file is read in chunks, and the lines in each chunk are parsed in 
+ * parallel. This loader supports sequential access, so with 
+ * #VIPS_ACCESS_SEQUENTIAL very large files can be processed in a small
+ * amount of memory.
+ *
  * @skip sets the number of lines to skip at the start of the file. 
  * Default zero.
  *
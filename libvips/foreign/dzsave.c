@@ -85,6 +85,12 @@
  * 	- add @no_strip
  * 9/11/19
  * 	- add IIIF layout
+ * 19/10/19
+ * 	- our own zip writer deflates tiles in parallel and supports zip64
+ * 	- add @dirty_left, @dirty_top, @dirty_width, @dirty_height and 
+ * 	  @checkpoint to update or resume a pyramid in place
+ * 	- faster blank tile test
+ * 	- add @dedup
  */
 
 /*
@@ -165,6 +171,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif /*HAVE_UNISTD_H*/
 
 #include <vips/vips.h>
 #include <vips/internal.h>
@@ -173,6 +183,560 @@
 
 #include <gsf/gsf.h>
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#include <gsf/gsf-output-impl.h>
+#endif /*HAVE_ZLIB*/
+
+#ifdef HAVE_ZLIB
+
+/* A native zip writer.
+ *
+ * libgsf deflates and writes each zip member inside a single lock, so zip 
+ * output runs at the speed of one thread. Here, each member is built in 
+ * memory by the worker that makes it and deflated on that worker. It is then
+ * appended to the zip under a short lock. The central directory is built up 
+ * as members arrive and written at the end, with zip64 records if we need 
+ * them. 
+ */
+typedef struct _VipsZip {
+	/* The zip file we write.
+	 */
+	GsfOutput *sink;
+
+	/* 0 means store, -1 is the zlib default, 1 - 9 are deflate levels.
+	 */
+	int deflate_level;
+
+	/* Writes to sink, and all the fields below, are protected by this.
+	 */
+	GMutex *lock;
+
+	/* Bytes written to sink so far, and therefore the position of the 
+	 * next local header.
+	 */
+	guint64 offset;
+
+	/* The central directory, built up as we go.
+	 */
+	VipsDbuf central;
+	guint64 n_entries;
+
+	/* The directories we have written entries for.
+	 */
+	GHashTable *dirs;
+
+	/* Timestamp for all members, in MS-DOS format.
+	 */
+	guint16 dos_time;
+	guint16 dos_date;
+} VipsZip;
+
+#define VIPS_ZIP_LOCAL_SIG (0x04034b50)
+#define VIPS_ZIP_CENTRAL_SIG (0x02014b50)
+#define VIPS_ZIP_EOCD64_SIG (0x06064b50)
+#define VIPS_ZIP_EOCD64_LOCATOR_SIG (0x07064b50)
+#define VIPS_ZIP_EOCD_SIG (0x06054b50)
+
+/* Version needed to extract: 2.0 for deflate, 4.5 for zip64.
+ */
+#define VIPS_ZIP_VERSION (20)
+#define VIPS_ZIP_VERSION_ZIP64 (45)
+
+#define VIPS_ZIP_STORED (0)
+#define VIPS_ZIP_DEFLATED (8)
+
+/* Fields larger than this must go into the zip64 extra field.
+ */
+#define VIPS_ZIP_MAX32 (0xffffffffU)
+#define VIPS_ZIP_MAX16 (0xffffU)
+
+static unsigned char *
+vips_zip_put16( unsigned char *p, guint16 value )
+{
+	p[0] = value & 0xff;
+	p[1] = (value >> 8) & 0xff;
+
+	return( p + 2 );
+}
+
+static unsigned char *
+vips_zip_put32( unsigned char *p, guint32 value )
+{
+	p = vips_zip_put16( p, value & 0xffff );
+	p = vips_zip_put16( p, (value >> 16) & 0xffff );
+
+	return( p );
+}
+
+static unsigned char *
+vips_zip_put64( unsigned char *p, guint64 value )
+{
+	p = vips_zip_put32( p, value & 0xffffffff );
+	p = vips_zip_put32( p, (value >> 32) & 0xffffffff );
+
+	return( p );
+}
+
+static void
+vips_zip_free( VipsZip *zip )
+{
+	VIPS_UNREF( zip->sink );
+	VIPS_FREEF( vips_g_mutex_free, zip->lock );
+	vips_dbuf_destroy( &zip->central );
+	VIPS_FREEF( g_hash_table_destroy, zip->dirs );
+	VIPS_FREE( zip );
+}
+
+static VipsZip *
+vips_zip_new( GsfOutput *sink, int deflate_level )
+{
+	VipsZip *zip = g_new( VipsZip, 1 );
+
+	GDateTime *now;
+
+	zip->sink = sink;
+	g_object_ref( sink );
+	zip->deflate_level = deflate_level;
+	zip->lock = vips_g_mutex_new();
+	zip->offset = 0;
+	vips_dbuf_init( &zip->central );
+	zip->n_entries = 0;
+	zip->dirs = g_hash_table_new_full( g_str_hash, g_str_equal, 
+		g_free, NULL );
+
+	now = g_date_time_new_now_local();
+	zip->dos_time = 
+		(g_date_time_get_hour( now ) << 11) |
+		(g_date_time_get_minute( now ) << 5) |
+		(g_date_time_get_second( now ) / 2);
+	zip->dos_date = 
+		((VIPS_MAX( 1980, g_date_time_get_year( now ) ) - 1980) << 9) |
+		(g_date_time_get_month( now ) << 5) |
+		g_date_time_get_day_of_month( now );
+	g_date_time_unref( now );
+
+	return( zip );
+}
+
+static int
+vips_zip_write( VipsZip *zip, const void *data, size_t length )
+{
+	if( length > 0 &&
+		!gsf_output_write( zip->sink, length, data ) ) {
+		vips_error( "vips_zip", "%s", _( "unable to write to zip" ) ); 
+		return( -1 );
+	}
+
+	zip->offset += length;
+
+	return( 0 );
+}
+
+/* Append a member. The lock must be held.
+ */
+static int
+vips_zip_append( VipsZip *zip, const char *name, int method, guint32 crc,
+	const void *data, guint64 compressed_length, guint64 length )
+{
+	size_t name_length = strlen( name );
+	gboolean is_dir = name_length > 0 && name[name_length - 1] == '/';
+	guint64 offset = zip->offset;
+
+	/* Fixed parts of the local header and the central record, plus the
+	 * largest zip64 extra field we make.
+	 */
+	unsigned char local[30 + 20];
+	unsigned char central[46 + 28];
+	unsigned char *p;
+	unsigned char *q;
+	gboolean local_zip64;
+	int extra_length;
+
+	if( name_length > VIPS_ZIP_MAX16 ) {
+		vips_error( "vips_zip", "%s", _( "filename too long" ) ); 
+		return( -1 );
+	}
+
+	/* The sizes are known before we write the local header, so we only
+	 * need zip64 there for huge members.
+	 */
+	local_zip64 = length >= VIPS_ZIP_MAX32 || 
+		compressed_length >= VIPS_ZIP_MAX32;
+
+	p = local;
+	p = vips_zip_put32( p, VIPS_ZIP_LOCAL_SIG );
+	p = vips_zip_put16( p, local_zip64 ? 
+		VIPS_ZIP_VERSION_ZIP64 : VIPS_ZIP_VERSION );
+	p = vips_zip_put16( p, 0 );
+	p = vips_zip_put16( p, method );
+	p = vips_zip_put16( p, zip->dos_time );
+	p = vips_zip_put16( p, zip->dos_date );
+	p = vips_zip_put32( p, crc );
+	if( local_zip64 ) {
+		p = vips_zip_put32( p, VIPS_ZIP_MAX32 );
+		p = vips_zip_put32( p, VIPS_ZIP_MAX32 );
+	}
+	else {
+		p = vips_zip_put32( p, compressed_length );
+		p = vips_zip_put32( p, length );
+	}
+	p = vips_zip_put16( p, name_length );
+	p = vips_zip_put16( p, local_zip64 ? 20 : 0 );
+	if( local_zip64 ) {
+		p = vips_zip_put16( p, 0x0001 );
+		p = vips_zip_put16( p, 16 );
+		p = vips_zip_put64( p, length );
+		p = vips_zip_put64( p, compressed_length );
+	}
+
+	/* The central record needs zip64 for any field that's too large, in
+	 * this order.
+	 */
+	extra_length = 0;
+	if( length >= VIPS_ZIP_MAX32 )
+		extra_length += 8;
+	if( compressed_length >= VIPS_ZIP_MAX32 )
+		extra_length += 8;
+	if( offset >= VIPS_ZIP_MAX32 )
+		extra_length += 8;
+
+	q = central;
+	q = vips_zip_put32( q, VIPS_ZIP_CENTRAL_SIG );
+	q = vips_zip_put16( q, VIPS_ZIP_VERSION_ZIP64 );
+	q = vips_zip_put16( q, extra_length > 0 ? 
+		VIPS_ZIP_VERSION_ZIP64 : VIPS_ZIP_VERSION );
+	q = vips_zip_put16( q, 0 );
+	q = vips_zip_put16( q, method );
+	q = vips_zip_put16( q, zip->dos_time );
+	q = vips_zip_put16( q, zip->dos_date );
+	q = vips_zip_put32( q, crc );
+	q = vips_zip_put32( q, VIPS_MIN( compressed_length, VIPS_ZIP_MAX32 ) );
+	q = vips_zip_put32( q, VIPS_MIN( length, VIPS_ZIP_MAX32 ) );
+	q = vips_zip_put16( q, name_length );
+	q = vips_zip_put16( q, extra_length > 0 ? extra_length + 4 : 0 );
+	q = vips_zip_put16( q, 0 );
+	q = vips_zip_put16( q, 0 );
+	q = vips_zip_put16( q, 0 );
+	/* MS-DOS directory attribute.
+	 */
+	q = vips_zip_put32( q, is_dir ? 0x10 : 0 );
+	q = vips_zip_put32( q, VIPS_MIN( offset, VIPS_ZIP_MAX32 ) );
+
+	if( vips_zip_write( zip, local, 30 ) ||
+		vips_zip_write( zip, name, name_length ) ||
+		vips_zip_write( zip, local + 30, p - local - 30 ) ||
+		vips_zip_write( zip, data, compressed_length ) )
+		return( -1 );
+
+	vips_dbuf_write( &zip->central, central, 46 ); 
+	vips_dbuf_write( &zip->central, (unsigned char *) name, name_length ); 
+	if( extra_length > 0 ) { 
+		q = central + 46;
+		q = vips_zip_put16( q, 0x0001 );
+		q = vips_zip_put16( q, extra_length );
+		if( length >= VIPS_ZIP_MAX32 )
+			q = vips_zip_put64( q, length );
+		if( compressed_length >= VIPS_ZIP_MAX32 )
+			q = vips_zip_put64( q, compressed_length );
+		if( offset >= VIPS_ZIP_MAX32 )
+			q = vips_zip_put64( q, offset );
+		vips_dbuf_write( &zip->central, central + 46, q - central - 46 ); 
+	}
+
+	zip->n_entries += 1;
+
+	return( 0 );
+}
+
+/* Write entries for any directories in @name we've not seen before. The lock
+ * must be held.
+ */
+static int
+vips_zip_append_dirs( VipsZip *zip, const char *name )
+{
+	const char *p;
+
+	for( p = name; (p = strchr( p, '/' )); p++ ) {
+		char *dir = g_strndup( name, p - name + 1 );
+
+		if( g_hash_table_contains( zip->dirs, dir ) ) 
+			g_free( dir );
+		else {
+			g_hash_table_add( zip->dirs, dir );
+
+			if( vips_zip_append( zip, dir, VIPS_ZIP_STORED, 0, 
+				NULL, 0, 0 ) )
+				return( -1 );
+		}
+	}
+
+	return( 0 );
+}
+
+/* zlib takes uInt lengths, so we must crc in chunks.
+ */
+static guint32
+vips_zip_crc32( const unsigned char *data, size_t length )
+{
+	uLong crc;
+
+	crc = crc32( 0L, Z_NULL, 0 );
+	while( length > 0 ) {
+		uInt chunk = VIPS_MIN( length, 1 << 30 );
+
+		crc = crc32( crc, data, chunk );
+		data += chunk;
+		length -= chunk;
+	}
+
+	return( crc );
+}
+
+/* Deflate to a new buffer. Return NULL if deflate fails, or if it does not
+ * make the data smaller.
+ */
+static void *
+vips_zip_deflate( int level, const void *data, size_t length, 
+	size_t *compressed_length )
+{
+	z_stream stream;
+	uLong bound;
+	void *buf;
+
+	/* One deflate() call can only take uInt bytes.
+	 */
+	if( length == 0 ||
+		length > UINT_MAX )
+		return( NULL );
+
+	memset( &stream, 0, sizeof( stream ) );
+	if( deflateInit2( &stream, level, 
+		Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+		return( NULL );
+
+	bound = deflateBound( &stream, length );
+	if( !(buf = g_try_malloc( bound )) ) {
+		deflateEnd( &stream );
+		return( NULL );
+	}
+
+	stream.next_in = (Bytef *) data;
+	stream.avail_in = length;
+	stream.next_out = buf;
+	stream.avail_out = bound;
+	if( deflate( &stream, Z_FINISH ) != Z_STREAM_END ||
+		stream.total_out >= length ) {
+		deflateEnd( &stream );
+		g_free( buf );
+		return( NULL );
+	}
+
+	*compressed_length = stream.total_out;
+	deflateEnd( &stream );
+
+	return( buf );
+}
+
+/* Add a member to the zip. This can be called from many threads at once: the
+ * crc and the deflate run unlocked, only the append is single-threaded.
+ */
+static int
+vips_zip_add( VipsZip *zip, const char *name, const void *data, size_t length )
+{
+	guint32 crc;
+	void *compressed;
+	size_t compressed_length;
+	int result;
+
+	crc = vips_zip_crc32( data, length );
+
+	compressed = NULL;
+	if( zip->deflate_level != 0 )
+		compressed = vips_zip_deflate( zip->deflate_level, 
+			data, length, &compressed_length );
+
+	g_mutex_lock( zip->lock );
+	if( compressed )
+		result = vips_zip_append_dirs( zip, name ) ||
+			vips_zip_append( zip, name, VIPS_ZIP_DEFLATED, crc,
+				compressed, compressed_length, length );
+	else
+		result = vips_zip_append_dirs( zip, name ) ||
+			vips_zip_append( zip, name, VIPS_ZIP_STORED, crc,
+				data, length, length );
+	g_mutex_unlock( zip->lock );
+
+	g_free( compressed );
+
+	return( result ? -1 : 0 );
+}
+
+/* Write the central directory and the end records, and close the sink.
+ */
+static int
+vips_zip_close( VipsZip *zip )
+{
+	guint64 central_offset = zip->offset;
+
+	unsigned char end[56 + 20 + 22];
+	unsigned char *p;
+	unsigned char *central;
+	size_t central_length;
+
+	central = vips_dbuf_string( &zip->central, &central_length );
+	if( vips_zip_write( zip, central, central_length ) )
+		return( -1 );
+
+	p = end;
+	if( zip->n_entries >= VIPS_ZIP_MAX16 ||
+		central_length >= VIPS_ZIP_MAX32 ||
+		central_offset >= VIPS_ZIP_MAX32 ) {
+		guint64 end64_offset = zip->offset;
+
+		p = vips_zip_put32( p, VIPS_ZIP_EOCD64_SIG );
+		p = vips_zip_put64( p, 44 );
+		p = vips_zip_put16( p, VIPS_ZIP_VERSION_ZIP64 );
+		p = vips_zip_put16( p, VIPS_ZIP_VERSION_ZIP64 );
+		p = vips_zip_put32( p, 0 );
+		p = vips_zip_put32( p, 0 );
+		p = vips_zip_put64( p, zip->n_entries );
+		p = vips_zip_put64( p, zip->n_entries );
+		p = vips_zip_put64( p, central_length );
+		p = vips_zip_put64( p, central_offset );
+
+		p = vips_zip_put32( p, VIPS_ZIP_EOCD64_LOCATOR_SIG );
+		p = vips_zip_put32( p, 0 );
+		p = vips_zip_put64( p, end64_offset );
+		p = vips_zip_put32( p, 1 );
+	}
+
+	p = vips_zip_put32( p, VIPS_ZIP_EOCD_SIG );
+	p = vips_zip_put16( p, 0 );
+	p = vips_zip_put16( p, 0 );
+	p = vips_zip_put16( p, VIPS_MIN( zip->n_entries, VIPS_ZIP_MAX16 ) );
+	p = vips_zip_put16( p, VIPS_MIN( zip->n_entries, VIPS_ZIP_MAX16 ) );
+	p = vips_zip_put32( p, VIPS_MIN( central_length, VIPS_ZIP_MAX32 ) );
+	p = vips_zip_put32( p, VIPS_MIN( central_offset, VIPS_ZIP_MAX32 ) );
+	p = vips_zip_put16( p, 0 );
+
+	if( vips_zip_write( zip, end, p - end ) )
+		return( -1 );
+
+	if( !gsf_output_is_closed( zip->sink ) &&
+		!gsf_output_close( zip->sink ) ) {
+		vips_error( "vips_zip", "%s", _( "unable to close stream" ) ); 
+		return( -1 );
+	}
+
+	return( 0 );
+}
+
+/* A GsfOutput for one zip member. Writes are gathered in memory, and
+ * the member is compressed and added to the zip on close. 
+ */
+typedef struct _VipsZipEntry {
+	GsfOutput parent_object;
+
+	VipsZip *zip;
+	char *name;
+	VipsDbuf buf;
+} VipsZipEntry;
+
+typedef GsfOutputClass VipsZipEntryClass;
+
+G_DEFINE_TYPE( VipsZipEntry, vips_zip_entry, GSF_OUTPUT_TYPE );
+
+static void
+vips_zip_entry_finalize( GObject *gobject )
+{
+	VipsZipEntry *entry = (VipsZipEntry *) gobject;
+	GsfOutput *output = GSF_OUTPUT( gobject );
+
+	/* An entry that was never closed was abandoned, perhaps after an 
+	 * error. Don't add it to the zip.
+	 */
+	if( !gsf_output_is_closed( output ) ) {
+		entry->zip = NULL;
+		(void) gsf_output_close( output );
+	}
+
+	VIPS_FREE( entry->name );
+	vips_dbuf_destroy( &entry->buf );
+
+	G_OBJECT_CLASS( vips_zip_entry_parent_class )->finalize( gobject );
+}
+
+static gboolean
+vips_zip_entry_write( GsfOutput *output, 
+	size_t num_bytes, guint8 const *data )
+{
+	VipsZipEntry *entry = (VipsZipEntry *) output;
+
+	if( !vips_dbuf_write( &entry->buf, data, num_bytes ) )
+		return( gsf_output_set_error( output, 0, 
+			"%s", _( "out of memory" ) ) );
+
+	return( TRUE );
+}
+
+static gboolean
+vips_zip_entry_seek( GsfOutput *output, gsf_off_t offset, GSeekType whence )
+{
+	return( gsf_output_set_error( output, 0, 
+		"%s", _( "seek not supported" ) ) );
+}
+
+static gboolean
+vips_zip_entry_close( GsfOutput *output )
+{
+	VipsZipEntry *entry = (VipsZipEntry *) output;
+
+	if( entry->zip ) {
+		unsigned char *data;
+		size_t length;
+
+		data = vips_dbuf_string( &entry->buf, &length );
+		if( vips_zip_add( entry->zip, entry->name, data, length ) )
+			return( gsf_output_set_error( output, 0, 
+				"%s", _( "unable to write to zip" ) ) );
+	}
+
+	return( TRUE );
+}
+
+static void
+vips_zip_entry_class_init( VipsZipEntryClass *class )
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS( class );
+
+	gobject_class->finalize = vips_zip_entry_finalize;
+
+	class->Write = vips_zip_entry_write;
+	class->Seek = vips_zip_entry_seek;
+	class->Close = vips_zip_entry_close;
+}
+
+static void
+vips_zip_entry_init( VipsZipEntry *entry )
+{
+	vips_dbuf_init( &entry->buf );
+}
+
+static GsfOutput *
+vips_zip_entry_new( VipsZip *zip, const char *name )
+{
+	VipsZipEntry *entry = g_object_new( vips_zip_entry_get_type(), NULL );
+
+	entry->zip = zip;
+	entry->name = g_strdup( name );
+	(void) gsf_output_set_name( GSF_OUTPUT( entry ), name );
+
+	return( GSF_OUTPUT( entry ) );
+}
+
+#endif /*HAVE_ZLIB*/
+
 /* Simple wrapper around libgsf.
  *
  * We need to be able to do scattered writes to structured files. So while
@@ -214,22 +778,54 @@ typedef struct _VipsGsfDirectory {
 	 */
 	gint deflate_level;
 
+#ifdef HAVE_ZLIB
+	/* If set, the root node writes with our own zip writer, and the tree 
+	 * of GsfOutputs is not used. 
+	 */
+	VipsZip *zip;
+#endif /*HAVE_ZLIB*/
+
+	/* If set, the root node writes files straight into the directory 
+	 * tree at this path, and the tree of GsfOutputs is not used.
+	 */
+	char *root_dir;
+
 } VipsGsfDirectory; 
 
-/* Close all dirs, non-NULL on error.
+/* Close all dirs and free the tree. The tree is freed even if we fail.
+ *
+ * If @finish is FALSE, we are abandoning the write, perhaps after an error 
+ * or a cancel. Our zip writer is then freed without writing the central 
+ * directory, so we can't leave a valid-looking zip with missing tiles.
  */
-static void *
-vips_gsf_tree_close( VipsGsfDirectory *tree )
+static int
+vips_gsf_tree_finish( VipsGsfDirectory *tree, gboolean finish )
 {
-	vips_slist_map2( tree->children, 
-		(VipsSListMap2Fn) vips_gsf_tree_close, NULL, NULL );
+	int result;
+	GSList *p;
+
+	result = 0;
+	for( p = tree->children; p; p = p->next ) 
+		if( vips_gsf_tree_finish( (VipsGsfDirectory *) p->data, 
+			finish ) )
+			result = -1;
+
+#ifdef HAVE_ZLIB
+	if( tree->zip ) {
+		if( finish &&
+			vips_zip_close( tree->zip ) )
+			result = -1;
+
+		VIPS_FREEF( vips_zip_free, tree->zip );
+	}
+#endif /*HAVE_ZLIB*/
 
 	if( tree->out ) {
 		if( !gsf_output_is_closed( tree->out ) &&
 			!gsf_output_close( tree->out ) ) {
 			vips_error( "vips_gsf", 
 				"%s", _( "unable to close stream" ) ); 
-			return( tree );
+			result = -1;
 		}
 
 		VIPS_UNREF( tree->out );
@@ -240,7 +836,7 @@ vips_gsf_tree_close( VipsGsfDirectory *tree )
 			!gsf_output_close( tree->container ) ) {
 			vips_error( "vips_gsf", 
 				"%s", _( "unable to close stream" ) ); 
-			return( tree );
+			result = -1;
 		}
 
 		VIPS_UNREF( tree->container );
@@ -248,9 +844,41 @@ vips_gsf_tree_close( VipsGsfDirectory *tree )
 
 	VIPS_FREEF( g_slist_free, tree->children );
 	VIPS_FREE( tree->name );
+	VIPS_FREE( tree->root_dir );
 	VIPS_FREE( tree );
 
-	return( NULL ); 
+	return( result ); 
+}
+
+/* Finish the write, close all dirs and free the tree.
+ */
+static int
+vips_gsf_tree_close( VipsGsfDirectory *tree )
+{
+	return( vips_gsf_tree_finish( tree, TRUE ) );
+}
+
+/* Abandon the write and free the tree.
+ */
+static void
+vips_gsf_tree_free( VipsGsfDirectory *tree )
+{
+	(void) vips_gsf_tree_finish( tree, FALSE );
+}
+
+/* Append @sep and @component to @path, a VIPS_PATH_MAX buffer. Error if it 
+ * won't fit.
+ */
+static int
+vips_gsf_path_append( char *path, const char *sep, const char *component )
+{
+	if( g_strlcat( path, sep, VIPS_PATH_MAX ) >= VIPS_PATH_MAX ||
+		g_strlcat( path, component, VIPS_PATH_MAX ) >= VIPS_PATH_MAX ) {
+		vips_error( "vips_gsf", "%s", _( "path too long" ) ); 
+		return( -1 );
+	}
+
+	return( 0 );
 }
 
 /* Make a new tree root.
@@ -268,6 +896,10 @@ vips_gsf_tree_new( GsfOutput *out, gint deflate_level )
 	tree->file_count = 0;
 	tree->filename_lengths = 0;
 	tree->deflate_level = deflate_level;
+#ifdef HAVE_ZLIB
+	tree->zip = NULL;
+#endif /*HAVE_ZLIB*/
+	tree->root_dir = NULL;
 
 	return( tree ); 
 }
@@ -307,6 +939,10 @@ vips_gsf_dir_new( VipsGsfDirectory *parent, const char *name )
 	dir->file_count = 0;
 	dir->filename_lengths = 0;
 	dir->deflate_level = parent->deflate_level;
+#ifdef HAVE_ZLIB
+	dir->zip = NULL;
+#endif /*HAVE_ZLIB*/
+	dir->root_dir = NULL;
 
 	if( GSF_IS_OUTFILE_ZIP( parent->out ) )
 		dir->out = gsf_outfile_new_child_full( 
@@ -331,19 +967,86 @@ vips_gsf_dir_new( VipsGsfDirectory *parent, const char *name )
  *
  * GsfOutput *obj = vips_gsf_path( tree, "fred.jpg", "a", "b", NULL );
  *
- * Returns an obj you can use to write to a/b/fred.jpg. 
+ * Returns an obj you can use to write to a/b/fred.jpg, or NULL on error. 
+ *
+ * If @filename is non-NULL, it is set to the name of the file obj will
+ * write to, or "" if obj is not a plain file.
  *
  * You must write, close and unref obj.
  */
 static GsfOutput *
-vips_gsf_path( VipsGsfDirectory *tree, const char *name, ... )
+vips_gsf_path_valist( VipsGsfDirectory *tree, 
+	char *filename, const char *name, va_list ap )
 {
-	va_list ap;
 	VipsGsfDirectory *dir;
 	VipsGsfDirectory *child;
 	char *dir_name;
 	GsfOutput *obj;
 
+	if( filename )
+		strcpy( filename, "" );
+
+#ifdef HAVE_ZLIB
+	/* With our own zip writer, we just need the full path to the member.
+	 * Directory entries are made by the writer.
+	 */
+	if( tree->zip ) {
+		char path[VIPS_PATH_MAX];
+
+		path[0] = '\0';
+		if( vips_gsf_path_append( path, "", tree->name ) )
+			return( NULL );
+		while( (dir_name = va_arg( ap, char * )) ) 
+			if( vips_gsf_path_append( path, "/", dir_name ) )
+				return( NULL );
+		if( vips_gsf_path_append( path, "/", name ) )
+			return( NULL );
+
+		tree->file_count += 1;
+
+		return( vips_zip_entry_new( tree->zip, path ) );
+	}
+#endif /*HAVE_ZLIB*/
+
+	/* Writing straight to the filesystem, perhaps into an existing tree: 
+	 * make any missing directories and write the file directly. 
+	 * gsf_output_stdio writes to a temp file and 
+	 * renames on close, so old files are replaced atomically and a crash
+	 * can't leave a truncated tile behind.
+	 */
+	if( tree->root_dir ) {
+		char path[VIPS_PATH_MAX];
+		GError *error = NULL;
+
+		path[0] = '\0';
+		if( vips_gsf_path_append( path, "", tree->root_dir ) )
+			return( NULL );
+		while( (dir_name = va_arg( ap, char * )) ) 
+			if( vips_gsf_path_append( path, 
+				G_DIR_SEPARATOR_S, dir_name ) )
+				return( NULL );
+
+		if( g_mkdir_with_parents( path, 0777 ) ) {
+			vips_error( "vips_gsf", 
+				_( "unable to make directory \"%s\", %s" ), 
+				path, g_strerror( errno ) );
+			return( NULL );
+		}
+
+		if( vips_gsf_path_append( path, G_DIR_SEPARATOR_S, name ) )
+			return( NULL );
+		if( filename )
+			vips_strncpy( filename, path, VIPS_PATH_MAX );
+		if( !(obj = gsf_output_stdio_new( path, &error )) ) {
+			vips_g_error( &error );
+			return( NULL );
+		}
+
+		tree->file_count += 1;
+
+		return( obj );
+	}
+
 	/* vips_gsf_path() always makes a new file, though it may add to an
 	 * existing directory. Note the file, and note the length of the full
 	 * path we are creating.
@@ -352,7 +1055,6 @@ vips_gsf_path( VipsGsfDirectory *tree, const char *name, ... )
 	tree->filename_lengths += strlen( tree->out->name ) + strlen( name ) + 1;
 
 	dir = tree; 
-	va_start( ap, name );
 	while( (dir_name = va_arg( ap, char * )) ) {
 		if( (child = vips_gsf_child_by_name( dir, dir_name )) )
 			dir = child;
@@ -361,7 +1063,6 @@ vips_gsf_path( VipsGsfDirectory *tree, const char *name, ... )
 
 		tree->filename_lengths += strlen( dir_name ) + 1;
 	}
-	va_end( ap );
 
 	if( GSF_IS_OUTFILE_ZIP( dir->out ) ) {
 		/* Confusingly, libgsf compression-level really means
@@ -395,6 +1096,36 @@ vips_gsf_path( VipsGsfDirectory *tree, const char *name, ... )
 	return( obj ); 
 }
 
+static GsfOutput *
+vips_gsf_path( VipsGsfDirectory *tree, const char *name, ... )
+{
+	va_list ap;
+	GsfOutput *obj;
+
+	va_start( ap, name );
+	obj = vips_gsf_path_valist( tree, NULL, name, ap );
+	va_end( ap );
+
+	return( obj ); 
+}
+
+/* As vips_gsf_path(), but also get the filename, see above. @filename must 
+ * be VIPS_PATH_MAX bytes.
+ */
+static GsfOutput *
+vips_gsf_path_filename( VipsGsfDirectory *tree, 
+	char *filename, const char *name, ... )
+{
+	va_list ap;
+	GsfOutput *obj;
+
+	va_start( ap, name );
+	obj = vips_gsf_path_valist( tree, filename, name, ap );
+	va_end( ap );
+
+	return( obj ); 
+}
+
 typedef struct _VipsForeignSaveDz VipsForeignSaveDz;
 typedef struct _Layer Layer;
 
@@ -436,6 +1167,15 @@ struct _Layer {
 	VipsRegion *strip;		/* The current strip of pixels */
 	VipsRegion *copy;		/* Pixels we copy to the next strip */
 
+	/* Only tiles which touch this rect need writing. This is the whole
+	 * layer, unless we are updating part of an existing pyramid.
+	 */
+	VipsRect dirty;
+
+	/* An earlier, interrupted run wrote all strips above this line.
+	 */
+	int done_y;
+
 	int sub;			/* Subsample factor for this layer */
 	int n;				/* Layer number ... 0 for smallest */
 
@@ -459,6 +1199,12 @@ struct _VipsForeignSaveDz {
 	VipsRegionShrink region_shrink;
 	int skip_blanks;
 	gboolean no_strip;
+	int dirty_left;
+	int dirty_top;
+	int dirty_width;
+	int dirty_height;
+	gboolean checkpoint;
+	gboolean dedup;
 
 	/* Tile and overlap geometry. The members above are the parameters we
 	 * accept, this next set are the derived values which are actually 
@@ -539,6 +1285,24 @@ struct _VipsForeignSaveDz {
 	 */
 	VipsPel *ink;
 
+	/* Set if we are writing into an existing directory tree rather than 
+	 * making a new one, ie. for a dirty rect or a checkpoint.
+	 */
+	gboolean update;
+
+	/* Save the checkpoint here.
+	 */
+	char *checkpoint_name;
+
+	/* @ink repeated across a tile, for blank tile tests.
+	 */
+	VipsPel *ink_line;
+
+	/* For @dedup, map the hash of each tile's pixels to the file we
+	 * wrote it to.
+	 */
+	GHashTable *tiles;
+
 };
 
 typedef VipsForeignSaveClass VipsForeignSaveDzClass;
@@ -613,6 +1377,27 @@ write_image( VipsForeignSaveDz *dz,
 	}
 	VIPS_UNREF( t );
 
+#ifdef HAVE_ZLIB
+	/* Members of our own zip writer are private to this thread until 
+	 * close, and close does the deflate before a short locked append, so
+	 * there's no need for the global lock.
+	 */
+	if( dz->tree->zip ) {
+		if( !gsf_output_write( out, len, buf ) ||
+			!gsf_output_close( out ) ) {
+			g_free( buf );
+			vips_error( class->nickname,
+				"%s", gsf_output_error( out )->message );
+
+			return( -1 );
+		}
+
+		g_free( buf );
+
+		return( 0 );
+	}
+#endif /*HAVE_ZLIB*/
+
 	/* gsf doesn't like more than one write active at once.
 	 */
 	g_mutex_lock( vips__global_lock );
@@ -680,13 +1465,16 @@ vips_foreign_save_dz_dispose( GObject *gobject )
 	VipsForeignSaveDz *dz = (VipsForeignSaveDz *) gobject;
 
 	VIPS_FREEF( layer_free, dz->layer );
-	VIPS_FREEF( vips_gsf_tree_close,  dz->tree );
+	VIPS_FREEF( vips_gsf_tree_free, dz->tree );
 	VIPS_FREEF( g_object_unref, dz->out );
 	VIPS_FREE( dz->basename );
 	VIPS_FREE( dz->dirname );
 	VIPS_FREE( dz->tempdir );
 	VIPS_FREE( dz->root_name );
 	VIPS_FREE( dz->file_suffix );
+	VIPS_FREE( dz->checkpoint_name );
+	VIPS_FREE( dz->ink_line );
+	VIPS_FREEF( g_hash_table_destroy, dz->tiles );
 
 	G_OBJECT_CLASS( vips_foreign_save_dz_parent_class )->
 		dispose( gobject );
@@ -720,6 +1508,12 @@ pyramid_build( VipsForeignSaveDz *dz, Layer *above,
 
 	layer->real_pixels = *real_pixels; 
 
+	layer->dirty.left = 0;
+	layer->dirty.top = 0;
+	layer->dirty.width = width;
+	layer->dirty.height = height;
+	layer->done_y = 0;
+
 	layer->image = NULL;
 	layer->strip = NULL;
 	layer->copy = NULL;
@@ -842,6 +1636,121 @@ pyramid_build( VipsForeignSaveDz *dz, Layer *above,
 	return( layer );
 }
 
+/* Set the dirty area of a layer, and project it down the pyramid. Round
+ * outward, so we get every pixel the dirty area can affect.
+ */
+static void
+pyramid_dirty( Layer *layer, VipsRect *dirty )
+{
+	VipsRect image;
+
+	image.left = 0;
+	image.top = 0;
+	image.width = layer->width;
+	image.height = layer->height;
+	vips_rect_intersectrect( dirty, &image, &layer->dirty );
+
+	if( layer->below ) {
+		VipsRect halfrect;
+
+		if( vips_rect_isempty( &layer->dirty ) )
+			halfrect = layer->dirty;
+		else {
+			halfrect.left = layer->dirty.left / 2;
+			halfrect.top = layer->dirty.top / 2;
+			halfrect.width = 
+				(VIPS_RECT_RIGHT( &layer->dirty ) + 1) / 2 - 
+				halfrect.left;
+			halfrect.height = 
+				(VIPS_RECT_BOTTOM( &layer->dirty ) + 1) / 2 - 
+				halfrect.top;
+		}
+
+		pyramid_dirty( layer->below, &halfrect );
+	}
+}
+
+/* The checkpoint file records the geometry of the pyramid, then for each 
+ * layer, top first, the line above which all strips have been written.
+ */
+#define CHECKPOINT_MAGIC "vips-dzsave-checkpoint"
+
+static int
+checkpoint_write( VipsForeignSaveDz *dz )
+{
+	char text[1024];
+	VipsBuf buf = VIPS_BUF_STATIC( text );
+	Layer *layer;
+	GError *error = NULL;
+
+	vips_buf_appendf( &buf, "%s %d %d %d %d %d %d\n", 
+		CHECKPOINT_MAGIC,
+		dz->layer->width, dz->layer->height, 
+		dz->tile_size, dz->overlap, dz->layout, dz->layer->n + 1 );
+	for( layer = dz->layer; layer; layer = layer->below )
+		vips_buf_appendf( &buf, "%d\n", layer->y );
+
+	/* This writes to a temp file and renames, so the checkpoint is 
+	 * always complete.
+	 */
+	if( !g_file_set_contents( dz->checkpoint_name, 
+		vips_buf_all( &buf ), -1, &error ) ) {
+		vips_g_error( &error );
+		return( -1 );
+	}
+
+	return( 0 );
+}
+
+/* Load any checkpoint left by an earlier run and mark the strips it wrote 
+ * as done.
+ */
+static void
+checkpoint_read( VipsForeignSaveDz *dz )
+{
+	char *contents;
+	char *p;
+	int geometry[6];
+	int i;
+	Layer *layer;
+
+	if( !g_file_get_contents( dz->checkpoint_name, &contents, NULL, NULL ) )
+		return;
+
+	p = contents;
+	if( !vips_isprefix( CHECKPOINT_MAGIC, p ) ) {
+		g_free( contents );
+		g_warning( _( "%s is not a dzsave checkpoint, ignoring" ), 
+			dz->checkpoint_name );
+		return;
+	}
+	p += strlen( CHECKPOINT_MAGIC );
+	for( i = 0; i < 6; i++ ) 
+		geometry[i] = strtol( p, &p, 10 );
+
+	if( geometry[0] != dz->layer->width ||
+		geometry[1] != dz->layer->height ||
+		geometry[2] != dz->tile_size ||
+		geometry[3] != dz->overlap ||
+		geometry[4] != dz->layout ||
+		geometry[5] != dz->layer->n + 1 ) {
+		g_free( contents );
+		g_warning( _( "%s does not match this pyramid, ignoring" ), 
+			dz->checkpoint_name );
+		return;
+	}
+
+	for( layer = dz->layer; layer; layer = layer->below )
+		layer->done_y = strtol( p, &p, 10 );
+
+	g_free( contents );
+
+#ifdef DEBUG
+	printf( "checkpoint_read: resuming from line %d\n", 
+		dz->layer->done_y );
+#endif /*DEBUG*/
+}
+
 static int
 write_dzi( VipsForeignSaveDz *dz )
 {
@@ -850,7 +1759,8 @@ write_dzi( VipsForeignSaveDz *dz )
 	char *p;
 
 	vips_snprintf( buf, VIPS_PATH_MAX, "%s.dzi", dz->basename );
-	out = vips_gsf_path( dz->tree, buf, NULL ); 
+	if( !(out = vips_gsf_path( dz->tree, buf, NULL )) )
+		return( -1 );
 
 	vips_snprintf( buf, VIPS_PATH_MAX, "%s", dz->suffix + 1 );
 	if( (p = (char *) vips__find_rightmost_brackets( buf )) )
@@ -880,15 +1790,30 @@ static int
 write_properties( VipsForeignSaveDz *dz )
 {
 	GsfOutput *out;
+	int tile_count;
 
-	out = vips_gsf_path( dz->tree, "ImageProperties.xml", NULL ); 
+	/* An update only writes some tiles, but it writes blanks too, so the
+	 * pyramid has every tile.
+	 */
+	if( dz->update ) {
+		Layer *p;
+
+		tile_count = 0;
+		for( p = dz->layer; p; p = p->below )
+			tile_count += p->tiles_across * p->tiles_down;
+	}
+	else
+		tile_count = dz->tile_count;
+
+	if( !(out = vips_gsf_path( dz->tree, "ImageProperties.xml", NULL )) )
+		return( -1 );
 
 	gsf_output_printf( out, "<IMAGE_PROPERTIES "
 		"WIDTH=\"%d\" HEIGHT=\"%d\" NUMTILES=\"%d\" "
 		"NUMIMAGES=\"1\" VERSION=\"1.8\" TILESIZE=\"%d\" />\n",
 		dz->layer->width,
 		dz->layer->height,
-		dz->tile_count,
+		tile_count,
 		dz->tile_size );
 
 	(void) gsf_output_close( out );
@@ -934,7 +1859,10 @@ write_blank( VipsForeignSaveDz *dz )
 	g_object_unref( x );
 	x = t;
 
-	out = vips_gsf_path( dz->tree, "blank.png", NULL ); 
+	if( !(out = vips_gsf_path( dz->tree, "blank.png", NULL )) ) {
+		g_object_unref( x );
+		return( -1 );
+	}
 
 	if( write_image( dz, out, x, ".png" ) ) {
 		g_object_unref( out );
@@ -967,7 +1895,8 @@ write_json( VipsForeignSaveDz *dz )
 	GsfOutput *out;
 	int i;
 
-	out = vips_gsf_path( dz->tree, "info.json", NULL ); 
+	if( !(out = vips_gsf_path( dz->tree, "info.json", NULL )) )
+		return( -1 );
 
 	gsf_output_printf( out, 
 		"{\n"
@@ -1066,6 +1995,10 @@ write_vips_meta( VipsForeignSaveDz *dz )
 			"vips-properties.xml", dz->root_name, NULL );
 	else
 		out = vips_gsf_path( dz->tree, "vips-properties.xml", NULL );
+	if( !out ) {
+		g_free( dump );
+		return( -1 );
+	}
 
 	gsf_output_write( out, strlen( dump ), (guchar *) dump ); 
 	(void) gsf_output_close( out );
@@ -1351,10 +2284,11 @@ strip_allocate( VipsThreadState *state, void *a, gboolean *stop )
 	return( 0 );
 }
 
-/* Make an output object for a tile in the current layout.
+/* Make an output object for a tile in the current layout. @filename is set
+ * as for vips_gsf_path_filename().
  */
 static GsfOutput *
-tile_name( Layer *layer, int x, int y )
+tile_name( Layer *layer, int x, int y, char *filename )
 {
 	VipsForeignSaveDz *dz = layer->dz;
 
@@ -1371,8 +2305,8 @@ tile_name( Layer *layer, int x, int y )
 		vips_snprintf( name, VIPS_PATH_MAX, 
 			"%d_%d%s", x, y, dz->file_suffix );
 
-		out = vips_gsf_path( dz->tree, name, 
-			dz->root_name, dirname, NULL );
+		out = vips_gsf_path_filename( dz->tree, filename,
+			name, dz->root_name, dirname, NULL );
 
 		break;
 
@@ -1401,7 +2335,8 @@ tile_name( Layer *layer, int x, int y )
 		 */
 		dz->tile_count += 1;
 
-		out = vips_gsf_path( dz->tree, name, dirname, NULL );
+		out = vips_gsf_path_filename( dz->tree, filename,
+			name, dirname, NULL );
 
 		break;
 
@@ -1411,7 +2346,8 @@ tile_name( Layer *layer, int x, int y )
 		vips_snprintf( name, VIPS_PATH_MAX, 
 			"%d%s", x, dz->file_suffix );
 
-		out = vips_gsf_path( dz->tree, name, dirname, dirname2, NULL );
+		out = vips_gsf_path_filename( dz->tree, filename,
+			name, dirname, dirname2, NULL );
 
 		break;
 
@@ -1443,7 +2379,7 @@ tile_name( Layer *layer, int x, int y )
 
 		/* "0" is rotation and is always 0.
 		 */
-		out = vips_gsf_path( dz->tree, 
+		out = vips_gsf_path_filename( dz->tree, filename,
 			name, dirname, dirname2, "0", NULL );
 }
 
@@ -1469,15 +2405,19 @@ tile_name( Layer *layer, int x, int y )
  *
  * Don't use exactly equality since compression artefacts or noise can upset
  * this.
+ *
+ * @ink_line is the background pixel repeated across at least a tile width.
+ * We test a whole line at a time with no early exit, so the inner loop is a
+ * simple max of absolute differences the compiler can vectorise.
  */
 static gboolean
-tile_equal( VipsImage *image, int threshold, VipsPel * restrict ink )
+tile_equal( VipsImage *image, int threshold, VipsPel * restrict ink_line )
 {
-	const int bytes = VIPS_IMAGE_SIZEOF_PEL( image );
+	const int n = VIPS_IMAGE_SIZEOF_LINE( image );
 
 	VipsRect rect;
 	VipsRegion *region;
-	int x, y, b;
+	int x, y;
 
 	region = vips_region_new( image ); 
 
@@ -1495,20 +2435,112 @@ tile_equal( VipsImage *image, int threshold, VipsPel * restrict ink )
 	for( y = 0; y < image->Ysize; y++ ) {
 		VipsPel * restrict p = VIPS_REGION_ADDR( region, 0, y ); 
 
-		for( x = 0; x < image->Xsize; x++ ) {
-			for( b = 0; b < bytes; b++ ) 
-				if( VIPS_ABS( p[b] - ink[b] ) > threshold ) {
-					g_object_unref( region );
-					return( FALSE ); 
-				}
+		if( threshold == 0 ) {
+			if( memcmp( p, ink_line, n ) != 0 ) 
+				break;
+		}
+		else {
+			int max;
+
+			max = 0;
+			for( x = 0; x < n; x++ ) {
+				int d = VIPS_ABS( p[x] - ink_line[x] );
 
-			p += bytes;
+				max = VIPS_MAX( max, d );
+			}
+
+			if( max > threshold ) 
+				break;
 		}
 	}
 
 	g_object_unref( region );
 
-	return( TRUE );
+	return( y == image->Ysize );
+}
+
+/* Hash the pixels in a tile. Returns a string you must free, or NULL on
+ * error.
+ */
+static char *
+tile_digest( VipsImage *image )
+{
+	const int n = VIPS_IMAGE_SIZEOF_LINE( image );
+
+	VipsRect rect;
+	VipsRegion *region;
+	GChecksum *checksum;
+	int header[3];
+	int y;
+	char *digest;
+
+	region = vips_region_new( image ); 
+	rect.left = 0;
+	rect.top = 0;
+	rect.width = image->Xsize;
+	rect.height = image->Ysize;
+	if( vips_region_prepare( region, &rect ) ) {
+		g_object_unref( region );
+		return( NULL ); 
+	}
+
+	checksum = g_checksum_new( G_CHECKSUM_SHA1 );
+
+	/* Edge tiles can be smaller, so the size must be part of the hash.
+	 */
+	header[0] = image->Xsize;
+	header[1] = image->Ysize;
+	header[2] = VIPS_IMAGE_SIZEOF_PEL( image );
+	g_checksum_update( checksum, (guchar *) header, sizeof( header ) );
+
+	for( y = 0; y < image->Ysize; y++ ) 
+		g_checksum_update( checksum, 
+			VIPS_REGION_ADDR( region, 0, y ), n );
+
+	digest = g_strdup( g_checksum_get_string( checksum ) );
+
+	g_checksum_free( checksum );
+	g_object_unref( region );
+
+	return( digest );
+}
+
+/* What tile_link() managed to do.
+ */
+typedef enum {
+	TILE_LINK_OK,		/* Linked, nothing more to do */
+	TILE_LINK_WRITE,	/* Not linked, write the tile to @out */
+	TILE_LINK_REOPEN	/* Not linked and @out is closed */
+} TileLink;
+
+/* Make @filename a hard link to @first, an identical tile we wrote earlier.
+ * @out is the output we would have written to: close it empty, then replace
+ * it with the link in one step.
+ *
+ * If we can't make the link (another filesystem, no link support, @first
+ * not closed yet, etc.) the caller must write the tile. If we fail after 
+ * closing @out, the caller must open the tile again before writing.
+ */
+static TileLink
+tile_link( GsfOutput *out, const char *first, const char *filename )
+{
+#ifndef G_OS_WIN32
+	char link_name[VIPS_PATH_MAX];
+
+	vips_snprintf( link_name, VIPS_PATH_MAX, "%s.link", filename );
+	if( link( first, link_name ) )
+		return( TILE_LINK_WRITE );
+
+	if( !gsf_output_close( out ) ||
+		g_rename( link_name, filename ) ) {
+		g_unlink( link_name );
+		return( TILE_LINK_REOPEN );
+	}
+
+	return( TILE_LINK_OK );
+#else /*G_OS_WIN32*/
+	return( TILE_LINK_WRITE );
+#endif /*!G_OS_WIN32*/
 }
 
 static int
@@ -1522,6 +2554,9 @@ strip_work( VipsThreadState *state, void *a )
 	VipsImage *x;
 	VipsImage *t;
 	GsfOutput *out; 
+	char filename[VIPS_PATH_MAX];
+	char *digest;
+	char *first;
 
 #ifdef DEBUG_VERBOSE
 	printf( "strip_work\n" );
@@ -1548,6 +2583,11 @@ strip_work( VipsThreadState *state, void *a )
 		}
 	}
 
+	/* Updating, and this tile can't have changed.
+	 */
+	if( !vips_rect_overlapsrect( &state->pos, &layer->dirty ) ) 
+		return( 0 ); 
+
 	g_assert( vips_object_sanity( VIPS_OBJECT( strip->image ) ) );
 
 	/* Extract relative to the strip top-left corner.
@@ -1557,8 +2597,12 @@ strip_work( VipsThreadState *state, void *a )
 		state->pos.width, state->pos.height, NULL ) ) 
 		return( -1 );
 
+	/* When updating, we must write blank tiles too, or we'd leave any old
+	 * tile there in place.
+	 */
 	if( dz->skip_blanks >= 0 &&
-		tile_equal( x, dz->skip_blanks, dz->ink ) ) { 
+		!dz->update &&
+		tile_equal( x, dz->skip_blanks, dz->ink_line ) ) { 
 		g_object_unref( x );
 
 #ifdef DEBUG_VERBOSE
@@ -1584,16 +2628,72 @@ strip_work( VipsThreadState *state, void *a )
 		x = t;
 	}
 
+	/* Hash the pixels so we can spot repeated tiles.
+	 */
+	digest = NULL;
+	if( dz->tiles &&
+		!(digest = tile_digest( x )) ) {
+		g_object_unref( x );
+		return( -1 );
+	}
+
 	/* we need to single-thread around calls to gsf.
 	 */
 	g_mutex_lock( vips__global_lock );
 
 	out = tile_name( layer, 
-		state->x / dz->tile_step, state->y / dz->tile_step );
+		state->x / dz->tile_step, state->y / dz->tile_step, filename );
+
+	first = NULL;
+	if( out &&
+		digest )
+		first = g_strdup( g_hash_table_lookup( dz->tiles, digest ) );
 
 	g_mutex_unlock( vips__global_lock );
 
+	if( !out ) {
+		g_free( digest );
+		g_object_unref( x );
+		return( -1 );
+	}
+
+	/* We've written these pixels before: link to that file rather than
+	 * encoding them again. 
+	 */
+	if( first ) {
+		TileLink link = tile_link( out, first, filename );
+
+		g_free( first );
+
+		if( link == TILE_LINK_OK ) {
+			g_free( digest );
+			g_object_unref( out );
+			g_object_unref( x );
+
+			return( 0 );
+		}
+		else if( link == TILE_LINK_REOPEN ) {
+			/* @out has been closed, so we need a fresh output to
+			 * write to.
+			 */
+			g_object_unref( out );
+
+			g_mutex_lock( vips__global_lock );
+			out = tile_name( layer, 
+				state->x / dz->tile_step, 
+				state->y / dz->tile_step, filename );
+			g_mutex_unlock( vips__global_lock );
+
+			if( !out ) {
+				g_free( digest );
+				g_object_unref( x );
+				return( -1 );
+			}
+		}
+	}
+
 	if( write_image( dz, out, x, dz->suffix ) ) {
+		g_free( digest );
 		g_object_unref( x );
 
 		return( -1 );
@@ -1601,6 +2701,19 @@ strip_work( VipsThreadState *state, void *a )
 
 	g_object_unref( out );
 
+	/* Only note the file once it's complete, so we can't link to a 
+	 * partial tile.
+	 */
+	if( digest ) {
+		g_mutex_lock( vips__global_lock );
+		if( !g_hash_table_lookup( dz->tiles, digest ) ) 
+			g_hash_table_insert( dz->tiles, 
+				digest, g_strdup( filename ) );
+		else
+			g_free( digest );
+		g_mutex_unlock( vips__global_lock );
+	}
+
 #ifdef DEBUG_VERBOSE
 	printf( "strip_work: success\n" );
 #endif /*DEBUG_VERBOSE*/
@@ -1613,12 +2726,26 @@ strip_work( VipsThreadState *state, void *a )
 static int
 strip_save( Layer *layer )
 {
+	VipsForeignSaveDz *dz = layer->dz;
+
 	Strip strip;
+	VipsRect line;
 
 #ifdef DEBUG
 	printf( "strip_save: n = %d, y = %d\n", layer->n, layer->y );
 #endif /*DEBUG*/
 
+	/* Skip strips an earlier run wrote, or which miss the dirty area.
+	 */
+	line.left = 0;
+	line.top = layer->y;
+	line.width = layer->width;
+	line.height = dz->tile_size;
+	vips_rect_marginadjust( &line, dz->tile_margin );
+	if( layer->y < layer->done_y ||
+		!vips_rect_overlapsrect( &line, &layer->dirty ) )
+		return( 0 );
+
 	strip_init( &strip, layer );
 	if( vips_threadpool_run( strip.image, 
 		vips_thread_state_new, strip_allocate, strip_work, NULL, 
@@ -1926,6 +3053,13 @@ pyramid_strip( VipsRegion *region, VipsRect *area, void *a )
 			layer->write_y == layer->height ) {
 			if( strip_arrived( layer ) ) 
 				return( -1 );
+
+			/* Every layer has now written all the tiles it can
+			 * from these pixels.
+			 */
+			if( dz->checkpoint &&
+				checkpoint_write( dz ) )
+				return( -1 );
 		}
 	}
 
@@ -1949,6 +3083,39 @@ pyramid_strip( VipsRegion *region, VipsRect *area, void *a )
 	return( 0 );
 }
 
+/* Move a rect on a width x height image to the same pixels after rotating 
+ * by @angle.
+ */
+static void
+rect_rotate( VipsRect *rect, VipsAngle angle, int width, int height )
+{
+	VipsRect in = *rect;
+
+	switch( angle ) {
+	case VIPS_ANGLE_D90:
+		rect->left = height - VIPS_RECT_BOTTOM( &in );
+		rect->top = in.left;
+		rect->width = in.height;
+		rect->height = in.width;
+		break;
+
+	case VIPS_ANGLE_D180:
+		rect->left = width - VIPS_RECT_RIGHT( &in );
+		rect->top = height - VIPS_RECT_BOTTOM( &in );
+		break;
+
+	case VIPS_ANGLE_D270:
+		rect->left = in.top;
+		rect->top = width - VIPS_RECT_RIGHT( &in );
+		rect->width = in.height;
+		rect->height = in.width;
+		break;
+
+	default:
+		break;
+	}
+}
+
 static int
 vips_foreign_save_dz_build( VipsObject *object )
 {
@@ -1956,6 +3123,8 @@ vips_foreign_save_dz_build( VipsObject *object )
 	VipsForeignSaveDz *dz = (VipsForeignSaveDz *) object;
 	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS( dz ); 
 	VipsRect real_pixels; 
+	VipsRect dirty;
+	VipsGsfDirectory *tree;
 
 	/* Google, zoomify and iiif default to zero overlap, ".jpg".
 	 */
@@ -2035,11 +3204,33 @@ vips_foreign_save_dz_build( VipsObject *object )
 		build( object ) )
 		return( -1 );
 
-	/* Optional rotate.
+	/* A dirty rect or a checkpoint means we update an existing tree in
+	 * place.
+	 */
+	dz->update = dz->checkpoint ||
+		vips_object_argument_isset( object, "dirty_width" ) ||
+		vips_object_argument_isset( object, "dirty_height" );
+	if( dz->update &&
+		(dz->container != VIPS_FOREIGN_DZ_CONTAINER_FS ||
+		 !dz->dirname) ) {
+		vips_error( class->nickname, "%s", 
+			_( "update needs filesystem output" ) );
+		return( -1 );
+	}
+
+	/* Optional rotate. The dirty rect is on the input image, so that
+	 * needs to rotate too.
 	 */
 {
 	VipsImage *z;
 
+	dirty.left = dz->dirty_left;
+	dirty.top = dz->dirty_top;
+	dirty.width = dz->dirty_width;
+	dirty.height = dz->dirty_height;
+	rect_rotate( &dirty, dz->angle, 
+		save->ready->Xsize, save->ready->Ysize );
+
 	if( vips_rot( save->ready, &z, dz->angle, NULL ) )
 		return( -1 );
 
@@ -2050,13 +3241,34 @@ vips_foreign_save_dz_build( VipsObject *object )
 	/* We use ink to check for blank tiles.
 	 */
 	if( dz->skip_blanks >= 0 ) {
+		int ps;
+		int width;
+		int i;
+
 		if( !(dz->ink = vips__vector_to_ink( 
 			class->nickname, save->ready,
 			VIPS_AREA( save->background )->data, NULL, 
 			VIPS_AREA( save->background )->n )) )
 			return( -1 );
+
+		/* Repeat ink across the widest possible tile, so we can 
+		 * test whole lines at once.
+		 */
+		ps = VIPS_IMAGE_SIZEOF_PEL( save->ready );
+		width = dz->tile_size + 2 * dz->tile_margin;
+		if( !(dz->ink_line = VIPS_ARRAY( NULL, width * ps, VipsPel )) )
+			return( -1 );
+		for( i = 0; i < width; i++ )
+			memcpy( dz->ink_line + i * ps, dz->ink, ps );
 	}
 
+	/* To dedup, we need tiles as plain files we can link to.
+	 */
+	if( dz->dedup &&
+		dz->container == VIPS_FOREIGN_DZ_CONTAINER_FS )
+		dz->tiles = g_hash_table_new_full( g_str_hash, g_str_equal,
+			(GDestroyNotify) g_free, (GDestroyNotify) g_free );
+
 	/* The real pixels we have from our input. This is about to get
 	 * expanded with background. 
 	 */
@@ -2123,6 +3335,15 @@ vips_foreign_save_dz_build( VipsObject *object )
 		save->ready->Xsize, save->ready->Ysize, &real_pixels )) )
 		return( -1 );
 
+	/* Limit the tiles we write to those the dirty rect touches. 
+	 */
+	if( vips_object_argument_isset( object, "dirty_width" ) ||
+		vips_object_argument_isset( object, "dirty_height" ) ) {
+		dirty.left += real_pixels.left;
+		dirty.top += real_pixels.top;
+		pyramid_dirty( dz->layer, &dirty );
+	}
+
 	if( dz->layout == VIPS_FOREIGN_DZ_LAYOUT_DZ )
 		dz->root_name = g_strdup_printf( "%s_files", dz->basename );
 	else
@@ -2144,6 +3365,7 @@ vips_foreign_save_dz_build( VipsObject *object )
 	if( dz->layout == VIPS_FOREIGN_DZ_LAYOUT_DZ &&
 		dz->container == VIPS_FOREIGN_DZ_CONTAINER_FS &&
 		dz->dirname &&
+		!dz->update &&
 		vips_existsf( "%s/%s_files", dz->dirname, dz->basename ) ) {
 		vips_error( "dzsave", 
 			_( "output directory %s/%s_files exists" ),
@@ -2155,7 +3377,19 @@ vips_foreign_save_dz_build( VipsObject *object )
 	 */
 	switch( dz->container ) {
 	case VIPS_FOREIGN_DZ_CONTAINER_FS:
-		if( dz->layout == VIPS_FOREIGN_DZ_LAYOUT_DZ ) {
+		if( dz->update ) {
+			/* Write straight into the existing tree. Deepzoom
+			 * puts ${basename}.dzi and ${basename}_files in 
+			 * dirname, the others make a directory.
+			 */
+			dz->tree = vips_gsf_tree_new( NULL, 0 );
+			if( dz->layout == VIPS_FOREIGN_DZ_LAYOUT_DZ ) 
+				dz->tree->root_dir = g_strdup( dz->dirname );
+			else
+				dz->tree->root_dir = g_build_filename( 
+					dz->dirname, dz->basename, NULL );
+		}
+		else if( dz->layout == VIPS_FOREIGN_DZ_LAYOUT_DZ ) {
 			/* For deepzoom, we have to rearrange the output
 			 * directory after writing it, see the end of this
 			 * function. We write to a temporary directory, then
@@ -2181,6 +3415,14 @@ vips_foreign_save_dz_build( VipsObject *object )
 			close( fd );
 			g_unlink( dz->tempdir );
 
+			/* To dedup, we write plain files we can link to.
+			 */
+			if( dz->tiles ) {
+				dz->tree = vips_gsf_tree_new( NULL, 0 );
+				dz->tree->root_dir = g_strdup( dz->tempdir );
+				break;
+			}
+
 			if( !(out = (GsfOutput *) 
 				gsf_outfile_stdio_new( dz->tempdir, 
 					&error )) ) {
@@ -2197,6 +3439,13 @@ vips_foreign_save_dz_build( VipsObject *object )
 
 			vips_snprintf( name, VIPS_PATH_MAX, "%s/%s", 
 				dz->dirname, dz->basename ); 
+
+			if( dz->tiles ) {
+				dz->tree = vips_gsf_tree_new( NULL, 0 );
+				dz->tree->root_dir = g_strdup( name );
+				break;
+			}
+
 			if( !(out = (GsfOutput *) 
 				gsf_outfile_stdio_new( name, &error )) ) {
 				vips_g_error( &error );
@@ -2210,8 +3459,10 @@ vips_foreign_save_dz_build( VipsObject *object )
 	case VIPS_FOREIGN_DZ_CONTAINER_ZIP:
 	case VIPS_FOREIGN_DZ_CONTAINER_SZI:
 {
+#ifndef HAVE_ZLIB
 		GsfOutput *zip;
 		GsfOutput *out2;
+#endif /*!HAVE_ZLIB*/
 		GError *error = NULL;
 		char name[VIPS_PATH_MAX];
 
@@ -2233,6 +3484,14 @@ vips_foreign_save_dz_build( VipsObject *object )
 		else
 			dz->out = gsf_output_memory_new();
 
+#ifdef HAVE_ZLIB
+		/* Our own zip writer can deflate tiles in parallel and
+		 * always supports zip64.
+		 */
+		dz->tree = vips_gsf_tree_new( NULL, dz->compression );
+		dz->tree->name = g_strdup( dz->basename );
+		dz->tree->zip = vips_zip_new( dz->out, dz->compression );
+#else /*!HAVE_ZLIB*/
 		if( !(zip = (GsfOutput *) 
 			gsf_outfile_zip_new( dz->out, &error )) ) {
 			vips_g_error( &error );
@@ -2261,6 +3520,7 @@ vips_foreign_save_dz_build( VipsObject *object )
 		/* Note the thing that will need closing up on exit.
 		 */
 		dz->tree->container = zip; 
+#endif /*HAVE_ZLIB*/
 }
 		break;
 
@@ -2268,6 +3528,14 @@ vips_foreign_save_dz_build( VipsObject *object )
 		g_assert_not_reached();
 	}
 
+	/* Pick up where any earlier run left off.
+	 */
+	if( dz->checkpoint ) {
+		dz->checkpoint_name = g_strdup_printf( "%s/%s.checkpoint",
+			dz->dirname, dz->basename );
+		checkpoint_read( dz );
+	}
+
 	if( vips_sink_disc( save->ready, pyramid_strip, dz ) )
 		return( -1 );
 
@@ -2317,7 +3585,8 @@ vips_foreign_save_dz_build( VipsObject *object )
 	 * FIXME have a flag to stop this stupidity
 	 */
 	if( dz->layout == VIPS_FOREIGN_DZ_LAYOUT_DZ &&
-		dz->container == VIPS_FOREIGN_DZ_CONTAINER_FS ) { 
+		dz->container == VIPS_FOREIGN_DZ_CONTAINER_FS &&
+		!dz->update ) { 
 		char old_name[VIPS_PATH_MAX];
 		char new_name[VIPS_PATH_MAX];
 
@@ -2339,11 +3608,18 @@ vips_foreign_save_dz_build( VipsObject *object )
 			return( -1 ); 
 	}
 
-	/* Shut down the output to flush everything.
+	/* Shut down the output to flush everything. This frees the tree, 
+	 * even on error.
 	 */
-	if( vips_gsf_tree_close( dz->tree ) )
-		return( -1 ); 
+	tree = dz->tree;
 	dz->tree = NULL; 
+	if( vips_gsf_tree_close( tree ) )
+		return( -1 ); 
+
+	/* Everything is written, so the checkpoint is no longer needed.
+	 */
+	if( dz->checkpoint )
+		g_unlink( dz->checkpoint_name );
 
 	/* If we are writing a zip to the filesystem, we must unref out to
 	 * force it to disc.
@@ -2495,6 +3771,48 @@ vips_foreign_save_dz_class_init( VipsForeignSaveDzClass *class )
 		G_STRUCT_OFFSET( VipsForeignSaveDz, no_strip ),
 		FALSE );
 
+	VIPS_ARG_INT( class, "dirty_left", 21, 
+		_( "Dirty left" ), 
+		_( "Left edge of area to update" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsForeignSaveDz, dirty_left ),
+		0, VIPS_MAX_COORD, 0 );
+
+	VIPS_ARG_INT( class, "dirty_top", 22, 
+		_( "Dirty top" ), 
+		_( "Top edge of area to update" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsForeignSaveDz, dirty_top ),
+		0, VIPS_MAX_COORD, 0 );
+
+	VIPS_ARG_INT( class, "dirty_width", 23, 
+		_( "Dirty width" ), 
+		_( "Width of area to update" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsForeignSaveDz, dirty_width ),
+		0, VIPS_MAX_COORD, 0 );
+
+	VIPS_ARG_INT( class, "dirty_height", 24, 
+		_( "Dirty height" ), 
+		_( "Height of area to update" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsForeignSaveDz, dirty_height ),
+		0, VIPS_MAX_COORD, 0 );
+
+	VIPS_ARG_BOOL( class, "checkpoint", 25, 
+		_( "Checkpoint" ), 
+		_( "Record progress, and resume an interrupted save" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsForeignSaveDz, checkpoint ),
+		FALSE );
+
+	VIPS_ARG_BOOL( class, "dedup", 26, 
+		_( "Dedup" ), 
+		_( "Write repeated tiles as links to the first copy" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsForeignSaveDz, dedup ),
+		FALSE );
+
 	/* How annoying. We stupidly had these in earlier versions.
 	 */
 
@@ -2737,6 +4055,12 @@ vips_foreign_save_dz_buffer_init( VipsForeignSaveDzBuffer *buffer )
  * * @region_shrink: #VipsRegionShrink how to shrink each 2x2 region
  * * @skip_blanks: %gint skip tiles which are nearly equal to the background
  * * @no_strip: %gboolean don't strip tiles
+ * * @dirty_left: %gint left edge of area to update
+ * * @dirty_top: %gint top edge of area to update
+ * * @dirty_width: %gint width of area to update
+ * * @dirty_height: %gint height of area to update
+ * * @checkpoint: %gboolean record progress and resume interrupted saves
+ * * @dedup: %gboolean link repeated tiles to the first copy
  *
  * Save an image as a set of tiles at various resolutions. By default dzsave
  * uses DeepZoom layout -- use @layout to pick other conventions.
@@ -2792,6 +4116,31 @@ vips_foreign_save_dz_buffer_init( VipsForeignSaveDzBuffer *buffer )
  * which are all within that many pixel values to the background are skipped. 
  * This can save a lot of space for some image types. This option defaults to 
  * 5 in Google layout mode, -1 otherwise.
+ *
+ * If you set @dirty_width and @dirty_height, vips_dzsave() will update an
+ * existing pyramid in place, rewriting only those tiles at each level which 
+ * are touched by the rectangle given by @dirty_left, @dirty_top, 
+ * @dirty_width and @dirty_height. The rectangle is in @in coordinates. 
+ * Other tiles are left alone, so @in must be the whole of the new image, 
+ * and all other parameters must match the original save. 
+ *
+ * If @checkpoint is set, vips_dzsave() writes into the output directory in
+ * place and records its progress in `basename.checkpoint` after each
+ * strip of tiles. If a save is interrupted, running it again with the same
+ * image and parameters will skip all the tiles that were written before. The
+ * checkpoint file is removed when the save completes.
+ *
+ * Updates and checkpoints are only possible with filesystem output. Tiles 
+ * are written to a temporary file and renamed, so viewers never see a
+ * partial tile. Blank tiles are always written in these modes, 
+ * whatever @skip_blanks is set to.
+ *
+ * If @dedup is set, vips_dzsave() hashes the pixels of each tile. A tile 
+ * identical to one already written is not encoded again, but is saved as a
+ * hard link to the earlier file. This can save a lot of time and space for
+ * images with large uniform areas. @dedup only applies to filesystem output,
+ * and tiles are written normally where the filesystem does not support 
+ * links.
  * 
  * See also: vips_tiffsave().
  *
@@ -24,6 +24,9 @@
  * 	- block _start if one start fails, see #893
  * 1/4/18
  * 	- drop incompatible ICC profiles before save
+ * 19/10/19
+ * 	- loaders can set magic-number signatures, and loader search reads 
+ * 	  the file header just once
  */
 
 /*
@@ -121,6 +124,12 @@
  * The suffix list is used to select a format to save a file in, and to pick a
  * loader if you don't define is_a().
  *
+ * If your format can be recognised from a few bytes at the start of the file,
+ * call vips_foreign_load_class_set_magic() from your class init with an 
+ * array of #VipsForeignMagic signatures. Loader search
+ * reads the first few bytes once and tests all loaders against them, which is
+ * much faster than calling is_a() for each loader in turn.
+ *
  * You should also define @nickname and @description in #VipsObject. 
  *
  * As a complete example, here's code for a PNG loader, minus the actual
@@ -474,20 +483,165 @@ vips_foreign_load_summary_class( VipsObjectClass *object_class, VipsBuf *buf )
 	}
 }
 
+/**
+ * VipsForeignMagic:
+ * @offset: position of the signature in the file
+ * @length: number of bytes in the signature
+ * @bytes: the signature
+ * @mask: (nullable): AND bytes from the file with this before comparing
+ *
+ * A magic-number signature. Loaders can register an array of these with
+ * vips_foreign_load_class_set_magic(). The first #VIPS_FOREIGN_MAGIC_MAX
+ * bytes of a file, buffer or stream are read once, and then matched against
+ * the signatures of every loader, so the search for a loader makes a single
+ * read.
+ *
+ * @mask can be %NULL, meaning compare all bits. The array is terminated by an
+ * entry with @length of zero.
+ */
+
+/* Signatures are kept in a table indexed by loader GType, rather than in
+ * the class struct, so that VipsForeignLoadClass keeps its size and layout.
+ */
+static GMutex *vips_foreign_magic_lock = NULL;
+static GHashTable *vips_foreign_magic_table = NULL;
+
+static void *
+vips_foreign_magic_init( void *data )
+{
+	vips_foreign_magic_lock = vips_g_mutex_new();
+	vips_foreign_magic_table = g_hash_table_new( NULL, NULL );
+
+	return( NULL );
+}
+
+/**
+ * vips_foreign_load_class_set_magic: (skip)
+ * @load_class: loader class to set signatures for
+ * @magic: (nullable): signatures, terminated by an entry with zero length
+ *
+ * Register a set of magic-number signatures for a loader. Call this from
+ * your class init. The array must stay valid for the life of the program, 
+ * so it will usually be static. 
+ *
+ * Once a loader has signatures, the file, buffer or stream is matched 
+ * against them during loader search, and @is_a(), @is_a_buffer() and 
+ * @is_a_stream() are not used for that search. Pass %NULL to remove the 
+ * signatures again.
+ *
+ * See also: vips_foreign_find_load().
+ */
+void
+vips_foreign_load_class_set_magic( VipsForeignLoadClass *load_class,
+	const VipsForeignMagic *magic )
+{
+	static GOnce once = G_ONCE_INIT;
+
+	GType type = G_TYPE_FROM_CLASS( load_class );
+
+	VIPS_ONCE( &once, vips_foreign_magic_init, NULL );
+
+	g_mutex_lock( vips_foreign_magic_lock );
+	if( magic ) 
+		g_hash_table_insert( vips_foreign_magic_table, 
+			GSIZE_TO_POINTER( type ), (void *) magic );
+	else
+		g_hash_table_remove( vips_foreign_magic_table, 
+			GSIZE_TO_POINTER( type ) );
+	g_mutex_unlock( vips_foreign_magic_lock );
+}
+
+/* The signatures for a loader, or NULL. Subclasses do not inherit 
+ * signatures.
+ */
+static const VipsForeignMagic *
+vips_foreign_load_class_get_magic( VipsForeignLoadClass *load_class )
+{
+	const VipsForeignMagic *magic;
+
+	if( !vips_foreign_magic_lock )
+		return( NULL );
+
+	g_mutex_lock( vips_foreign_magic_lock );
+	magic = (const VipsForeignMagic *) g_hash_table_lookup( 
+		vips_foreign_magic_table, 
+		GSIZE_TO_POINTER( G_TYPE_FROM_CLASS( load_class ) ) );
+	g_mutex_unlock( vips_foreign_magic_lock );
+
+	return( magic );
+}
+
+/* Does this header block match any of a set of signatures?
+ */
+static gboolean
+vips_foreign_magic_match( const VipsForeignMagic *magic, 
+	const unsigned char *data, size_t length )
+{
+	for( ; magic->length > 0; magic++ ) {
+		const unsigned char *bytes = (const unsigned char *) magic->bytes;
+		const unsigned char *mask = (const unsigned char *) magic->mask;
+
+		int i;
+
+		g_assert( magic->offset + magic->length <= 
+			VIPS_FOREIGN_MAGIC_MAX );
+
+		if( (size_t) (magic->offset + magic->length) > length )
+			continue;
+
+		for( i = 0; i < magic->length; i++ ) {
+			unsigned char ch = data[magic->offset + i];
+
+			if( mask )
+				ch &= mask[i];
+			if( ch != bytes[i] )
+				break;
+		}
+
+		if( i == magic->length )
+			return( TRUE );
+	}
+
+	return( FALSE );
+}
+
+/* The start of the file, buffer or stream we are searching for. We read this 
+ * once and share it between all the magic tests.
+ */
+typedef struct _VipsForeignSniff {
+	unsigned char data[VIPS_FOREIGN_MAGIC_MAX];
+	size_t length;
+} VipsForeignSniff;
+
 /* Can this VipsForeign open this file?
  */
 static void *
 vips_foreign_find_load_sub( VipsForeignLoadClass *load_class, 
-	const char *filename )
+	const char *filename, VipsForeignSniff *sniff )
 {
 	VipsForeignClass *class = VIPS_FOREIGN_CLASS( load_class );
+	const VipsForeignMagic *magic = 
+		vips_foreign_load_class_get_magic( load_class );
 
 #ifdef DEBUG
 	printf( "vips_foreign_find_load_sub: %s\n", 
 		VIPS_OBJECT_CLASS( class )->nickname );
 #endif /*DEBUG*/
 
-	if( load_class->is_a ) {
+	/* Only file loaders take part in filename search. Loaders with magic
+	 * are tested against the header block, the rest fall back to is_a().
+	 */
+	if( load_class->is_a &&
+		magic ) {
+		if( vips_foreign_magic_match( magic, 
+			sniff->data, sniff->length ) )
+			return( load_class );
+
+#ifdef DEBUG
+		printf( "vips_foreign_find_load_sub: magic failed\n" ); 
+#endif /*DEBUG*/
+	}
+	else if( load_class->is_a ) {
 		if( load_class->is_a( filename ) ) 
 			return( load_class );
 
@@ -523,6 +677,8 @@ vips_foreign_find_load( const char *name )
 {
 	char filename[VIPS_PATH_MAX];
 	char option_string[VIPS_PATH_MAX];
+	VipsForeignSniff sniff;
+	gint64 bytes_read;
 	VipsForeignLoadClass *load_class;
 
 	vips__filename_split8( name, filename, option_string );
@@ -535,10 +691,16 @@ vips_foreign_find_load( const char *name )
 		return( NULL );
 	}
 
+	/* A short or failed read just means no magic tests will match.
+	 */
+	bytes_read = vips__get_bytes( filename, 
+		sniff.data, VIPS_FOREIGN_MAGIC_MAX );
+	sniff.length = VIPS_CLIP( 0, bytes_read, VIPS_FOREIGN_MAGIC_MAX );
+
 	if( !(load_class = (VipsForeignLoadClass *) vips_foreign_map( 
 		"VipsForeignLoad",
 		(VipsSListMap2Fn) vips_foreign_find_load_sub, 
-		(void *) filename, NULL )) ) {
+		(void *) filename, &sniff )) ) {
 		vips_error( "VipsForeignLoad", 
 			_( "\"%s\" is not a known file format" ), name );
 		return( NULL );
@@ -583,7 +745,15 @@ static void *
 vips_foreign_find_load_buffer_sub( VipsForeignLoadClass *load_class, 
 	const void **buf, size_t *len )
 {
+	const VipsForeignMagic *magic = 
+		vips_foreign_load_class_get_magic( load_class );
+
 	if( load_class->is_a_buffer &&
+		magic ) {
+		if( vips_foreign_magic_match( magic, *buf, *len ) )
+			return( load_class );
+	}
+	else if( load_class->is_a_buffer &&
 		load_class->is_a_buffer( *buf, *len ) ) 
 		return( load_class );
 
@@ -630,8 +800,17 @@ vips_foreign_find_load_stream_sub( void *item, void *a, void *b )
 {
 	VipsForeignLoadClass *load_class = VIPS_FOREIGN_LOAD_CLASS( item );
 	VipsStreami *streami = VIPS_STREAMI( a );
+	VipsForeignSniff *sniff = (VipsForeignSniff *) b;
+	const VipsForeignMagic *magic = 
+		vips_foreign_load_class_get_magic( load_class );
 
-	if( load_class->is_a_stream ) {
+	if( load_class->is_a_stream &&
+		magic ) {
+		if( vips_foreign_magic_match( magic, 
+			sniff->data, sniff->length ) )
+			return( load_class );
+	}
+	else if( load_class->is_a_stream ) {
 		/* We may have done a read() rather than a sniff() in one of
 		 * the is_a testers. Always rewind.
 		 */
@@ -661,12 +840,23 @@ vips_foreign_find_load_stream_sub( void *item, void *a, void *b )
 const char *
 vips_foreign_find_load_stream( VipsStreami *streami )
 {
+	VipsForeignSniff sniff;
+	unsigned char *data = NULL;
+	gint64 bytes_read;
 	VipsForeignLoadClass *load_class;
 
+	/* Take a copy, since the is_a_stream() fallbacks will sniff again.
+	 */
+	bytes_read = vips_streami_sniff_at_most( streami, 
+		&data, VIPS_FOREIGN_MAGIC_MAX );
+	sniff.length = VIPS_CLIP( 0, bytes_read, VIPS_FOREIGN_MAGIC_MAX );
+	if( sniff.length > 0 )
+		memcpy( sniff.data, data, sniff.length );
+
 	if( !(load_class = (VipsForeignLoadClass *) vips_foreign_map( 
 		"VipsForeignLoad",
 		vips_foreign_find_load_stream_sub, 
-		streami, NULL )) ) {
+		streami, &sniff )) ) {
 		vips_error( "VipsForeignLoad", 
 			"%s", _( "stream is not in a known format" ) ); 
 		return( NULL );
@@ -2209,3 +2399,14 @@ vips_foreign_operation_init( void )
 	vips__foreign_load_operation = 
 		g_quark_from_static_string( "vips-foreign-load-operation" ); 
 }
+
+/* Free any process-wide state the loaders and savers hold. Called from
+ * vips_shutdown().
+ */
+void
+vips__foreign_shutdown( void )
+{
+#ifdef HAVE_OPENSLIDE
+	vips__openslide_cache_shutdown();
+#endif /*HAVE_OPENSLIDE*/
+}
@@ -34,6 +34,9 @@
  * 	- check image and frame bounds, since giflib does not
  * 1/9/19
  * 	- improve early close again
+ * 19/10/19
+ * 	- build a frame index during header scan and skip straight to the 
+ * 	  nearest keyframe for @page
  */
 
 /*
@@ -123,6 +126,26 @@
 	(G_TYPE_INSTANCE_GET_CLASS( (obj), \
 	VIPS_TYPE_FOREIGN_LOAD_GIF, VipsForeignLoadGifClass ))
 
+/* Both GIF87a and GIF89a.
+ */
+static const VipsForeignMagic vips_foreign_load_gif_magic[] = {
+	{ 0, 4, "GIF8", NULL },
+	{ 0 }
+};
+
+/* What we discover about each frame during the header scan.
+ */
+typedef struct _VipsForeignLoadGifFrame {
+	/* The dispose method in effect for this frame.
+	 */
+	int dispose;
+
+	/* Set if rendering this frame does not depend on the pixels of any
+	 * earlier frame.
+	 */
+	gboolean keyframe;
+} VipsForeignLoadGifFrame;
+
 typedef struct _VipsForeignLoadGif {
 	VipsForeignLoad parent_object;
 
@@ -149,6 +172,17 @@ typedef struct _VipsForeignLoadGif {
 	int *delays;
 	int delays_length;
 
+	/* The frame index, also delays_length long.
+	 */
+	VipsForeignLoadGifFrame *frames;
+
+	/* During header scan, the dispose and transparency from the most
+	 * recent graphics control extension. They carry over to following
+	 * frames.
+	 */
+	int scan_dispose;
+	gboolean scan_transparency;
+
 	/* Number of times to loop the animation.
 	 */
 	int loop;
@@ -405,6 +439,7 @@ vips_foreign_load_gif_dispose( GObject *gobject )
 	VIPS_FREE( gif->comment );
 	VIPS_FREE( gif->line );
 	VIPS_FREE( gif->delays );
+	VIPS_FREE( gif->frames );
 
 	G_OBJECT_CLASS( vips_foreign_load_gif_parent_class )->
 		dispose( gobject );
@@ -449,7 +484,7 @@ vips_foreign_load_gif_is_a( const char *filename )
 	return( 0 );
 }
 
-/* Make sure delays is allocated and large enough.
+/* Make sure delays and the frame index are allocated and large enough.
  */
 static void
 vips_foreign_load_gif_allocate_delays( VipsForeignLoadGif *gif )
@@ -461,8 +496,14 @@ vips_foreign_load_gif_allocate_delays( VipsForeignLoadGif *gif )
 		gif->delays_length = gif->delays_length + gif->n_pages + 64;
 		gif->delays = (int *) g_realloc( gif->delays, 
 			gif->delays_length * sizeof( int ) );
-		for( i = old; i < gif->delays_length; i++ )
+		gif->frames = (VipsForeignLoadGifFrame *) g_realloc( 
+			gif->frames, 
+			gif->delays_length * sizeof( VipsForeignLoadGifFrame ) );
+		for( i = old; i < gif->delays_length; i++ ) {
 			gif->delays[i] = 40;
+			gif->frames[i].dispose = DISPOSAL_UNSPECIFIED;
+			gif->frames[i].keyframe = FALSE;
+		}
 	}
 }
 
@@ -506,6 +547,8 @@ vips_foreign_load_gif_scan_image( VipsForeignLoadGif *gif )
 
 	ColorMapObject *map;
 	GifByteType *extension;
+	VipsForeignLoadGifFrame *frame;
+	gboolean full;
 
 	if( DGifGetImageDesc( gif->file ) == GIF_ERROR ) {
 		vips_foreign_load_gif_error( gif ); 
@@ -527,6 +570,24 @@ vips_foreign_load_gif_scan_image( VipsForeignLoadGif *gif )
 		return( -1 );
 	}
 
+	/* Add to the frame index. See vips_foreign_load_gif_render() for the
+	 * rules we follow. BACKGROUND clears the whole frame before
+	 * rendering, and a frame covering the whole canvas is independent
+	 * unless transparent pixels let the previous frame show through.
+	 */
+	frame = &gif->frames[gif->n_pages];
+	full = file->Image.Left == 0 &&
+		file->Image.Top == 0 &&
+		file->Image.Width == file->SWidth &&
+		file->Image.Height == file->SHeight;
+	frame->dispose = gif->scan_dispose;
+	frame->keyframe = gif->n_pages == 0 ||
+		frame->dispose == DISPOSE_BACKGROUND ||
+		(full &&
+		 frame->dispose != DISPOSE_PREVIOUS &&
+		 (frame->dispose != DISPOSE_DO_NOT || 
+		  !gif->scan_transparency));
+
 	/* Test for a non-greyscale colourmap for this frame.
 	 */
 	map = file->Image.ColorMap ? file->Image.ColorMap : file->SColorMap;
@@ -623,6 +684,13 @@ vips_foreign_load_gif_scan_extension( VipsForeignLoadGif *gif )
 				gif->has_transparency = TRUE;
 			}
 
+			/* Track dispose and transparency for the frame index.
+			 */
+			if( extension[0] == 4 ) {
+				gif->scan_transparency = extension[1] & 0x1;
+				gif->scan_dispose = (extension[1] >> 2) & 0x7;
+			}
+
 			/* giflib uses centiseconds, we use ms.
 			 */
 			gif->delays[gif->n_pages] = 
@@ -710,6 +778,8 @@ vips_foreign_load_gif_scan( VipsForeignLoadGif *gif )
 	VIPS_DEBUG_MSG( "vips_foreign_load_gif_scan:\n" );
 
 	gif->n_pages = 0;
+	gif->scan_dispose = DISPOSAL_UNSPECIFIED;
+	gif->scan_transparency = FALSE;
 
 	do {
 		if( DGifGetRecordType( gif->file, &record ) == GIF_ERROR ) 
@@ -1006,10 +1076,32 @@ vips_foreign_load_gif_extension( VipsForeignLoadGif *gif )
 	return( 0 );
 }
 
-/* Read the next page from the file into @frame.
+/* Step over the compressed pixels for an image record.
  */
 static int
-vips_foreign_load_gif_next_page( VipsForeignLoadGif *gif )
+vips_foreign_load_gif_skip_image( VipsForeignLoadGif *gif )
+{
+	GifByteType *extension;
+
+	if( DGifGetImageDesc( gif->file ) == GIF_ERROR ) {
+		vips_foreign_load_gif_error( gif );
+		return( -1 );
+	}
+
+	do {
+		if( vips_foreign_load_gif_code_next( gif, &extension ) )
+			return( -1 );
+	} while( extension != NULL );
+
+	return( 0 );
+}
+
+/* Read the next page from the file into @frame. If @skip is set, step over
+ * the pixels without decompressing them. We must still process extensions,
+ * since dispose and transparency carry over to later frames.
+ */
+static int
+vips_foreign_load_gif_next_page( VipsForeignLoadGif *gif, gboolean skip )
 {
 	GifRecordType record;
 	gboolean have_read_frame;
@@ -1026,7 +1118,11 @@ vips_foreign_load_gif_next_page( VipsForeignLoadGif *gif )
 			VIPS_DEBUG_MSG( "vips_foreign_load_gif_next_page: "
 				"IMAGE_DESC_RECORD_TYPE\n" );
 
-			if( vips_foreign_load_gif_render( gif ) )
+			if( skip ) {
+				if( vips_foreign_load_gif_skip_image( gif ) )
+					return( -1 );
+			}
+			else if( vips_foreign_load_gif_render( gif ) )
 				return( -1 );
 
 			have_read_frame = TRUE;
@@ -1063,6 +1159,29 @@ vips_foreign_load_gif_next_page( VipsForeignLoadGif *gif )
 	return( 0 );
 }
 
+/* The frame we should start rendering from to get @page. This is the
+ * nearest keyframe at or before @page, but a keyframe which does not 
+ * clear to background sets the previous frame to the frame before it, so 
+ * we can't start there if the next frame is DISPOSE_PREVIOUS.
+ */
+static int
+vips_foreign_load_gif_find_keyframe( VipsForeignLoadGif *gif, int page )
+{
+	int i;
+
+	for( i = page; i > 0; i-- ) {
+		VipsForeignLoadGifFrame *frame = &gif->frames[i];
+
+		if( frame->keyframe &&
+			(frame->dispose == DISPOSE_BACKGROUND ||
+			 i + 1 >= gif->n_pages ||
+			 gif->frames[i + 1].dispose != DISPOSE_PREVIOUS) )
+			break;
+	}
+
+	return( i );
+}
+
 static int
 vips_foreign_load_gif_generate( VipsRegion *or,
 	void *seq, void *a, void *b, gboolean *stop )
@@ -1099,9 +1218,25 @@ vips_foreign_load_gif_generate( VipsRegion *or,
 
 		/* current_page == 0 means we've not loaded any pages yet. So
 		 * we need to have loaded the page beyond the page we want.
+		 *
+		 * Skip without decompressing any frames before the nearest
+		 * keyframe.
 		 */
+		if( gif->current_page <= page ) {
+			int keyframe = 
+				vips_foreign_load_gif_find_keyframe( gif, page );
+
+			while( gif->current_page < keyframe ) {
+				if( vips_foreign_load_gif_next_page( gif, 
+					TRUE ) )
+					return( -1 );
+
+				gif->current_page += 1;
+			}
+		}
+
 		while( gif->current_page <= page ) {
-			if( vips_foreign_load_gif_next_page( gif ) )
+			if( vips_foreign_load_gif_next_page( gif, FALSE ) )
 				return( -1 );
 
 			gif->current_page += 1;
@@ -1284,6 +1419,7 @@ vips_foreign_load_gif_init( VipsForeignLoadGif *gif )
 	gif->transparency = -1;
 	gif->delays = NULL;
 	gif->delays_length = 0;
+	gif->frames = NULL;
 	gif->loop = 0;
 	gif->comment = NULL;
 	gif->dispose = 0;
@@ -1415,6 +1551,8 @@ vips_foreign_load_gif_file_class_init(
 	foreign_class->suffs = vips_foreign_gif_suffs;
 
 	load_class->is_a = vips_foreign_load_gif_is_a;
+	vips_foreign_load_class_set_magic( load_class, 
+		vips_foreign_load_gif_magic );
 
 	gif_class->open = vips_foreign_load_gif_file_open;
 	gif_class->rewind = vips_foreign_load_gif_file_rewind;
@@ -1525,6 +1663,8 @@ vips_foreign_load_gif_buffer_class_init(
 	object_class->description = _( "load GIF with giflib" );
 
 	load_class->is_a_buffer = vips_foreign_load_gif_is_a_buffer;
+	vips_foreign_load_class_set_magic( load_class, 
+		vips_foreign_load_gif_magic );
 
 	gif_class->open = vips_foreign_load_gif_buffer_open;
 	gif_class->rewind = vips_foreign_load_gif_buffer_rewind;
@@ -106,6 +106,8 @@
  * 	- restart after minimise
  * 14/10/19
  * 	- revise for stream IO
+ * 19/10/19
+ * 	- add @scans: stop progressive decode early
  */
 
 /*
@@ -171,6 +173,10 @@ typedef struct _ReadJpeg {
 	 */
 	gboolean fail;
 
+	/* Stop progressive images after this many scans, 0 for all of them.
+	 */
+	int scans;
+
 	struct jpeg_decompress_struct cinfo;
         ErrorManager eman;
 	gboolean invert_pels;
@@ -345,7 +351,7 @@ readjpeg_minimise_cb( VipsImage *image, ReadJpeg *jpeg )
 
 static ReadJpeg *
 readjpeg_new( VipsStreami *streami, VipsImage *out, 
-	int shrink, gboolean fail, gboolean autorotate )
+	int shrink, int scans, gboolean fail, gboolean autorotate )
 {
 	ReadJpeg *jpeg;
 
@@ -355,6 +361,7 @@ readjpeg_new( VipsStreami *streami, VipsImage *out,
 	jpeg->streami = streami;
 	g_object_ref( streami );
 	jpeg->shrink = shrink;
+	jpeg->scans = scans;
 	jpeg->fail = fail;
         jpeg->cinfo.err = jpeg_std_error( &jpeg->eman.pub );
 	jpeg->eman.pub.error_exit = vips__new_error_exit;
@@ -874,7 +881,22 @@ read_jpeg_image( ReadJpeg *jpeg, VipsImage *out )
 	if( read_jpeg_header( jpeg, t[0] ) )
 		return( -1 );
 
-	jpeg_start_decompress( cinfo );
+	/* Progressive images are usually decompressed entirely in
+	 * jpeg_start_decompress(). If we only want the first few scans, use
+	 * buffered mode instead: jpeg_read_scanlines() will then only pull
+	 * in enough of the file to output the scan we ask for. libjpeg
+	 * smooths blocks with no AC coefficients yet, and @shrink will only 
+	 * run the IDCT for the coefficients we have, so the early scans make 
+	 * a good preview.
+	 */
+	if( jpeg->scans > 0 &&
+		jpeg_has_multiple_scans( cinfo ) ) {
+		cinfo->buffered_image = TRUE;
+		jpeg_start_decompress( cinfo );
+		jpeg_start_output( cinfo, jpeg->scans );
+	}
+	else
+		jpeg_start_decompress( cinfo );
 
 #ifdef DEBUG
 	printf( "read_jpeg_image: starting decompress\n" );
@@ -960,11 +982,13 @@ vips__jpeg_read( ReadJpeg *jpeg, VipsImage *out, gboolean header_only )
 
 int
 vips__jpeg_read_stream( VipsStreami *streami, VipsImage *out,
-	gboolean header_only, int shrink, int fail, gboolean autorotate )
+	gboolean header_only, int shrink, int scans, int fail, 
+	gboolean autorotate )
 {
 	ReadJpeg *jpeg;
 
-	if( !(jpeg = readjpeg_new( streami, out, shrink, fail, autorotate )) )
+	if( !(jpeg = readjpeg_new( streami, out, 
+		shrink, scans, fail, autorotate )) )
 		return( -1 );
 
 	if( setjmp( jpeg->eman.jmp ) ) 
@@ -4,6 +4,8 @@
  * 	- wrap a class around the jpeg writer
  * 29/11/11
  * 	- split to make load, load from buffer and load from file
+ * 19/10/19
+ * 	- add @scans
  */
 
 /*
@@ -65,6 +67,13 @@
 #endif /*UNTAGGED_EXIF*/
 #endif /*HAVE_EXIF*/
 
+/* JPEG files start with the SOI marker.
+ */
+static const VipsForeignMagic vips_foreign_load_jpeg_magic[] = {
+	{ 0, 2, "\377\330", NULL },
+	{ 0 }
+};
+
 typedef struct _VipsForeignLoadJpeg {
 	VipsForeignLoad parent_object;
 
@@ -76,6 +85,10 @@ typedef struct _VipsForeignLoadJpeg {
 	 */
 	gboolean autorotate;
 
+	/* Only decode this many scans of progressive images.
+	 */
+	int scans;
+
 } VipsForeignLoadJpeg;
 
 typedef VipsForeignLoadClass VipsForeignLoadJpegClass;
@@ -142,6 +155,13 @@ vips_foreign_load_jpeg_class_init( VipsForeignLoadJpegClass *class )
 		G_STRUCT_OFFSET( VipsForeignLoadJpeg, autorotate ),
 		FALSE );
 
+	VIPS_ARG_INT( class, "scans", 22, 
+		_( "Scans" ), 
+		_( "Stop progressive images after this many scans" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsForeignLoadJpeg, scans ),
+		0, 1000, 0 );
+
 }
 
 static void
@@ -169,7 +189,8 @@ vips_foreign_load_jpeg_stream_header( VipsForeignLoad *load )
 	VipsForeignLoadJpegStream *stream = (VipsForeignLoadJpegStream *) load;
 
 	if( vips__jpeg_read_stream( stream->streami, 
-		load->out, TRUE, jpeg->shrink, load->fail, jpeg->autorotate ) )
+		load->out, TRUE, jpeg->shrink, jpeg->scans, load->fail, 
+		jpeg->autorotate ) )
 		return( -1 );
 
 	return( 0 );
@@ -182,7 +203,7 @@ vips_foreign_load_jpeg_stream_load( VipsForeignLoad *load )
 	VipsForeignLoadJpegStream *stream = (VipsForeignLoadJpegStream *) load;
 
 	if( vips__jpeg_read_stream( stream->streami,
-		load->real, FALSE, jpeg->shrink, load->fail, 
+		load->real, FALSE, jpeg->shrink, jpeg->scans, load->fail, 
 		jpeg->autorotate ) )
 		return( -1 );
 
@@ -210,6 +231,8 @@ vips_foreign_load_jpeg_stream_class_init(
 	object_class->description = _( "load image from jpeg stream" );
 
 	load_class->is_a_stream = vips_foreign_load_jpeg_stream_is_a;
+	vips_foreign_load_class_set_magic( load_class, 
+		vips_foreign_load_jpeg_magic );
 	load_class->header = vips_foreign_load_jpeg_stream_header;
 	load_class->load = vips_foreign_load_jpeg_stream_load;
 
@@ -264,7 +287,8 @@ vips_foreign_load_jpeg_file_header( VipsForeignLoad *load )
 	if( !(streami = vips_streami_new_from_file( file->filename )) ) 
 		return( -1 );
 	if( vips__jpeg_read_stream( streami, load->out, 
-		TRUE, jpeg->shrink, load->fail, jpeg->autorotate ) ) {
+		TRUE, jpeg->shrink, jpeg->scans, load->fail, 
+		jpeg->autorotate ) ) {
 		VIPS_UNREF( streami );
 		return( -1 );
 	}
@@ -284,7 +308,8 @@ vips_foreign_load_jpeg_file_load( VipsForeignLoad *load )
 	if( !(streami = vips_streami_new_from_file( file->filename )) ) 
 		return( -1 );
 	if( vips__jpeg_read_stream( streami, load->real, 
-		FALSE, jpeg->shrink, load->fail, jpeg->autorotate ) ) {
+		FALSE, jpeg->shrink, jpeg->scans, load->fail, 
+		jpeg->autorotate ) ) {
 		VIPS_UNREF( streami );
 		return( -1 );
 	}
@@ -314,6 +339,8 @@ vips_foreign_load_jpeg_file_class_init( VipsForeignLoadJpegFileClass *class )
 	foreign_class->priority = 50;
 
 	load_class->is_a = vips_foreign_load_jpeg_file_is_a;
+	vips_foreign_load_class_set_magic( load_class, 
+		vips_foreign_load_jpeg_magic );
 	load_class->header = vips_foreign_load_jpeg_file_header;
 	load_class->load = vips_foreign_load_jpeg_file_load;
 
@@ -367,7 +394,8 @@ vips_foreign_load_jpeg_buffer_header( VipsForeignLoad *load )
 	if( !(streami = vips_streami_new_from_blob( buffer->blob )) ) 
 		return( -1 );
 	if( vips__jpeg_read_stream( streami, load->out, 
-		TRUE, jpeg->shrink, load->fail, jpeg->autorotate ) ) {
+		TRUE, jpeg->shrink, jpeg->scans, load->fail, 
+		jpeg->autorotate ) ) {
 		VIPS_UNREF( streami );
 		return( -1 );
 	}
@@ -387,7 +415,8 @@ vips_foreign_load_jpeg_buffer_load( VipsForeignLoad *load )
 	if( !(streami = vips_streami_new_from_blob( buffer->blob )) ) 
 		return( -1 );
 	if( vips__jpeg_read_stream( streami, load->real, 
-		FALSE, jpeg->shrink, load->fail, jpeg->autorotate ) ) {
+		FALSE, jpeg->shrink, jpeg->scans, load->fail, 
+		jpeg->autorotate ) ) {
 		VIPS_UNREF( streami );
 		return( -1 );
 	}
@@ -411,6 +440,8 @@ vips_foreign_load_jpeg_buffer_class_init(
 	object_class->description = _( "load jpeg from buffer" );
 
 	load_class->is_a_buffer = vips_foreign_load_jpeg_buffer_is_a_buffer;
+	vips_foreign_load_class_set_magic( load_class, 
+		vips_foreign_load_jpeg_magic );
 	load_class->header = vips_foreign_load_jpeg_buffer_header;
 	load_class->load = vips_foreign_load_jpeg_buffer_load;
 
@@ -440,6 +471,7 @@ vips_foreign_load_jpeg_buffer_init( VipsForeignLoadJpegBuffer *buffer )
  * * @shrink: %gint, shrink by this much on load
  * * @fail: %gboolean, fail on errors
  * * @autorotate: %gboolean, rotate image upright during load 
+ * * @scans: %gint, only decode this many scans of progressive images
  *
  * Read a JPEG file into a VIPS image. It can read most 8-bit JPEG images, 
  * including CMYK and YCbCr.
@@ -463,6 +495,13 @@ vips_foreign_load_jpeg_buffer_init( VipsForeignLoadJpegBuffer *buffer )
  * operations will use #VIPS_META_ORIENTATION, if present, to set the
  * orientation of output images. 
  *
+ * Set @scans to stop decoding progressive images after that many scans. 
+ * The image is the full size, but has only the detail that those scans hold,
+ * and the rest of the file is not read or decoded. The first scan of most
+ * progressive JPEGs holds just the DC coefficients, so for a fast preview,
+ * use @scans 1 together with @shrink 8. The default, 0, decodes all
+ * scans. @scans has no effect on baseline images.
+ *
  * Example:
  *
  * |[
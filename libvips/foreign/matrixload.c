@@ -2,6 +2,8 @@
  *
  * 5/12/11
  * 	- from csvload.c
+ * 19/10/19
+ * 	- support sequential access
  */
 
 /*
@@ -67,7 +69,7 @@ G_DEFINE_TYPE( VipsForeignLoadMatrix, vips_foreign_load_matrix,
 static VipsForeignFlags
 vips_foreign_load_matrix_get_flags_filename( const char *filename )
 {
-	return( 0 );
+	return( VIPS_FOREIGN_SEQUENTIAL );
 }
 
 static VipsForeignFlags
@@ -109,15 +111,8 @@ vips_foreign_load_matrix_load( VipsForeignLoad *load )
 {
 	VipsForeignLoadMatrix *matrix = (VipsForeignLoadMatrix *) load;
 
-	VipsImage *out; 
-
-	if( !(out = vips__matrix_read( matrix->filename )) )
+	if( vips__matrix_read_sequential( matrix->filename, load->real ) )
 		return( -1 );
-	if( vips_image_write( out, load->real ) ) {
-		g_object_unref( out );
-		return( -1 );
-	}
-	g_object_unref( out );
 
 	return( 0 );
 }
@@ -190,6 +185,9 @@ vips_foreign_load_matrix_init( VipsForeignLoadMatrix *matrix )
  * Extra characters at the ends of lines or at the end of the file are
  * ignored.
  *
+ * Lines are parsed in parallel, and this loader supports sequential access,
+ * so large matrix files can be processed in a small amount of memory.
+ *
  * See also: vips_csvload().
  *
  * Returns: 0 on success, -1 on error.
@@ -52,6 +52,13 @@
 
 #include "pforeign.h"
 
+/* The OpenEXR magic number, 20000630 in little-endian order.
+ */
+static const VipsForeignMagic vips_foreign_load_openexr_magic[] = {
+	{ 0, 4, "\166\057\061\001", NULL },
+	{ 0 }
+};
+
 typedef struct _VipsForeignLoadOpenexr {
 	VipsForeignLoad parent_object;
 
@@ -134,6 +141,8 @@ vips_foreign_load_openexr_class_init( VipsForeignLoadOpenexrClass *class )
 	foreign_class->priority = 200;
 
 	load_class->is_a = vips__openexr_isexr;
+	vips_foreign_load_class_set_magic( load_class, 
+		vips_foreign_load_openexr_magic );
 	load_class->get_flags_filename = 
 		vips_foreign_load_openexr_get_flags_filename;
 	load_class->get_flags = vips_foreign_load_openexr_get_flags;
@@ -51,6 +51,10 @@
  * 	- reorganise to support invalidate on read error
  * 27/1/18
  * 	- option to attach associated images as metadata
+ * 19/10/19
+ * 	- add a process-wide cache of decoded tiles, sized with
+ * 	  vips_openslide_cache_set_max_mem() or VIPS_OPENSLIDE_CACHE
+ * 	- faster unpremultiply
  */
 
 /*
@@ -90,6 +94,8 @@
 #include <stdlib.h>
 #include <limits.h>
 
+#include <glib/gstdio.h>
+
 #include <vips/vips.h>
 #include <vips/debug.h>
 
@@ -122,8 +128,199 @@ typedef struct {
 	 */
 	int tile_width;
 	int tile_height;
+
+	/* Prefix for keys in the decoded tile cache, or NULL for no caching.
+	 */
+	char *cache_key;
 } ReadSlide;
 
+/* Default size of the decoded tile cache, in megabytes.
+ */
+#define SLIDE_CACHE_DEFAULT (64)
+
+/* A process-wide cache of decoded and unpremultiplied tiles, shared between
+ * all loads of all slides. Viewers and tile servers will often open the same
+ * slide many times, and openslide's own cache is small and private to each
+ * openslide_t.
+ *
+ * Tiles are kept in LRU order, most recently used at the head.
+ */
+typedef struct _SlideTile {
+	char *key;
+	size_t length;
+	uint32_t *pixels;
+} SlideTile;
+
+static GMutex *slide_cache_lock = NULL;
+static GHashTable *slide_cache_table = NULL;
+static GQueue slide_cache_lru = G_QUEUE_INIT;
+static size_t slide_cache_size = 0;
+static size_t slide_cache_max = 0;
+
+/* Undo premultiplication with a lookup, indexed by [alpha][value].
+ */
+static VipsPel unpremultiply_table[256][256];
+
+static void *
+slide_cache_init( void *data )
+{
+	const char *str;
+	int a, v;
+
+	slide_cache_max = (size_t) SLIDE_CACHE_DEFAULT * 1024 * 1024;
+	if( (str = g_getenv( "VIPS_OPENSLIDE_CACHE" )) )
+		slide_cache_max = (size_t) VIPS_MAX( 0, atoi( str ) ) * 
+			1024 * 1024;
+
+	slide_cache_lock = vips_g_mutex_new();
+	slide_cache_table = g_hash_table_new( g_str_hash, g_str_equal );
+
+	/* Values larger than alpha are invalid, but truncate them to 8 bits
+	 * in the same way the old arithmetic did.
+	 */
+	for( a = 1; a < 256; a++ )
+		for( v = 0; v < 256; v++ )
+			unpremultiply_table[a][v] = 255 * v / a;
+
+	return( NULL );
+}
+
+static void
+slide_cache_once( void )
+{
+	static GOnce once = G_ONCE_INIT;
+
+	VIPS_ONCE( &once, slide_cache_init, NULL );
+}
+
+static void
+slide_tile_free( SlideTile *tile )
+{
+	VIPS_FREE( tile->key );
+	VIPS_FREE( tile->pixels );
+	g_free( tile );
+}
+
+/* Drop tiles until we are within budget. Call with the lock held.
+ */
+static void
+slide_cache_trim( void )
+{
+	while( slide_cache_size > slide_cache_max ) {
+		SlideTile *old = (SlideTile *) 
+			g_queue_pop_tail( &slide_cache_lru );
+
+		g_hash_table_remove( slide_cache_table, old->key );
+		slide_cache_size -= old->length;
+		slide_tile_free( old );
+	}
+}
+
+void
+vips__openslide_cache_set_max_mem( size_t max_mem )
+{
+	slide_cache_once();
+
+	g_mutex_lock( slide_cache_lock );
+	slide_cache_max = max_mem;
+	slide_cache_trim();
+	g_mutex_unlock( slide_cache_lock );
+}
+
+size_t
+vips__openslide_cache_get_max_mem( void )
+{
+	size_t max_mem;
+
+	slide_cache_once();
+
+	g_mutex_lock( slide_cache_lock );
+	max_mem = slide_cache_max;
+	g_mutex_unlock( slide_cache_lock );
+
+	return( max_mem );
+}
+
+/* Free all cached tiles, called from vips_shutdown(). We set the budget to
+ * zero too, so nothing can be added after this.
+ */
+void
+vips__openslide_cache_shutdown( void )
+{
+	SlideTile *tile;
+
+	/* Never used, so nothing to free.
+	 */
+	if( !slide_cache_lock )
+		return;
+
+	g_mutex_lock( slide_cache_lock );
+
+	while( (tile = (SlideTile *) g_queue_pop_head( &slide_cache_lru )) )
+		slide_tile_free( tile );
+	VIPS_FREEF( g_hash_table_destroy, slide_cache_table );
+	slide_cache_size = 0;
+	slide_cache_max = 0;
+
+	g_mutex_unlock( slide_cache_lock );
+}
+
+/* Copy a tile out of the cache, if we can.
+ */
+static gboolean
+slide_cache_get( const char *key, uint32_t *buf, size_t length )
+{
+	GList *link;
+	gboolean found;
+
+	found = FALSE;
+
+	g_mutex_lock( slide_cache_lock );
+
+	if( slide_cache_table &&
+		(link = g_hash_table_lookup( slide_cache_table, key )) ) {
+		SlideTile *tile = (SlideTile *) link->data;
+
+		if( tile->length == length ) {
+			memcpy( buf, tile->pixels, length );
+			g_queue_unlink( &slide_cache_lru, link );
+			g_queue_push_head_link( &slide_cache_lru, link );
+			found = TRUE;
+		}
+	}
+
+	g_mutex_unlock( slide_cache_lock );
+
+	return( found );
+}
+
+static void
+slide_cache_put( const char *key, uint32_t *buf, size_t length )
+{
+	g_mutex_lock( slide_cache_lock );
+
+	/* Another thread may have decoded this tile at the same time.
+	 */
+	if( length <= slide_cache_max &&
+		!g_hash_table_lookup( slide_cache_table, key ) ) {
+		SlideTile *tile;
+
+		tile = g_new( SlideTile, 1 );
+		tile->key = g_strdup( key );
+		tile->length = length;
+		tile->pixels = g_memdup( buf, length );
+
+		g_queue_push_head( &slide_cache_lru, tile );
+		g_hash_table_insert( slide_cache_table, 
+			tile->key, slide_cache_lru.head );
+		slide_cache_size += length;
+
+		slide_cache_trim();
+	}
+
+	g_mutex_unlock( slide_cache_lock );
+}
+
 int
 vips__openslide_isslide( const char *filename )
 {
@@ -181,6 +378,7 @@ readslide_destroy_cb( VipsImage *image, ReadSlide *rslide )
 	VIPS_FREEF( openslide_close, rslide->osr );
 	VIPS_FREE( rslide->associated );
 	VIPS_FREE( rslide->filename );
+	VIPS_FREE( rslide->cache_key );
 	VIPS_FREE( rslide );
 }
 
@@ -284,34 +482,65 @@ readslide_new( const char *filename, VipsImage *out,
  * We could output plain RGB instead, but that would break
  * compatibility with older vipses.
  */
+static void
+argb2rgba_pel( uint32_t * restrict p, uint32_t pbg )
+{
+	uint32_t x = *p;
+	uint8_t a = x >> 24;
+	VipsPel * restrict out = (VipsPel *) p;
+
+	if( a == 255 ) 
+		*p = GUINT32_TO_BE( (x << 8) | 255 );
+	else if( a == 0 ) 
+		/* Use background color.
+		 */
+		*p = pbg;
+	else {
+		/* Undo premultiplication.
+		 */
+		VipsPel *table = unpremultiply_table[a];
+
+		out[0] = table[(x >> 16) & 255];
+		out[1] = table[(x >> 8) & 255];
+		out[2] = table[x & 255];
+		out[3] = 255;
+	}
+}
+
+/* Pixels per block in argb2rgba().
+ */
+#define ARGB_BLOCK (16)
+
 static void
 argb2rgba( uint32_t * restrict buf, int n, uint32_t bg )
 {
 	const uint32_t pbg = GUINT32_TO_BE( (bg << 8) | 255 );
 
-	int i;
+	int i, j;
 
-	for( i = 0; i < n; i++ ) {
+	slide_cache_once();
+
+	for( i = 0; i + ARGB_BLOCK <= n; i += ARGB_BLOCK ) {
 		uint32_t * restrict p = buf + i;
-		uint32_t x = *p;
-		uint8_t a = x >> 24;
-		VipsPel * restrict out = (VipsPel *) p;
-
-		if( a == 255 ) 
-			*p = GUINT32_TO_BE( (x << 8) | 255 );
-		else if( a == 0 ) 
-			/* Use background color.
-			 */
-			*p = pbg;
-		else {
-			/* Undo premultiplication.
-			 */
-			out[0] = 255 * ((x >> 16) & 255) / a;
-			out[1] = 255 * ((x >> 8) & 255) / a;
-			out[2] = 255 * (x & 255) / a;
-			out[3] = 255;
-		}
+		uint32_t alpha;
+
+		/* Almost all pixels are opaque. Test a block at once, then 
+		 * swizzle with a branch-free loop the compiler can vectorise.
+		 */
+		alpha = 0xffffffff;
+		for( j = 0; j < ARGB_BLOCK; j++ )
+			alpha &= p[j];
+
+		if( (alpha >> 24) == 255 ) 
+			for( j = 0; j < ARGB_BLOCK; j++ )
+				p[j] = GUINT32_TO_BE( (p[j] << 8) | 255 );
+		else
+			for( j = 0; j < ARGB_BLOCK; j++ )
+				argb2rgba_pel( p + j, pbg );
 	}
+
+	for( ; i < n; i++ )
+		argb2rgba_pel( buf + i, pbg );
 }
 
 static int
@@ -535,8 +764,11 @@ vips__openslide_generate( VipsRegion *out,
 	VipsRect *r = &out->valid;
 	int n = r->width * r->height;
 	uint32_t *buf = (uint32_t *) VIPS_REGION_ADDR( out, r->left, r->top );
+	int64_t x = (r->left + rslide->bounds.left) * rslide->downsample;
+	int64_t y = (r->top + rslide->bounds.top) * rslide->downsample;
 
 	const char *error;
+	char *key;
 
 	VIPS_DEBUG_MSG( "vips__openslide_generate: %dx%d @ %dx%d\n",
 		r->width, r->height, r->left, r->top );
@@ -554,10 +786,25 @@ vips__openslide_generate( VipsRegion *out,
 	 */
 	g_assert( VIPS_REGION_LSKIP( out ) == r->width * 4 );
 
+	/* Keys are the level 0 position openslide will read from, plus the
+	 * size, so edge tiles can't collide.
+	 */
+	key = NULL;
+	if( rslide->cache_key ) {
+		key = g_strdup_printf( "%s %" G_GINT64_FORMAT 
+			" %" G_GINT64_FORMAT " %d %d", 
+			rslide->cache_key, 
+			(gint64) x, (gint64) y, r->width, r->height );
+
+		if( slide_cache_get( key, buf, (size_t) n * 4 ) ) {
+			g_free( key );
+			return( 0 );
+		}
+	}
+
 	openslide_read_region( rslide->osr, 
 		buf,
-		(r->left + rslide->bounds.left) * rslide->downsample, 
-		(r->top + rslide->bounds.top) * rslide->downsample, 
+		x, y,
 		rslide->level,
 		r->width, r->height ); 
 
@@ -572,6 +819,7 @@ vips__openslide_generate( VipsRegion *out,
 	if( error ) {
 		vips_error( "openslide2vips", 
 			_( "reading region: %s" ), error );
+		VIPS_FREE( key );
 		return( -1 );
 	}
 
@@ -579,12 +827,38 @@ vips__openslide_generate( VipsRegion *out,
 	 */
 	argb2rgba( buf, n, bg );
 
+	if( key ) {
+		slide_cache_put( key, buf, (size_t) n * 4 );
+		g_free( key );
+	}
+
 	return( 0 );
 }
 
+/* Can we cache tiles from this slide? Keys only record the state of the 
+ * main file, so we skip formats which keep pixels in sibling files: MIRAX,
+ * and Hamamatsu VMS and VMU. NDPI is a single file.
+ */
+static gboolean
+readslide_is_cacheable( ReadSlide *rslide )
+{
+	const char *vendor;
+
+	vendor = openslide_get_property_value( rslide->osr,
+		OPENSLIDE_PROPERTY_NAME_VENDOR );
+	if( !vendor ||
+		strcmp( vendor, "mirax" ) == 0 ||
+		(strcmp( vendor, "hamamatsu" ) == 0 &&
+		 !vips_iscasepostfix( rslide->filename, ".ndpi" )) )
+		return( FALSE );
+
+	return( TRUE );
+}
+
 int
 vips__openslide_read( const char *filename, VipsImage *out, 
-	int level, gboolean autocrop, gboolean attach_associated )
+	int level, gboolean autocrop, gboolean attach_associated,
+	gboolean cache )
 {
 	ReadSlide *rslide;
 	VipsImage *raw;
@@ -600,9 +874,28 @@ vips__openslide_read( const char *filename, VipsImage *out,
 	raw = vips_image_new();
 	vips_object_local( out, raw );
 
-	if( readslide_parse( rslide, raw ) ||
-		vips_image_generate( raw, 
-			NULL, vips__openslide_generate, NULL, rslide, NULL ) )
+	if( readslide_parse( rslide, raw ) )
+		return( -1 );
+
+	/* Tiles in the shared cache are tagged with the file's size and
+	 * modification time, so we never see stale pixels if a slide is 
+	 * rewritten.
+	 */
+	if( cache &&
+		vips__openslide_cache_get_max_mem() > 0 &&
+		readslide_is_cacheable( rslide ) ) {
+		GStatBuf st;
+
+		if( !g_stat( filename, &st ) )
+			rslide->cache_key = g_strdup_printf( "%s %" 
+				G_GINT64_FORMAT " %" G_GINT64_FORMAT " %d", 
+				filename, 
+				(gint64) st.st_mtime, (gint64) st.st_size,
+				rslide->level );
+	}
+
+	if( vips_image_generate( raw, 
+		NULL, vips__openslide_generate, NULL, rslide, NULL ) )
 		return( -1 );
 
 	/* Copy to out, adding a cache. Enough tiles for two complete rows, 
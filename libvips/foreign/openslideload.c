@@ -84,6 +84,10 @@ typedef struct _VipsForeignLoadOpenslide {
 	 */
 	gboolean attach_associated;
 
+	/* Use the shared cache of decoded tiles.
+	 */
+	gboolean cache;
+
 } VipsForeignLoadOpenslide;
 
 typedef VipsForeignLoadClass VipsForeignLoadOpenslideClass;
@@ -136,7 +140,7 @@ vips_foreign_load_openslide_load( VipsForeignLoad *load )
 	if( !openslide->associated ) {
 		if( vips__openslide_read( openslide->filename, load->real, 
 			openslide->level, openslide->autocrop, 
-			openslide->attach_associated ) )
+			openslide->attach_associated, openslide->cache ) )
 			return( -1 );
 	}
 	else {
@@ -225,11 +229,19 @@ vips_foreign_load_openslide_class_init( VipsForeignLoadOpenslideClass *class )
 		G_STRUCT_OFFSET( VipsForeignLoadOpenslide, attach_associated ),
 		FALSE ); 
 
+	VIPS_ARG_BOOL( class, "cache", 23,
+		_( "Cache" ),
+		_( "Use the shared cache of decoded tiles" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsForeignLoadOpenslide, cache ),
+		TRUE ); 
+
 }
 
 static void
 vips_foreign_load_openslide_init( VipsForeignLoadOpenslide *openslide )
 {
+	openslide->cache = TRUE;
 }
 
 #endif /*HAVE_OPENSLIDE*/
@@ -246,6 +258,7 @@ vips_foreign_load_openslide_init( VipsForeignLoadOpenslide *openslide )
  * * @associated: %gchararray, load this associated image
  * * @attach_associated: %gboolean, attach all associated images as metadata
  * * @autocrop: %gboolean, crop to image bounds
+ * * @cache: %gboolean, use the shared cache of decoded tiles
  *
  * Read a virtual slide supported by the OpenSlide library into a VIPS image.
  * OpenSlide supports images in Aperio, Hamamatsu, MIRAX, Sakura, Trestle,
@@ -270,6 +283,12 @@ vips_foreign_load_openslide_init( VipsForeignLoadOpenslide *openslide )
  *
  * The output of this operator is always RGBA.
  *
+ * Decoded tiles are kept in a cache shared by all slides and all loads, so
+ * reopening a slide, or reading overlapping regions from it, will not decode
+ * the same tiles again. Set @cache to %FALSE to bypass it for this load. 
+ * Set the size with vips_openslide_cache_set_max_mem(). MIRAX and Hamamatsu
+ * VMS and VMU slides keep pixels in several files and are never cached.
+ *
  * See also: vips_image_new_from_file().
  *
  * Returns: 0 on success, -1 on error.
@@ -286,3 +305,42 @@ vips_openslideload( const char *filename, VipsImage **out, ... )
 
 	return( result );
 }
+
+/**
+ * vips_openslide_cache_set_max_mem:
+ * @max_mem: maximum number of bytes of decoded tiles to keep
+ *
+ * Set the size of the cache of decoded tiles that vips_openslideload() 
+ * shares between all slides and loads. Set 0 to turn the cache off. Making 
+ * the cache smaller drops tiles straight away. 
+ *
+ * The default is 64MB, or the number of megabytes in the environment 
+ * variable `VIPS_OPENSLIDE_CACHE`.
+ *
+ * See also: vips_openslideload(), vips_cache_set_max_mem().
+ */
+void
+vips_openslide_cache_set_max_mem( size_t max_mem )
+{
+#ifdef HAVE_OPENSLIDE
+	vips__openslide_cache_set_max_mem( max_mem );
+#endif /*HAVE_OPENSLIDE*/
+}
+
+/**
+ * vips_openslide_cache_get_max_mem:
+ *
+ * See also: vips_openslide_cache_set_max_mem().
+ *
+ * Returns: the maximum number of bytes of decoded tiles 
+ * vips_openslideload() will keep.
+ */
+size_t
+vips_openslide_cache_get_max_mem( void )
+{
+#ifdef HAVE_OPENSLIDE
+	return( vips__openslide_cache_get_max_mem() );
+#else /*!HAVE_OPENSLIDE*/
+	return( 0 );
+#endif /*HAVE_OPENSLIDE*/
+}
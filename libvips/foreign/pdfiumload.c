@@ -648,6 +648,7 @@ vips_foreign_load_pdf_file_class_init(
 	foreign_class->suffs = vips_foreign_pdf_suffs;
 
 	load_class->is_a = vips_foreign_load_pdf_is_a;
+	vips_foreign_load_class_set_magic( load_class, vips__pdf_magic );
 	load_class->header = vips_foreign_load_pdf_file_header;
 
 	VIPS_ARG_STRING( class, "filename", 1, 
@@ -715,6 +716,7 @@ vips_foreign_load_pdf_buffer_class_init(
 	object_class->nickname = "pdfload_buffer";
 
 	load_class->is_a_buffer = vips_foreign_load_pdf_is_a_buffer;
+	vips_foreign_load_class_set_magic( load_class, vips__pdf_magic );
 	load_class->header = vips_foreign_load_pdf_buffer_header;
 
 	VIPS_ARG_BOXED( class, "buffer", 1, 
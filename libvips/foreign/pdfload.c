@@ -14,6 +14,8 @@
  * 	- shut down the input file as soon as we can 
  * 19/9/19
  * 	- reopen the input if we minimised too early
+ * 19/10/19
+ * 	- render on many threads, each with its own document
  */
 
 /*
@@ -106,14 +108,21 @@ typedef struct _VipsForeignLoadPdf {
 	 */
 	VipsArrayDouble *background;
 
-	/* Poppler is not thread-safe, so we run inside a single-threaded
-	 * cache. On the plus side, this means we only need one @page pointer,
-	 * even though we change this during _generate().
+	/* The document we read the header from. 
 	 */
 	PopplerDocument *doc;
 	PopplerPage *page;
 	int current_page;
 
+	/* A poppler document is not thread-safe, but separate documents can
+	 * render at the same time. Each render thread takes a document from
+	 * this pool of idle documents, or opens a new one, and returns it
+	 * when it's done. The pool can't grow larger than the number of 
+	 * threads.
+	 */
+	GMutex *lock;
+	GSList *docs;
+
 	/* Doc has this many pages. 
 	 */
 	int n_pages;
@@ -136,6 +145,10 @@ typedef struct _VipsForeignLoadPdfClass {
 	int (*open)( VipsForeignLoadPdf *pdf );
 
 	void (*close)( VipsForeignLoadPdf *pdf );
+
+	/* Open a new document on our source, or NULL for error.
+	 */
+	PopplerDocument *(*new_doc)( VipsForeignLoadPdf *pdf );
 } VipsForeignLoadPdfClass;
 
 G_DEFINE_ABSTRACT_TYPE( VipsForeignLoadPdf, vips_foreign_load_pdf, 
@@ -153,6 +166,22 @@ vips_foreign_load_pdf_dispose( GObject *gobject )
 		dispose( gobject );
 }
 
+static void
+vips_foreign_load_pdf_finalize( GObject *gobject )
+{
+	VipsForeignLoadPdf *pdf = VIPS_FOREIGN_LOAD_PDF( gobject );
+
+	/* Render threads can return their documents to the pool after we've
+	 * been disposed. 
+	 */
+	g_slist_free_full( pdf->docs, g_object_unref );
+	pdf->docs = NULL;
+	VIPS_FREEF( vips_g_mutex_free, pdf->lock );
+
+	G_OBJECT_CLASS( vips_foreign_load_pdf_parent_class )->
+		finalize( gobject );
+}
+
 static int
 vips_foreign_load_pdf_build( VipsObject *object )
 {
@@ -374,12 +403,93 @@ vips_foreign_load_pdf_minimise( VipsObject *object, VipsForeignLoadPdf *pdf )
 	class->close( pdf ); 
 }
 
+/* A render thread's document and current page.
+ */
+typedef struct _VipsForeignLoadPdfRender {
+	VipsForeignLoadPdf *pdf;
+
+	PopplerDocument *doc;
+	PopplerPage *page;
+	int current_page;
+} VipsForeignLoadPdfRender;
+
+static void *
+vips_foreign_load_pdf_start( VipsImage *out, void *a, void *b )
+{
+	VipsForeignLoadPdf *pdf = VIPS_FOREIGN_LOAD_PDF( a );
+	VipsForeignLoadPdfClass *class = VIPS_FOREIGN_LOAD_PDF_GET_CLASS( pdf );
+
+	VipsForeignLoadPdfRender *render;
+
+	render = g_new( VipsForeignLoadPdfRender, 1 );
+	render->pdf = pdf;
+	render->doc = NULL;
+	render->page = NULL;
+	render->current_page = -1;
+
+	g_mutex_lock( pdf->lock );
+	if( pdf->docs ) {
+		render->doc = (PopplerDocument *) pdf->docs->data;
+		pdf->docs = g_slist_delete_link( pdf->docs, pdf->docs );
+	}
+	else
+		render->doc = class->new_doc( pdf );
+	g_mutex_unlock( pdf->lock );
+
+	if( !render->doc ) {
+		g_free( render );
+		return( NULL );
+	}
+
+	return( render );
+}
+
+static int
+vips_foreign_load_pdf_stop( void *seq, void *a, void *b )
+{
+	VipsForeignLoadPdfRender *render = (VipsForeignLoadPdfRender *) seq;
+	VipsForeignLoadPdf *pdf = render->pdf;
+
+	VIPS_UNREF( render->page );
+
+	g_mutex_lock( pdf->lock );
+	pdf->docs = g_slist_prepend( pdf->docs, render->doc );
+	g_mutex_unlock( pdf->lock );
+
+	g_free( render );
+
+	return( 0 );
+}
+
+static int
+vips_foreign_load_pdf_render_get_page( VipsForeignLoadPdfRender *render, 
+	int page_no )
+{
+	if( render->current_page != page_no ||
+		!render->page ) { 
+		VipsObjectClass *class = VIPS_OBJECT_GET_CLASS( render->pdf );
+
+		VIPS_UNREF( render->page );
+		render->current_page = -1;
+
+		if( !(render->page = poppler_document_get_page( render->doc, 
+			page_no )) ) {
+			vips_error( class->nickname, 
+				_( "unable to load page %d" ), page_no );
+			return( -1 ); 
+		}
+		render->current_page = page_no;
+	}
+
+	return( 0 );
+}
+
 static int
 vips_foreign_load_pdf_generate( VipsRegion *or, 
 	void *seq, void *a, void *b, gboolean *stop )
 {
+	VipsForeignLoadPdfRender *render = (VipsForeignLoadPdfRender *) seq;
 	VipsForeignLoadPdf *pdf = VIPS_FOREIGN_LOAD_PDF( a );
-	VipsForeignLoadPdfClass *class = VIPS_FOREIGN_LOAD_PDF_GET_CLASS( pdf );
 	VipsRect *r = &or->valid;
 
 	int top;
@@ -392,11 +502,6 @@ vips_foreign_load_pdf_generate( VipsRegion *or,
 		r->left, r->top, r->width, r->height ); 
 	 */
 
-	/* We may have been minimised. Make sure the doc is open.
-	 */
-	if( class->open( pdf ) )
-		return( -1 );
-
 	/* Poppler won't always paint the background. 
 	 */
 	vips_region_paint_pel( or, r, pdf->ink ); 
@@ -430,12 +535,13 @@ vips_foreign_load_pdf_generate( VipsRegion *or,
 			(pdf->pages[i].left - rect.left) / pdf->scale, 
 			(pdf->pages[i].top - rect.top) / pdf->scale );
 
-		/* poppler is single-threaded, but we don't need to lock since 
-		 * we're running inside a non-threaded tilecache.
+		/* This thread has its own document, so we don't need to 
+		 * lock.
 		 */
-		if( vips_foreign_load_pdf_get_page( pdf, pdf->page_no + i ) )
+		if( vips_foreign_load_pdf_render_get_page( render, 
+			pdf->page_no + i ) )
 			return( -1 ); 
-		poppler_page_render( pdf->page, cr );
+		poppler_page_render( render->page, cr );
 
 		cairo_destroy( cr );
 
@@ -461,13 +567,12 @@ vips_foreign_load_pdf_load( VipsForeignLoad *load )
 	VipsImage **t = (VipsImage **) 
 		vips_object_local_array( (VipsObject *) load, 2 );
 
+	int tile_height;
+
 #ifdef DEBUG
 	printf( "vips_foreign_load_pdf_load: %p\n", pdf );
 #endif /*DEBUG*/
 
-	if( class->open( pdf ) )
-		return( -1 );
-
 	/* Read to this image, then cache to out, see below.
 	 */
 	t[0] = vips_image_new(); 
@@ -477,18 +582,36 @@ vips_foreign_load_pdf_load( VipsForeignLoad *load )
 	g_signal_connect( t[0], "minimise", 
 		G_CALLBACK( vips_foreign_load_pdf_minimise ), pdf ); 
 
+	/* The header closed the doc, but we need it again for the metadata.
+	 * Render threads open their own docs, so we can close it straight
+	 * afterwards.
+	 */
+	if( class->open( pdf ) )
+		return( -1 );
 	vips_foreign_load_pdf_set_image( pdf, t[0] ); 
+	class->close( pdf );
+
 	if( vips_image_generate( t[0], 
-		NULL, vips_foreign_load_pdf_generate, NULL, pdf, NULL ) )
+		vips_foreign_load_pdf_start, 
+		vips_foreign_load_pdf_generate, 
+		vips_foreign_load_pdf_stop, 
+		pdf, NULL ) )
 		return( -1 );
 
 	/* Don't use tilecache to keep the number of calls to
-	 * pdf_page_render() low. Don't thread the cache, we rely on
-	 * locking to keep pdf single-threaded. Use a large strip size to
-	 * (again) keep the number of calls to page_render low. 
+	 * pdf_page_render() low. Use a large strip size to (again) keep the 
+	 * number of calls to page_render low, but make sure there are enough 
+	 * strips to keep all threads busy.
+	 *
+	 * Each thread has its own document, so the cache can be threaded and
+	 * strips can render in parallel.
 	 */
+	tile_height = VIPS_MIN( 5000, pdf->pages[0].height );
+	tile_height = VIPS_MIN( tile_height, 
+		VIPS_MAX( 500, pdf->image.height / vips_concurrency_get() ) );
 	if( vips_linecache( t[0], &t[1],
-		"tile_height", VIPS_MIN( 5000, pdf->pages[0].height ), 
+		"tile_height", tile_height,
+		"threaded", TRUE,
 		NULL ) ) 
 		return( -1 );
 	if( vips_image_write( t[1], load->real ) ) 
@@ -512,6 +635,14 @@ vips_foreign_load_pdf_close( VipsForeignLoadPdf *pdf )
 
 	VIPS_UNREF( pdf->page );
 	VIPS_UNREF( pdf->doc );
+
+	/* Any render threads still running keep their documents and return 
+	 * them later.
+	 */
+	g_mutex_lock( pdf->lock );
+	g_slist_free_full( pdf->docs, g_object_unref );
+	pdf->docs = NULL;
+	g_mutex_unlock( pdf->lock );
 }
 
 static void
@@ -522,6 +653,7 @@ vips_foreign_load_pdf_class_init( VipsForeignLoadPdfClass *class )
 	VipsForeignLoadClass *load_class = (VipsForeignLoadClass *) class;
 
 	gobject_class->dispose = vips_foreign_load_pdf_dispose;
+	gobject_class->finalize = vips_foreign_load_pdf_finalize;
 	gobject_class->set_property = vips_object_set_property;
 	gobject_class->get_property = vips_object_get_property;
 
@@ -583,6 +715,7 @@ vips_foreign_load_pdf_init( VipsForeignLoadPdf *pdf )
 	pdf->n = 1;
 	pdf->current_page = -1;
 	pdf->background = vips_array_double_newv( 1, 255.0 );
+	pdf->lock = vips_g_mutex_new();
 }
 
 typedef struct _VipsForeignLoadPdfFile {
@@ -629,19 +762,19 @@ static const char *vips_foreign_pdf_suffs[] = {
 	NULL
 };
 
-static int
-vips_foreign_load_pdf_file_open( VipsForeignLoadPdf *pdf )
+static PopplerDocument *
+vips_foreign_load_pdf_file_new_doc( VipsForeignLoadPdf *pdf )
 {
 	VipsForeignLoadPdfFile *file = (VipsForeignLoadPdfFile *) pdf;
 
 	GError *error = NULL;
+	PopplerDocument *doc;
 
 #ifdef DEBUG
-	printf( "vips_foreign_load_pdf_file_open: %s\n", file->filename );
+	printf( "vips_foreign_load_pdf_file_new_doc: %s\n", file->filename );
 #endif /*DEBUG*/
 
-	if( !file->uri &&
-		file->filename ) { 
+	if( !file->uri ) { 
 		char *path;
 
 		/* We need an absolute path for a URI.
@@ -650,19 +783,27 @@ vips_foreign_load_pdf_file_open( VipsForeignLoadPdf *pdf )
 		if( !(file->uri = g_filename_to_uri( path, NULL, &error )) ) { 
 			g_free( path );
 			vips_g_error( &error );
-			return( -1 ); 
+			return( NULL ); 
 		}
 		g_free( path );
 	}
 
-	if( !pdf->doc &&
-		file->uri &&
-		!(pdf->doc = poppler_document_new_from_file( 
-			file->uri, NULL, &error )) ) { 
+	if( !(doc = poppler_document_new_from_file( 
+		file->uri, NULL, &error )) ) { 
 		vips_g_error( &error );
-		return( -1 ); 
+		return( NULL ); 
 	}
 
+	return( doc );
+}
+
+static int
+vips_foreign_load_pdf_file_open( VipsForeignLoadPdf *pdf )
+{
+	if( !pdf->doc &&
+		!(pdf->doc = vips_foreign_load_pdf_file_new_doc( pdf )) )
+		return( -1 ); 
+
 	return( VIPS_FOREIGN_LOAD_PDF_CLASS(
 		vips_foreign_load_pdf_file_parent_class )->open( pdf ) );
 }
@@ -685,9 +826,11 @@ vips_foreign_load_pdf_file_class_init(
 	foreign_class->suffs = vips_foreign_pdf_suffs;
 
 	load_class->is_a = vips_foreign_load_pdf_is_a;
+	vips_foreign_load_class_set_magic( load_class, vips__pdf_magic );
 	load_class->header = vips_foreign_load_pdf_file_header;
 
 	class->open = vips_foreign_load_pdf_file_open;
+	class->new_doc = vips_foreign_load_pdf_file_new_doc;
 
 	VIPS_ARG_STRING( class, "filename", 1, 
 		_( "Filename" ),
@@ -717,20 +860,30 @@ typedef VipsForeignLoadPdfClass VipsForeignLoadPdfBufferClass;
 G_DEFINE_TYPE( VipsForeignLoadPdfBuffer, vips_foreign_load_pdf_buffer, 
 	vips_foreign_load_pdf_get_type() );
 
-static int
-vips_foreign_load_pdf_buffer_open( VipsForeignLoadPdf *pdf )
+static PopplerDocument *
+vips_foreign_load_pdf_buffer_new_doc( VipsForeignLoadPdf *pdf )
 {
 	VipsForeignLoadPdfBuffer *buffer = (VipsForeignLoadPdfBuffer *) pdf;
 
 	GError *error = NULL;
+	PopplerDocument *doc;
 
-	if( !pdf->doc &&
-		!(pdf->doc = poppler_document_new_from_data( 
+	if( !(doc = poppler_document_new_from_data( 
 		buffer->buf->data, buffer->buf->length, NULL, &error )) ) { 
 		vips_g_error( &error );
-		return( -1 ); 
+		return( NULL ); 
 	}
 
+	return( doc );
+}
+
+static int
+vips_foreign_load_pdf_buffer_open( VipsForeignLoadPdf *pdf )
+{
+	if( !pdf->doc &&
+		!(pdf->doc = vips_foreign_load_pdf_buffer_new_doc( pdf )) )
+		return( -1 ); 
+
 	return( VIPS_FOREIGN_LOAD_PDF_CLASS(
 		vips_foreign_load_pdf_buffer_parent_class )->open( pdf ) );
 }
@@ -749,8 +902,10 @@ vips_foreign_load_pdf_buffer_class_init(
 	object_class->nickname = "pdfload_buffer";
 
 	load_class->is_a_buffer = vips_foreign_load_pdf_is_a_buffer;
+	vips_foreign_load_class_set_magic( load_class, vips__pdf_magic );
 
 	class->open = vips_foreign_load_pdf_buffer_open;
+	class->new_doc = vips_foreign_load_pdf_buffer_new_doc;
 
 	VIPS_ARG_BOXED( class, "buffer", 1, 
 		_( "Buffer" ),
@@ -768,6 +923,13 @@ vips_foreign_load_pdf_buffer_init( VipsForeignLoadPdfBuffer *buffer )
 
 #endif /*HAVE_POPPLER*/
 
+/* Also used by the pdfium loader.
+ */
+const VipsForeignMagic vips__pdf_magic[] = {
+	{ 0, 4, "%PDF", NULL },
+	{ 0 }
+};
+
 /* Also used by the pdfium loader.
  */
 gboolean
@@ -45,6 +45,11 @@ extern "C" {
 )
 #endif /*HAVE_CHECKED_MUL*/
 
+int vips__tiled_read( const char *filename, VipsImage *out );
+int vips__tiled_write( VipsImage *in, const char *filename,
+	int tile_width, int tile_height,
+	VipsForeignVipsCompression compression, int level );
+
 void vips__tiff_init( void );
 
 int vips__tiff_write( VipsImage *in, const char *filename, 
@@ -81,6 +86,8 @@ int vips__tiff_write_buf( VipsImage *in,
 
 gboolean vips__istiff_stream( VipsStreami *streami );
 gboolean vips__istifftiled_stream( VipsStreami *streami );
+gboolean vips__istiffmappable_stream( VipsStreami *streami, 
+	int page, int n );
 int vips__tiff_read_header_stream( VipsStreami *streami, VipsImage *out, 
 	int page, int n, gboolean autorotate );
 int vips__tiff_read_stream( VipsStreami *streami, VipsImage *out,
@@ -109,6 +116,7 @@ int vips__matrix_read_header( const char *filename,
 int vips__matrix_ismatrix( const char *filename );
 VipsImage *vips__matrix_read_file( FILE *fp );
 VipsImage *vips__matrix_read( const char *filename );
+int vips__matrix_read_sequential( const char *filename, VipsImage *out );
 int vips__matrix_write( VipsImage *in, const char *filename );
 int vips__matrix_write_file( VipsImage *in, FILE *fp );
 
@@ -165,20 +173,23 @@ int vips__jpeg_write_stream( VipsImage *in, VipsStreamo *streamo,
 	int quant_table );
 
 int vips__jpeg_read_stream( VipsStreami *streami, VipsImage *out,
-	gboolean header_only, int shrink, int fail, gboolean autorotate );
+	gboolean header_only, int shrink, int scans, int fail, 
+	gboolean autorotate );
 int vips__isjpeg_stream( VipsStreami *streami );
 
 int vips__png_ispng_stream( VipsStreami *streami );
-int vips__png_header_stream( VipsStreami *streami, VipsImage *out );
+int vips__png_header_stream( VipsStreami *streami, VipsImage *out, 
+	int shrink );
 int vips__png_read_stream( VipsStreami *streami, VipsImage *out, 
-	gboolean fail );
+	int shrink, int passes, gboolean fail );
 gboolean vips__png_isinterlaced_stream( VipsStreami *streami );
 extern const char *vips__png_suffs[];
 
 int vips__png_write_stream( VipsImage *in, VipsStreamo *streamo,
 	int compress, int interlace, const char *profile,
 	VipsForeignPngFilter filter, gboolean strip,
-	gboolean palette, int colours, int Q, double dither );
+	gboolean palette, int colours, int Q, double dither,
+	gboolean parallel );
 
 /* Map WEBP metadata names to vips names.
  */
@@ -204,6 +215,7 @@ int vips__webp_write_stream( VipsImage *image, VipsStreamo *streamo,
 	gboolean smart_subsample, gboolean near_lossless,
 	int alpha_q, int reduction_effort,
 	gboolean min_size, int kmin, int kmax,
+	int thread_level, gboolean frame_parallel,
 	gboolean strip );
 
 int vips__openslide_isslide( const char *filename );
@@ -211,12 +223,17 @@ int vips__openslide_read_header( const char *filename, VipsImage *out,
 	int level, gboolean autocrop, 
 	char *associated, gboolean attach_associated );
 int vips__openslide_read( const char *filename, VipsImage *out, 
-	int level, gboolean autocrop, gboolean attach_associated );
+	int level, gboolean autocrop, gboolean attach_associated, 
+	gboolean cache );
+void vips__openslide_cache_set_max_mem( size_t max_mem );
+size_t vips__openslide_cache_get_max_mem( void );
+void vips__openslide_cache_shutdown( void );
 int vips__openslide_read_associated( const char *filename, VipsImage *out, 
 	const char *associated );
 
 gboolean vips_foreign_load_pdf_is_a_buffer( const void *buf, size_t len );
 gboolean vips_foreign_load_pdf_is_a( const char *filename );
+extern const VipsForeignMagic vips__pdf_magic[];
 
 int vips__quantise_image( VipsImage *in, 
 	VipsImage **index_out, VipsImage **palette_out,
@@ -2,6 +2,9 @@
  *
  * 5/12/11
  * 	- from tiffload.c
+ * 19/10/19
+ * 	- add @passes
+ * 	- add @shrink
  */
 
 /*
@@ -52,6 +55,13 @@
 
 #ifdef HAVE_PNG
 
+/* PNG files start with an 8-byte signature.
+ */
+static const VipsForeignMagic vips_foreign_load_png_magic[] = {
+	{ 0, 8, "\211PNG\r\n\032\n", NULL },
+	{ 0 }
+};
+
 typedef struct _VipsForeignLoadPngStream {
 	VipsForeignLoad parent_object;
 
@@ -59,6 +69,14 @@ typedef struct _VipsForeignLoadPngStream {
 	 */
 	VipsStreami *streami;
 
+	/* Stop interlaced images after this many passes.
+	 */
+	int passes;
+
+	/* Shrink by this much during load.
+	 */
+	int shrink;
+
 } VipsForeignLoadPngStream;
 
 typedef VipsForeignLoadClass VipsForeignLoadPngStreamClass;
@@ -87,7 +105,8 @@ vips_foreign_load_png_stream_header( VipsForeignLoad *load )
 {
 	VipsForeignLoadPngStream *stream = (VipsForeignLoadPngStream *) load;
 
-	if( vips__png_header_stream( stream->streami, load->out ) )
+	if( vips__png_header_stream( stream->streami, load->out, 
+		stream->shrink ) )
 		return( -1 );
 
 	return( 0 );
@@ -98,7 +117,8 @@ vips_foreign_load_png_stream_load( VipsForeignLoad *load )
 {
 	VipsForeignLoadPngStream *stream = (VipsForeignLoadPngStream *) load;
 
-	if( vips__png_read_stream( stream->streami, load->real, load->fail ) )
+	if( vips__png_read_stream( stream->streami, load->real, 
+		stream->shrink, stream->passes, load->fail ) )
 		return( -1 );
 
 	return( 0 );
@@ -118,6 +138,8 @@ vips_foreign_load_png_stream_class_init( VipsForeignLoadPngStreamClass *class )
 	object_class->description = _( "load png from stream" );
 
 	load_class->is_a_stream = vips__png_ispng_stream;
+	vips_foreign_load_class_set_magic( load_class, 
+		vips_foreign_load_png_magic );
 	load_class->get_flags = vips_foreign_load_png_stream_get_flags;
 	load_class->header = vips_foreign_load_png_stream_header;
 	load_class->load = vips_foreign_load_png_stream_load;
@@ -129,11 +151,26 @@ vips_foreign_load_png_stream_class_init( VipsForeignLoadPngStreamClass *class )
 		G_STRUCT_OFFSET( VipsForeignLoadPngStream, streami ),
 		VIPS_TYPE_STREAMI );
 
+	VIPS_ARG_INT( class, "passes", 20, 
+		_( "Passes" ), 
+		_( "Stop interlaced images after this many passes" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsForeignLoadPngStream, passes ),
+		0, 7, 0 );
+
+	VIPS_ARG_INT( class, "shrink", 21, 
+		_( "Shrink" ), 
+		_( "Shrink factor on load" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsForeignLoadPngStream, shrink ),
+		1, 16, 1 );
+
 }
 
 static void
 vips_foreign_load_png_stream_init( VipsForeignLoadPngStream *stream )
 {
+	stream->shrink = 1;
 }
 
 typedef struct _VipsForeignLoadPng {
@@ -143,6 +180,14 @@ typedef struct _VipsForeignLoadPng {
 	 */
 	char *filename; 
 
+	/* Stop interlaced images after this many passes.
+	 */
+	int passes;
+
+	/* Shrink by this much during load.
+	 */
+	int shrink;
+
 } VipsForeignLoadPng;
 
 typedef VipsForeignLoadClass VipsForeignLoadPngClass;
@@ -201,7 +246,7 @@ vips_foreign_load_png_header( VipsForeignLoad *load )
 
 	if( !(streami = vips_streami_new_from_file( png->filename )) )
 		return( -1 );
-	if( vips__png_header_stream( streami, load->out ) ) {
+	if( vips__png_header_stream( streami, load->out, png->shrink ) ) {
 		VIPS_UNREF( streami );
 		return( -1 );
 	}
@@ -219,7 +264,8 @@ vips_foreign_load_png_load( VipsForeignLoad *load )
 
 	if( !(streami = vips_streami_new_from_file( png->filename )) )
 		return( -1 );
-	if( vips__png_read_stream( streami, load->real, load->fail ) ) {
+	if( vips__png_read_stream( streami, load->real, 
+		png->shrink, png->passes, load->fail ) ) {
 		VIPS_UNREF( streami );
 		return( -1 );
 	}
@@ -249,6 +295,8 @@ vips_foreign_load_png_class_init( VipsForeignLoadPngClass *class )
 	foreign_class->priority = 200;
 
 	load_class->is_a = vips_foreign_load_png_is_a;
+	vips_foreign_load_class_set_magic( load_class, 
+		vips_foreign_load_png_magic );
 	load_class->get_flags_filename = 
 		vips_foreign_load_png_get_flags_filename;
 	load_class->get_flags = vips_foreign_load_png_get_flags;
@@ -261,11 +309,26 @@ vips_foreign_load_png_class_init( VipsForeignLoadPngClass *class )
 		VIPS_ARGUMENT_REQUIRED_INPUT, 
 		G_STRUCT_OFFSET( VipsForeignLoadPng, filename ),
 		NULL );
+
+	VIPS_ARG_INT( class, "passes", 20, 
+		_( "Passes" ), 
+		_( "Stop interlaced images after this many passes" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsForeignLoadPng, passes ),
+		0, 7, 0 );
+
+	VIPS_ARG_INT( class, "shrink", 21, 
+		_( "Shrink" ), 
+		_( "Shrink factor on load" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsForeignLoadPng, shrink ),
+		1, 16, 1 );
 }
 
 static void
 vips_foreign_load_png_init( VipsForeignLoadPng *png )
 {
+	png->shrink = 1;
 }
 
 typedef struct _VipsForeignLoadPngBuffer {
@@ -275,6 +338,14 @@ typedef struct _VipsForeignLoadPngBuffer {
 	 */
 	VipsArea *buf;
 
+	/* Stop interlaced images after this many passes.
+	 */
+	int passes;
+
+	/* Shrink by this much during load.
+	 */
+	int shrink;
+
 } VipsForeignLoadPngBuffer;
 
 typedef VipsForeignLoadClass VipsForeignLoadPngBufferClass;
@@ -329,7 +400,8 @@ vips_foreign_load_png_buffer_header( VipsForeignLoad *load )
 	if( !(streami = vips_streami_new_from_memory( buffer->buf->data, 
 		buffer->buf->length )) ) 
 		return( -1 );
-	if( vips__png_header_stream( streami, load->out ) ) {
+	if( vips__png_header_stream( streami, load->out, 
+		buffer->shrink ) ) {
 		VIPS_UNREF( streami );
 		return( -1 );
 	}
@@ -348,7 +420,8 @@ vips_foreign_load_png_buffer_load( VipsForeignLoad *load )
 	if( !(streami = vips_streami_new_from_memory( buffer->buf->data, 
 		buffer->buf->length )) ) 
 		return( -1 );
-	if( vips__png_read_stream( streami, load->real, load->fail ) ) {
+	if( vips__png_read_stream( streami, load->real, 
+		buffer->shrink, buffer->passes, load->fail ) ) {
 		VIPS_UNREF( streami );
 		return( -1 );
 	}
@@ -371,6 +444,8 @@ vips_foreign_load_png_buffer_class_init( VipsForeignLoadPngBufferClass *class )
 	object_class->description = _( "load png from buffer" );
 
 	load_class->is_a_buffer = vips_foreign_load_png_buffer_is_a_buffer;
+	vips_foreign_load_class_set_magic( load_class, 
+		vips_foreign_load_png_magic );
 	load_class->get_flags = vips_foreign_load_png_buffer_get_flags;
 	load_class->header = vips_foreign_load_png_buffer_header;
 	load_class->load = vips_foreign_load_png_buffer_load;
@@ -382,11 +457,26 @@ vips_foreign_load_png_buffer_class_init( VipsForeignLoadPngBufferClass *class )
 		G_STRUCT_OFFSET( VipsForeignLoadPngBuffer, buf ),
 		VIPS_TYPE_BLOB );
 
+	VIPS_ARG_INT( class, "passes", 20, 
+		_( "Passes" ), 
+		_( "Stop interlaced images after this many passes" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsForeignLoadPngBuffer, passes ),
+		0, 7, 0 );
+
+	VIPS_ARG_INT( class, "shrink", 21, 
+		_( "Shrink" ), 
+		_( "Shrink factor on load" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsForeignLoadPngBuffer, shrink ),
+		1, 16, 1 );
+
 }
 
 static void
 vips_foreign_load_png_buffer_init( VipsForeignLoadPngBuffer *buffer )
 {
+	buffer->shrink = 1;
 }
 
 #endif /*HAVE_PNG*/
@@ -397,9 +487,26 @@ vips_foreign_load_png_buffer_init( VipsForeignLoadPngBuffer *buffer )
  * @out: (out): decompressed image
  * @...: %NULL-terminated list of optional named arguments
  *
+ * Optional arguments:
+ *
+ * * @passes: %gint, only decode this many passes of interlaced images
+ * * @shrink: %gint, shrink by this much on load
+ *
  * Read a PNG file into a VIPS image. It can read all png images, including 8-
  * and 16-bit images, 1 and 3 channel, with and without an alpha channel.
  *
+ * Set @passes to stop decoding Adam7 interlaced images after that many 
+ * passes. The image is the full size, but each pixel that has been decoded is
+ * repeated over the block it stands for, and the rest of the file is not
+ * read. After pass 1 the image has 1/8 of the resolution, after pass 3 1/4, 
+ * and after pass 5 1/2. The default, 0, decodes all passes. @passes has no 
+ * effect on non-interlaced images.
+ *
+ * @shrink means shrink by this integer factor during load. Each block of 
+ * @shrink by @shrink pixels is averaged as rows are decoded, so the full-size
+ * image is never made. Pixels at the right and bottom edges which do not fill
+ * a whole block are dropped. 
+ *
  * Any ICC profile is read and attached to the VIPS image. It also supports
  * XMP metadata.
  *
@@ -6,6 +6,8 @@
  * 	- compression should be 0-9, not 1-10
  * 20/6/18 [felixbuenemann]
  * 	- support png8 palette write with palette, colours, Q, dither
+ * 19/10/19
+ * 	- add @parallel
  */
 
 /*
@@ -66,6 +68,7 @@ typedef struct _VipsForeignSavePng {
 	int colours;
 	int Q;
 	double dither;
+	gboolean parallel;
 } VipsForeignSavePng;
 
 typedef VipsForeignSaveClass VipsForeignSavePngClass;
@@ -167,6 +170,13 @@ vips_foreign_save_png_class_init( VipsForeignSavePngClass *class )
 		G_STRUCT_OFFSET( VipsForeignSavePng, dither ),
 		0.0, 1.0, 1.0 );
 
+	VIPS_ARG_BOOL( class, "parallel", 17,
+		_( "Parallel" ),
+		_( "Compress with many threads" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsForeignSavePng, parallel ),
+		FALSE );
+
 }
 
 static void
@@ -203,7 +213,8 @@ vips_foreign_save_png_stream_build( VipsObject *object )
 
 	if( vips__png_write_stream( save->ready, stream->streamo,
 		png->compression, png->interlace, png->profile, png->filter,
-		save->strip, png->palette, png->colours, png->Q, png->dither ) )
+		save->strip, png->palette, png->colours, png->Q, png->dither,
+		png->parallel ) )
 		return( -1 );
 
 	return( 0 );
@@ -265,7 +276,7 @@ vips_foreign_save_png_file_build( VipsObject *object )
 	if( vips__png_write_stream( save->ready, streamo, 
 		png->compression, png->interlace, 
 		png->profile, png->filter, save->strip, png->palette,
-		png->colours, png->Q, png->dither ) ) {
+		png->colours, png->Q, png->dither, png->parallel ) ) {
 		VIPS_UNREF( streamo );
 		return( -1 );
 	}
@@ -331,7 +342,7 @@ vips_foreign_save_png_buffer_build( VipsObject *object )
 	if( vips__png_write_stream( save->ready, streamo,
 		png->compression, png->interlace, png->profile, png->filter,
 		save->strip, png->palette, png->colours, png->Q, 
-		png->dither ) ) {
+		png->dither, png->parallel ) ) {
 		VIPS_UNREF( streamo );
 		return( -1 );
 	}
@@ -389,6 +400,7 @@ vips_foreign_save_png_buffer_init( VipsForeignSavePngBuffer *buffer )
  * * @colours: %gint, max number of palette colours for quantisation
  * * @Q: %gint, quality for 8bpp quantisation (does not exceed @colours)
  * * @dither: %gdouble, amount of dithering for 8bpp quantization
+ * * @parallel: %gboolean, compress with many threads
  *
  * Write a VIPS image to a file as PNG.
  *
@@ -421,6 +433,12 @@ vips_foreign_save_png_buffer_init( VipsForeignSavePngBuffer *buffer )
  * @dither controls the amount of Floyd-Steinberg dithering.
  * This feature requires libvips to be compiled with libimagequant.
  *
+ * Set @parallel to %TRUE to compress with many threads. libvips will filter
+ * scanlines itself and deflate the image in independent chunks, each 
+ * primed with the previous 32kb of data, in the style of pigz. The output is
+ * a standard PNG, though usually very slightly larger. Interlaced images
+ * are always compressed with a single thread. 
+ *
  * XMP metadata is written to the XMP chunk. PNG comments are written to
  * separate text chunks.
  *
@@ -458,6 +476,7 @@ vips_pngsave( VipsImage *in, const char *filename, ... )
  * * @colours: %gint, max number of palette colours for quantisation
  * * @Q: %gint, quality for 8bpp quantisation (does not exceed @colours)
  * * @dither: %gdouble, amount of dithering for 8bpp quantization
+ * * @parallel: %gboolean, compress with many threads
  *
  * As vips_pngsave(), but save to a memory buffer. 
  *
@@ -513,6 +532,7 @@ vips_pngsave_buffer( VipsImage *in, void **buf, size_t *len, ... )
  * * @colours: max number of palette colours for quantisation
  * * @Q: quality for 8bpp quantisation (does not exceed @colours)
  * * @dither: amount of dithering for 8bpp quantization
+ * * @parallel: compress with many threads
  *
  * As vips_pngsave(), but save to a stream.
  *
@@ -35,6 +35,8 @@
  * 	- redone with streams
  * 	- sequential load, plus mmap for filename streams
  * 	- faster plus lower memory use
+ * 19/10/19
+ * 	- map file streams in windows, like .v files
  */
 
 /*
@@ -388,33 +390,56 @@ vips_foreign_load_ppm_header( VipsForeignLoad *load )
 }
 
 /* Read a ppm/pgm file using mmap().
+ *
+ * If the stream is a file, we can map it in windows, in the same way that we
+ * map .v files, and never need to map the whole thing. 
  */
 static int
 vips_foreign_load_ppm_map( VipsForeignLoadPpm *ppm, VipsImage *image )
 {
 	VipsImage **t = (VipsImage **)
                 vips_object_local_array( VIPS_OBJECT( ppm ), 3 );
+	const char *filename = 
+		vips_stream_filename( VIPS_STREAM( ppm->streami ) );
 
 	gint64 header_offset;
-	size_t length;
-	const void *data;
 
 	vips_bufis_unbuffer( ppm->bufis );
 	header_offset = vips_streami_seek( ppm->streami, 0, SEEK_CUR );
-	data = vips_streami_map( ppm->streami, &length );
-	if( header_offset < 0 || 
-		!data )
+	if( header_offset < 0 )
 		return( -1 );
-	data += header_offset;
-       	length -= header_offset;
 
-	if( !(t[0] = vips_image_new_from_memory( data, length,
-		ppm->width, ppm->height, ppm->bands, ppm->format )) )
-		return( -1 );
+	if( filename ) {
+		int sizeof_pel = 
+			ppm->bands * vips_format_sizeof( ppm->format );
+
+		if( !(t[0] = vips__image_new_from_file_raw( filename,
+			ppm->width, ppm->height, sizeof_pel, header_offset, 
+			TRUE )) ||
+			vips_copy( t[0], &t[1], 
+				"bands", ppm->bands, 
+				"format", ppm->format, 
+				"interpretation", ppm->interpretation, 
+				NULL ) )
+			return( -1 );
+	}
+	else {
+		size_t length;
+		const void *data;
+
+		if( !(data = vips_streami_map( ppm->streami, &length )) )
+			return( -1 );
+		data += header_offset;
+		length -= header_offset;
+
+		if( !(t[1] = vips_image_new_from_memory( data, length,
+			ppm->width, ppm->height, ppm->bands, ppm->format )) )
+			return( -1 );
+	}
 
-	if( vips__byteswap_bool( t[0], &t[1],
+	if( vips__byteswap_bool( t[1], &t[2],
                         vips_amiMSBfirst() != ppm->msb_first ) ||
-		vips_image_write( t[1], image ) ) 
+		vips_image_write( t[2], image ) ) 
 		return( -1 );
 
 	return( 0 );
@@ -0,0 +1,520 @@
+/* fast header probe
+ *
+ * 19/10/19
+ * 	- from foreign.c
+ */
+
+/*
+
+    This file is part of VIPS.
+
+    VIPS is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA
+
+ */
+
+/*
+
+    These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <vips/intl.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+#include <vips/debug.h>
+
+/* Loaders we have our own header parsers for. Set to NULL if the loader is
+ * not in this build, so we always fall back to the real loader.
+ */
+static const char *vips_foreign_probe_jpegload = NULL;
+static const char *vips_foreign_probe_pngload = NULL;
+
+static void *
+vips_foreign_probe_init( void *client )
+{
+	if( vips_type_find( "VipsOperation", "jpegload" ) )
+		vips_foreign_probe_jpegload = "jpegload";
+	if( vips_type_find( "VipsOperation", "pngload" ) )
+		vips_foreign_probe_pngload = "pngload";
+
+	return( NULL );
+}
+
+static int
+vips_foreign_probe_get16( const unsigned char *p, gboolean msb_first )
+{
+	if( msb_first )
+		return( p[0] << 8 | p[1] );
+	else
+		return( p[1] << 8 | p[0] );
+}
+
+static guint32
+vips_foreign_probe_get32( const unsigned char *p, gboolean msb_first )
+{
+	if( msb_first )
+		return( (guint32) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3] );
+	else
+		return( (guint32) p[3] << 24 | p[2] << 16 | p[1] << 8 | p[0] );
+}
+
+/* Find the orientation tag in a JPEG APP1 block. We only look in IFD0,
+ * like exif.c.
+ */
+static int
+vips_foreign_probe_exif_orientation( const unsigned char *data, size_t length )
+{
+	const unsigned char *p;
+	gboolean msb_first;
+	guint32 offset;
+	int n;
+	int i;
+
+	/* Skip "Exif\0\0", then there must be at least a TIFF header.
+	 */
+	if( length < 6 + 8 )
+		return( 1 );
+	p = data + 6;
+	length -= 6;
+
+	if( p[0] == 'I' && p[1] == 'I' )
+		msb_first = FALSE;
+	else if( p[0] == 'M' && p[1] == 'M' )
+		msb_first = TRUE;
+	else
+		return( 1 );
+
+	offset = vips_foreign_probe_get32( p + 4, msb_first );
+	if( offset > length - 2 )
+		return( 1 );
+	n = vips_foreign_probe_get16( p + offset, msb_first );
+
+	for( i = 0; i < n; i++ ) {
+		size_t pos = (size_t) offset + 2 + i * 12;
+		const unsigned char *entry = p + pos;
+
+		if( pos + 12 > length )
+			break;
+
+		/* Orientation is a SHORT, tag 0x112.
+		 */
+		if( vips_foreign_probe_get16( entry, msb_first ) == 0x112 &&
+			vips_foreign_probe_get16( entry + 2, msb_first ) == 3 )
+			return( VIPS_CLIP( 1,
+				vips_foreign_probe_get16( entry + 8,
+					msb_first ),
+				8 ) );
+	}
+
+	return( 1 );
+}
+
+/* Scan JPEG markers up to the start of scan.
+ */
+static int
+vips_foreign_probe_jpeg( FILE *fp, VipsForeignProbe *probe )
+{
+	unsigned char buf[65536];
+	gboolean seen_sof;
+
+	if( fseek( fp, 2, SEEK_SET ) )
+		return( -1 );
+
+	seen_sof = FALSE;
+	for(;;) {
+		int ch;
+		int marker;
+		int length;
+
+		/* Markers are any number of 0xff, then the marker code.
+		 */
+		if( (ch = getc( fp )) != 0xff )
+			return( -1 );
+		while( (ch = getc( fp )) == 0xff )
+			;
+		if( ch == EOF )
+			return( -1 );
+		marker = ch;
+
+		/* EOI, or start of scan. SOS must follow a SOF.
+		 */
+		if( marker == 0xd9 ||
+			marker == 0xda )
+			break;
+
+		/* Standalone markers have no length.
+		 */
+		if( marker == 0x01 ||
+			(marker >= 0xd0 && marker <= 0xd7) )
+			continue;
+
+		if( fread( buf, 1, 2, fp ) != 2 )
+			return( -1 );
+		length = vips_foreign_probe_get16( buf, TRUE ) - 2;
+		if( length < 0 )
+			return( -1 );
+
+		/* SOF0 - SOF15, except DHT, JPG and DAC.
+		 */
+		if( marker >= 0xc0 &&
+			marker <= 0xcf &&
+			marker != 0xc4 &&
+			marker != 0xc8 &&
+			marker != 0xcc ) {
+			if( length < 6 ||
+				fread( buf, 1, length, fp ) != (size_t) length )
+				return( -1 );
+
+			probe->height = vips_foreign_probe_get16( buf + 1, TRUE );
+			probe->width = vips_foreign_probe_get16( buf + 3, TRUE );
+			probe->bands = buf[5];
+			seen_sof = TRUE;
+		}
+		else if( marker == 0xe1 ) {
+			if( fread( buf, 1, length, fp ) != (size_t) length )
+				return( -1 );
+
+			if( length >= 6 &&
+				memcmp( buf, "Exif\0\0", 6 ) == 0 )
+				probe->orientation =
+					vips_foreign_probe_exif_orientation(
+						buf, length );
+		}
+		else if( marker == 0xe2 ) {
+			if( fread( buf, 1, length, fp ) != (size_t) length )
+				return( -1 );
+
+			if( length >= 12 &&
+				memcmp( buf, "ICC_PROFILE", 12 ) == 0 )
+				probe->icc = TRUE;
+		}
+		else if( fseek( fp, length, SEEK_CUR ) )
+			return( -1 );
+	}
+
+	/* A zero height means the height is in a DNL marker after the scan,
+	 * leave that to libjpeg.
+	 */
+	if( !seen_sof ||
+		probe->width <= 0 ||
+		probe->height <= 0 ||
+		(probe->bands != 1 && probe->bands != 3 && probe->bands != 4) )
+		return( -1 );
+
+	probe->loader = vips_foreign_probe_jpegload;
+	probe->format = VIPS_FORMAT_UCHAR;
+
+	return( 0 );
+}
+
+/* Scan PNG chunks up to the first IDAT.
+ */
+static int
+vips_foreign_probe_png( FILE *fp, VipsForeignProbe *probe )
+{
+	unsigned char buf[13];
+	int bit_depth;
+	int color_type;
+	gboolean alpha;
+
+	/* The signature, then IHDR must be the first chunk.
+	 */
+	if( fseek( fp, 8, SEEK_SET ) ||
+		fread( buf, 1, 8, fp ) != 8 ||
+		vips_foreign_probe_get32( buf, TRUE ) != 13 ||
+		memcmp( buf + 4, "IHDR", 4 ) != 0 ||
+		fread( buf, 1, 13, fp ) != 13 )
+		return( -1 );
+
+	probe->width = vips_foreign_probe_get32( buf, TRUE );
+	probe->height = vips_foreign_probe_get32( buf + 4, TRUE );
+	bit_depth = buf[8];
+	color_type = buf[9];
+
+	/* Skip the CRC.
+	 */
+	if( fseek( fp, 4, SEEK_CUR ) )
+		return( -1 );
+
+	alpha = FALSE;
+	for(;;) {
+		guint32 length;
+
+		if( fread( buf, 1, 8, fp ) != 8 )
+			return( -1 );
+		length = vips_foreign_probe_get32( buf, TRUE );
+
+		if( memcmp( buf + 4, "IDAT", 4 ) == 0 ||
+			memcmp( buf + 4, "IEND", 4 ) == 0 )
+			break;
+		if( memcmp( buf + 4, "iCCP", 4 ) == 0 )
+			probe->icc = TRUE;
+		if( memcmp( buf + 4, "tRNS", 4 ) == 0 )
+			alpha = TRUE;
+
+		if( length > 0x7fffffff ||
+			fseek( fp, (long) length + 4, SEEK_CUR ) )
+			return( -1 );
+	}
+
+	/* Must match the band calculation in vipspng.c.
+	 */
+	switch( color_type ) {
+	case 0:
+		probe->bands = 1;
+		break;
+
+	case 2:
+	case 3:
+		probe->bands = 3;
+		break;
+
+	case 4:
+		probe->bands = 1;
+		alpha = TRUE;
+		break;
+
+	case 6:
+		probe->bands = 3;
+		alpha = TRUE;
+		break;
+
+	default:
+		return( -1 );
+	}
+	if( alpha )
+		probe->bands += 1;
+
+	if( probe->width <= 0 ||
+		probe->height <= 0 ||
+		probe->width > VIPS_MAX_COORD ||
+		probe->height > VIPS_MAX_COORD )
+		return( -1 );
+
+	probe->loader = vips_foreign_probe_pngload;
+	probe->format = bit_depth > 8 ? VIPS_FORMAT_USHORT : VIPS_FORMAT_UCHAR;
+
+	return( 0 );
+}
+
+/* Try one of our own parsers.
+ */
+static int
+vips_foreign_probe_fast( const char *filename, VipsForeignProbe *probe )
+{
+	static const unsigned char png_signature[] =
+		{ 137, 80, 78, 71, 13, 10, 26, 10 };
+
+	FILE *fp;
+	unsigned char buf[8];
+	int result;
+
+	/* Don't use vips__file_open_read(), it logs an error. We fall back to
+	 * the real loader on failure, and that will report the problem.
+	 */
+	if( !(fp = g_fopen( filename, "rb" )) ) 
+		return( -1 );
+
+	result = -1;
+	if( fread( buf, 1, 8, fp ) == 8 ) {
+		if( vips_foreign_probe_jpegload &&
+			buf[0] == 0xff &&
+			buf[1] == 0xd8 &&
+			buf[2] == 0xff )
+			result = vips_foreign_probe_jpeg( fp, probe );
+		else if( vips_foreign_probe_pngload &&
+			memcmp( buf, png_signature, 8 ) == 0 )
+			result = vips_foreign_probe_png( fp, probe );
+	}
+
+	fclose( fp );
+
+	return( result );
+}
+
+/* Open with the real loader. This will only read the header, but it needs to
+ * build a load operation and an image.
+ */
+static int
+vips_foreign_probe_load( const char *filename, VipsForeignProbe *probe )
+{
+	const char *loader;
+	VipsImage *image;
+	int orientation;
+
+	if( !(loader = vips_foreign_find_load( filename )) ||
+		!(image = vips_image_new_from_file( filename,
+			"access", VIPS_ACCESS_SEQUENTIAL,
+			NULL )) )
+		return( -1 );
+
+	probe->loader = loader;
+	probe->width = image->Xsize;
+	probe->height = image->Ysize;
+	probe->bands = image->Bands;
+	probe->format = image->BandFmt;
+	if( vips_image_get_typeof( image, VIPS_META_ORIENTATION ) &&
+		!vips_image_get_int( image,
+			VIPS_META_ORIENTATION, &orientation ) )
+		probe->orientation = VIPS_CLIP( 1, orientation, 8 );
+	probe->icc = vips_image_get_typeof( image, VIPS_META_ICC_NAME ) != 0;
+
+	g_object_unref( image );
+
+	return( 0 );
+}
+
+/**
+ * VipsForeignProbe:
+ * @loader: nickname of the loader that would be used for this file
+ * @width: image width, in pixels
+ * @height: image height, in pixels
+ * @bands: number of bands
+ * @format: band format
+ * @orientation: the EXIF orientation, 1 if there is no orientation tag
+ * @icc: %TRUE if the file has an embedded ICC profile
+ *
+ * The core header fields of an image file, as found by vips_foreign_probe().
+ * These are the fields that the loader would set on the image it made.
+ */
+
+/**
+ * vips_foreign_probe:
+ * @filename: file to probe
+ * @probe: (out): fill this with the file's header fields
+ *
+ * Find the core header fields of a file, as quickly as possible.
+ *
+ * JPEG and PNG files are probed by scanning their markers or chunks directly,
+ * without making an image or a load operation, and without parsing EXIF or
+ * XMP. Other formats are probed by opening the file with
+ * vips_image_new_from_file(), which reads just the header.
+ *
+ * This is safe to call from many threads at once.
+ *
+ * See also: vips_foreign_probe_many(), vips_foreign_find_load().
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+int
+vips_foreign_probe( const char *filename, VipsForeignProbe *probe )
+{
+	static GOnce once = G_ONCE_INIT;
+
+	VIPS_ONCE( &once, vips_foreign_probe_init, NULL );
+
+	memset( probe, 0, sizeof( VipsForeignProbe ) );
+	probe->orientation = 1;
+	if( !vips_foreign_probe_fast( filename, probe ) )
+		return( 0 );
+
+	memset( probe, 0, sizeof( VipsForeignProbe ) );
+	probe->orientation = 1;
+	if( !vips_foreign_probe_load( filename, probe ) )
+		return( 0 );
+
+	memset( probe, 0, sizeof( VipsForeignProbe ) );
+
+	return( -1 );
+}
+
+typedef struct _VipsForeignProbeMany {
+	const char **filenames;
+	VipsForeignProbe *probe;
+	int n;
+
+	/* The next file to probe, and set if any probe fails. Both are
+	 * updated atomically.
+	 */
+	int next;
+	int failed;
+} VipsForeignProbeMany;
+
+static void *
+vips_foreign_probe_many_work( void *a )
+{
+	VipsForeignProbeMany *many = (VipsForeignProbeMany *) a;
+
+	int i;
+
+	while( (i = g_atomic_int_add( &many->next, 1 )) < many->n )
+		if( vips_foreign_probe( many->filenames[i], &many->probe[i] ) )
+			g_atomic_int_set( &many->failed, 1 );
+
+	return( NULL );
+}
+
+/**
+ * vips_foreign_probe_many:
+ * @filenames: (array length=n): files to probe
+ * @n: number of files
+ * @probe: (array length=n) (out caller-allocates): fill these with the
+ * header fields
+ *
+ * Run vips_foreign_probe() on a set of files, using a pool of
+ * vips_concurrency_get() threads.
+ *
+ * Probes which fail have a %NULL @loader and zero @width, and the reason
+ * is added to the error buffer. The others are filled in as usual.
+ *
+ * See also: vips_foreign_probe().
+ *
+ * Returns: 0 on success, -1 if any file could not be probed.
+ */
+int
+vips_foreign_probe_many( const char **filenames, int n,
+	VipsForeignProbe *probe )
+{
+	VipsForeignProbeMany many;
+	GThread **threads;
+	int n_threads;
+	int i;
+
+	many.filenames = filenames;
+	many.probe = probe;
+	many.n = n;
+	many.next = 0;
+	many.failed = 0;
+
+	/* The calling thread does some of the work too.
+	 */
+	n_threads = VIPS_CLIP( 0, vips_concurrency_get() - 1, n - 1 );
+	threads = VIPS_ARRAY( NULL, VIPS_MAX( 1, n_threads ), GThread * );
+	for( i = 0; i < n_threads; i++ )
+		threads[i] = vips_g_thread_new( "probe",
+			vips_foreign_probe_many_work, &many );
+
+	(void) vips_foreign_probe_many_work( &many );
+
+	for( i = 0; i < n_threads; i++ )
+		if( threads[i] )
+			(void) vips_g_thread_join( threads[i] );
+	g_free( threads );
+
+	return( many.failed ? -1 : 0 );
+}
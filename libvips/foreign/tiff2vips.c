@@ -193,6 +193,8 @@
  * 	- switch to stream input
  * 18/11/19
  * 	- support ASSOCALPHA in any alpha band
+ * 19/10/19
+ * 	- map uncompressed, contiguous strip images directly
  */
 
 /*
@@ -2160,6 +2162,197 @@ rtiff_read_stripwise( Rtiff *rtiff, VipsImage *out )
 	return( 0 );
 }
 
+/* Test if the current directory of @tif is an uncompressed, chunky, strip 
+ * image with whole-byte samples, and with all the strips laid out one after 
+ * the other in the file. If it is, we can skip libtiff completely and map 
+ * the pixels directly. @offset is set to the file position of the first 
+ * pixel.
+ */
+static gboolean
+tiff_is_mappable_offset( TIFF *tif, toff_t *offset )
+{
+	uint32 height;
+	uint32 rows_per_strip;
+	uint16 compression;
+	uint16 planar_config;
+	uint16 samples_per_pixel;
+	uint16 bits_per_sample;
+	uint16 photometric_interpretation;
+	tsize_t scanline_size;
+	tstrip_t number_of_strips;
+	toff_t *strip_offsets;
+	toff_t *strip_byte_counts;
+	tstrip_t i;
+
+	if( TIFFIsTiled( tif ) ||
+		!TIFFGetFieldDefaulted( tif, TIFFTAG_IMAGELENGTH, &height ) ||
+		!TIFFGetFieldDefaulted( tif, 
+			TIFFTAG_ROWSPERSTRIP, &rows_per_strip ) ||
+		!TIFFGetFieldDefaulted( tif, 
+			TIFFTAG_COMPRESSION, &compression ) ||
+		!TIFFGetFieldDefaulted( tif, 
+			TIFFTAG_PLANARCONFIG, &planar_config ) ||
+		!TIFFGetFieldDefaulted( tif, 
+			TIFFTAG_SAMPLESPERPIXEL, &samples_per_pixel ) ||
+		!TIFFGetFieldDefaulted( tif, 
+			TIFFTAG_BITSPERSAMPLE, &bits_per_sample ) ||
+		!TIFFGetField( tif, 
+			TIFFTAG_PHOTOMETRIC, &photometric_interpretation ) )
+		return( FALSE );
+
+	/* Only the interpretations that rtiff_parse_copy() and
+	 * rtiff_parse_greyscale() can handle with a plain memcpy().
+	 */
+	if( compression != COMPRESSION_NONE ||
+		(samples_per_pixel > 1 && 
+		 planar_config != PLANARCONFIG_CONTIG) ||
+		bits_per_sample < 8 ||
+		bits_per_sample % 8 != 0 ||
+		photometric_interpretation == PHOTOMETRIC_MINISWHITE ||
+		photometric_interpretation == PHOTOMETRIC_PALETTE ||
+		photometric_interpretation == PHOTOMETRIC_YCBCR ||
+		photometric_interpretation == PHOTOMETRIC_CIELAB )
+		return( FALSE );
+
+	scanline_size = TIFFScanlineSize( tif );
+	number_of_strips = TIFFNumberOfStrips( tif );
+	if( height == 0 ||
+		rows_per_strip == 0 ||
+		scanline_size <= 0 ||
+		number_of_strips == 0 ||
+		!TIFFGetField( tif, TIFFTAG_STRIPOFFSETS, &strip_offsets ) ||
+		!TIFFGetField( tif, 
+			TIFFTAG_STRIPBYTECOUNTS, &strip_byte_counts ) )
+		return( FALSE );
+
+	for( i = 0; i < number_of_strips; i++ ) {
+		guint64 top = (guint64) i * rows_per_strip;
+		guint64 rows = VIPS_MIN( rows_per_strip, height - top );
+
+		if( top >= height ||
+			strip_offsets[i] != 
+				strip_offsets[0] + top * scanline_size ||
+			strip_byte_counts[i] < rows * scanline_size )
+			return( FALSE );
+	}
+
+	*offset = strip_offsets[0];
+
+	return( TRUE );
+}
+
+static gboolean
+tiff_is_mappable( TIFF *tif )
+{
+	toff_t offset;
+
+	return( tiff_is_mappable_offset( tif, &offset ) ); 
+}
+
+/* Can we map this image directly? We need a file for the window mapper, a 
+ * single page, and a simple strip layout.
+ */
+static gboolean
+rtiff_is_mappable( Rtiff *rtiff, toff_t *offset )
+{
+	return( vips_stream_filename( VIPS_STREAM( rtiff->streami ) ) &&
+		vips_streami_is_mappable( rtiff->streami ) &&
+		rtiff->n == 1 &&
+		tiff_is_mappable_offset( rtiff->tiff, offset ) );
+}
+
+static int
+rtiff_mapped_generate( VipsRegion *or, 
+	void *seq, void *a, void *b, gboolean *stop )
+{
+	VipsRegion *ir = (VipsRegion *) seq;
+	VipsRect *r = &or->valid;
+
+	/* The file pixels have exactly the layout of the output, so we can
+	 * just point the output at the mapped input.
+	 */
+	if( vips_region_prepare( ir, r ) ||
+		vips_region_region( or, ir, r, r->left, r->top ) )
+		return( -1 );
+
+	return( 0 );
+}
+
+/* Map an uncompressed strip image directly, in the same way that vipsload
+ * maps .v files. There's no decode, there's no copy, and we can support 
+ * random access.
+ */
+static int
+rtiff_read_mapped( Rtiff *rtiff, toff_t offset, VipsImage *out )
+{
+	VipsImage **t = (VipsImage **) 
+		vips_object_local_array( VIPS_OBJECT( out ), 5 );
+	const char *filename = 
+		vips_stream_filename( VIPS_STREAM( rtiff->streami ) );
+	int sizeof_pel = rtiff->header.samples_per_pixel * 
+		(rtiff->header.bits_per_sample >> 3);
+
+	VipsAngle angle;
+
+#ifdef DEBUG
+	printf( "tiff2vips: rtiff_read_mapped: offset = %zd\n", 
+		(size_t) offset );
+#endif /*DEBUG*/
+
+	/* A uchar image with one band per byte of pixel.
+	 */
+	if( !(t[0] = vips__image_new_from_file_raw( filename, 
+		rtiff->header.width, rtiff->header.height, 
+		sizeof_pel, offset, TRUE )) )
+		return( -1 );
+
+	/* pipelinev() copies the fields of the raw uchar image, so set the
+	 * real header afterwards.
+	 */
+	t[1] = vips_image_new();
+	if( vips_image_pipelinev( t[1], 
+		VIPS_DEMAND_STYLE_THINSTRIP, t[0], NULL ) ||
+		rtiff_set_header( rtiff, t[1] ) )
+		return( -1 );
+
+	/* Double check: the vips pixel size must exactly match the tiff pixel
+	 * size.
+	 */
+	if( VIPS_IMAGE_SIZEOF_PEL( t[1] ) != (size_t) sizeof_pel ) {
+		vips_error( "tiff2vips", 
+			"%s", _( "unsupported tiff image type" ) );
+		return( -1 );
+	}
+
+	if( vips_image_generate( t[1], 
+			vips_start_one, rtiff_mapped_generate, vips_stop_one, 
+			t[0], NULL ) ||
+		vips__byteswap_bool( t[1], &t[2], 
+			TIFFIsByteSwapped( rtiff->tiff ) ) )
+		return( -1 );
+
+	/* We support random access, so we can rotate directly, there's no
+	 * need for the copy that rtiff_autorotate() makes.
+	 */
+	angle = vips_autorot_get_angle( t[2] );
+	if( rtiff->autorotate &&
+		angle != VIPS_ANGLE_D0 ) {
+		if( vips_rot( t[2], &t[3], angle, NULL ) )
+			return( -1 );
+		vips_autorot_remove_angle( t[3] ); 
+	}
+	else {
+		t[3] = t[2];
+		g_object_ref( t[3] );
+	}
+
+	if( rtiff_unpremultiply( rtiff, t[3], &t[4] ) ||
+		vips_image_write( t[4], out ) )
+		return( -1 );
+
+	return( 0 );
+}
+
 /* Load from a tiff dir into one of our tiff header structs.
  */
 static int
@@ -2496,6 +2689,45 @@ vips__istifftiled_stream( VipsStreami *streami )
 	return( vips__testtiff_stream( streami, TIFFIsTiled ) ); 
 }
 
+/* Will vips__tiff_read_stream() map @page of this file directly? This must 
+ * make the same test as rtiff_is_mappable().
+ */
+gboolean
+vips__istiffmappable_stream( VipsStreami *streami, int page, int n )
+{
+	TIFF *tif;
+	gboolean mappable;
+
+	if( !vips_stream_filename( VIPS_STREAM( streami ) ) ||
+		!vips_streami_is_mappable( streami ) )
+		return( FALSE );
+
+	vips__tiff_init();
+
+	if( !(tif = vips__tiff_openin_stream( streami )) ) {
+		vips_error_clear();
+		return( FALSE );
+	}
+
+	/* n == -1 means all pages from @page onwards.
+	 */
+	if( n == -1 ) {
+		int n_pages;
+
+		for( n_pages = 1; TIFFReadDirectory( tif ); n_pages++ )
+			;
+		n = n_pages - page;
+	}
+
+	mappable = n == 1 &&
+		TIFFSetDirectory( tif, page ) &&
+		tiff_is_mappable( tif );
+
+	TIFFClose( tif );
+
+	return( mappable );
+}
+
 int
 vips__tiff_read_header_stream( VipsStreami *streami, VipsImage *out, 
 	int page, int n, gboolean autorotate )
@@ -2526,6 +2758,7 @@ vips__tiff_read_stream( VipsStreami *streami, VipsImage *out,
 	int page, int n, gboolean autorotate )
 {
 	Rtiff *rtiff;
+	toff_t offset;
 
 #ifdef DEBUG
 	printf( "tiff2vips: libtiff version is \"%s\"\n", TIFFGetVersion() );
@@ -2542,6 +2775,10 @@ vips__tiff_read_stream( VipsStreami *streami, VipsImage *out,
 		if( rtiff_read_tilewise( rtiff, out ) )
 			return( -1 );
 	}
+	else if( rtiff_is_mappable( rtiff, &offset ) ) {
+		if( rtiff_read_mapped( rtiff, offset, out ) )
+			return( -1 );
+	}
 	else {
 		if( rtiff_read_stripwise( rtiff, out ) )
 			return( -1 );
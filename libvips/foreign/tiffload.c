@@ -4,6 +4,8 @@
  * 	- from tiffload.c
  * 27/1/17
  * 	- add get_flags for buffer loader
+ * 19/10/19
+ * 	- uncompressed strip images are mapped, so flag them as partial
  */
 
 /*
@@ -153,7 +155,8 @@ vips_foreign_load_tiff_file_is_a( const char *filename )
 }
 
 static VipsForeignFlags
-vips_foreign_load_tiff_file_get_flags_filename( const char *filename )
+vips_foreign_load_tiff_file_get_flags_page( const char *filename, 
+	int page, int n )
 {
 	VipsStreami *streami;
 	VipsForeignFlags flags;
@@ -161,8 +164,12 @@ vips_foreign_load_tiff_file_get_flags_filename( const char *filename )
 	if( !(streami = vips_streami_new_from_file( filename )) )
 		return( 0 );
 
+	/* Tiled images, and uncompressed strip pages we can map directly, 
+	 * support random access.
+	 */
 	flags = 0;
-	if( vips__istifftiled_stream( streami ) ) 
+	if( vips__istifftiled_stream( streami ) ||
+		vips__istiffmappable_stream( streami, page, n ) ) 
 		flags |= VIPS_FOREIGN_PARTIAL;
 	else
 		flags |= VIPS_FOREIGN_SEQUENTIAL;
@@ -172,13 +179,22 @@ vips_foreign_load_tiff_file_get_flags_filename( const char *filename )
 	return( flags );
 }
 
+static VipsForeignFlags
+vips_foreign_load_tiff_file_get_flags_filename( const char *filename )
+{
+	/* We've no page or n, so use the defaults.
+	 */
+	return( vips_foreign_load_tiff_file_get_flags_page( filename, 0, 1 ) );
+}
+
 static VipsForeignFlags
 vips_foreign_load_tiff_file_get_flags( VipsForeignLoad *load )
 {
+	VipsForeignLoadTiff *tiff = (VipsForeignLoadTiff *) load;
 	VipsForeignLoadTiffFile *file = (VipsForeignLoadTiffFile *) load;
 
-	return( vips_foreign_load_tiff_file_get_flags_filename( 
-		file->filename ) );
+	return( vips_foreign_load_tiff_file_get_flags_page( file->filename,
+		tiff->page, tiff->n ) );
 }
 
 static int
@@ -18,6 +18,9 @@
  * 	- set loop even if we strip
  * 14/10/19
  * 	- revise for stream IO
+ * 19/10/19
+ * 	- add @thread_level
+ * 	- add @frame_parallel: encode animation frames on a threadpool
  */
 
 /*
@@ -87,6 +90,8 @@ typedef struct {
 	gboolean min_size;
 	int kmin;
 	int kmax;
+	int thread_level;
+	gboolean frame_parallel;
 	gboolean strip;
 
 	WebPConfig config;
@@ -103,8 +108,29 @@ typedef struct {
 	/* Add metadata with this.
 	 */
 	WebPMux *mux;
+
+	/* In frame-parallel mode, the set of frames we are encoding.
+	 */
+	struct _VipsWebPFrame *frames;
+	int n_frames;
 } VipsWebPWrite;
 
+/* A frame we encode in frame-parallel mode.
+ */
+typedef struct _VipsWebPFrame {
+	VipsWebPWrite *write;
+
+	/* This frame's pixels, part of a memory image.
+	 */
+	VipsImage *image;
+	int top;
+	int height;
+
+	/* The compressed frame.
+	 */
+	WebPMemoryWriter memory_writer;
+} VipsWebPFrame;
+
 static WebPPreset
 get_preset( VipsForeignWebpPreset preset )
 {
@@ -131,9 +157,23 @@ get_preset( VipsForeignWebpPreset preset )
 	return( -1 );
 }
 
+static void
+write_webp_frames_free( VipsWebPWrite *write )
+{
+	int i;
+
+	if( write->frames ) { 
+		for( i = 0; i < write->n_frames; i++ ) 
+			WebPMemoryWriterClear( &write->frames[i].memory_writer );
+		VIPS_FREE( write->frames );
+	}
+	write->n_frames = 0;
+}
+
 static void
 vips_webp_write_unset( VipsWebPWrite *write )
 {
+	write_webp_frames_free( write );
 	WebPMemoryWriterClear( &write->memory_writer );
 	VIPS_FREEF( WebPAnimEncoderDelete, write->enc );
 	VIPS_FREEF( WebPMuxDelete, write->mux );
@@ -146,6 +186,7 @@ vips_webp_write_init( VipsWebPWrite *write, VipsImage *image,
 	gboolean smart_subsample, gboolean near_lossless,
 	int alpha_q, int reduction_effort,
 	gboolean min_size, int kmin, int kmax,
+	int thread_level, gboolean frame_parallel,
 	gboolean strip )
 {
 	write->image = NULL;
@@ -159,10 +200,14 @@ vips_webp_write_init( VipsWebPWrite *write, VipsImage *image,
 	write->min_size = min_size;
 	write->kmin = kmin;
 	write->kmax = kmax;
+	write->thread_level = thread_level;
+	write->frame_parallel = frame_parallel;
 	write->strip = strip;
 	WebPMemoryWriterInit( &write->memory_writer );
 	write->enc = NULL;
 	write->mux = NULL;
+	write->frames = NULL;
+	write->n_frames = 0;
 
 	/* Rebuild exif on image. We must do this on a copy. 
 	 */
@@ -193,6 +238,7 @@ vips_webp_write_init( VipsWebPWrite *write, VipsImage *image,
 	write->config.lossless = lossless || near_lossless;
 	write->config.alpha_quality = alpha_q;
 	write->config.method = reduction_effort;
+	write->config.thread_level = thread_level;
 
 	if( lossless )
 		write->config.quality = Q;
@@ -290,6 +336,19 @@ write_webp_single( VipsWebPWrite *write, VipsImage *image )
 	return( 0 );
 }
 
+/* The delay after page @page_index, in ms.
+ */
+static int
+vips_webp_get_delay( int *delay, int delay_length, int gif_delay, 
+	int page_index )
+{
+	if( delay &&
+		page_index < delay_length )
+		return( delay[page_index] );
+	else 
+		return( gif_delay * 10 );
+}
+
 /* Write a set of animated frames into write->memory_writer.
  */
 static int
@@ -363,11 +422,8 @@ write_webp_anim( VipsWebPWrite *write, VipsImage *image, int page_height )
 		WebPPictureFree( &pic );
 
 		page_index = top / page_height;
-		if( delay &&
-			page_index < delay_length )
-			timestamp_ms += delay[page_index];
-		else 
-			timestamp_ms += gif_delay * 10;
+		timestamp_ms += vips_webp_get_delay( delay, delay_length,
+			gif_delay, page_index );
 	}
 
 	/* Closes encoder and add last frame delay.
@@ -398,13 +454,204 @@ write_webp_anim( VipsWebPWrite *write, VipsImage *image, int page_height )
 	return( 0 );
 }
 
+/* Import and encode a single frame. This runs on many threads at once, so it
+ * must only touch its own frame.
+ */
+static int
+write_webp_frame_work( void *a, int unit )
+{
+	VipsWebPWrite *write = (VipsWebPWrite *) a;
+	VipsWebPFrame *frame = &write->frames[unit];
+	VipsImage *image = frame->image;
+
+	WebPPicture pic;
+	webp_import import;
+
+	if( !vips_webp_pic_init( write, &pic ) ) 
+		return( -1 );
+	pic.custom_ptr = (void *) &frame->memory_writer;
+	pic.width = image->Xsize;
+	pic.height = frame->height;
+
+	if( image->Bands == 4 )
+		import = WebPPictureImportRGBA;
+	else
+		import = WebPPictureImportRGB;
+
+	if( !import( &pic, VIPS_IMAGE_ADDR( image, 0, frame->top ),
+		VIPS_IMAGE_SIZEOF_LINE( image ) ) ) {
+		WebPPictureFree( &pic );
+		vips_error( "vips2webp", "%s", _( "picture memory error" ) );
+		return( -1 );
+	}
+
+	if( !WebPEncode( &write->config, &pic ) ) {
+		WebPPictureFree( &pic );
+		vips_error( "vips2webp", "%s", _( "unable to encode" ) );
+		return( -1 );
+	}
+
+	WebPPictureFree( &pic );
+
+	return( 0 );
+}
+
+/* Write a set of animated frames into write->memory_writer, encoding frames 
+ * in parallel. 
+ *
+ * We compute one frame per thread to a memory image, encode them all at 
+ * once as independent full-canvas frames, then add them to a mux in order.
+ * This gives up the inter-frame optimisation that WebPAnimEncoder does.
+ */
+static int
+write_webp_anim_parallel( VipsWebPWrite *write, 
+	VipsImage *image, int page_height )
+{
+	int n_pages = image->Ysize / page_height;
+	int batch = VIPS_MAX( 1, vips_concurrency_get() );
+
+	WebPMuxAnimParams params;
+	WebPData webp_data;
+	int gif_delay;
+	int *delay;
+	int delay_length;
+	int page;
+
+	/* There might just be the old gif-delay field. This is centiseconds.
+	 */
+	gif_delay = 4;
+	if( vips_image_get_typeof( image, "gif-delay" ) &&
+		vips_image_get_int( image, "gif-delay", &gif_delay ) )
+		return( -1 );
+
+	/* New images have an array of ints instead.
+	 */
+	delay = NULL;
+	delay_length = 0;
+	if( vips_image_get_typeof( image, "delay" ) &&
+		vips_image_get_array_int( image, "delay", 
+			&delay, &delay_length ) )
+		return( -1 );
+
+	if( !(write->mux = WebPMuxNew()) ) {
+		vips_error( "vips2webp", "%s", _( "mux error" ) );
+		return( -1 );
+	}
+
+	/* The same defaults as WebPAnimEncoder.
+	 */
+	params.bgcolor = 0xffffffff;
+	params.loop_count = 0;
+	if( WebPMuxSetAnimationParams( write->mux, &params ) != 
+		WEBP_MUX_OK ) {
+		vips_error( "vips2webp", "%s", _( "mux error" ) );
+		return( -1 );
+	}
+
+	for( page = 0; page < n_pages; page += batch ) {
+		int n = VIPS_MIN( batch, n_pages - page );
+
+		VipsImage *x;
+		VipsImage *memory;
+		int i;
+
+		/* Generate the pixels for this set of frames in one go, and
+		 * in order, since the source might be sequential.
+		 */
+		if( vips_crop( image, &x, 
+			0, page * page_height, image->Xsize, n * page_height, 
+			NULL ) )
+			return( -1 );
+		memory = vips_image_copy_memory( x );
+		VIPS_UNREF( x );
+		if( !memory )
+			return( -1 );
+
+		if( !(write->frames = VIPS_ARRAY( NULL, n, VipsWebPFrame )) ) {
+			VIPS_UNREF( memory );
+			return( -1 );
+		}
+		write->n_frames = n;
+		for( i = 0; i < n; i++ ) {
+			VipsWebPFrame *frame = &write->frames[i];
+
+			frame->write = write;
+			frame->image = memory;
+			frame->top = i * page_height;
+			frame->height = page_height;
+			WebPMemoryWriterInit( &frame->memory_writer );
+		}
+
+		if( vips__threadpool_run_units( n, 
+			write_webp_frame_work, write ) ) {
+			write_webp_frames_free( write );
+			VIPS_UNREF( memory );
+			return( -1 );
+		}
+
+		VIPS_UNREF( memory );
+
+		for( i = 0; i < n; i++ ) {
+			VipsWebPFrame *frame = &write->frames[i];
+			WebPMuxFrameInfo info;
+
+			memset( &info, 0, sizeof( info ) );
+			info.bitstream.bytes = frame->memory_writer.mem;
+			info.bitstream.size = frame->memory_writer.size;
+			info.x_offset = 0;
+			info.y_offset = 0;
+			info.duration = vips_webp_get_delay( delay, delay_length, 
+				gif_delay, page + i );
+			info.id = WEBP_CHUNK_ANMF;
+			info.dispose_method = WEBP_MUX_DISPOSE_NONE;
+			info.blend_method = WEBP_MUX_NO_BLEND;
+
+			if( WebPMuxPushFrame( write->mux, &info, 1 ) != 
+				WEBP_MUX_OK ) {
+				write_webp_frames_free( write );
+				vips_error( "vips2webp",
+					"%s", _( "anim add error" ) );
+				return( -1 );
+			}
+		}
+
+		write_webp_frames_free( write );
+	}
+
+	if( WebPMuxAssemble( write->mux, &webp_data ) != WEBP_MUX_OK ) {
+		vips_error( "vips2webp",
+			"%s", _( "anim build error" ) );
+		return( -1 );
+	}
+	VIPS_FREEF( WebPMuxDelete, write->mux );
+
+	/* Terrible. This will only work if the output buffer is currently
+	 * empty. 
+	 */
+	if( write->memory_writer.mem != NULL ) {
+		WebPDataClear( &webp_data );
+		vips_error( "vips2webp", "%s", _( "internal error" ) );
+		return( -1 );
+	}
+	write->memory_writer.mem = (uint8_t *) webp_data.bytes;
+	write->memory_writer.size = webp_data.size;
+
+	return( 0 );
+}
+
 static int
 write_webp( VipsWebPWrite *write )
 {
 	int page_height = vips_image_get_page_height( write->image ); 
 
-	if( page_height < write->image->Ysize )
-		return( write_webp_anim( write, write->image, page_height ) );
+	if( page_height < write->image->Ysize ) {
+		if( write->frame_parallel )
+			return( write_webp_anim_parallel( write, 
+				write->image, page_height ) );
+		else
+			return( write_webp_anim( write, 
+				write->image, page_height ) );
+	}
 	else
 		return( write_webp_single( write, write->image ) );
 }
@@ -519,13 +766,15 @@ vips__webp_write_stream( VipsImage *image, VipsStreamo *streamo,
 	gboolean smart_subsample, gboolean near_lossless,
 	int alpha_q, int reduction_effort,
 	gboolean min_size, int kmin, int kmax,
+	int thread_level, gboolean frame_parallel,
 	gboolean strip )
 {
 	VipsWebPWrite write;
 
 	if( vips_webp_write_init( &write, image,
 		Q, lossless, preset, smart_subsample, near_lossless,
-		alpha_q, reduction_effort, min_size, kmin, kmax, strip ) )
+		alpha_q, reduction_effort, min_size, kmin, kmax, 
+		thread_level, frame_parallel, strip ) )
 		return( -1 );
 
 	if( write_webp( &write ) ) {
@@ -1,6 +1,8 @@
 /* load vips from a file
  *
  * 24/11/11
+ * 19/10/19
+ * 	- load tiled vips files
  */
 
 /*
@@ -45,6 +47,19 @@
 #include <vips/vips.h>
 #include <vips/internal.h>
 
+#include "pforeign.h"
+
+/* The magic numbers for .v files, in either byte order, plus the tiled
+ * variants.
+ */
+static const VipsForeignMagic vips_foreign_load_vips_magic[] = {
+	{ 0, 4, "\010\362\246\266", NULL },
+	{ 0, 4, "\266\246\362\010", NULL },
+	{ 0, 4, "\011\362\246\266", NULL },
+	{ 0, 4, "\266\246\362\011", NULL },
+	{ 0 }
+};
+
 typedef struct _VipsForeignLoadVips {
 	VipsForeignLoad parent_object;
 
@@ -60,7 +75,8 @@ G_DEFINE_TYPE( VipsForeignLoadVips, vips_foreign_load_vips,
 static gboolean
 vips_foreign_load_vips_is_a( const char *filename )
 {
-	return( vips__file_magic( filename ) );
+	return( vips__file_magic( filename ) || 
+		vips__file_magic_tiled( filename ) );
 }
 
 static VipsForeignFlags
@@ -70,7 +86,8 @@ vips_foreign_load_vips_get_flags_filename( const char *filename )
 
 	flags = VIPS_FOREIGN_PARTIAL;
 
-	if( vips__file_magic( filename ) == VIPS_MAGIC_SPARC ) 
+	if( vips__file_magic( filename ) == VIPS_MAGIC_SPARC ||
+		vips__file_magic_tiled( filename ) == VIPS_MAGIC_TILED_SPARC ) 
 		flags |= VIPS_FOREIGN_BIGENDIAN;
 
 	return( flags );
@@ -91,7 +108,16 @@ vips_foreign_load_vips_header( VipsForeignLoad *load )
 	VipsImage *out;
 	VipsImage *out2;
 
-	if( !(out2 = vips_image_new_mode( vips->filename, "r" )) )
+	/* Tiled files are decompressed on demand, plain files are mmaped.
+	 */
+	if( vips__file_magic_tiled( vips->filename ) ) {
+		out2 = vips_image_new();
+		if( vips__tiled_read( vips->filename, out2 ) ) {
+			g_object_unref( out2 );
+			return( -1 );
+		}
+	}
+	else if( !(out2 = vips_image_new_mode( vips->filename, "r" )) )
 		return( -1 );
 
 	/* Remove the @out that's there now. 
@@ -128,6 +154,8 @@ vips_foreign_load_vips_class_init( VipsForeignLoadVipsClass *class )
 	foreign_class->priority = 200;
 
 	load_class->is_a = vips_foreign_load_vips_is_a;
+	vips_foreign_load_class_set_magic( load_class, 
+		vips_foreign_load_vips_magic );
 	load_class->get_flags = vips_foreign_load_vips_get_flags;
 	load_class->get_flags_filename = 
 		vips_foreign_load_vips_get_flags_filename;
@@ -155,6 +183,9 @@ vips_foreign_load_vips_init( VipsForeignLoadVips *vips )
  *
  * Read in a vips image. 
  *
+ * Tiled vips files, see vips_vipssave(), are decompressed on demand, a tile 
+ * at a time, and support random access.
+ *
  * See also: vips_vipssave().
  *
  * Returns: 0 on success, -1 on error.
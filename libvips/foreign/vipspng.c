@@ -77,6 +77,10 @@
  * 	- restart after minimise
  * 14/10/19
  * 	- revise for stream IO
+ * 19/10/19
+ * 	- add @parallel: filter ourselves and deflate chunks on a threadpool
+ * 	- add @passes: stop interlaced decode early
+ * 	- add @shrink: box filter rows as they are decoded
  */
 
 /*
@@ -130,6 +134,10 @@
 
 #include <png.h>
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif /*HAVE_ZLIB*/
+
 #if PNG_LIBPNG_VER < 10003
 #error "PNG library too old."
 #endif
@@ -168,6 +176,17 @@ typedef struct {
 	VipsImage *out;
 	gboolean fail;
 
+	/* Stop interlaced images after this many passes, 0 for all of them.
+	 */
+	int passes;
+
+	/* Box shrink by this much during load. We need a full-width row to
+	 * decode to, and a row of sums.
+	 */
+	int shrink;
+	png_bytep shrink_row;
+	guint32 *shrink_sum;
+
 	int y_pos;
 	png_structp pPng;
 	png_infop pInfo;
@@ -197,6 +216,8 @@ read_destroy( Read *read )
 		png_destroy_read_struct( &read->pPng, &read->pInfo, NULL );
 	VIPS_UNREF( read->streami );
 	VIPS_FREE( read->row_pointer );
+	VIPS_FREE( read->shrink_row );
+	VIPS_FREE( read->shrink_sum );
 }
 
 static void
@@ -258,6 +279,10 @@ read_new( VipsStreami *streami, VipsImage *out, gboolean fail )
 
 	read->name = NULL;
 	read->fail = fail;
+	read->passes = 0;
+	read->shrink = 1;
+	read->shrink_row = NULL;
+	read->shrink_sum = NULL;
 	read->out = out;
 	read->y_pos = 0;
 	read->pPng = NULL;
@@ -314,6 +339,17 @@ read_new( VipsStreami *streami, VipsImage *out, gboolean fail )
 	return( read );
 }
 
+/* We never shrink an axis to nothing.
+ */
+static void
+read_set_shrink( Read *read, int shrink )
+{
+	int width = png_get_image_width( read->pPng, read->pInfo );
+	int height = png_get_image_height( read->pPng, read->pInfo );
+
+	read->shrink = VIPS_CLIP( 1, shrink, VIPS_MIN( width, height ) );
+}
+
 /* Set the png text data as metadata on the vips image. These are always
  * null-terminated strings.
  */
@@ -345,10 +381,10 @@ vips__set_text( VipsImage *out, int i, const char *key, const char *text )
 	return( 0 );
 }
 
-/* Read a png header.
+/* Read a png header. The image is @shrink times smaller than the png.
  */
 static int
-png2vips_header( Read *read, VipsImage *out )
+png2vips_header( Read *read, VipsImage *out, int shrink )
 {
 	png_uint_32 width, height;
 	int bit_depth, color_type;
@@ -472,10 +508,13 @@ png2vips_header( Read *read, VipsImage *out )
 		break;
 	}
 
-	/* Set VIPS header.
+	/* Set VIPS header. We only average whole blocks of @shrink pixels, 
+	 * so the size rounds down and partial blocks at the right and bottom
+	 * edges are dropped.
 	 */
 	vips_image_init_fields( out,
-		width, height, bands,
+		VIPS_MAX( 1, width / shrink ), VIPS_MAX( 1, height / shrink ), 
+		bands,
 		bit_depth > 8 ? 
 			VIPS_FORMAT_USHORT : VIPS_FORMAT_UCHAR,
 		VIPS_CODING_NONE, interpretation, 
@@ -526,7 +565,7 @@ png2vips_header( Read *read, VipsImage *out )
 	 */
 	png_read_update_info( read->pPng, read->pInfo );
 	if( png_get_rowbytes( read->pPng, read->pInfo ) != 
-		VIPS_IMAGE_SIZEOF_LINE( out ) ) {
+		(size_t) width * VIPS_IMAGE_SIZEOF_PEL( out ) ) {
 		vips_error( "vipspng", 
 			"%s", _( "unable to read PNG header" ) );
 		return( -1 );
@@ -579,13 +618,78 @@ png2vips_interlace( Read *read, VipsImage *out )
 	for( y = 0; y < out->Ysize; y++ )
 		read->row_pointer[y] = VIPS_IMAGE_ADDR( out, 0, y );
 
-	png_read_image( read->pPng, read->row_pointer );
+	if( read->passes > 0 ) {
+		int n_passes = png_set_interlace_handling( read->pPng );
+
+		int pass;
+
+		/* Rows go in the display argument, so libpng replicates each
+		 * pixel over the block it stands for, and the image is
+		 * complete, but blocky, after every pass. The rest of the 
+		 * file is never read.
+		 */
+		for( pass = 0; pass < VIPS_MIN( read->passes, n_passes ); 
+			pass++ )
+			png_read_rows( read->pPng, 
+				NULL, read->row_pointer, out->Ysize );
+	}
+	else
+		png_read_image( read->pPng, read->row_pointer );
 
 	read_destroy( read );
 
 	return( 0 );
 }
 
+#define SHRINK_SUM( TYPE ) { \
+	TYPE * restrict p = (TYPE *) read->shrink_row; \
+	\
+	for( x = 0; x < width; x++ ) \
+		for( i = 0; i < shrink; i++ ) \
+			for( b = 0; b < bands; b++ ) \
+				sum[x * bands + b] += \
+					p[(x * shrink + i) * bands + b]; \
+}
+
+#define SHRINK_AVERAGE( TYPE ) { \
+	TYPE * restrict q = (TYPE *) out; \
+	\
+	for( x = 0; x < n; x++ ) \
+		q[x] = (sum[x] + n_pels / 2) / n_pels; \
+}
+
+/* Read @shrink rows and box filter down to one. Rows and columns at the edge
+ * which don't make a full block are dropped.
+ */
+static void
+png2vips_shrink_row( Read *read, VipsImage *im, VipsPel *out )
+{
+	int width = im->Xsize;
+	int bands = im->Bands;
+	int shrink = read->shrink;
+	int n = width * bands;
+	int n_pels = shrink * shrink;
+	guint32 * restrict sum = read->shrink_sum;
+
+	int x, y, i, b;
+
+	memset( sum, 0, n * sizeof( guint32 ) );
+
+	for( y = 0; y < shrink; y++ ) {
+		png_read_row( read->pPng, read->shrink_row, NULL );
+
+		if( im->BandFmt == VIPS_FORMAT_USHORT )
+			SHRINK_SUM( unsigned short )
+		else
+			SHRINK_SUM( unsigned char )
+	}
+
+	if( im->BandFmt == VIPS_FORMAT_USHORT )
+		SHRINK_AVERAGE( unsigned short )
+	else
+		SHRINK_AVERAGE( unsigned char )
+}
+
 static int
 png2vips_generate( VipsRegion *or, 
 	void *seq, void *a, void *b, gboolean *stop )
@@ -627,8 +731,12 @@ png2vips_generate( VipsRegion *or,
 
 		/* We need to catch errors from read_row().
 		 */
-		if( !setjmp( png_jmpbuf( read->pPng ) ) ) 
-			png_read_row( read->pPng, q, NULL );
+		if( !setjmp( png_jmpbuf( read->pPng ) ) ) {
+			if( read->shrink > 1 )
+				png2vips_shrink_row( read, or->im, q );
+			else
+				png_read_row( read->pPng, q, NULL );
+		}
 		else { 
 			/* We've failed to read some pixels. Knock this 
 			 * operation out of cache. 
@@ -671,18 +779,49 @@ png2vips_image( Read *read, VipsImage *out )
 		/* Arg awful interlaced image. We have to load to a huge mem 
 		 * buffer, then copy to out.
 		 */
+		VipsImage *in;
+
 		t[0] = vips_image_new_memory();
-		if( png2vips_header( read, t[0] ) ||
-			png2vips_interlace( read, t[0] ) ||
-			vips_image_write( t[0], out ) )
+		if( png2vips_header( read, t[0], 1 ) ||
+			png2vips_interlace( read, t[0] ) )
+			return( -1 );
+		in = t[0];
+
+		/* Shrink in memory. Crop to a multiple of shrink first, so 
+		 * we make exactly the size png2vips_header() promised.
+		 */
+		if( read->shrink > 1 ) {
+			int width = in->Xsize / read->shrink;
+			int height = in->Ysize / read->shrink;
+
+			if( vips_extract_area( in, &t[1], 0, 0, 
+				width * read->shrink, height * read->shrink, 
+				NULL ) ||
+				vips_shrink( t[1], &t[2], 
+					read->shrink, read->shrink, NULL ) )
+				return( -1 );
+			in = t[2];
+		}
+
+		if( vips_image_write( in, out ) )
 			return( -1 );
 	}
 	else {
 		t[0] = vips_image_new();
-		if( png2vips_header( read, t[0] ) ||
-			vips_image_generate( t[0], 
-				NULL, png2vips_generate, NULL, 
-				read, NULL ) ||
+		if( png2vips_header( read, t[0], read->shrink ) )
+			return( -1 );
+
+		if( read->shrink > 1 &&
+			(!(read->shrink_row = VIPS_ARRAY( NULL, 
+				png_get_rowbytes( read->pPng, read->pInfo ), 
+				png_byte )) ||
+			 !(read->shrink_sum = VIPS_ARRAY( NULL, 
+				t[0]->Xsize * t[0]->Bands, guint32 ))) )
+			return( -1 );
+
+		if( vips_image_generate( t[0], 
+			NULL, png2vips_generate, NULL, 
+			read, NULL ) ||
 			vips_sequential( t[0], &t[1], 
 				"tile_height", VIPS__FATSTRIP_HEIGHT, 
 				NULL ) ||
@@ -706,12 +845,14 @@ vips__png_ispng_stream( VipsStreami *streami )
 }
 
 int
-vips__png_header_stream( VipsStreami *streami, VipsImage *out )
+vips__png_header_stream( VipsStreami *streami, VipsImage *out, int shrink )
 {
 	Read *read;
 
-	if( !(read = read_new( streami, out, TRUE )) ||
-		png2vips_header( read, out ) )
+	if( !(read = read_new( streami, out, TRUE )) )
+		return( -1 );
+	read_set_shrink( read, shrink );
+	if( png2vips_header( read, out, read->shrink ) )
 		return( -1 );
 
 	vips_streami_minimise( streami );
@@ -720,12 +861,17 @@ vips__png_header_stream( VipsStreami *streami, VipsImage *out )
 }
 
 int
-vips__png_read_stream( VipsStreami *streami, VipsImage *out, gboolean fail )
+vips__png_read_stream( VipsStreami *streami, VipsImage *out, 
+	int shrink, int passes, gboolean fail )
 {
 	Read *read;
 
-	if( !(read = read_new( streami, out, fail )) ||
-		png2vips_image( read, out ) ||
+	if( !(read = read_new( streami, out, fail )) )
+		return( -1 );
+	read->passes = passes;
+	read_set_shrink( read, shrink );
+
+	if( png2vips_image( read, out ) ||
 		vips_streami_decode( streami ) )
 		return( -1 );
 
@@ -767,11 +913,120 @@ typedef struct {
 	png_structp pPng;
 	png_infop pInfo;
 	png_bytep *row_pointer;
+
+#ifdef HAVE_ZLIB
+	/* Parallel compression state. We filter scanlines ourselves, then 
+	 * deflate the filtered data in independent chunks on a threadpool.
+	 */
+	gboolean parallel;
+	int compress;
+	VipsForeignPngFilter filter;
+
+	/* Bytes per scanline, and bytes per pixel (the filter stride).
+	 */
+	size_t rowbytes;
+	int bpp;
+
+	/* The previous and current unfiltered scanlines, byteswapped for
+	 * 16-bit images.
+	 */
+	VipsPel *prev;
+	VipsPel *cur;
+
+	/* Filter byte plus filtered scanline for each of the filters.
+	 */
+	VipsPel *trial[5];
+
+	/* Filtered data for the current strip.
+	 */
+	VipsPel *filtered;
+	size_t filtered_size;
+	size_t filtered_length;
+
+	/* The final 32kb of filtered data we compressed, the dictionary for
+	 * the first chunk of the next strip.
+	 */
+	VipsPel *window;
+	size_t window_length;
+
+	/* Chunks in the current strip.
+	 */
+	struct _WriteChunk *chunks;
+	int n_chunks;
+
+	/* Running adler32 for the whole zlib stream.
+	 */
+	uLong adler;
+
+	gboolean header_written;
+#endif /*HAVE_ZLIB*/
 } Write;
 
+#ifdef HAVE_ZLIB
+/* Compress filtered data in chunks this size. Each chunk is deflated 
+ * independently, so this trades a little compression for parallelism.
+ */
+#define CHUNK_SIZE (128 * 1024)
+
+/* Deflate's window, the max dictionary size. 
+ */
+#define WINDOW_SIZE (32 * 1024)
+
+/* One unit of deflate work.
+ */
+typedef struct _WriteChunk {
+	/* Filtered bytes to compress, and the dictionary to prime deflate
+	 * with.
+	 */
+	VipsPel *in;
+	size_t in_length;
+	VipsPel *dict;
+	size_t dict_length;
+
+	/* Z_SYNC_FLUSH, or Z_FINISH for the final chunk of the image.
+	 */
+	int flush;
+
+	/* Compressed output. We leave 2 bytes at the front for the zlib 
+	 * header and 4 at the end for the adler32 checksum.
+	 */
+	VipsPel *out;
+	size_t out_length;
+
+	/* Checksum of just this chunk's uncompressed bytes.
+	 */
+	uLong adler;
+} WriteChunk;
+
+static void
+write_chunks_free( Write *write )
+{
+	int i;
+
+	if( write->chunks ) { 
+		for( i = 0; i < write->n_chunks; i++ ) 
+			VIPS_FREE( write->chunks[i].out );
+		VIPS_FREE( write->chunks );
+	}
+	write->n_chunks = 0;
+}
+#endif /*HAVE_ZLIB*/
+
 static void
 write_finish( Write *write )
 {
+#ifdef HAVE_ZLIB
+	int i;
+
+	write_chunks_free( write );
+	VIPS_FREE( write->prev );
+	VIPS_FREE( write->cur );
+	for( i = 0; i < 5; i++ )
+		VIPS_FREE( write->trial[i] );
+	VIPS_FREE( write->filtered );
+	VIPS_FREE( write->window );
+#endif /*HAVE_ZLIB*/
+
 	VIPS_UNREF( write->memory );
 	if( write->streamo ) 
 		vips_streamo_finish( write->streamo );
@@ -864,6 +1119,402 @@ write_png_block( VipsRegion *region, VipsRect *area, void *a )
 	return( 0 );
 }
 
+#ifdef HAVE_ZLIB
+static int
+paeth( int a, int b, int c )
+{
+	int p = a + b - c;
+	int pa = abs( p - a );
+	int pb = abs( p - b );
+	int pc = abs( p - c );
+
+	if( pa <= pb && 
+		pa <= pc )
+		return( a );
+	else if( pb <= pc )
+		return( b );
+	else
+		return( c );
+}
+
+/* Filter @cur with filter @type into @out. @out gets the filter type byte
+ * first. Return the sum of absolute values of the filtered bytes, treated as
+ * signed, the same heuristic libpng uses to pick a filter.
+ */
+static size_t
+write_filter_row( Write *write, int type, VipsPel *out )
+{
+	VipsPel * restrict cur = write->cur;
+	VipsPel * restrict prev = write->prev;
+	VipsPel * restrict q = out + 1;
+	size_t rowbytes = write->rowbytes;
+	size_t bpp = write->bpp;
+
+	size_t i;
+	size_t sum;
+
+	out[0] = type;
+
+	switch( type ) {
+	case PNG_FILTER_VALUE_NONE:
+		memcpy( q, cur, rowbytes );
+		break;
+
+	case PNG_FILTER_VALUE_SUB:
+		for( i = 0; i < bpp; i++ )
+			q[i] = cur[i];
+		for( ; i < rowbytes; i++ )
+			q[i] = cur[i] - cur[i - bpp];
+		break;
+
+	case PNG_FILTER_VALUE_UP:
+		for( i = 0; i < rowbytes; i++ )
+			q[i] = cur[i] - prev[i];
+		break;
+
+	case PNG_FILTER_VALUE_AVG:
+		for( i = 0; i < bpp; i++ )
+			q[i] = cur[i] - (prev[i] >> 1);
+		for( ; i < rowbytes; i++ )
+			q[i] = cur[i] - ((cur[i - bpp] + prev[i]) >> 1);
+		break;
+
+	case PNG_FILTER_VALUE_PAETH:
+		for( i = 0; i < bpp; i++ )
+			q[i] = cur[i] - prev[i];
+		for( ; i < rowbytes; i++ )
+			q[i] = cur[i] - 
+				paeth( cur[i - bpp], prev[i], prev[i - bpp] );
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+
+	sum = 0;
+	for( i = 0; i < rowbytes; i++ )
+		sum += q[i] < 128 ? q[i] : 256 - q[i];
+
+	return( sum );
+}
+
+/* Filter write->cur onto the end of the strip buffer, picking the best of the 
+ * enabled filters.
+ */
+static void
+write_filter( Write *write )
+{
+	static const int flags[5] = {
+		VIPS_FOREIGN_PNG_FILTER_NONE,
+		VIPS_FOREIGN_PNG_FILTER_SUB,
+		VIPS_FOREIGN_PNG_FILTER_UP,
+		VIPS_FOREIGN_PNG_FILTER_AVG,
+		VIPS_FOREIGN_PNG_FILTER_PAETH
+	};
+
+	VipsPel *q = write->filtered + write->filtered_length;
+
+	int n_enabled;
+	int best;
+	size_t best_sum;
+	int i;
+
+	n_enabled = 0;
+	for( i = 0; i < 5; i++ )
+		if( write->filter & flags[i] )
+			n_enabled += 1;
+
+	if( n_enabled <= 1 ) {
+		/* Just one filter (or none set, in which case libpng would
+		 * use NONE too): filter directly into the strip.
+		 */
+		best = PNG_FILTER_VALUE_NONE;
+		for( i = 0; i < 5; i++ )
+			if( write->filter & flags[i] )
+				best = i;
+
+		(void) write_filter_row( write, best, q );
+	}
+	else {
+		best = -1;
+		best_sum = 0;
+		for( i = 0; i < 5; i++ ) 
+			if( write->filter & flags[i] ) {
+				size_t sum = 
+					write_filter_row( write, i, 
+						write->trial[i] );
+
+				if( best < 0 || 
+					sum < best_sum ) {
+					best = i;
+					best_sum = sum;
+				}
+			}
+
+		memcpy( q, write->trial[best], write->rowbytes + 1 );
+	}
+
+	write->filtered_length += write->rowbytes + 1;
+}
+
+/* Deflate a chunk. We make a raw deflate stream (no zlib header or trailer) 
+ * primed with the previous 32kb of data, and end it with a sync flush so 
+ * the chunks can simply be concatenated. 
+ */
+static int
+write_deflate_work( void *a, int unit )
+{
+	Write *write = (Write *) a;
+	WriteChunk *chunk = &write->chunks[unit];
+
+	z_stream stream;
+	uLong bound;
+	int result;
+
+	memset( &stream, 0, sizeof( stream ) );
+	if( deflateInit2( &stream, write->compress, Z_DEFLATED, -15, 8, 
+		write->filter == VIPS_FOREIGN_PNG_FILTER_NONE ?
+			Z_DEFAULT_STRATEGY : Z_FILTERED ) != Z_OK ) {
+		vips_error( "vips2png", "%s", _( "unable to init deflate" ) );
+		return( -1 );
+	}
+
+	if( chunk->dict_length > 0 &&
+		deflateSetDictionary( &stream, 
+			chunk->dict, chunk->dict_length ) != Z_OK ) {
+		deflateEnd( &stream );
+		vips_error( "vips2png", "%s", _( "unable to set dictionary" ) );
+		return( -1 );
+	}
+
+	/* deflateBound() is for Z_FINISH, a sync flush can add a few more 
+	 * bytes for the empty stored block.
+	 */
+	bound = deflateBound( &stream, chunk->in_length ) + 16;
+	VIPS_FREE( chunk->out );
+	if( !(chunk->out = vips_malloc( NULL, 2 + bound + 4 )) ) {
+		deflateEnd( &stream );
+		return( -1 );
+	}
+
+	stream.next_in = chunk->in;
+	stream.avail_in = chunk->in_length;
+	stream.next_out = chunk->out + 2;
+	stream.avail_out = bound;
+	result = deflate( &stream, chunk->flush );
+	if( (chunk->flush == Z_FINISH && result != Z_STREAM_END) ||
+		(chunk->flush != Z_FINISH && result != Z_OK) ||
+		stream.avail_in != 0 ) {
+		deflateEnd( &stream );
+		vips_error( "vips2png", "%s", _( "deflate failed" ) );
+		return( -1 );
+	}
+
+	chunk->out_length = bound - stream.avail_out;
+	chunk->adler = adler32( 1L, chunk->in, chunk->in_length );
+
+	deflateEnd( &stream );
+
+	return( 0 );
+}
+
+/* Write the compressed chunks for a strip as IDATs. The first chunk of the
+ * image gets the zlib header, the last gets the adler32 trailer.
+ */
+static int
+write_chunks( Write *write )
+{
+	int i;
+
+	/* Catch PNG errors. 
+	 */
+	if( setjmp( png_jmpbuf( write->pPng ) ) ) 
+		return( -1 );
+
+	for( i = 0; i < write->n_chunks; i++ ) {
+		WriteChunk *chunk = &write->chunks[i];
+
+		VipsPel *p;
+		size_t length;
+
+		p = chunk->out + 2;
+		length = chunk->out_length;
+
+		if( !write->header_written ) {
+			/* CMF is deflate with a 32kb window, FLG has the
+			 * compression level and the check bits.
+			 */
+			int level = write->compress < 2 ? 0 :
+				write->compress < 6 ? 1 :
+				write->compress == 6 ? 2 : 3;
+			int header = (0x78 << 8) | (level << 6);
+
+			header += 31 - (header % 31);
+			p[-2] = header >> 8;
+			p[-1] = header & 0xff;
+
+			p -= 2;
+			length += 2;
+			write->header_written = TRUE;
+		}
+
+		write->adler = adler32_combine( write->adler, 
+			chunk->adler, chunk->in_length );
+
+		if( chunk->flush == Z_FINISH ) {
+			VipsPel *q = p + length;
+
+			q[0] = write->adler >> 24;
+			q[1] = (write->adler >> 16) & 0xff;
+			q[2] = (write->adler >> 8) & 0xff;
+			q[3] = write->adler & 0xff;
+
+			length += 4;
+		}
+
+		png_write_chunk( write->pPng, (png_bytep) "IDAT", p, length );
+	}
+
+	return( 0 );
+}
+
+/* Remember the final 32kb of filtered data, it's the dictionary for the 
+ * next strip.
+ */
+static void
+write_update_window( Write *write )
+{
+	size_t length = write->filtered_length;
+
+	if( length >= WINDOW_SIZE ) {
+		memcpy( write->window, 
+			write->filtered + length - WINDOW_SIZE, WINDOW_SIZE );
+		write->window_length = WINDOW_SIZE;
+	}
+	else {
+		size_t keep = VIPS_MIN( write->window_length, 
+			WINDOW_SIZE - length );
+
+		memmove( write->window, 
+			write->window + write->window_length - keep, keep );
+		memcpy( write->window + keep, write->filtered, length );
+		write->window_length = keep + length;
+	}
+}
+
+/* Filter and compress a strip of scanlines in parallel.
+ */
+static int
+write_png_block_parallel( VipsRegion *region, VipsRect *area, void *a )
+{
+	Write *write = (Write *) a;
+	VipsImage *in = region->im;
+	gboolean last = area->top + area->height == in->Ysize;
+
+	size_t needed;
+	int n_chunks;
+	int i;
+
+	needed = (write->rowbytes + 1) * area->height;
+	if( needed > write->filtered_size ) {
+		VIPS_FREE( write->filtered );
+		if( !(write->filtered = vips_malloc( NULL, needed )) )
+			return( -1 );
+		write->filtered_size = needed;
+	}
+	write->filtered_length = 0;
+
+	for( i = 0; i < area->height; i++ ) {
+		VipsPel *p = VIPS_REGION_ADDR( region, 0, area->top + i );
+
+		/* PNG is always big-endian.
+		 */
+		if( in->BandFmt == VIPS_FORMAT_USHORT &&
+			!vips_amiMSBfirst() ) {
+			size_t j;
+
+			for( j = 0; j < write->rowbytes; j += 2 ) {
+				write->cur[j] = p[j + 1];
+				write->cur[j + 1] = p[j];
+			}
+		}
+		else
+			memcpy( write->cur, p, write->rowbytes );
+
+		write_filter( write );
+
+		VIPS_SWAP( VipsPel *, write->cur, write->prev );
+	}
+
+	/* Cut the filtered strip into chunks. Each chunk uses the 32kb 
+	 * before it as a dictionary.
+	 */
+	n_chunks = VIPS_ROUND_UP( write->filtered_length, CHUNK_SIZE ) / 
+		CHUNK_SIZE;
+	write_chunks_free( write );
+	if( !(write->chunks = VIPS_ARRAY( NULL, n_chunks, WriteChunk )) )
+		return( -1 );
+	memset( write->chunks, 0, n_chunks * sizeof( WriteChunk ) );
+	write->n_chunks = n_chunks;
+
+	for( i = 0; i < n_chunks; i++ ) {
+		WriteChunk *chunk = &write->chunks[i];
+		size_t start = (size_t) i * CHUNK_SIZE;
+
+		chunk->in = write->filtered + start;
+		chunk->in_length = VIPS_MIN( CHUNK_SIZE, 
+			write->filtered_length - start );
+		if( i == 0 ) {
+			chunk->dict = write->window;
+			chunk->dict_length = write->window_length;
+		}
+		else {
+			chunk->dict = chunk->in - WINDOW_SIZE;
+			chunk->dict_length = WINDOW_SIZE;
+		}
+		chunk->flush = last && i == n_chunks - 1 ? 
+			Z_FINISH : Z_SYNC_FLUSH;
+	}
+
+	if( vips__threadpool_run_units( n_chunks, write_deflate_work, write ) ||
+		write_chunks( write ) )
+		return( -1 );
+
+	write_update_window( write );
+
+	return( 0 );
+}
+
+/* Set up for a parallel write. 
+ */
+static int
+write_parallel_init( Write *write, VipsImage *in, int bit_depth )
+{
+	int i;
+
+	write->bpp = VIPS_MAX( 1, in->Bands * bit_depth / 8 );
+	write->rowbytes = (size_t) write->bpp * in->Xsize;
+	write->adler = adler32( 0L, Z_NULL, 0 );
+	write->header_written = FALSE;
+	write->window_length = 0;
+
+	if( !(write->prev = vips_malloc( NULL, write->rowbytes )) ||
+		!(write->cur = vips_malloc( NULL, write->rowbytes )) ||
+		!(write->window = vips_malloc( NULL, WINDOW_SIZE )) )
+		return( -1 );
+	for( i = 0; i < 5; i++ )
+		if( !(write->trial[i] = 
+			vips_malloc( NULL, write->rowbytes + 1 )) )
+			return( -1 );
+
+	/* The row before the first row is all zeros.
+	 */
+	memset( write->prev, 0, write->rowbytes );
+
+	return( 0 );
+}
+#endif /*HAVE_ZLIB*/
+
 static void
 vips__png_set_text( png_structp pPng, png_infop pInfo, 
 	const char *key, const char *value )
@@ -918,7 +1569,8 @@ static int
 write_vips( Write *write, 
 	int compress, int interlace, const char *profile,
 	VipsForeignPngFilter filter, gboolean strip,
-	gboolean palette, int colours, int Q, double dither )
+	gboolean palette, int colours, int Q, double dither,
+	gboolean parallel )
 {
 	VipsImage *in = write->in;
 
@@ -1147,6 +1799,35 @@ write_vips( Write *write,
 		!vips_amiMSBfirst() ) 
 		png_set_swap( write->pPng ); 
 
+#ifdef HAVE_ZLIB
+	/* Parallel compression needs a single pass over the image.
+	 */
+	if( parallel &&
+		!interlace ) {
+		write->parallel = TRUE;
+		write->compress = compress;
+		write->filter = filter;
+		if( write_parallel_init( write, in, bit_depth ) )
+			return( -1 );
+
+		if( vips_sink_disc( in, write_png_block_parallel, write ) )
+			return( -1 );
+
+		/* IEND, since png_write_end() will refuse to run without
+		 * libpng having seen an IDAT.
+		 */
+		if( setjmp( png_jmpbuf( write->pPng ) ) ) 
+			return( -1 );
+		png_write_chunk( write->pPng, (png_bytep) "IEND", NULL, 0 );
+
+		return( 0 );
+	}
+#else /*!HAVE_ZLIB*/
+	if( parallel )
+		g_warning( "%s",
+			_( "ignoring parallel (no zlib support)" ) );
+#endif /*HAVE_ZLIB*/
+
 	if( interlace )	
 		nb_passes = png_set_interlace_handling( write->pPng );
 	else
@@ -1172,7 +1853,8 @@ int
 vips__png_write_stream( VipsImage *in, VipsStreamo *streamo,
 	int compression, int interlace,
 	const char *profile, VipsForeignPngFilter filter, gboolean strip,
-	gboolean palette, int colours, int Q, double dither )
+	gboolean palette, int colours, int Q, double dither, 
+	gboolean parallel )
 {
 	Write *write;
 
@@ -1181,7 +1863,7 @@ vips__png_write_stream( VipsImage *in, VipsStreamo *streamo,
 
 	if( write_vips( write, 
 		compression, interlace, profile, filter, strip, palette,
-		colours, Q, dither ) ) {
+		colours, Q, dither, parallel ) ) {
 		write_finish( write );
 		vips_error( "vips2png", 
 			"%s", _( "unable to write to stream" ) );
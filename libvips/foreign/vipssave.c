@@ -1,6 +1,8 @@
 /* save to vips
  *
  * 24/11/11
+ * 19/10/19
+ * 	- add @tile, @tile_width, @tile_height, @compression, @level
  */
 
 /*
@@ -48,11 +50,19 @@
 #include <vips/vips.h>
 #include <vips/internal.h>
 
+#include "pforeign.h"
+
 typedef struct _VipsForeignSaveVips {
 	VipsForeignSave parent_object;
 
 	char *filename;
 
+	gboolean tile;
+	int tile_width;
+	int tile_height;
+	VipsForeignVipsCompression compression;
+	int level;
+
 } VipsForeignSaveVips;
 
 typedef VipsForeignSaveClass VipsForeignSaveVipsClass;
@@ -72,6 +82,14 @@ vips_foreign_save_vips_build( VipsObject *object )
 		build( object ) )
 		return( -1 );
 
+	/* Compression needs tiles.
+	 */
+	if( vips->tile ||
+		vips->compression != VIPS_FOREIGN_VIPS_COMPRESSION_NONE ) 
+		return( vips__tiled_write( save->ready, vips->filename,
+			vips->tile_width, vips->tile_height, 
+			vips->compression, vips->level ) );
+
 	if( !(x = vips_image_new_mode( vips->filename, "w" )) )
 		return( -1 );
 	if( vips_image_write( save->ready, x ) ) {
@@ -116,11 +134,51 @@ vips_foreign_save_vips_class_init( VipsForeignSaveVipsClass *class )
 		VIPS_ARGUMENT_REQUIRED_INPUT, 
 		G_STRUCT_OFFSET( VipsForeignSaveVips, filename ),
 		NULL );
+
+	VIPS_ARG_BOOL( class, "tile", 2, 
+		_( "Tile" ), 
+		_( "Write a tiled vips file" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsForeignSaveVips, tile ),
+		FALSE );
+
+	VIPS_ARG_INT( class, "tile_width", 3, 
+		_( "Tile width" ), 
+		_( "Tile width in pixels" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsForeignSaveVips, tile_width ),
+		1, 8192, 256 );
+
+	VIPS_ARG_INT( class, "tile_height", 4, 
+		_( "Tile height" ), 
+		_( "Tile height in pixels" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsForeignSaveVips, tile_height ),
+		1, 8192, 256 );
+
+	VIPS_ARG_ENUM( class, "compression", 5, 
+		_( "Compression" ), 
+		_( "Compression for each tile" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsForeignSaveVips, compression ),
+		VIPS_TYPE_FOREIGN_VIPS_COMPRESSION, 
+			VIPS_FOREIGN_VIPS_COMPRESSION_NONE ); 
+
+	VIPS_ARG_INT( class, "level", 6,
+		_( "Level" ),
+		_( "Compression level" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsForeignSaveVips, level ),
+		1, 22, 1 );
 }
 
 static void
 vips_foreign_save_vips_init( VipsForeignSaveVips *vips )
 {
+	vips->tile_width = 256;
+	vips->tile_height = 256;
+	vips->compression = VIPS_FOREIGN_VIPS_COMPRESSION_NONE;
+	vips->level = 1;
 }
 
 /**
@@ -129,8 +187,28 @@ vips_foreign_save_vips_init( VipsForeignSaveVips *vips )
  * @filename: file to write to 
  * @...: %NULL-terminated list of optional named arguments
  *
+ * Optional arguments:
+ *
+ * * @tile: %gboolean, write a tiled file
+ * * @tile_width: %gint for tile size
+ * * @tile_height: %gint for tile size
+ * * @compression: use this #VipsForeignVipsCompression for each tile
+ * * @level: %gint, compression level
+ *
  * Write @in to @filename in VIPS format.
  *
+ * Set @tile to write a tiled vips file. Tiles are @tile_width by 
+ * @tile_height pixels, and are compressed with @compression, 
+ * #VIPS_FOREIGN_VIPS_COMPRESSION_ZSTD for example. Setting @compression 
+ * implies @tile. @level sets the compression effort: 1 (the default) is 
+ * fastest, higher values make smaller files. Deflate uses levels up to 9, 
+ * zstd up to 22. 
+ *
+ * Tiles are compressed in parallel as the image is computed, and 
+ * vips_vipsload() decompresses them in parallel and on demand, so 
+ * tiled files still support random access. Tiled files can only be read by 
+ * libvips 8.9 and later. 
+ *
  * See also: vips_vipsload().
  *
  * Returns: 0 on success, -1 on error.
@@ -0,0 +1,985 @@
+/* Read and write tiled vips files.
+ *
+ * 19/10/19
+ * 	- from tiff2vips.c and vipspng.c
+ */
+
+/*
+
+    This file is part of VIPS.
+
+    VIPS is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA
+
+ */
+
+/*
+
+    These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <vips/intl.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif /*HAVE_UNISTD_H*/
+#ifdef HAVE_IO_H
+#include <io.h>
+#endif /*HAVE_IO_H*/
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+#include <vips/debug.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif /*HAVE_ZLIB*/
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif /*HAVE_ZSTD*/
+
+#include "pforeign.h"
+
+/* A tiled vips file is:
+ *
+ * 	- the usual 64-byte vips header, but with a tiled magic number
+ * 	- a 32-byte tile directory: tile width, tile height, compression
+ * 	  and a spare as 4-byte ints, then the offset of the XML extension
+ * 	  block and a spare as 8-byte ints
+ * 	- the tile index: an 8-byte offset and an 8-byte length for each
+ * 	  tile, left-to-right, top-to-bottom
+ * 	- the compressed tiles
+ * 	- the usual XML extension block
+ *
+ * Everything is in the byte order given by the magic number. Edge tiles are
+ * clipped to the image edges before compression.
+ */
+
+#define DIRECTORY_SIZE (32)
+#define INDEX_ENTRY_SIZE (16)
+
+/* Sanity limit on tile size.
+ */
+#define MAX_TILE_SIZE (8192)
+
+static void
+copy_8byte( gboolean swap, unsigned char *to, unsigned char *from )
+{
+	guint64 *in = (guint64 *) from;
+	guint64 *out = (guint64 *) to;
+
+	if( swap )
+		*out = GUINT64_SWAP_LE_BE( *in );
+	else
+		*out = *in;
+}
+
+/* Can we handle this compression type?
+ */
+static gboolean
+tiled_compression_supported( VipsForeignVipsCompression compression )
+{
+	switch( compression ) {
+	case VIPS_FOREIGN_VIPS_COMPRESSION_NONE:
+		return( TRUE );
+
+#ifdef HAVE_ZLIB
+	case VIPS_FOREIGN_VIPS_COMPRESSION_DEFLATE:
+		return( TRUE );
+#endif /*HAVE_ZLIB*/
+
+#ifdef HAVE_ZSTD
+	case VIPS_FOREIGN_VIPS_COMPRESSION_ZSTD:
+		return( TRUE );
+#endif /*HAVE_ZSTD*/
+
+	default:
+		return( FALSE );
+	}
+}
+
+/* The area covered by a tile, clipped against the image.
+ */
+static void
+tiled_tile_rect( VipsImage *image, int tile_width, int tile_height,
+	int x, int y, VipsRect *tile )
+{
+	VipsRect all;
+
+	tile->left = x * tile_width;
+	tile->top = y * tile_height;
+	tile->width = tile_width;
+	tile->height = tile_height;
+
+	all.left = 0;
+	all.top = 0;
+	all.width = image->Xsize;
+	all.height = image->Ysize;
+	vips_rect_intersectrect( tile, &all, tile );
+}
+
+typedef struct _ReadTiled {
+	char *filename;
+
+	/* Swap from file byte order.
+	 */
+	gboolean swap;
+
+	int tile_width;
+	int tile_height;
+	VipsForeignVipsCompression compression;
+	gint64 extension_offset;
+
+	int tiles_across;
+	int tiles_down;
+
+	/* Position and size of each tile in the file.
+	 */
+	gint64 *offset;
+	gint64 *length;
+} ReadTiled;
+
+/* Each thread gets its own fd, so reads don't need a lock.
+ */
+typedef struct _ReadTiledSeq {
+	ReadTiled *tiled;
+	int fd;
+
+	/* Compressed bytes land here.
+	 */
+	VipsPel *buf;
+	size_t buf_length;
+
+	/* And decompress to here.
+	 */
+	VipsPel *tile;
+} ReadTiledSeq;
+
+static int
+read_tiled_stop( void *vseq, void *a, void *b )
+{
+	ReadTiledSeq *seq = (ReadTiledSeq *) vseq;
+
+	if( seq->fd != -1 ) {
+		vips_tracked_close( seq->fd );
+		seq->fd = -1;
+	}
+	VIPS_FREE( seq->buf );
+	VIPS_FREE( seq->tile );
+	VIPS_FREE( seq );
+
+	return( 0 );
+}
+
+static void *
+read_tiled_start( VipsImage *out, void *a, void *b )
+{
+	ReadTiled *tiled = (ReadTiled *) a;
+
+	ReadTiledSeq *seq;
+
+	if( !(seq = VIPS_NEW( NULL, ReadTiledSeq )) )
+		return( NULL );
+	seq->tiled = tiled;
+	seq->fd = -1;
+	seq->buf = NULL;
+	seq->buf_length = 0;
+	seq->tile = NULL;
+
+	if( (seq->fd = vips__open_image_read( tiled->filename )) == -1 ||
+		!(seq->tile = vips_malloc( NULL,
+			VIPS_IMAGE_SIZEOF_PEL( out ) *
+			tiled->tile_width * tiled->tile_height )) ) {
+		read_tiled_stop( seq, NULL, NULL );
+		return( NULL );
+	}
+
+	return( seq );
+}
+
+/* Read and decompress a tile to seq->tile.
+ */
+static int
+read_tiled_tile( ReadTiledSeq *seq, VipsImage *out,
+	int x, int y, VipsRect *tile )
+{
+	ReadTiled *tiled = seq->tiled;
+	int i = y * tiled->tiles_across + x;
+	gint64 offset = tiled->offset[i];
+	gint64 length = tiled->length[i];
+
+	size_t tile_length;
+	VipsPel *buf;
+
+	tiled_tile_rect( out, 
+		tiled->tile_width, tiled->tile_height, x, y, tile );
+	tile_length = (size_t) VIPS_IMAGE_SIZEOF_PEL( out ) *
+		tile->width * tile->height;
+
+	if( offset == 0 ) {
+		vips_error( "vipsload", _( "tile %d x %d is missing" ), x, y );
+		return( -1 );
+	}
+
+	/* Uncompressed tiles can go straight to the output buffer.
+	 */
+	if( tiled->compression == VIPS_FOREIGN_VIPS_COMPRESSION_NONE ) {
+		if( length != (gint64) tile_length ) {
+			vips_error( "vipsload",
+				_( "tile %d x %d is damaged" ), x, y );
+			return( -1 );
+		}
+		buf = seq->tile;
+	}
+	else {
+		if( (gint64) seq->buf_length < length ) {
+			VIPS_FREE( seq->buf );
+			if( !(seq->buf = vips_malloc( NULL, length )) )
+				return( -1 );
+			seq->buf_length = length;
+		}
+		buf = seq->buf;
+	}
+
+	if( vips__seek( seq->fd, offset, SEEK_SET ) == -1 )
+		return( -1 );
+	if( vips__read( seq->fd, buf, length ) ) {
+		vips_error( "vipsload",
+			_( "unable to read tile %d x %d" ), x, y );
+		return( -1 );
+	}
+
+	switch( tiled->compression ) {
+	case VIPS_FOREIGN_VIPS_COMPRESSION_NONE:
+		break;
+
+#ifdef HAVE_ZLIB
+	case VIPS_FOREIGN_VIPS_COMPRESSION_DEFLATE:
+{
+		uLongf dest_length = tile_length;
+
+		if( uncompress( seq->tile, &dest_length, buf, length ) !=
+			Z_OK ||
+			dest_length != tile_length ) {
+			vips_error( "vipsload",
+				_( "tile %d x %d is damaged" ), x, y );
+			return( -1 );
+		}
+}
+		break;
+#endif /*HAVE_ZLIB*/
+
+#ifdef HAVE_ZSTD
+	case VIPS_FOREIGN_VIPS_COMPRESSION_ZSTD:
+{
+		size_t dest_length;
+
+		dest_length = ZSTD_decompress( seq->tile, tile_length,
+			buf, length );
+		if( ZSTD_isError( dest_length ) ||
+			dest_length != tile_length ) {
+			vips_error( "vipsload",
+				_( "tile %d x %d is damaged" ), x, y );
+			return( -1 );
+		}
+}
+		break;
+#endif /*HAVE_ZSTD*/
+
+	default:
+		g_assert_not_reached();
+		break;
+	}
+
+	return( 0 );
+}
+
+static int
+read_tiled_generate( VipsRegion *or,
+	void *vseq, void *a, void *b, gboolean *stop )
+{
+	ReadTiledSeq *seq = (ReadTiledSeq *) vseq;
+	ReadTiled *tiled = (ReadTiled *) a;
+	VipsRect *r = &or->valid;
+	size_t sizeof_pel = VIPS_IMAGE_SIZEOF_PEL( or->im );
+
+	/* The range of tiles we touch.
+	 */
+	int xs = r->left / tiled->tile_width;
+	int ys = r->top / tiled->tile_height;
+	int xe = (VIPS_RECT_RIGHT( r ) - 1) / tiled->tile_width;
+	int ye = (VIPS_RECT_BOTTOM( r ) - 1) / tiled->tile_height;
+
+	int x, y, z;
+
+	VIPS_GATE_START( "read_tiled_generate: work" );
+
+	for( y = ys; y <= ye; y++ )
+		for( x = xs; x <= xe; x++ ) {
+			VipsRect tile;
+			VipsRect hit;
+
+			if( read_tiled_tile( seq, or->im, x, y, &tile ) ) {
+				VIPS_GATE_STOP( "read_tiled_generate: work" );
+				return( -1 );
+			}
+
+			vips_rect_intersectrect( &tile, r, &hit );
+
+			for( z = 0; z < hit.height; z++ ) {
+				VipsPel *p = seq->tile + sizeof_pel *
+					((hit.top - tile.top + z) *
+					 tile.width +
+					 hit.left - tile.left);
+				VipsPel *q = VIPS_REGION_ADDR( or,
+					hit.left, hit.top + z );
+
+				memcpy( q, p, sizeof_pel * hit.width );
+			}
+		}
+
+	VIPS_GATE_STOP( "read_tiled_generate: work" );
+
+	return( 0 );
+}
+
+/* Read the header, tile directory, tile index and XML.
+ */
+static int
+read_tiled_header( ReadTiled *tiled, int fd, VipsImage *out )
+{
+	unsigned char header[VIPS_SIZEOF_HEADER];
+	unsigned char directory[DIRECTORY_SIZE];
+	guint32 value[4];
+	gint64 value64[2];
+	gint64 file_length;
+	guint64 tile_size;
+	int n_tiles;
+	unsigned char *entries;
+	unsigned char *p;
+	int i;
+
+	if( vips__seek( fd, 0, SEEK_SET ) == -1 ||
+		vips__read( fd, header, VIPS_SIZEOF_HEADER ) ||
+		vips__read_header_bytes_tiled( out, header ) ) {
+		vips_error( "vipsload",
+			_( "unable to read header for \"%s\"" ),
+			tiled->filename );
+		return( -1 );
+	}
+	if( out->magic != VIPS_MAGIC_TILED_INTEL &&
+		out->magic != VIPS_MAGIC_TILED_SPARC ) {
+		vips_error( "vipsload",
+			_( "\"%s\" is not a tiled vips image" ),
+			tiled->filename );
+		return( -1 );
+	}
+	tiled->swap = vips_amiMSBfirst() !=
+		(out->magic == VIPS_MAGIC_TILED_SPARC);
+
+	/* Pixels come out of the decompressor in file byte order.
+	 */
+	out->magic = out->magic == VIPS_MAGIC_TILED_SPARC ?
+		VIPS_MAGIC_SPARC : VIPS_MAGIC_INTEL;
+
+	if( vips__read( fd, directory, DIRECTORY_SIZE ) ) {
+		vips_error( "vipsload",
+			"%s", _( "unable to read tile directory" ) );
+		return( -1 );
+	}
+	p = directory;
+	for( i = 0; i < 4; i++ ) {
+		vips__copy_4byte( tiled->swap, (unsigned char *) &value[i], p );
+		p += 4;
+	}
+	for( i = 0; i < 2; i++ ) {
+		copy_8byte( tiled->swap, (unsigned char *) &value64[i], p );
+		p += 8;
+	}
+	tiled->tile_width = value[0];
+	tiled->tile_height = value[1];
+	tiled->compression = value[2];
+	tiled->extension_offset = value64[0];
+
+	if( (file_length = vips_file_length( fd )) == -1 )
+		return( -1 );
+
+	tile_size = (guint64) VIPS_IMAGE_SIZEOF_PEL( out ) *
+		value[0] * value[1];
+	if( value[0] < 1 ||
+		value[0] > MAX_TILE_SIZE ||
+		value[1] < 1 ||
+		value[1] > MAX_TILE_SIZE ||
+		tile_size > INT_MAX ||
+		tiled->extension_offset > file_length ) {
+		vips_error( "vipsload",
+			"%s", _( "bad tile directory" ) );
+		return( -1 );
+	}
+	if( value[2] >= VIPS_FOREIGN_VIPS_COMPRESSION_LAST ||
+		!tiled_compression_supported( tiled->compression ) ) {
+		vips_error( "vipsload",
+			"%s", _( "unsupported compression" ) );
+		return( -1 );
+	}
+
+	tiled->tiles_across =
+		VIPS_ROUND_UP( out->Xsize, tiled->tile_width ) /
+			tiled->tile_width;
+	tiled->tiles_down =
+		VIPS_ROUND_UP( out->Ysize, tiled->tile_height ) /
+			tiled->tile_height;
+	if( (guint64) tiled->tiles_across * tiled->tiles_down *
+		INDEX_ENTRY_SIZE > file_length ) {
+		vips_error( "vipsload",
+			"%s", _( "file has been truncated" ) );
+		return( -1 );
+	}
+	n_tiles = tiled->tiles_across * tiled->tiles_down;
+
+	if( !(tiled->offset = VIPS_ARRAY( out, n_tiles, gint64 )) ||
+		!(tiled->length = VIPS_ARRAY( out, n_tiles, gint64 )) ||
+		!(entries = vips_malloc( NULL, n_tiles * INDEX_ENTRY_SIZE )) )
+		return( -1 );
+	if( vips__read( fd, entries, n_tiles * INDEX_ENTRY_SIZE ) ) {
+		vips_free( entries );
+		vips_error( "vipsload",
+			"%s", _( "unable to read tile index" ) );
+		return( -1 );
+	}
+	p = entries;
+	for( i = 0; i < n_tiles; i++ ) {
+		copy_8byte( tiled->swap, 
+			(unsigned char *) &tiled->offset[i], p );
+		copy_8byte( tiled->swap,
+			(unsigned char *) &tiled->length[i], p + 8 );
+		p += INDEX_ENTRY_SIZE;
+
+		if( tiled->offset[i] < 0 ||
+			tiled->length[i] < 0 ||
+			tiled->length[i] > INT_MAX ||
+			tiled->offset[i] + tiled->length[i] > file_length ) {
+			vips_free( entries );
+			vips_error( "vipsload",
+				"%s", _( "bad tile index" ) );
+			return( -1 );
+		}
+	}
+	vips_free( entries );
+
+	/* As vips_image_open_input(), don't fail on bad XML.
+	 */
+	if( tiled->extension_offset > 0 &&
+		vips__readhist_fd( out, fd, tiled->extension_offset ) ) {
+		g_warning( _( "error reading vips image metadata: %s" ),
+			vips_error_buffer() );
+		vips_error_clear();
+	}
+
+	return( 0 );
+}
+
+/* Open a tiled vips file for RANDOM access. Tiles are decompressed on demand,
+ * and in parallel.
+ */
+int
+vips__tiled_read( const char *filename, VipsImage *out )
+{
+	VipsImage **t = (VipsImage **)
+		vips_object_local_array( VIPS_OBJECT( out ), 3 );
+
+	ReadTiled *tiled;
+	int fd;
+
+	if( !(tiled = VIPS_NEW( out, ReadTiled )) )
+		return( -1 );
+	tiled->filename = vips_strdup( VIPS_OBJECT( out ), filename );
+	tiled->offset = NULL;
+	tiled->length = NULL;
+
+	/* Read to this image, then cache to out, see below.
+	 */
+	t[0] = vips_image_new();
+
+	if( (fd = vips__open_image_read( filename )) == -1 )
+		return( -1 );
+	if( read_tiled_header( tiled, fd, t[0] ) ) {
+		vips_tracked_close( fd );
+		return( -1 );
+	}
+	vips_tracked_close( fd );
+
+	/* Hint thinstrip, like tiff2vips, since the cache lets us serve
+	 * anything.
+	 */
+	vips_image_pipelinev( t[0], VIPS_DEMAND_STYLE_THINSTRIP, NULL );
+
+	if( vips_image_generate( t[0],
+		read_tiled_start, read_tiled_generate, read_tiled_stop,
+		tiled, NULL ) )
+		return( -1 );
+
+	/* Enough tiles for two complete rows. Threaded, so many tiles can
+	 * decompress at once.
+	 */
+	if( vips_tilecache( t[0], &t[1],
+		"tile_width", tiled->tile_width,
+		"tile_height", tiled->tile_height,
+		"max_tiles", 2 * tiled->tiles_across,
+		"threaded", TRUE,
+		NULL ) )
+		return( -1 );
+
+	if( tiled->swap ) {
+		if( vips_byteswap( t[1], &t[2], NULL ) )
+			return( -1 );
+	}
+	else {
+		t[2] = t[1];
+		g_object_ref( t[2] );
+	}
+
+	if( vips_image_write( t[2], out ) )
+		return( -1 );
+
+	return( 0 );
+}
+
+typedef struct _WriteTiled WriteTiled;
+
+/* A tile we are compressing in a strip.
+ */
+typedef struct _WriteTile {
+	/* Area of the image.
+	 */
+	VipsRect rect;
+
+	/* Pixels copied out of the strip.
+	 */
+	VipsPel *pixels;
+	size_t pixels_length;
+
+	/* Compress to here.
+	 */
+	VipsPel *compressed;
+	size_t compressed_size;
+	size_t compressed_length;
+} WriteTile;
+
+struct _WriteTiled {
+	VipsImage *in;
+	int tile_width;
+	int tile_height;
+	VipsForeignVipsCompression compression;
+	int level;
+
+	int fd;
+	int tiles_across;
+	int tiles_down;
+
+	/* The index we build as we write.
+	 */
+	gint64 *offset;
+	gint64 *length;
+
+	/* Where the next tile goes.
+	 */
+	gint64 position;
+
+	/* Accumulate a row of tiles here.
+	 */
+	VipsPel *strip;
+	int strip_top;
+	int strip_height;
+
+	/* One job per tile in a strip.
+	 */
+	WriteTile *tiles;
+};
+
+static void
+write_tiled_free( WriteTiled *write )
+{
+	int i;
+
+	if( write->tiles ) {
+		for( i = 0; i < write->tiles_across; i++ ) {
+			VIPS_FREE( write->tiles[i].pixels );
+			VIPS_FREE( write->tiles[i].compressed );
+		}
+		VIPS_FREE( write->tiles );
+	}
+	if( write->fd != -1 ) {
+		vips_tracked_close( write->fd );
+		write->fd = -1;
+	}
+	VIPS_FREE( write->strip );
+	VIPS_FREE( write->offset );
+	VIPS_FREE( write->length );
+	VIPS_FREE( write );
+}
+
+/* Worst-case compressed size.
+ */
+static size_t
+write_tiled_bound( WriteTiled *write, size_t length )
+{
+	switch( write->compression ) {
+#ifdef HAVE_ZLIB
+	case VIPS_FOREIGN_VIPS_COMPRESSION_DEFLATE:
+		return( compressBound( length ) );
+#endif /*HAVE_ZLIB*/
+
+#ifdef HAVE_ZSTD
+	case VIPS_FOREIGN_VIPS_COMPRESSION_ZSTD:
+		return( ZSTD_compressBound( length ) );
+#endif /*HAVE_ZSTD*/
+
+	default:
+		return( 0 );
+	}
+}
+
+static WriteTiled *
+write_tiled_new( VipsImage *in,
+	int tile_width, int tile_height,
+	VipsForeignVipsCompression compression, int level )
+{
+	size_t tile_size = (size_t) VIPS_IMAGE_SIZEOF_PEL( in ) *
+		tile_width * tile_height;
+
+	WriteTiled *write;
+	int n_tiles;
+	int i;
+
+	if( !(write = VIPS_NEW( NULL, WriteTiled )) )
+		return( NULL );
+	memset( write, 0, sizeof( WriteTiled ) );
+	write->in = in;
+	write->tile_width = tile_width;
+	write->tile_height = tile_height;
+	write->compression = compression;
+	write->level = level;
+	write->fd = -1;
+	write->tiles_across =
+		VIPS_ROUND_UP( in->Xsize, tile_width ) / tile_width;
+	write->tiles_down =
+		VIPS_ROUND_UP( in->Ysize, tile_height ) / tile_height;
+	write->strip_top = 0;
+	write->strip_height = VIPS_MIN( tile_height, in->Ysize );
+	n_tiles = write->tiles_across * write->tiles_down;
+
+	if( !(write->offset = VIPS_ARRAY( NULL, n_tiles, gint64 )) ||
+		!(write->length = VIPS_ARRAY( NULL, n_tiles, gint64 )) ||
+		!(write->strip = vips_malloc( NULL,
+			VIPS_IMAGE_SIZEOF_LINE( in ) * tile_height )) ||
+		!(write->tiles = VIPS_ARRAY( NULL,
+			write->tiles_across, WriteTile )) ) {
+		write_tiled_free( write );
+		return( NULL );
+	}
+	memset( write->offset, 0, n_tiles * sizeof( gint64 ) );
+	memset( write->length, 0, n_tiles * sizeof( gint64 ) );
+	memset( write->tiles, 0, write->tiles_across * sizeof( WriteTile ) );
+
+	for( i = 0; i < write->tiles_across; i++ ) {
+		WriteTile *tile = &write->tiles[i];
+
+		if( !(tile->pixels = vips_malloc( NULL, tile_size )) ) {
+			write_tiled_free( write );
+			return( NULL );
+		}
+
+		tile->compressed_size = write_tiled_bound( write, tile_size );
+		if( tile->compressed_size > 0 &&
+			!(tile->compressed = vips_malloc( NULL,
+				tile->compressed_size )) ) {
+			write_tiled_free( write );
+			return( NULL );
+		}
+	}
+
+	return( write );
+}
+
+/* Copy a tile out of the strip and compress it. This runs on many threads,
+ * each working on a different tile.
+ */
+static int
+write_tiled_work( void *a, int unit )
+{
+	WriteTiled *write = (WriteTiled *) a;
+	WriteTile *tile = &write->tiles[unit];
+	size_t sizeof_pel = VIPS_IMAGE_SIZEOF_PEL( write->in );
+	size_t sizeof_line = VIPS_IMAGE_SIZEOF_LINE( write->in );
+	size_t tile_line = sizeof_pel * tile->rect.width;
+
+	int y;
+
+	for( y = 0; y < tile->rect.height; y++ )
+		memcpy( tile->pixels + y * tile_line,
+			write->strip + y * sizeof_line +
+				tile->rect.left * sizeof_pel,
+			tile_line );
+	tile->pixels_length = tile_line * tile->rect.height;
+
+	switch( write->compression ) {
+	case VIPS_FOREIGN_VIPS_COMPRESSION_NONE:
+		tile->compressed_length = tile->pixels_length;
+		break;
+
+#ifdef HAVE_ZLIB
+	case VIPS_FOREIGN_VIPS_COMPRESSION_DEFLATE:
+{
+		uLongf length = tile->compressed_size;
+
+		if( compress2( tile->compressed, &length,
+			tile->pixels, tile->pixels_length,
+			VIPS_CLIP( 1, write->level, 9 ) ) != Z_OK ) {
+			vips_error( "vipssave",
+				"%s", _( "deflate error" ) );
+			return( -1 );
+		}
+		tile->compressed_length = length;
+}
+		break;
+#endif /*HAVE_ZLIB*/
+
+#ifdef HAVE_ZSTD
+	case VIPS_FOREIGN_VIPS_COMPRESSION_ZSTD:
+{
+		size_t length;
+
+		length = ZSTD_compress( tile->compressed,
+			tile->compressed_size,
+			tile->pixels, tile->pixels_length,
+			write->level );
+		if( ZSTD_isError( length ) ) {
+			vips_error( "vipssave",
+				"%s", ZSTD_getErrorName( length ) );
+			return( -1 );
+		}
+		tile->compressed_length = length;
+}
+		break;
+#endif /*HAVE_ZSTD*/
+
+	default:
+		g_assert_not_reached();
+		break;
+	}
+
+	return( 0 );
+}
+
+/* Compress all the tiles in the strip in parallel, then append to the file
+ * in order.
+ */
+static int
+write_tiled_strip( WriteTiled *write )
+{
+	int y = write->strip_top / write->tile_height;
+
+	int i;
+
+	for( i = 0; i < write->tiles_across; i++ )
+		tiled_tile_rect( write->in,
+			write->tile_width, write->tile_height,
+			i, y, &write->tiles[i].rect );
+
+	if( vips__threadpool_run_units( write->tiles_across, 
+		write_tiled_work, write ) )
+		return( -1 );
+
+	for( i = 0; i < write->tiles_across; i++ ) {
+		WriteTile *tile = &write->tiles[i];
+		int n = y * write->tiles_across + i;
+		VipsPel *data =
+			write->compression ==
+				VIPS_FOREIGN_VIPS_COMPRESSION_NONE ?
+			tile->pixels : tile->compressed;
+
+		if( vips__write( write->fd, data, tile->compressed_length ) )
+			return( -1 );
+
+		write->offset[n] = write->position;
+		write->length[n] = tile->compressed_length;
+		write->position += tile->compressed_length;
+	}
+
+	return( 0 );
+}
+
+/* Accumulate lines into the strip, write when we have a complete row of
+ * tiles.
+ */
+static int
+write_tiled_block( VipsRegion *region, VipsRect *area, void *a )
+{
+	WriteTiled *write = (WriteTiled *) a;
+	size_t sizeof_line = VIPS_IMAGE_SIZEOF_LINE( write->in );
+
+	int y;
+
+	for( y = area->top; y < VIPS_RECT_BOTTOM( area ); y++ ) {
+		memcpy( write->strip + (y - write->strip_top) * sizeof_line,
+			VIPS_REGION_ADDR( region, 0, y ),
+			sizeof_line );
+
+		if( y == write->strip_top + write->strip_height - 1 ) {
+			if( write_tiled_strip( write ) )
+				return( -1 );
+
+			write->strip_top += write->tile_height;
+			write->strip_height = VIPS_MIN( write->tile_height,
+				write->in->Ysize - write->strip_top );
+		}
+	}
+
+	return( 0 );
+}
+
+/* Write the tile directory and index. This goes after the header.
+ */
+static int
+write_tiled_index( WriteTiled *write, gint64 extension_offset )
+{
+	int n_tiles = write->tiles_across * write->tiles_down;
+	size_t length = DIRECTORY_SIZE + (size_t) n_tiles * INDEX_ENTRY_SIZE;
+
+	unsigned char *buf;
+	unsigned char *p;
+	guint32 value[4];
+	gint64 value64[2];
+	int i;
+
+	if( !(buf = vips_malloc( NULL, length )) )
+		return( -1 );
+
+	value[0] = write->tile_width;
+	value[1] = write->tile_height;
+	value[2] = write->compression;
+	value[3] = 0;
+	value64[0] = extension_offset;
+	value64[1] = 0;
+
+	p = buf;
+	for( i = 0; i < 4; i++ ) {
+		memcpy( p, &value[i], 4 );
+		p += 4;
+	}
+	for( i = 0; i < 2; i++ ) {
+		memcpy( p, &value64[i], 8 );
+		p += 8;
+	}
+	for( i = 0; i < n_tiles; i++ ) {
+		memcpy( p, &write->offset[i], 8 );
+		memcpy( p + 8, &write->length[i], 8 );
+		p += INDEX_ENTRY_SIZE;
+	}
+
+	if( vips__seek( write->fd, VIPS_SIZEOF_HEADER, SEEK_SET ) == -1 ||
+		vips__write( write->fd, buf, length ) ) {
+		vips_free( buf );
+		return( -1 );
+	}
+	vips_free( buf );
+
+	return( 0 );
+}
+
+/* Write @in as a tiled vips file. Tiles are compressed in parallel as
+ * vips_sink_disc() generates each row of tiles.
+ */
+int
+vips__tiled_write( VipsImage *in, const char *filename,
+	int tile_width, int tile_height,
+	VipsForeignVipsCompression compression, int level )
+{
+	unsigned char header[VIPS_SIZEOF_HEADER];
+
+	WriteTiled *write;
+	VipsImage *x;
+	gint64 extension_offset;
+
+	if( !tiled_compression_supported( compression ) ) {
+		vips_error( "vipssave",
+			"%s", _( "unsupported compression" ) );
+		return( -1 );
+	}
+	if( tile_width < 1 ||
+		tile_width > MAX_TILE_SIZE ||
+		tile_height < 1 ||
+		tile_height > MAX_TILE_SIZE ) {
+		vips_error( "vipssave", "%s", _( "bad tile size" ) );
+		return( -1 );
+	}
+
+	if( !(write = write_tiled_new( in,
+		tile_width, tile_height, compression, level )) )
+		return( -1 );
+
+	/* Make the header on a copy, since we need to set a tiled magic.
+	 */
+	x = vips_image_new();
+	if( vips_image_pipelinev( x, VIPS_DEMAND_STYLE_THINSTRIP, in, NULL ) ) {
+		g_object_unref( x );
+		write_tiled_free( write );
+		return( -1 );
+	}
+	x->magic = vips_amiMSBfirst() ?
+		VIPS_MAGIC_TILED_SPARC : VIPS_MAGIC_TILED_INTEL;
+	vips__write_header_bytes( x, header );
+	g_object_unref( x );
+
+	/* Tiles start after the directory and entries, which we fill in at
+	 * the end.
+	 */
+	write->position = VIPS_SIZEOF_HEADER + DIRECTORY_SIZE +
+		(gint64) write->tiles_across * write->tiles_down *
+			INDEX_ENTRY_SIZE;
+
+	if( (write->fd = vips__open_image_write( filename, FALSE )) < 0 ||
+		vips__write( write->fd, header, VIPS_SIZEOF_HEADER ) ||
+		vips__seek( write->fd, write->position, SEEK_SET ) == -1 ||
+		vips_sink_disc( in, write_tiled_block, write ) ) {
+		write_tiled_free( write );
+		return( -1 );
+	}
+
+	extension_offset = write->position;
+	if( vips__writehist_fd( in, write->fd, extension_offset ) ||
+		write_tiled_index( write, extension_offset ) ) {
+		write_tiled_free( write );
+		return( -1 );
+	}
+
+	write_tiled_free( write );
+
+	return( 0 );
+}
@@ -26,6 +26,11 @@
  * 	- support array of delays 
  * 14/10/19
  * 	- revise for stream IO
+ * 19/10/19
+ * 	- build a keyframe index and jump straight to the nearest keyframe
+ * 	  for @page
+ * 	- frames are still decoded one at a time: we run inside a generate
+ * 	  function, so we can't start a threadpool of our own
  */
 
 /*
@@ -154,6 +159,11 @@ typedef struct {
 	 */
 	WebPMuxAnimDispose dispose_method;
 	VipsRect dispose_rect;
+
+	/* For each frame, TRUE if it can be composited without reference to
+	 * earlier frames. Indexed from 0.
+	 */
+	gboolean *keyframe;
 } Read;
 
 const char *
@@ -328,6 +338,7 @@ vips__iswebp_stream( VipsStreami *streami )
 static int
 read_free( Read *read )
 {
+	VIPS_FREE( read->keyframe );
 	WebPDemuxReleaseIterator( &read->iter );
 	VIPS_UNREF( read->frame );
 	VIPS_FREEF( WebPDemuxDelete, read->demux );
@@ -358,6 +369,7 @@ read_new( VipsStreami *streami, int page, int n, double scale )
 	read->frame = NULL;
 	read->dispose_method = WEBP_MUX_DISPOSE_NONE;
 	read->frame_no = 0;
+	read->keyframe = NULL;
 
 	WebPInitDecoderConfig( &read->config );
 	read->config.options.use_threads = 1;
@@ -437,20 +449,54 @@ read_header( Read *read, VipsImage *out )
 			VIPS_META_PAGE_HEIGHT, read->frame_height );
 
 		if( WebPDemuxGetFrame( read->demux, 1, &iter ) ) {
+			gboolean prev_full;
+			gboolean prev_keyframe;
+			WebPMuxAnimDispose prev_dispose;
 			int i;
 
 			read->delays = (int *) 
 				g_malloc0( read->frame_count * sizeof( int ) );
 			for( i = 0; i < read->frame_count; i++ ) 
 				read->delays[i] = 40;
+			read->keyframe = (gboolean *) 
+				g_malloc0( read->frame_count * 
+					sizeof( gboolean ) );
 
+			prev_full = FALSE;
+			prev_keyframe = FALSE;
+			prev_dispose = WEBP_MUX_DISPOSE_NONE;
 			do {
+				gboolean full = 
+					iter.x_offset == 0 &&
+					iter.y_offset == 0 &&
+					iter.width == read->canvas_width &&
+					iter.height == read->canvas_height;
+				gboolean keyframe;
+
 				g_assert( iter.frame_num >= 1 &&
 					iter.frame_num <= read->frame_count );
 
 				read->delays[iter.frame_num - 1] = 
 					iter.duration;
 
+				/* A keyframe paints every pixel, or follows a 
+				 * frame which left the canvas transparent. 
+				 * These are the rules libwebp uses.
+				 */
+				keyframe = iter.frame_num == 1 ||
+					(full &&
+					 (!iter.has_alpha ||
+					  iter.blend_method == 
+					  	WEBP_MUX_NO_BLEND)) ||
+					(prev_dispose == 
+					 	WEBP_MUX_DISPOSE_BACKGROUND &&
+					 (prev_full || prev_keyframe));
+				read->keyframe[iter.frame_num - 1] = keyframe;
+
+				prev_full = full;
+				prev_keyframe = keyframe;
+				prev_dispose = iter.dispose_method;
+
 				/* We need the alpha in an animation if:
 				 *   - any frame has transparent pixels 
 				 *   - any frame doesn't fill the whole canvas.
@@ -596,6 +642,47 @@ read_frame( Read *read,
 	return( frame );
 }
 
+/* Jump to the nearest keyframe at or before @frame_num, if that's ahead of
+ * where we are now. 
+ */
+static int
+read_seek( Read *read, int frame_num )
+{
+	int keyframe;
+
+	if( !read->keyframe )
+		return( 0 );
+
+	for( keyframe = frame_num; keyframe > 1; keyframe-- )
+		if( read->keyframe[keyframe - 1] )
+			break;
+
+	if( keyframe > read->frame_no + 1 ) {
+		guint32 zero = 0;
+		VipsRect all = { 0, 0, read->frame->Xsize, read->frame->Ysize };
+
+#ifdef DEBUG
+		printf( "read_seek: jumping to frame %d\n", keyframe ); 
+#endif /*DEBUG*/
+
+		WebPDemuxReleaseIterator( &read->iter );
+		if( !WebPDemuxGetFrame( read->demux, keyframe, &read->iter ) ) {
+			vips_error( "webp2vips", 
+				"%s", _( "not enough frames" ) ); 
+			return( -1 );
+		}
+
+		/* Keyframes either paint every pixel, or expect a 
+		 * transparent canvas.
+		 */
+		vips_image_paint_area( read->frame, &all, (VipsPel *) &zero );
+		read->dispose_method = WEBP_MUX_DISPOSE_NONE;
+		read->frame_no = keyframe - 1;
+	}
+
+	return( 0 );
+}
+
 static int
 read_next_frame( Read *read )
 {
@@ -700,6 +787,10 @@ read_webp_generate( VipsRegion *or,
 
 	g_assert( r->height == 1 );
 
+	if( read->frame_no < frame &&
+		read_seek( read, frame ) )
+		return( -1 );
+
 	while( read->frame_no < frame ) {
 		if( read_next_frame( read ) )
 			return( -1 );
@@ -55,6 +55,14 @@
 
 #ifdef HAVE_LIBWEBP
 
+/* WebP is "RIFF xxxx WEBP", with xxxx the chunk length.
+ */
+static const VipsForeignMagic vips_foreign_load_webp_magic[] = {
+	{ 0, 12, "RIFF\0\0\0\0WEBP", 
+		"\377\377\377\377\0\0\0\0\377\377\377\377" },
+	{ 0 }
+};
+
 typedef struct _VipsForeignLoadWebp {
 	VipsForeignLoad parent_object;
 
@@ -211,6 +219,8 @@ vips_foreign_load_webp_stream_class_init(
 	foreign_class->priority = -50;
 
 	load_class->is_a_stream = vips__iswebp_stream; 
+	vips_foreign_load_class_set_magic( load_class, 
+		vips_foreign_load_webp_magic );
 	load_class->header = vips_foreign_load_webp_stream_header;
 	load_class->load = vips_foreign_load_webp_stream_load;
 
@@ -330,6 +340,8 @@ vips_foreign_load_webp_file_class_init( VipsForeignLoadWebpFileClass *class )
 	load_class->get_flags_filename = 
 		vips_foreign_load_webp_file_get_flags_filename;
 	load_class->is_a = vips_foreign_load_webp_file_is_a;
+	vips_foreign_load_class_set_magic( load_class, 
+		vips_foreign_load_webp_magic );
 	load_class->header = vips_foreign_load_webp_file_header;
 	load_class->load = vips_foreign_load_webp_file_load;
 
@@ -436,6 +448,8 @@ vips_foreign_load_webp_buffer_class_init(
 	foreign_class->priority = -50;
 
 	load_class->is_a_buffer = vips_foreign_load_webp_buffer_is_a_buffer; 
+	vips_foreign_load_class_set_magic( load_class, 
+		vips_foreign_load_webp_magic );
 	load_class->header = vips_foreign_load_webp_buffer_header;
 	load_class->load = vips_foreign_load_webp_buffer_load;
 
@@ -6,6 +6,8 @@
  * 	- add animated webp support
  * 15/1/19 lovell
  * 	- add @reduction_effort 
+ * 19/10/19
+ * 	- add @thread_level and @frame_parallel
  */
 
 /*
@@ -99,6 +101,14 @@ typedef struct _VipsForeignSaveWebp {
 	 */
 	int kmax;
 
+	/* libwebp's multi-threaded encode.
+	 */
+	int thread_level;
+
+	/* Encode animation frames independently, in parallel.
+	 */
+	gboolean frame_parallel;
+
 } VipsForeignSaveWebp;
 
 typedef VipsForeignSaveClass VipsForeignSaveWebpClass;
@@ -204,6 +214,20 @@ vips_foreign_save_webp_class_init( VipsForeignSaveWebpClass *class )
 		VIPS_ARGUMENT_OPTIONAL_INPUT,
 		G_STRUCT_OFFSET( VipsForeignSaveWebp, reduction_effort ),
 		0, 6, 4 );
+
+	VIPS_ARG_INT( class, "thread_level", 20,
+		_( "Thread level" ),
+		_( "Use multi-threaded encoding, if non-zero" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsForeignSaveWebp, thread_level ),
+		0, 1, 0 );
+
+	VIPS_ARG_BOOL( class, "frame_parallel", 21,
+		_( "Frame parallel" ),
+		_( "Encode animation frames in parallel" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsForeignSaveWebp, frame_parallel ),
+		FALSE );
 }
 
 static void
@@ -248,6 +272,7 @@ vips_foreign_save_webp_stream_build( VipsObject *object )
 		webp->smart_subsample, webp->near_lossless,
 		webp->alpha_q, webp->reduction_effort,
 		webp->min_size, webp->kmin, webp->kmax,
+		webp->thread_level, webp->frame_parallel,
 		save->strip ) )
 		return( -1 );
 
@@ -316,6 +341,7 @@ vips_foreign_save_webp_file_build( VipsObject *object )
 		webp->smart_subsample, webp->near_lossless,
 		webp->alpha_q, webp->reduction_effort,
 		webp->min_size, webp->kmin, webp->kmax,
+		webp->thread_level, webp->frame_parallel,
 		save->strip ) ) {
 		VIPS_UNREF( streamo );
 		return( -1 );
@@ -388,6 +414,7 @@ vips_foreign_save_webp_buffer_build( VipsObject *object )
 		webp->smart_subsample, webp->near_lossless,
 		webp->alpha_q, webp->reduction_effort,
 		webp->min_size, webp->kmin, webp->kmax,
+		webp->thread_level, webp->frame_parallel,
 		save->strip ) ) {
 		VIPS_UNREF( streamo );
 		return( -1 );
@@ -460,6 +487,7 @@ vips_foreign_save_webp_mime_build( VipsObject *object )
 		webp->smart_subsample, webp->near_lossless,
 		webp->alpha_q, webp->reduction_effort,
 		webp->min_size, webp->kmin, webp->kmax,
+		webp->thread_level, webp->frame_parallel,
 		save->strip ) ) {
 		VIPS_UNREF( streamo );
 		return( -1 );
@@ -517,6 +545,8 @@ vips_foreign_save_webp_mime_init( VipsForeignSaveWebpMime *mime )
  * * @min_size: %gboolean, minimise size
  * * @kmin: %gint, minimum number of frames between keyframes
  * * @kmax: %gint, maximum number of frames between keyframes
+ * * @thread_level: %gint, use multi-threaded encoding, if non-zero
+ * * @frame_parallel: %gboolean, encode animation frames in parallel
  * * @strip: %gboolean, remove all metadata from image
  *
  * Write an image to a file in WebP format. 
@@ -548,6 +578,14 @@ vips_foreign_save_webp_mime_init( VipsForeignSaveWebpMime *mime )
  * frames between frames. Setting 0 means no keyframes. By default, keyframes
  * are disabled.
  *
+ * Set @thread_level to 1 to let libwebp use more than one thread to encode
+ * each frame.
+ *
+ * Set @frame_parallel to encode the frames of an animation independently
+ * and in parallel, one frame per thread. Every frame becomes a full-canvas
+ * keyframe, so files will usually be larger, and @min_size, @kmin and @kmax
+ * are ignored. 
+ *
  * Use the metadata items `gif-loop` and `delay` to set the number of
  * loops for the animation and the frame delays.
  *
@@ -590,6 +628,8 @@ vips_webpsave( VipsImage *in, const char *filename, ... )
  * * @min_size: %gboolean, minimise size
  * * @kmin: %gint, minimum number of frames between keyframes
  * * @kmax: %gint, maximum number of frames between keyframes
+ * * @thread_level: %gint, use multi-threaded encoding, if non-zero
+ * * @frame_parallel: %gboolean, encode animation frames in parallel
  * * @strip: %gboolean, remove all metadata from image
  *
  * As vips_webpsave(), but save to a memory buffer.
@@ -647,6 +687,8 @@ vips_webpsave_buffer( VipsImage *in, void **buf, size_t *len, ... )
  * * @min_size: %gboolean, minimise size
  * * @kmin: %gint, minimum number of frames between keyframes
  * * @kmax: %gint, maximum number of frames between keyframes
+ * * @thread_level: %gint, use multi-threaded encoding, if non-zero
+ * * @frame_parallel: %gboolean, encode animation frames in parallel
  * * @strip: %gboolean, remove all metadata from image
  *
  * As vips_webpsave(), but save as a mime webp on stdout.
@@ -686,6 +728,8 @@ vips_webpsave_mime( VipsImage *in, ... )
  * * @min_size: %gboolean, minimise size
  * * @kmin: %gint, minimum number of frames between keyframes
  * * @kmax: %gint, maximum number of frames between keyframes
+ * * @thread_level: %gint, use multi-threaded encoding, if non-zero
+ * * @frame_parallel: %gboolean, encode animation frames in parallel
  * * @strip: %gboolean, remove all metadata from image
  *
  * As vips_webpsave(), but save to a stream.
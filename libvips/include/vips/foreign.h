@@ -165,6 +165,18 @@ typedef struct _VipsForeignLoad {
 	gboolean error;
 } VipsForeignLoad;
 
+/* Magic-number signatures must lie within this many bytes of the start of 
+ * the file.
+ */
+#define VIPS_FOREIGN_MAGIC_MAX (64)
+
+typedef struct _VipsForeignMagic {
+	int offset;
+	int length;
+	const char *bytes;
+	const char *mask;
+} VipsForeignMagic;
+
 typedef struct _VipsForeignLoadClass {
 	VipsForeignClass parent_class;
 	/*< public >*/
@@ -238,6 +250,9 @@ typedef struct _VipsForeignLoadClass {
  */
 GType vips_foreign_load_get_type(void);
 
+void vips_foreign_load_class_set_magic( VipsForeignLoadClass *load_class,
+	const VipsForeignMagic *magic );
+
 const char *vips_foreign_find_load( const char *filename );
 const char *vips_foreign_find_load_buffer( const void *data, size_t size );
 const char *vips_foreign_find_load_stream( VipsStreami *streami );
@@ -251,6 +266,20 @@ gboolean vips_foreign_is_a_stream( const char *loader,
 
 void vips_foreign_load_invalidate( VipsImage *image );
 
+typedef struct _VipsForeignProbe {
+	const char *loader;
+	int width;
+	int height;
+	int bands;
+	VipsBandFormat format;
+	int orientation;
+	gboolean icc;
+} VipsForeignProbe;
+
+int vips_foreign_probe( const char *filename, VipsForeignProbe *probe );
+int vips_foreign_probe_many( const char **filenames, int n, 
+	VipsForeignProbe *probe );
+
 #define VIPS_TYPE_FOREIGN_SAVE (vips_foreign_save_get_type())
 #define VIPS_FOREIGN_SAVE( obj ) \
 	(G_TYPE_CHECK_INSTANCE_CAST( (obj), \
@@ -356,6 +385,21 @@ gchar **vips_foreign_get_suffixes( void );
 const char *vips_foreign_find_save_buffer( const char *suffix );
 const char *vips_foreign_find_save_stream( const char *suffix );
 
+/**
+ * VipsForeignVipsCompression:
+ * @VIPS_FOREIGN_VIPS_COMPRESSION_NONE: no compression
+ * @VIPS_FOREIGN_VIPS_COMPRESSION_DEFLATE: deflate (zip) compression
+ * @VIPS_FOREIGN_VIPS_COMPRESSION_ZSTD: zstd compression
+ *
+ * The per-tile compression types supported by the tiled vips writer.
+ */
+typedef enum {
+	VIPS_FOREIGN_VIPS_COMPRESSION_NONE,
+	VIPS_FOREIGN_VIPS_COMPRESSION_DEFLATE,
+	VIPS_FOREIGN_VIPS_COMPRESSION_ZSTD,
+	VIPS_FOREIGN_VIPS_COMPRESSION_LAST
+} VipsForeignVipsCompression;
+
 int vips_vipsload( const char *filename, VipsImage **out, ... )
 	__attribute__((sentinel));
 int vips_vipssave( VipsImage *in, const char *filename, ... )
@@ -363,6 +407,8 @@ int vips_vipssave( VipsImage *in, const char *filename, ... )
 
 int vips_openslideload( const char *filename, VipsImage **out, ... )
 	__attribute__((sentinel));
+void vips_openslide_cache_set_max_mem( size_t max_mem );
+size_t vips_openslide_cache_get_max_mem( void );
 
 int vips_jpegload( const char *filename, VipsImage **out, ... )
 	__attribute__((sentinel));
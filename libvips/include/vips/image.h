@@ -47,6 +47,12 @@ extern "C" {
 #define VIPS_MAGIC_INTEL (0xb6a6f208U)
 #define VIPS_MAGIC_SPARC (0x08f2a6b6U)
 
+/* Tiled vips files have their own pair of magic numbers, so older readers 
+ * won't try to mmap them.
+ */
+#define VIPS_MAGIC_TILED_INTEL (0xb6a6f209U)
+#define VIPS_MAGIC_TILED_SPARC (0x09f2a6b6U)
+
 /* We have a maximum value for a coordinate at various points for sanity
  * checking. For example, vips_black() has a max with and height. We use int
  * for width/height so we could go up to 2bn, but it's good to have a lower
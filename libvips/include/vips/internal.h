@@ -112,6 +112,10 @@ extern int vips__n_active_threads;
 
 void vips__threadpool_init( void );
 
+typedef int (*VipsThreadpoolUnitFn)( void *a, int unit );
+int vips__threadpool_run_units( int n_units, 
+	VipsThreadpoolUnitFn fn, void *a );
+
 void vips__cache_init( void );
 
 void vips__print_renders( void );
@@ -149,11 +153,15 @@ void vips__copy_4byte( int swap, unsigned char *to, unsigned char *from );
 void vips__copy_2byte( gboolean swap, unsigned char *to, unsigned char *from );
 
 guint32 vips__file_magic( const char *filename );
+guint32 vips__file_magic_tiled( const char *filename );
 int vips__has_extension_block( VipsImage *im );
 void *vips__read_extension_block( VipsImage *im, int *size );
 int vips__write_extension_block( VipsImage *im, void *buf, int size );
 int vips__writehist( VipsImage *image );
+int vips__readhist_fd( VipsImage *im, int fd, gint64 offset );
+int vips__writehist_fd( VipsImage *image, int fd, gint64 offset );
 int vips__read_header_bytes( VipsImage *im, unsigned char *from );
+int vips__read_header_bytes_tiled( VipsImage *im, unsigned char *from );
 int vips__write_header_bytes( VipsImage *im, unsigned char *to );
 
 extern GMutex *vips__global_lock;
@@ -163,6 +171,8 @@ void vips_image_preeval( VipsImage *image );
 void vips_image_eval( VipsImage *image, guint64 processed );
 void vips_image_posteval( VipsImage *image );
 VipsImage *vips_image_new_mode( const char *filename, const char *mode );
+VipsImage *vips__image_new_from_file_raw( const char *filename, 
+	int xsize, int ysize, int bands, guint64 offset, gboolean trailing );
 
 int vips__formatalike_vec( VipsImage **in, VipsImage **out, int n );
 int vips__sizealike_vec( VipsImage **in, VipsImage **out, int n );
@@ -259,6 +269,7 @@ typedef struct _VipsImagePixels {
 int vips__foreign_convert_saveable( VipsImage *in, VipsImage **ready,
 	VipsSaveable saveable, VipsBandFormat *format, VipsCoding *coding,
 	VipsArrayDouble *background );
+void vips__foreign_shutdown( void );
 
 int vips_foreign_load( const char *filename, VipsImage **out, ... )
 	__attribute__((sentinel));
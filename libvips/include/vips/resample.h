@@ -71,6 +71,9 @@ int vips_reduceh( VipsImage *in, VipsImage **out, double hshrink, ... )
 	__attribute__((sentinel));
 int vips_reducev( VipsImage *in, VipsImage **out, double vshrink, ... )
 	__attribute__((sentinel));
+int vips_enlarge( VipsImage *in, VipsImage **out, 
+	double hscale, double vscale, ... )
+	__attribute__((sentinel));
 
 int vips_thumbnail( const char *filename, VipsImage **out, int width, ... )
 	__attribute__((sentinel));
@@ -82,6 +85,8 @@ int vips_thumbnail_image( VipsImage *in, VipsImage **out, int width, ... )
 int vips_thumbnail_stream( VipsStreami *streami, VipsImage **out, 
 	int width, ... )
 	__attribute__((sentinel));
+int vips_multires( const char *filename, VipsImage **out, double scale, ... )
+	__attribute__((sentinel));
 
 int vips_similarity( VipsImage *in, VipsImage **out, ... )
 	__attribute__((sentinel));
@@ -499,6 +499,25 @@ vips_saveable_get_type( void )
 	return( etype );
 }
 GType
+vips_foreign_vips_compression_get_type( void )
+{
+	static GType etype = 0;
+
+	if( etype == 0 ) {
+		static const GEnumValue values[] = {
+			{VIPS_FOREIGN_VIPS_COMPRESSION_NONE, "VIPS_FOREIGN_VIPS_COMPRESSION_NONE", "none"},
+			{VIPS_FOREIGN_VIPS_COMPRESSION_DEFLATE, "VIPS_FOREIGN_VIPS_COMPRESSION_DEFLATE", "deflate"},
+			{VIPS_FOREIGN_VIPS_COMPRESSION_ZSTD, "VIPS_FOREIGN_VIPS_COMPRESSION_ZSTD", "zstd"},
+			{VIPS_FOREIGN_VIPS_COMPRESSION_LAST, "VIPS_FOREIGN_VIPS_COMPRESSION_LAST", "last"},
+			{0, NULL, NULL}
+		};
+		
+		etype = g_enum_register_static( "VipsForeignVipsCompression", values );
+	}
+
+	return( etype );
+}
+GType
 vips_foreign_webp_preset_get_type( void )
 {
 	static GType etype = 0;
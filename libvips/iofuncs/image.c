@@ -149,6 +149,18 @@
  * The first four bytes of a VIPS file in SPARC byte ordering.
  */
 
+/**
+ * VIPS_MAGIC_TILED_INTEL:
+ *
+ * The first four bytes of a tiled VIPS file in Intel byte ordering.
+ */
+
+/**
+ * VIPS_MAGIC_TILED_SPARC:
+ *
+ * The first four bytes of a tiled VIPS file in SPARC byte ordering.
+ */
+
 /** 
  * VipsAccess:
  * @VIPS_ACCESS_RANDOM: can read anywhere
@@ -980,8 +992,12 @@ vips_image_build( VipsObject *object )
 
 		/* Just weird. Only print a warning for this, since we should
 		 * still be able to process it without coredumps.
+		 *
+		 * Mode "at" is for formats like TIFF, where trailing data is
+		 * normal.
 		 */
-		if( image->file_length > sizeof_image ) 
+		if( image->file_length > sizeof_image &&
+			mode[1] != 't' ) 
 			g_warning( _( "%s is longer than expected" ),
 				image->filename );
 		break;
@@ -1993,6 +2009,18 @@ vips_image_new_from_file_RW( const char *filename )
 VipsImage *
 vips_image_new_from_file_raw( const char *filename, 
 	int xsize, int ysize, int bands, guint64 offset )
+{
+	return( vips__image_new_from_file_raw( filename, 
+		xsize, ysize, bands, offset, FALSE ) ); 
+}
+
+/* As vips_image_new_from_file_raw(), but if @trailing is set, don't warn
+ * about data after the pixels. Loaders for formats like TIFF, where that's
+ * normal, use this.
+ */
+VipsImage *
+vips__image_new_from_file_raw( const char *filename, 
+	int xsize, int ysize, int bands, guint64 offset, gboolean trailing )
 {
 	VipsImage *image;
 
@@ -2001,7 +2029,7 @@ vips_image_new_from_file_raw( const char *filename,
 	image = VIPS_IMAGE( g_object_new( VIPS_TYPE_IMAGE, NULL ) );
 	g_object_set( image,
 		"filename", filename,
-		"mode", "a",
+		"mode", trailing ? "at" : "a",
 		"width", xsize,
 		"height", ysize,
 		"bands", bands,
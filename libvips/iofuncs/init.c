@@ -656,6 +656,8 @@ vips_shutdown( void )
 
 	vips__render_shutdown();
 
+	vips__foreign_shutdown();
+
 	vips_thread_shutdown();
 
 	vips__thread_profile_stop();
@@ -23,6 +23,8 @@
  * 	- don't depend on image width when setting n_lines
  * 27/2/19 jtorresfabra
  * 	- free threadpool earlier 
+ * 19/10/19
+ * 	- add vips__threadpool_run_units()
  */
 
 /*
@@ -989,6 +991,85 @@ vips_threadpool_run( VipsImage *im,
 	return( result );
 }
 
+/* State for vips__threadpool_run_units().
+ */
+typedef struct _VipsThreadpoolUnits {
+	int n_units;
+	int next;
+	VipsThreadpoolUnitFn fn;
+	void *a;
+} VipsThreadpoolUnits;
+
+static int
+vips_threadpool_units_allocate( VipsThreadState *state, 
+	void *a, gboolean *stop )
+{
+	VipsThreadpoolUnits *units = (VipsThreadpoolUnits *) a;
+
+	if( units->next >= units->n_units ) {
+		*stop = TRUE;
+		return( 0 );
+	}
+
+	state->x = units->next;
+	units->next += 1;
+
+	return( 0 );
+}
+
+static int
+vips_threadpool_units_work( VipsThreadState *state, void *a )
+{
+	VipsThreadpoolUnits *units = (VipsThreadpoolUnits *) a;
+
+	return( units->fn( units->a, state->x ) );
+}
+
+/* Run @fn on the threadpool for each of @n_units independent units of work,
+ * for example the chunks of a buffer a saver is about to compress. 
+ *
+ * The pool sizes itself from the tiling of the image it runs over and makes a
+ * region on it for each thread, so we give it a placeholder with one strip 
+ * per unit. No pixels are ever computed.
+ *
+ * This must not be called from inside a generate function. 
+ */
+int
+vips__threadpool_run_units( int n_units, VipsThreadpoolUnitFn fn, void *a )
+{
+	VipsThreadpoolUnits units;
+	VipsImage *image;
+	int result;
+
+	if( n_units <= 0 )
+		return( 0 );
+
+	units.n_units = n_units;
+	units.next = 0;
+	units.fn = fn;
+	units.a = a;
+
+	image = vips_image_new();
+	vips_image_init_fields( image, 
+		1, n_units * vips__fatstrip_height, 1, 
+		VIPS_FORMAT_UCHAR, VIPS_CODING_NONE, VIPS_INTERPRETATION_B_W, 
+		1.0, 1.0 );
+	if( vips_image_pipelinev( image, VIPS_DEMAND_STYLE_ANY, NULL ) ) {
+		g_object_unref( image );
+		return( -1 );
+	}
+
+	result = vips_threadpool_run( image, 
+		vips_thread_state_new, 
+		vips_threadpool_units_allocate, vips_threadpool_units_work, 
+		NULL, 
+		&units );
+
+	g_object_unref( image );
+
+	return( result );
+}
+
 /* Start up threadpools. This is called during vips_init.
  */
 void
@@ -546,6 +546,35 @@ vips__write( int fd, const void *buf, size_t count )
 	return( 0 );
 }
 
+/* Wrap read() up. Keep reading until we have @count bytes, and error on EOF 
+ * or a read error.
+ */
+int
+vips__read( int fd, void *buf, size_t count )
+{
+	while( count > 0 ) {
+		ssize_t nread = read( fd, buf, count );
+
+		if( nread == -1 &&
+			errno == EINTR )
+			continue;
+		if( nread == -1 ) {
+			vips_error_system( errno, "vips__read", 
+				"%s", _( "read failed" ) );
+			return( -1 );
+		}
+		if( nread == 0 ) {
+			vips_error( "vips__read", "%s", _( "unexpected EOF" ) );
+			return( -1 );
+		}
+
+		buf = (void *) ((char *) buf + nread);
+		count -= nread;
+	}
+
+	return( 0 );
+}
+
 #ifdef OS_WIN32
 /* Set the create date on a file. On Windows, the create date may be copied 
  * over from an existing file of the same name, unless you reset it. 
@@ -27,6 +27,8 @@
  * 	- escape ASCII control characters in XML
  * 29/8/19
  * 	- verify bands/format for coded images
+ * 19/10/19
+ * 	- add magic numbers and XML helpers for tiled vips files
  */
 
 /*
@@ -306,6 +308,31 @@ vips__file_magic( const char *filename )
 	return( 0 );
 }
 
+/* As vips__file_magic(), but for tiled vips files. These can't be mmaped, so 
+ * we keep them separate.
+ */
+guint32
+vips__file_magic_tiled( const char *filename )
+{
+	guint32 magic;
+
+	if( vips__get_bytes( filename, (unsigned char *) &magic, 4 ) == 4 &&
+		(magic == VIPS_MAGIC_TILED_INTEL || 
+		 magic == VIPS_MAGIC_TILED_SPARC) )
+		return( magic );
+
+	return( 0 );
+}
+
+/* Is a magic number for an MSB first file.
+ */
+static gboolean
+magic_is_msb( guint32 magic )
+{
+	return( magic == VIPS_MAGIC_SPARC || 
+		magic == VIPS_MAGIC_TILED_SPARC );
+}
+
 /* offset, read, write functions.
  */
 typedef struct _FieldIO {
@@ -331,8 +358,11 @@ static FieldIO fields[] = {
 	{ G_STRUCT_OFFSET( VipsImage, Yoffset ), 4, vips__copy_4byte }
 };
 
-int
-vips__read_header_bytes( VipsImage *im, unsigned char *from )
+/* Tiled vips files are compressed, so only the tiled reader can accept
+ * the tiled magic numbers.
+ */
+static int
+read_header_bytes( VipsImage *im, unsigned char *from, gboolean allow_tiled )
 {
 	gboolean swap;
 	int i;
@@ -349,7 +379,10 @@ vips__read_header_bytes( VipsImage *im, unsigned char *from )
 		(unsigned char *) &im->magic, from );
 	from += 4;
 	if( im->magic != VIPS_MAGIC_INTEL && 
-		im->magic != VIPS_MAGIC_SPARC ) {
+		im->magic != VIPS_MAGIC_SPARC &&
+		!(allow_tiled &&
+		  (im->magic == VIPS_MAGIC_TILED_INTEL || 
+		   im->magic == VIPS_MAGIC_TILED_SPARC)) ) {
 		vips_error( "VipsImage", 
 			_( "\"%s\" is not a VIPS image" ), im->filename );
 		return( -1 );
@@ -358,7 +391,7 @@ vips__read_header_bytes( VipsImage *im, unsigned char *from )
 	/* We need to swap for other fields if the file byte order is 
 	 * different from ours.
 	 */
-	swap = vips_amiMSBfirst() != (im->magic == VIPS_MAGIC_SPARC);
+	swap = vips_amiMSBfirst() != magic_is_msb( im->magic );
 
 	for( i = 0; i < VIPS_NUMBER( fields ); i++ ) {
 		fields[i].copy( swap,
@@ -433,13 +466,28 @@ vips__read_header_bytes( VipsImage *im, unsigned char *from )
 	return( 0 );
 }
 
+int
+vips__read_header_bytes( VipsImage *im, unsigned char *from )
+{
+	return( read_header_bytes( im, from, FALSE ) );
+}
+
+/* As vips__read_header_bytes(), but accept the magic numbers for tiled
+ * files too. Only the tiled reader should use this.
+ */
+int
+vips__read_header_bytes_tiled( VipsImage *im, unsigned char *from )
+{
+	return( read_header_bytes( im, from, TRUE ) );
+}
+
 int
 vips__write_header_bytes( VipsImage *im, unsigned char *to )
 {
 	/* Swap if the byte order we are asked to write the header in is
 	 * different from ours.
 	 */
-	gboolean swap = vips_amiMSBfirst() != (im->magic == VIPS_MAGIC_SPARC);
+	gboolean swap = vips_amiMSBfirst() != magic_is_msb( im->magic );
 
 	int i;
 	unsigned char *q;
@@ -746,16 +794,15 @@ parser_data_handler( void *user_data, const XML_Char *data, int len )
 	vips_dbuf_write( &vep->dbuf, (unsigned char *) data, len );
 }
 
-/* Called at the end of vips open ... get any XML after the pixel data
- * and read it in.
+/* Parse the XML extension block at @offset in @fd and attach to @im. 
  */
-static int 
-readhist( VipsImage *im )
+int 
+vips__readhist_fd( VipsImage *im, int fd, gint64 offset )
 {
 	XML_Parser parser;
 	VipsExpatParse vep;
 
-	if( vips__seek( im->fd, image_pixel_length( im ), SEEK_SET ) == -1 ) 
+	if( vips__seek( fd, offset, SEEK_SET ) == -1 ) 
 		return( -1 );
 
 	parser = XML_ParserCreate( "UTF-8" );
@@ -769,7 +816,7 @@ readhist( VipsImage *im )
 		parser_element_start_handler, parser_element_end_handler );
 	XML_SetCharacterDataHandler( parser, parser_data_handler ); 
 
-	if( parser_read_fd( parser, im->fd ) ||
+	if( parser_read_fd( parser, fd ) ||
 		vep.error ) { 
 		vips_dbuf_destroy( &vep.dbuf ); 
 		XML_ParserFree( parser );
@@ -782,6 +829,15 @@ readhist( VipsImage *im )
 	return( 0 ); 
 }
 
+/* Called at the end of vips open ... get any XML after the pixel data
+ * and read it in.
+ */
+static int 
+readhist( VipsImage *im )
+{
+	return( vips__readhist_fd( im, im->fd, image_pixel_length( im ) ) ); 
+}
+
 int
 vips__write_extension_block( VipsImage *im, void *buf, int size )
 {
@@ -1018,6 +1074,29 @@ vips__writehist( VipsImage *image )
 	return( 0 );
 }
 
+/* Write the XML for @image at @offset in @fd, truncating anything that was 
+ * there before. 
+ */
+int 
+vips__writehist_fd( VipsImage *image, int fd, gint64 offset )
+{
+	char *xml;
+
+	if( !(xml = build_xml( image )) )
+		return( -1 );
+
+	if( vips__ftruncate( fd, offset ) ||
+		vips__seek( fd, offset, SEEK_SET ) == -1 ||
+		vips__write( fd, xml, strlen( xml ) ) ) {
+		g_free( xml );
+                return( -1 );
+        }
+
+	g_free( xml );
+
+	return( 0 );
+}
+
 /* Open the filename, read the header, some sanity checking.
  */
 int
@@ -88,6 +88,8 @@
  * 	- add "background" parameter
  * 	- better clipping means we have no jaggies on edges
  * 	- premultiply alpha 
+ * 19/10/19
+ * 	- interpolate runs of pixels with vips__interpolate_get_line()
  */
 
 /*
@@ -203,6 +205,14 @@ G_DEFINE_TYPE( VipsAffine, vips_affine, VIPS_TYPE_RESAMPLE );
  * output image, and that affinei_gen() is asked for.
  */
 
+/* Is a point in the input clipping rectangle? 
+ */
+#define INSIDE( IX, IY ) \
+	(VIPS_FLOOR( IX ) >= ile && \
+	 VIPS_FLOOR( IX ) <= iri && \
+	 VIPS_FLOOR( IY ) >= ito && \
+	 VIPS_FLOOR( IY ) <= ibo)
+
 static int
 vips_affine_gen( VipsRegion *or, void *seq, void *a, void *b, gboolean *stop )
 {
@@ -213,8 +223,8 @@ vips_affine_gen( VipsRegion *or, void *seq, void *a, void *b, gboolean *stop )
 		vips_interpolate_get_window_size( affine->interpolate );
 	const int window_offset = 
 		vips_interpolate_get_window_offset( affine->interpolate );
-	const VipsInterpolateMethod interpolate = 
-		vips_interpolate_get_method( affine->interpolate );
+	const VipsInterpolateLineFn interpolate_line = 
+		vips__interpolate_get_line( affine->interpolate );
 
 	/* Area we generate in the output image.
 	 */
@@ -344,18 +354,29 @@ vips_affine_gen( VipsRegion *or, void *seq, void *a, void *b, gboolean *stop )
 
 		q = VIPS_REGION_ADDR( or, le, y );
 
-		for( x = le; x < ri; x++ ) {
-			int fx, fy; 	
+		x = le;
+		while( x < ri ) {
+			double run_ix, run_iy;
+			int n;
+
+			/* Out of range: paint the background.
+			 */
+			for( ; x < ri && !INSIDE( ix, iy ); x++ ) {
+				for( z = 0; z < ps; z++ ) 
+					q[z] = affine->ink[z];
 
-			fx = VIPS_FLOOR( ix );
-			fy = VIPS_FLOOR( iy );
+				ix += ddx;
+				iy += ddy;
+				q += ps;
+			}
 
-			/* Clip against iarea.
+			/* Find the run of pixels we can interpolate, and do 
+			 * them all in one call. We step the coordinates
+			 * exactly as the interpolator will.
 			 */
-			if( fx >= ile &&
-				fx <= iri &&
-				fy >= ito &&
-				fy <= ibo ) {
+			run_ix = ix;
+			run_iy = iy;
+			for( n = 0; x < ri && INSIDE( ix, iy ); n++, x++ ) {
 				/* Verify that we can read the whole stencil.
 				 * With DEBUG on this will range-check.
 				 */
@@ -368,19 +389,15 @@ vips_affine_gen( VipsRegion *or, void *seq, void *a, void *b, gboolean *stop )
 					(int) iy - window_offset + 
 						window_size - 1 ) );
 
-				interpolate( affine->interpolate, 
-					q, ir, ix, iy );
-			}
-			else {
-				/* Out of range: paint the background.
-				 */
-				for( z = 0; z < ps; z++ ) 
-					q[z] = affine->ink[z];
+				ix += ddx;
+				iy += ddy;
 			}
 
-			ix += ddx;
-			iy += ddy;
-			q += ps;
+			if( n > 0 ) {
+				interpolate_line( affine->interpolate, 
+					q, ir, n, run_ix, run_iy, ddx, ddy );
+				q += n * ps;
+			}
 		}
 	}
 
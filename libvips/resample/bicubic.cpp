@@ -4,6 +4,8 @@
  * 	- revise window_size / window_offset stuff again
  * 7/2/16
  * 	- double intermediate for 32-bit int types
+ * 19/10/19
+ * 	- add a line version for vips__interpolate_get_line()
  */
 
 /*
@@ -53,6 +55,7 @@
 #include <vips/internal.h>
 
 #include "templates.h"
+#include "presample.h"
 
 #ifdef WITH_DMALLOC
 #include <dmalloc.h>
@@ -628,6 +631,124 @@ vips_interpolate_bicubic_interpolate( VipsInterpolate *interpolate,
 	}
 }
 
+/* Find the mask index for a coordinate, as 
+ * vips_interpolate_bicubic_interpolate() does.
+ */
+static int inline
+bicubic_index( double x )
+{
+	const int sx = x * VIPS_TRANSFORM_SCALE * 2;
+	const int six = sx & (VIPS_TRANSFORM_SCALE * 2 - 1);
+
+	return( (six + 1) >> 1 );
+}
+
+/* Interpolate a line of pixels. Each pixel is computed exactly as
+ * vips_interpolate_bicubic_interpolate() does, but we only switch on format 
+ * once per line, and the pixel functions can inline into the loop.
+ */
+#define BICUBIC_LINE( FN, BANDS, CX, CY ) { \
+	for( int i = 0; i < n; i++ ) { \
+		const int ix = (int) x; \
+		const int iy = (int) y; \
+		const VipsPel *p = VIPS_REGION_ADDR( in, ix - 1, iy - 1 ); \
+		\
+		FN( out + i * ps, p, BANDS, lskip, CX, CY ); \
+		\
+		x += dx; \
+		y += dy; \
+	} \
+}
+
+#define MATRIXI( X ) vips_bicubic_matrixi[bicubic_index( X )]
+#define MATRIXF( X ) vips_bicubic_matrixf[bicubic_index( X )]
+
+static void
+vips_interpolate_bicubic_line( VipsInterpolate *interpolate,
+	VipsPel *out, VipsRegion *in, int n, 
+	double x, double y, double dx, double dy )
+{
+	const int ps = VIPS_IMAGE_SIZEOF_PEL( in->im );
+	const int bands = in->im->Bands;
+	const int lskip = VIPS_REGION_LSKIP( in );
+
+	switch( in->im->BandFmt ) {
+	case VIPS_FORMAT_UCHAR:
+		BICUBIC_LINE( 
+			(bicubic_unsigned_int_tab<unsigned char, UCHAR_MAX>),
+			bands, MATRIXI( x ), MATRIXI( y ) );
+		break;
+
+	case VIPS_FORMAT_CHAR:
+		BICUBIC_LINE( 
+			(bicubic_signed_int_tab<signed char, 
+				SCHAR_MIN, SCHAR_MAX>),
+			bands, MATRIXI( x ), MATRIXI( y ) );
+		break;
+
+	case VIPS_FORMAT_USHORT:
+		BICUBIC_LINE( 
+			(bicubic_unsigned_int32_tab<unsigned short, USHRT_MAX>),
+			bands, MATRIXF( x ), MATRIXF( y ) );
+		break;
+
+	case VIPS_FORMAT_SHORT:
+		BICUBIC_LINE( 
+			(bicubic_signed_int32_tab<signed short, 
+				SHRT_MIN, SHRT_MAX>),
+			bands, MATRIXF( x ), MATRIXF( y ) );
+		break;
+
+	case VIPS_FORMAT_UINT:
+		BICUBIC_LINE( 
+			(bicubic_unsigned_int32_tab<unsigned int, INT_MAX>),
+			bands, MATRIXF( x ), MATRIXF( y ) );
+		break;
+
+	case VIPS_FORMAT_INT:
+		BICUBIC_LINE( 
+			(bicubic_signed_int32_tab<signed int, 
+				INT_MIN, INT_MAX>),
+			bands, MATRIXF( x ), MATRIXF( y ) );
+		break;
+
+	case VIPS_FORMAT_FLOAT:
+		BICUBIC_LINE( bicubic_float_tab<float>,
+			bands, MATRIXF( x ), MATRIXF( y ) );
+		break;
+
+	case VIPS_FORMAT_DOUBLE:
+		BICUBIC_LINE( bicubic_notab<double>,
+			bands, x - ix, y - iy );
+		break;
+
+	case VIPS_FORMAT_COMPLEX:
+		BICUBIC_LINE( bicubic_float_tab<float>,
+			bands * 2, MATRIXF( x ), MATRIXF( y ) );
+		break;
+
+	case VIPS_FORMAT_DPCOMPLEX:
+		BICUBIC_LINE( bicubic_notab<double>,
+			bands * 2, x - ix, y - iy );
+		break;
+
+	default:
+		break;
+	}
+}
+
+/* The line function, if this is our bicubic, or NULL.
+ */
+VipsInterpolateLineFn
+vips__interpolate_bicubic_get_line( VipsInterpolate *interpolate )
+{
+	if( vips_interpolate_get_method( interpolate ) == 
+		vips_interpolate_bicubic_interpolate )
+		return( vips_interpolate_bicubic_line );
+
+	return( NULL );
+}
+
 static void
 vips_interpolate_bicubic_class_init( VipsInterpolateBicubicClass *iclass )
 {
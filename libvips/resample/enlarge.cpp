@@ -0,0 +1,771 @@
+/* 2D enlarge by a pair of float factors with a kernel
+ *
+ * 19/10/19
+ * 	- from reducehv.cpp
+ */
+
+/*
+
+    This file is part of VIPS.
+
+    VIPS is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA
+
+ */
+
+/*
+
+    These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <vips/intl.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <vips/vips.h>
+#include <vips/debug.h>
+#include <vips/internal.h>
+#include <vips/vector.h>
+
+#include "presample.h"
+#include "templates.h"
+
+typedef struct _VipsEnlarge {
+	VipsResample parent_instance;
+
+	double hscale;		/* Scale factors */
+	double vscale;
+
+	/* The thing we use to make the kernel.
+	 */
+	VipsKernel kernel;
+
+	/* Number of points in the kernel. When we enlarge, the kernel
+	 * doesn't stretch, so this is the same for both axes.
+	 */
+	int n_point;
+
+	/* Precalculated interpolation matrices. int (used for pel sizes up
+	 * to short), and double (for all others). We go to scale + 1 so we
+	 * can round-to-nearest safely.
+	 */
+	int *matrixi[VIPS_TRANSFORM_SCALE + 1];
+	double *matrixf[VIPS_TRANSFORM_SCALE + 1];
+
+	/* For each output column and row, the first input pixel under the
+	 * mask, and the matrix to use.
+	 */
+	int *hstart;
+	int *hphase;
+	int *vstart;
+	int *vphase;
+
+} VipsEnlarge;
+
+typedef VipsResampleClass VipsEnlargeClass;
+
+/* We need C linkage for this.
+ */
+extern "C" {
+G_DEFINE_TYPE( VipsEnlarge, vips_enlarge, VIPS_TYPE_RESAMPLE );
+}
+
+/* The number of input pixels we need for each output pixel. Nearest uses
+ * two so that it can share the phase tables with the others.
+ */
+static int
+vips_enlarge_get_points( VipsKernel kernel )
+{
+	switch( kernel ) {
+	case VIPS_KERNEL_NEAREST:
+	case VIPS_KERNEL_LINEAR:
+		return( 2 );
+
+	case VIPS_KERNEL_CUBIC:
+	case VIPS_KERNEL_MITCHELL:
+	case VIPS_KERNEL_LANCZOS2:
+		return( 4 );
+
+	case VIPS_KERNEL_LANCZOS3:
+		return( 6 );
+
+	default:
+		g_assert_not_reached();
+		return( 0 );
+	}
+}
+
+/* Nearest and linear are simple enough to do here.
+ */
+static double
+vips_enlarge_kernel( VipsKernel kernel, double x )
+{
+	switch( kernel ) {
+	case VIPS_KERNEL_NEAREST:
+		/* Round halves up, so we pick exactly one point.
+		 */
+		return( x > -0.5 && x <= 0.5 ? 1.0 : 0.0 );
+
+	case VIPS_KERNEL_LINEAR:
+		return( VIPS_MAX( 0.0, 1.0 - VIPS_FABS( x ) ) );
+
+	default:
+		g_assert_not_reached();
+		return( 0.0 );
+	}
+}
+
+/* Given an x in [0,1], the position of the sample point after the
+ * (n_point / 2 - 1)th point in the mask, make the mask.
+ *
+ * Cubic and lanczos come from the reduce coefficient builders at shrink 1,
+ * so the two can't drift apart. Those make one extra trailing tap, which is
+ * always zero for us, so we just drop it.
+ */
+static void
+vips_enlarge_make_mask( double *c, VipsKernel kernel, int n_point, double x )
+{
+	double t[MAX_POINT + 1];
+	double sum;
+
+	switch( kernel ) {
+	case VIPS_KERNEL_NEAREST:
+	case VIPS_KERNEL_LINEAR:
+		for( int i = 0; i < n_point; i++ )
+			t[i] = vips_enlarge_kernel( kernel,
+				i - (n_point / 2 - 1) - x );
+		break;
+
+	case VIPS_KERNEL_CUBIC:
+		/* Catmull-Rom.
+		 */
+		calculate_coefficients_cubic( t, 1.0, x, 0.0, 0.5 );
+		break;
+
+	case VIPS_KERNEL_MITCHELL:
+		calculate_coefficients_cubic( t, 1.0, x,
+			1.0 / 3.0, 1.0 / 3.0 );
+		break;
+
+	case VIPS_KERNEL_LANCZOS2:
+	case VIPS_KERNEL_LANCZOS3:
+		calculate_coefficients_lanczos( t,
+			kernel == VIPS_KERNEL_LANCZOS2 ? 2 : 3, 1.0, x );
+
+		/* sin() of a multiple of pi is not quite zero. The kernel
+		 * must be exactly zero at the other sample points, or an
+		 * enlarge by 1 will not be the identity.
+		 */
+		for( int i = 0; i < n_point; i++ ) {
+			const double xp = i - (n_point / 2 - 1) - x;
+
+			if( xp != 0.0 &&
+				xp == VIPS_RINT( xp ) )
+				t[i] = 0.0;
+		}
+		break;
+
+	default:
+		g_assert_not_reached();
+		break;
+	}
+
+	sum = 0;
+	for( int i = 0; i < n_point; i++ )
+		sum += t[i];
+
+	for( int i = 0; i < n_point; i++ )
+		c[i] = t[i] / sum;
+}
+
+/* For each of n output pixels, find the first input pixel under the mask and
+ * the matrix to use. Centre sampling convention, so output pixel x is at
+ * (x + 0.5) / scale - 0.5 in the input. The input has been embedded by
+ * n_point / 2 pixels.
+ */
+static void
+vips_enlarge_positions( int *start, int *phase, int n,
+	double scale, int n_point )
+{
+	for( int x = 0; x < n; x++ ) {
+		const double X = (x + 0.5) / scale - 0.5 + n_point / 2;
+		const int ix = (int) X;
+
+		start[x] = ix - (n_point / 2 - 1);
+		phase[x] = VIPS_RINT( (X - ix) * VIPS_TRANSFORM_SCALE );
+	}
+}
+
+/* Our per-thread state.
+ */
+typedef struct {
+	VipsRegion *ir;		/* Input region */
+
+	/* A ring of n_point horizontally enlarged lines. Input line y is
+	 * in slot y % n_point, and ring_y[] records which line each slot
+	 * holds, or -1 for empty. All the lines span output columns
+	 * left to left + width.
+	 */
+	VipsPel *ring;
+	int *ring_y;
+	int left;
+	int width;
+
+	/* Sum the vertical mask here.
+	 */
+	double *sum;
+} Sequence;
+
+static int
+vips_enlarge_stop( void *vseq, void *a, void *b )
+{
+	Sequence *seq = (Sequence *) vseq;
+
+	VIPS_UNREF( seq->ir );
+	VIPS_FREE( seq->ring );
+	VIPS_FREE( seq->ring_y );
+	VIPS_FREE( seq->sum );
+
+	return( 0 );
+}
+
+static void *
+vips_enlarge_start( VipsImage *out, void *a, void *b )
+{
+	VipsImage *in = (VipsImage *) a;
+	VipsEnlarge *enlarge = (VipsEnlarge *) b;
+	const int n = enlarge->n_point;
+
+	Sequence *seq;
+
+	if( !(seq = VIPS_NEW( out, Sequence )) )
+		return( NULL );
+
+	/* Init!
+	 */
+	seq->ir = NULL;
+	seq->ring = NULL;
+	seq->ring_y = NULL;
+	seq->left = 0;
+	seq->width = 0;
+	seq->sum = NULL;
+
+	/* Attach region and arrays. Double the elements for complex.
+	 */
+	seq->ir = vips_region_new( in );
+	seq->ring = VIPS_ARRAY( NULL,
+		(size_t) n * VIPS_IMAGE_SIZEOF_LINE( out ), VipsPel );
+	seq->ring_y = VIPS_ARRAY( NULL, n, int );
+	seq->sum = VIPS_ARRAY( NULL, 2 * VIPS_IMAGE_N_ELEMENTS( out ), double );
+	if( !seq->ir ||
+		!seq->ring ||
+		!seq->ring_y ||
+		!seq->sum ) {
+		vips_enlarge_stop( seq, NULL, NULL );
+		return( NULL );
+	}
+
+	for( int i = 0; i < n; i++ )
+		seq->ring_y[i] = -1;
+
+	return( seq );
+}
+
+/* Round and clip an int sum to the output type.
+ */
+template <typename T, int min_value, int max_value>
+static T inline
+enlarge_out( const int sum )
+{
+	int v;
+
+	if( min_value == 0 )
+		v = unsigned_fixed_round( sum );
+	else
+		v = signed_fixed_round( sum );
+
+	return( VIPS_CLIP( min_value, v, max_value ) );
+}
+
+/* And a double sum. max_value of zero means a float output, so no clip.
+ * Int outputs must round, not truncate.
+ */
+template <typename T, int min_value, int max_value>
+static T inline
+enlarge_out( double sum )
+{
+	if( max_value != 0 )
+		sum = VIPS_RINT( VIPS_CLIP( min_value, sum, max_value ) );
+
+	return( sum );
+}
+
+/* Enlarge an input line horizontally. @p0 is x == 0 in the input line, we
+ * write @width pixels starting at output column @left.
+ */
+template <typename T, typename IT, int min_value, int max_value>
+static void
+enlarge_hline( VipsEnlarge *enlarge, VipsPel *pout, const VipsPel *p0,
+	const int bands, IT **matrix, const int left, const int width )
+{
+	T* restrict out = (T *) pout;
+	const int n = enlarge->n_point;
+
+	for( int x = left; x < left + width; x++ ) {
+		const T* restrict in = (T *) p0 + enlarge->hstart[x] * bands;
+		const IT* restrict cx = matrix[enlarge->hphase[x]];
+
+		for( int z = 0; z < bands; z++ )
+			out[z] = enlarge_out<T, min_value, max_value>(
+				reduce_sum<T, IT>( in + z, bands, cx, n ) );
+
+		out += bands;
+	}
+}
+
+static void
+vips_enlarge_hline( VipsEnlarge *enlarge, VipsImage *in,
+	VipsPel *q, const VipsPel *p0, const int left, const int width )
+{
+	/* Double bands for complex.
+	 */
+	const int bands = in->Bands *
+		(vips_band_format_iscomplex( in->BandFmt ) ?  2 : 1);
+
+	int **mi = enlarge->matrixi;
+	double **mf = enlarge->matrixf;
+
+	switch( in->BandFmt ) {
+	case VIPS_FORMAT_UCHAR:
+		enlarge_hline<unsigned char, int, 0, UCHAR_MAX>(
+			enlarge, q, p0, bands, mi, left, width );
+		break;
+
+	case VIPS_FORMAT_CHAR:
+		enlarge_hline<signed char, int, SCHAR_MIN, SCHAR_MAX>(
+			enlarge, q, p0, bands, mi, left, width );
+		break;
+
+	case VIPS_FORMAT_USHORT:
+		enlarge_hline<unsigned short, int, 0, USHRT_MAX>(
+			enlarge, q, p0, bands, mi, left, width );
+		break;
+
+	case VIPS_FORMAT_SHORT:
+		enlarge_hline<signed short, int, SHRT_MIN, SHRT_MAX>(
+			enlarge, q, p0, bands, mi, left, width );
+		break;
+
+	case VIPS_FORMAT_UINT:
+		enlarge_hline<unsigned int, double, 0, INT_MAX>(
+			enlarge, q, p0, bands, mf, left, width );
+		break;
+
+	case VIPS_FORMAT_INT:
+		enlarge_hline<signed int, double, INT_MIN, INT_MAX>(
+			enlarge, q, p0, bands, mf, left, width );
+		break;
+
+	case VIPS_FORMAT_FLOAT:
+	case VIPS_FORMAT_COMPLEX:
+		enlarge_hline<float, double, 0, 0>(
+			enlarge, q, p0, bands, mf, left, width );
+		break;
+
+	case VIPS_FORMAT_DOUBLE:
+	case VIPS_FORMAT_DPCOMPLEX:
+		enlarge_hline<double, double, 0, 0>(
+			enlarge, q, p0, bands, mf, left, width );
+		break;
+
+	default:
+		g_assert_not_reached();
+		break;
+	}
+}
+
+/* Run the vertical mask down a set of lines. We sum a line at a time,
+ * so the compiler can vectorise the inner loops.
+ */
+template <typename T, typename IT, int min_value, int max_value>
+static void
+enlarge_vline( VipsEnlarge *enlarge, VipsPel *pout, VipsPel **lines,
+	const int ne, const IT * restrict cy, IT * restrict sum )
+{
+	T* restrict out = (T *) pout;
+	const int n = enlarge->n_point;
+	const T* restrict in;
+
+	in = (T *) lines[0];
+	for( int z = 0; z < ne; z++ )
+		sum[z] = cy[0] * in[z];
+
+	for( int i = 1; i < n; i++ ) {
+		const IT c = cy[i];
+
+		in = (T *) lines[i];
+		for( int z = 0; z < ne; z++ )
+			sum[z] += c * in[z];
+	}
+
+	for( int z = 0; z < ne; z++ )
+		out[z] = enlarge_out<T, min_value, max_value>( sum[z] );
+}
+
+static void
+vips_enlarge_vline( VipsEnlarge *enlarge, VipsImage *in,
+	VipsPel *q, VipsPel **lines, const int ne, const int phase,
+	double *sum )
+{
+	const int *cyi = enlarge->matrixi[phase];
+	const double *cyf = enlarge->matrixf[phase];
+
+	switch( in->BandFmt ) {
+	case VIPS_FORMAT_UCHAR:
+		enlarge_vline<unsigned char, int, 0, UCHAR_MAX>(
+			enlarge, q, lines, ne, cyi, (int *) sum );
+		break;
+
+	case VIPS_FORMAT_CHAR:
+		enlarge_vline<signed char, int, SCHAR_MIN, SCHAR_MAX>(
+			enlarge, q, lines, ne, cyi, (int *) sum );
+		break;
+
+	case VIPS_FORMAT_USHORT:
+		enlarge_vline<unsigned short, int, 0, USHRT_MAX>(
+			enlarge, q, lines, ne, cyi, (int *) sum );
+		break;
+
+	case VIPS_FORMAT_SHORT:
+		enlarge_vline<signed short, int, SHRT_MIN, SHRT_MAX>(
+			enlarge, q, lines, ne, cyi, (int *) sum );
+		break;
+
+	case VIPS_FORMAT_UINT:
+		enlarge_vline<unsigned int, double, 0, INT_MAX>(
+			enlarge, q, lines, ne, cyf, sum );
+		break;
+
+	case VIPS_FORMAT_INT:
+		enlarge_vline<signed int, double, INT_MIN, INT_MAX>(
+			enlarge, q, lines, ne, cyf, sum );
+		break;
+
+	case VIPS_FORMAT_FLOAT:
+	case VIPS_FORMAT_COMPLEX:
+		enlarge_vline<float, double, 0, 0>(
+			enlarge, q, lines, ne, cyf, sum );
+		break;
+
+	case VIPS_FORMAT_DOUBLE:
+	case VIPS_FORMAT_DPCOMPLEX:
+		enlarge_vline<double, double, 0, 0>(
+			enlarge, q, lines, ne, cyf, sum );
+		break;
+
+	default:
+		g_assert_not_reached();
+		break;
+	}
+}
+
+static int
+vips_enlarge_gen( VipsRegion *out_region, void *vseq,
+	void *a, void *b, gboolean *stop )
+{
+	VipsImage *in = (VipsImage *) a;
+	VipsEnlarge *enlarge = (VipsEnlarge *) b;
+	Sequence *seq = (Sequence *) vseq;
+	VipsRegion *ir = seq->ir;
+	VipsRect *r = &out_region->valid;
+	const int ps = VIPS_IMAGE_SIZEOF_PEL( in );
+	const size_t ls = VIPS_IMAGE_SIZEOF_LINE( out_region->im );
+	const int n = enlarge->n_point;
+
+	/* Double bands for complex.
+	 */
+	const int bands = in->Bands *
+		(vips_band_format_iscomplex( in->BandFmt ) ?  2 : 1);
+	const int ne = r->width * bands;
+
+	VipsPel *lines[MAX_POINT];
+	int top;
+	int bottom;
+	int first;
+
+#ifdef DEBUG
+	printf( "vips_enlarge_gen: generating %d x %d at %d x %d\n",
+		r->width, r->height, r->left, r->top );
+#endif /*DEBUG*/
+
+	/* Lines left in the ring by the previous region are only useful if
+	 * they span the same columns.
+	 */
+	if( r->left != seq->left ||
+		r->width != seq->width ) {
+		for( int i = 0; i < n; i++ )
+			seq->ring_y[i] = -1;
+		seq->left = r->left;
+		seq->width = r->width;
+	}
+
+	/* The input lines we need, and the first of those we don't have.
+	 */
+	top = enlarge->vstart[r->top];
+	bottom = enlarge->vstart[VIPS_RECT_BOTTOM( r ) - 1] + n;
+	for( first = top; first < bottom; first++ )
+		if( seq->ring_y[first % n] != first )
+			break;
+
+	if( first < bottom ) {
+		VipsRect s;
+
+		s.left = enlarge->hstart[r->left];
+		s.top = first;
+		s.width = enlarge->hstart[VIPS_RECT_RIGHT( r ) - 1] + n -
+			s.left;
+		s.height = bottom - first;
+		if( vips_region_prepare( ir, &s ) )
+			return( -1 );
+	}
+
+	VIPS_GATE_START( "vips_enlarge_gen: work" );
+
+	for( int y = 0; y < r->height; y++ ) {
+		const int py = enlarge->vstart[r->top + y];
+
+		VipsPel *q;
+
+		/* Enlarge any lines we don't have yet into the ring. We fill
+		 * in order, so we only overwrite lines above the mask.
+		 */
+		for( int i = 0; i < n; i++ ) {
+			const int iy = py + i;
+			const int slot = iy % n;
+
+			lines[i] = seq->ring + slot * ls;
+
+			if( seq->ring_y[slot] != iy ) {
+				/* We want p0 to be x == 0 of the input line.
+				 * It could be outside valid, so get the
+				 * leftmost pixel in valid and subtract a bit.
+				 */
+				VipsPel *p0 = VIPS_REGION_ADDR( ir,
+					ir->valid.left, iy ) -
+					ir->valid.left * ps;
+
+				vips_enlarge_hline( enlarge, in,
+					lines[i], p0, r->left, r->width );
+				seq->ring_y[slot] = iy;
+			}
+		}
+
+		q = VIPS_REGION_ADDR( out_region, r->left, r->top + y );
+		vips_enlarge_vline( enlarge, in, q, lines, ne,
+			enlarge->vphase[r->top + y], seq->sum );
+	}
+
+	VIPS_GATE_STOP( "vips_enlarge_gen: work" );
+
+	VIPS_COUNT_PIXELS( out_region, "vips_enlarge_gen" );
+
+	return( 0 );
+}
+
+static int
+vips_enlarge_build( VipsObject *object )
+{
+	VipsObjectClass *object_class = VIPS_OBJECT_GET_CLASS( object );
+	VipsResample *resample = VIPS_RESAMPLE( object );
+	VipsEnlarge *enlarge = (VipsEnlarge *) object;
+	VipsImage **t = (VipsImage **)
+		vips_object_local_array( object, 3 );
+
+	VipsImage *in;
+	int n;
+
+	if( VIPS_OBJECT_CLASS( vips_enlarge_parent_class )->build( object ) )
+		return( -1 );
+
+	in = resample->in;
+
+	if( enlarge->hscale < 1 ||
+		enlarge->vscale < 1 ) {
+		vips_error( object_class->nickname,
+			"%s", _( "enlarge factors should be >= 1" ) );
+		return( -1 );
+	}
+
+	/* Build the tables of pre-computed coefficients.
+	 */
+	n = enlarge->n_point = vips_enlarge_get_points( enlarge->kernel );
+	for( int x = 0; x < VIPS_TRANSFORM_SCALE + 1; x++ ) {
+		enlarge->matrixf[x] = VIPS_ARRAY( object, n, double );
+		enlarge->matrixi[x] = VIPS_ARRAY( object, n, int );
+		if( !enlarge->matrixf[x] ||
+			!enlarge->matrixi[x] )
+			return( -1 );
+
+		vips_enlarge_make_mask( enlarge->matrixf[x], enlarge->kernel,
+			n, (float) x / VIPS_TRANSFORM_SCALE );
+		vips_vector_to_fixed_point( enlarge->matrixf[x],
+			enlarge->matrixi[x], n, VIPS_INTERPOLATE_SCALE );
+	}
+
+	/* Unpack for processing.
+	 */
+	if( vips_image_decode( in, &t[0] ) )
+		return( -1 );
+	in = t[0];
+
+	/* Add new pixels around the input so we can interpolate at the edges.
+	 */
+	if( vips_embed( in, &t[1],
+		n / 2, n / 2,
+		in->Xsize + n, in->Ysize + n,
+		"extend", VIPS_EXTEND_COPY,
+		(void *) NULL ) )
+		return( -1 );
+	in = t[1];
+
+	t[2] = vips_image_new();
+	if( vips_image_pipelinev( t[2],
+		VIPS_DEMAND_STYLE_FATSTRIP, in, (void *) NULL ) )
+		return( -1 );
+
+	/* Size output. We need to always round to nearest, so round(), not
+	 * rint().
+	 *
+	 * Don't change xres/yres, leave that to the application layer.
+	 */
+	if( resample->in->Xsize * enlarge->hscale > VIPS_MAX_COORD ||
+		resample->in->Ysize * enlarge->vscale > VIPS_MAX_COORD ) {
+		vips_error( object_class->nickname,
+			"%s", _( "image too large" ) );
+		return( -1 );
+	}
+	t[2]->Xsize = VIPS_ROUND_UINT( resample->in->Xsize * enlarge->hscale );
+	t[2]->Ysize = VIPS_ROUND_UINT( resample->in->Ysize * enlarge->vscale );
+
+	/* The input position of every output column and row.
+	 */
+	enlarge->hstart = VIPS_ARRAY( object, t[2]->Xsize, int );
+	enlarge->hphase = VIPS_ARRAY( object, t[2]->Xsize, int );
+	enlarge->vstart = VIPS_ARRAY( object, t[2]->Ysize, int );
+	enlarge->vphase = VIPS_ARRAY( object, t[2]->Ysize, int );
+	if( !enlarge->hstart ||
+		!enlarge->hphase ||
+		!enlarge->vstart ||
+		!enlarge->vphase )
+		return( -1 );
+	vips_enlarge_positions( enlarge->hstart, enlarge->hphase,
+		t[2]->Xsize, enlarge->hscale, n );
+	vips_enlarge_positions( enlarge->vstart, enlarge->vphase,
+		t[2]->Ysize, enlarge->vscale, n );
+
+#ifdef DEBUG
+	printf( "vips_enlarge_build: enlarging %d x %d image to %d x %d\n",
+		in->Xsize, in->Ysize,
+		t[2]->Xsize, t[2]->Ysize );
+#endif /*DEBUG*/
+
+	if( vips_image_generate( t[2],
+		vips_enlarge_start, vips_enlarge_gen, vips_enlarge_stop,
+		in, enlarge ) )
+		return( -1 );
+	in = t[2];
+
+	vips_reorder_margin_hint( in, n );
+
+	if( vips_image_write( in, resample->out ) )
+		return( -1 );
+
+	return( 0 );
+}
+
+static void
+vips_enlarge_class_init( VipsEnlargeClass *enlarge_class )
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS( enlarge_class );
+	VipsObjectClass *vobject_class = VIPS_OBJECT_CLASS( enlarge_class );
+	VipsOperationClass *operation_class =
+		VIPS_OPERATION_CLASS( enlarge_class );
+
+	VIPS_DEBUG_MSG( "vips_enlarge_class_init\n" );
+
+	gobject_class->set_property = vips_object_set_property;
+	gobject_class->get_property = vips_object_get_property;
+
+	vobject_class->nickname = "enlarge";
+	vobject_class->description = _( "enlarge an image" );
+	vobject_class->build = vips_enlarge_build;
+
+	operation_class->flags = VIPS_OPERATION_SEQUENTIAL;
+
+	VIPS_ARG_DOUBLE( enlarge_class, "hscale", 8,
+		_( "Hscale" ),
+		_( "Horizontal scale factor" ),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET( VipsEnlarge, hscale ),
+		1.0, 1000000.0, 1.0 );
+
+	VIPS_ARG_DOUBLE( enlarge_class, "vscale", 9,
+		_( "Vscale" ),
+		_( "Vertical scale factor" ),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET( VipsEnlarge, vscale ),
+		1.0, 1000000.0, 1.0 );
+
+	VIPS_ARG_ENUM( enlarge_class, "kernel", 3,
+		_( "Kernel" ),
+		_( "Resampling kernel" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsEnlarge, kernel ),
+		VIPS_TYPE_KERNEL, VIPS_KERNEL_LANCZOS3 );
+
+}
+
+static void
+vips_enlarge_init( VipsEnlarge *enlarge )
+{
+	enlarge->kernel = VIPS_KERNEL_LANCZOS3;
+}
+
+/* See reduce.c for the doc comment.
+ */
+
+int
+vips_enlarge( VipsImage *in, VipsImage **out,
+	double hscale, double vscale, ... )
+{
+	va_list ap;
+	int result;
+
+	va_start( ap, vscale );
+	result = vips_call_split( "enlarge", ap, in, out, hscale, vscale );
+	va_end( ap );
+
+	return( result );
+}
@@ -18,6 +18,9 @@
  * 	- faster bilinear
  * 27/2/19 s-sajid-ali
  * 	- more accurate bilinear
+ * 19/10/19
+ * 	- add vips__interpolate_get_line() to interpolate a line of pixels at 
+ * 	  a time, with line versions of nearest and bilinear
  */
 
 /*
@@ -58,10 +61,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <vips/vips.h>
 #include <vips/internal.h>
 
+#include "presample.h"
+
 /**
  * SECTION: interpolate
  * @short_description: various interpolators: nearest, bilinear, and
@@ -350,6 +356,39 @@ vips_interpolate_nearest_interpolate( VipsInterpolate *interpolate,
 		q[z] = p[z];
 }
 
+static void
+vips_interpolate_nearest_line( VipsInterpolate *interpolate,
+	VipsPel *out, VipsRegion *in, int n, 
+	double x, double y, double dx, double dy )
+{
+	const int ps = VIPS_IMAGE_SIZEOF_PEL( in->im );
+
+	int i;
+
+	/* A horizontal line at unit steps is a run of input pixels.
+	 */
+	if( dy == 0.0 &&
+		dx == 1.0 &&
+		x == (int) x ) {
+		memcpy( out, VIPS_REGION_ADDR( in, (int) x, (int) y ), n * ps );
+		return;
+	}
+
+	for( i = 0; i < n; i++ ) {
+		const VipsPel * restrict p = 
+			VIPS_REGION_ADDR( in, (int) x, (int) y );
+
+		int z;
+
+		for( z = 0; z < ps; z++ )
+			out[z] = p[z];
+
+		out += ps;
+		x += dx;
+		y += dy;
+	}
+}
+
 static void
 vips_interpolate_nearest_class_init( VipsInterpolateNearestClass *class )
 {
@@ -542,6 +581,100 @@ vips_interpolate_bilinear_interpolate( VipsInterpolate *interpolate,
 	SWITCH_INTERPOLATE( in->im->BandFmt, BILINEAR_INT, BILINEAR_FLOAT );
 }
 
+/* Interpolate a line of pixels with BILINEAR_INT or BILINEAR_FLOAT. We
+ * compute each pixel exactly as vips_interpolate_bilinear_interpolate()
+ * does, but we only switch on format once per line.
+ */
+#define BILINEAR_LINE( INTERPOLATE, TYPE ) { \
+	for( i = 0; i < n; i++ ) { \
+		const int ix = (int) x; \
+		const int iy = (int) y; \
+		\
+		const VipsPel * restrict p1 = VIPS_REGION_ADDR( in, ix, iy ); \
+		const VipsPel * restrict p2 = p1 + ps; \
+		const VipsPel * restrict p3 = p1 + ls; \
+		const VipsPel * restrict p4 = p3 + ps; \
+		\
+		VipsPel * restrict out = pout + i * ps; \
+		\
+		INTERPOLATE( TYPE ); \
+		\
+		x += dx; \
+		y += dy; \
+	} \
+}
+
+#define BILINEAR_INT_LINE( TYPE ) BILINEAR_LINE( BILINEAR_INT, TYPE )
+#define BILINEAR_FLOAT_LINE( TYPE ) BILINEAR_LINE( BILINEAR_FLOAT, TYPE )
+
+/* A line at unit steps along an input line, starting on a pixel centre. 
+ * X is zero, so c2 and c4 are zero too and we just blend two input lines
+ * with fixed weights. This is the near-identity case, eg. a translate.
+ */
+#define BILINEAR_INT_VERTICAL( TYPE ) { \
+	TYPE * restrict tq = (TYPE *) pout; \
+	const TYPE * restrict tp1 = (TYPE *) \
+		VIPS_REGION_ADDR( in, (int) x, (int) y ); \
+	const TYPE * restrict tp3 = (TYPE *) \
+		(VIPS_REGION_ADDR( in, (int) x, (int) y ) + ls); \
+	\
+	const int Y = (y - (int) y) * VIPS_INTERPOLATE_SCALE; \
+	const int c1 = VIPS_INTERPOLATE_SCALE - Y; \
+	const int c3 = Y; \
+	\
+	for( i = 0; i < n * b; i++ ) \
+		tq[i] = (c1 * tp1[i] + c3 * tp3[i] + \
+			(1 << VIPS_INTERPOLATE_SHIFT) / 2) >> \
+				VIPS_INTERPOLATE_SHIFT; \
+}
+
+static void
+vips_interpolate_bilinear_line( VipsInterpolate *interpolate,
+	VipsPel *pout, VipsRegion *in, int n, 
+	double x, double y, double dx, double dy )
+{
+	const int ps = VIPS_IMAGE_SIZEOF_PEL( in->im );
+	const int ls = VIPS_REGION_LSKIP( in );
+	const int b = in->im->Bands *
+		(vips_band_format_iscomplex( in->im->BandFmt ) ?  2 : 1);
+
+	int i, z;
+
+	/* Horizontal lines at unit steps from a pixel centre. Float 
+	 * formats stay on the general path, since 0 * inf is not 0.
+	 */
+	if( dy == 0.0 &&
+		dx == 1.0 &&
+		x == (int) x &&
+		!vips_band_format_isfloat( in->im->BandFmt ) &&
+		vips_format_sizeof( in->im->BandFmt ) <= 2 ) {
+		/* On a pixel centre vertically as well, we can just copy.
+		 */
+		if( y == (int) y ) 
+			memcpy( pout, VIPS_REGION_ADDR( in, (int) x, (int) y ), 
+				n * ps );
+		else {
+			switch( in->im->BandFmt ) {
+			case VIPS_FORMAT_UCHAR:
+				BILINEAR_INT_VERTICAL( unsigned char ); break;
+			case VIPS_FORMAT_CHAR:
+				BILINEAR_INT_VERTICAL( char ); break;
+			case VIPS_FORMAT_USHORT:
+				BILINEAR_INT_VERTICAL( unsigned short ); break;
+			case VIPS_FORMAT_SHORT:
+				BILINEAR_INT_VERTICAL( short ); break;
+			default:
+				g_assert_not_reached();
+			}
+		}
+
+		return;
+	}
+
+	SWITCH_INTERPOLATE( in->im->BandFmt, 
+		BILINEAR_INT_LINE, BILINEAR_FLOAT_LINE );
+}
+
 static void
 vips_interpolate_bilinear_class_init( VipsInterpolateBilinearClass *class )
 {
@@ -594,6 +727,54 @@ vips_interpolate_bilinear_static( void )
 	return( interpolate );
 }
 
+/* Interpolate a line with a class's per-pixel method. 
+ */
+static void
+vips_interpolate_generic_line( VipsInterpolate *interpolate,
+	VipsPel *out, VipsRegion *in, int n, 
+	double x, double y, double dx, double dy )
+{
+	VipsInterpolateMethod interpolate_fn = 
+		vips_interpolate_get_method( interpolate );
+	const int ps = VIPS_IMAGE_SIZEOF_PEL( in->im );
+
+	int i;
+
+	for( i = 0; i < n; i++ ) {
+		interpolate_fn( interpolate, out, in, x, y );
+
+		out += ps;
+		x += dx;
+		y += dy;
+	}
+}
+
+/* Find a function to interpolate a line of pixels at a time. We test the
+ * class method rather than the type, so subclasses which override 
+ * interpolate get the generic path.
+ */
+VipsInterpolateLineFn 
+vips__interpolate_get_line( VipsInterpolate *interpolate )
+{
+	VipsInterpolateMethod interpolate_fn = 
+		vips_interpolate_get_method( interpolate );
+
+	VipsInterpolateLineFn line_fn;
+
+	if( interpolate_fn == vips_interpolate_nearest_interpolate )
+		return( vips_interpolate_nearest_line );
+	if( interpolate_fn == vips_interpolate_bilinear_interpolate )
+		return( vips_interpolate_bilinear_line );
+	if( (line_fn = vips__interpolate_bicubic_get_line( interpolate )) )
+		return( line_fn );
+	if( (line_fn = vips__interpolate_lbb_get_line( interpolate )) )
+		return( line_fn );
+	if( (line_fn = vips__interpolate_nohalo_get_line( interpolate )) )
+		return( line_fn );
+
+	return( vips_interpolate_generic_line );
+}
+
 /* Called on startup: register the base vips interpolators.
  */
 void
@@ -5,6 +5,9 @@
  * N. Robidoux, 16-19/05/2010
  *
  * N. Robidoux, 22/11/2011
+ *
+ * 19/10/19
+ * 	- add a line version for vips__interpolate_get_line()
  */
 
 /*
@@ -164,6 +167,7 @@
 #include <vips/internal.h>
 
 #include "templates.h"
+#include "presample.h"
 
 #define VIPS_TYPE_INTERPOLATE_LBB \
 	(vips_interpolate_lbb_get_type())
@@ -192,10 +196,9 @@ typedef struct _VipsInterpolateLbbClass {
 } VipsInterpolateLbbClass;
 
 /*
- * Absolute value and sign macros:
+ * Absolute value macro:
  */
 #define LBB_ABS(x)  ( ((x)>=0.) ? (x) : -(x) )
-#define LBB_SIGN(x) ( ((x)>=0.) ? 1.0 : -1.0 )
 /*
  * MIN and MAX macros set up so that I can put the likely winner in
  * the first argument (forward branch likely blah blah blah):
@@ -203,7 +206,18 @@ typedef struct _VipsInterpolateLbbClass {
 #define LBB_MIN(x,y) ( ((x)<=(y)) ? (x) : (y) )
 #define LBB_MAX(x,y) ( ((x)>=(y)) ? (x) : (y) )
 
-static inline double
+/*
+ * The kernels are large, so compilers won't usually inline them into
+ * the batch loops in the line functions, and that stops the loops
+ * vectorising. Insist.
+ */
+#ifdef __GNUC__
+#define LBB_INLINE inline __attribute__((always_inline))
+#else /*!__GNUC__*/
+#define LBB_INLINE inline
+#endif /*__GNUC__*/
+
+static LBB_INLINE double
 lbbicubic( const double c00,
            const double c10,
            const double c01,
@@ -390,21 +404,6 @@ lbbicubic( const double c00,
   const double dble_dzdx11i = tre_fou - tre_two;
   const double dble_dzdy00i = tre_two - uno_two;
 
-  /*
-   * Signs of the derivatives. The upcoming clamping does not change
-   * them (except if the clamping sends a negative derivative to 0, in
-   * which case the sign does not matter anyway).
-   */
-  const double sign_dzdx00 = LBB_SIGN( dble_dzdx00i );
-  const double sign_dzdx10 = LBB_SIGN( dble_dzdx10i );
-  const double sign_dzdx01 = LBB_SIGN( dble_dzdx01i );
-  const double sign_dzdx11 = LBB_SIGN( dble_dzdx11i );
-
-  const double sign_dzdy00 = LBB_SIGN( dble_dzdy00i );
-  const double sign_dzdy10 = LBB_SIGN( dble_dzdy10i );
-  const double sign_dzdy01 = LBB_SIGN( dble_dzdy01i );
-  const double sign_dzdy11 = LBB_SIGN( dble_dzdy11i );
-
   /*
    * Initial values of the cross-derivatives. Factors of 1/4 are left
    * out because folded in later:
@@ -424,32 +423,36 @@ lbbicubic( const double c00,
   const double dble_slopelimit_11 = 6.0 * LBB_MIN( u11, v11 );
 
   /*
-   * Clamped first derivatives:
+   * Clamped first derivatives. The slope limits are never negative,
+   * so clamping the magnitude of a derivative while keeping its sign
+   * is the same as clamping it to [-limit, limit]. Doing it with min
+   * and max rather than with signs means the "? :" only select between
+   * values, and the compiler can vectorise the line functions.
    */
   const double dble_dzdx00 =
-    ( sign_dzdx00 * dble_dzdx00i <= dble_slopelimit_00 )
-    ? dble_dzdx00i :  sign_dzdx00 * dble_slopelimit_00;
+    LBB_MIN( LBB_MAX( dble_dzdx00i, -dble_slopelimit_00 ),
+             dble_slopelimit_00 );
   const double dble_dzdy00 =
-    ( sign_dzdy00 * dble_dzdy00i <= dble_slopelimit_00 )
-    ? dble_dzdy00i :  sign_dzdy00 * dble_slopelimit_00;
+    LBB_MIN( LBB_MAX( dble_dzdy00i, -dble_slopelimit_00 ),
+             dble_slopelimit_00 );
   const double dble_dzdx10 =
-    ( sign_dzdx10 * dble_dzdx10i <= dble_slopelimit_10 )
-    ? dble_dzdx10i :  sign_dzdx10 * dble_slopelimit_10;
+    LBB_MIN( LBB_MAX( dble_dzdx10i, -dble_slopelimit_10 ),
+             dble_slopelimit_10 );
   const double dble_dzdy10 =
-    ( sign_dzdy10 * dble_dzdy10i <= dble_slopelimit_10 )
-    ? dble_dzdy10i :  sign_dzdy10 * dble_slopelimit_10;
+    LBB_MIN( LBB_MAX( dble_dzdy10i, -dble_slopelimit_10 ),
+             dble_slopelimit_10 );
   const double dble_dzdx01 =
-    ( sign_dzdx01 * dble_dzdx01i <= dble_slopelimit_01 )
-    ? dble_dzdx01i :  sign_dzdx01 * dble_slopelimit_01;
+    LBB_MIN( LBB_MAX( dble_dzdx01i, -dble_slopelimit_01 ),
+             dble_slopelimit_01 );
   const double dble_dzdy01 =
-    ( sign_dzdy01 * dble_dzdy01i <= dble_slopelimit_01 )
-    ? dble_dzdy01i :  sign_dzdy01 * dble_slopelimit_01;
+    LBB_MIN( LBB_MAX( dble_dzdy01i, -dble_slopelimit_01 ),
+             dble_slopelimit_01 );
   const double dble_dzdx11 =
-    ( sign_dzdx11 * dble_dzdx11i <= dble_slopelimit_11 )
-    ? dble_dzdx11i :  sign_dzdx11 * dble_slopelimit_11;
+    LBB_MIN( LBB_MAX( dble_dzdx11i, -dble_slopelimit_11 ),
+             dble_slopelimit_11 );
   const double dble_dzdy11 =
-    ( sign_dzdy11 * dble_dzdy11i <= dble_slopelimit_11 )
-    ? dble_dzdy11i :  sign_dzdy11 * dble_slopelimit_11;
+    LBB_MIN( LBB_MAX( dble_dzdy11i, -dble_slopelimit_11 ),
+             dble_slopelimit_11 );
 
   /*
    * Sums and differences of first derivatives:
@@ -573,6 +576,79 @@ lbbicubic( const double c00,
   return newval;
 }
 
+/*
+ * The sixteen weights of the LBB patch for a sampling point, in the
+ * order lbbicubic() takes them.
+ */
+static void inline
+lbb_weights( const double           xp1over2,
+             const double           yp1over2,
+                   double* restrict c )
+{
+  const double xm1over2   = xp1over2 - 1.0;
+  const double onepx      = 0.5 + xp1over2;
+  const double onemx      = 1.5 - xp1over2;
+  const double xp1over2sq = xp1over2 * xp1over2;
+
+  const double ym1over2   = yp1over2 - 1.0;
+  const double onepy      = 0.5 + yp1over2;
+  const double onemy      = 1.5 - yp1over2;
+  const double yp1over2sq = yp1over2 * yp1over2;
+
+  const double xm1over2sq = xm1over2 * xm1over2;
+  const double ym1over2sq = ym1over2 * ym1over2;
+
+  const double twice1px = onepx + onepx;
+  const double twice1py = onepy + onepy;
+  const double twice1mx = onemx + onemx;
+  const double twice1my = onemy + onemy;
+
+  const double xm1over2sq_times_ym1over2sq = xm1over2sq * ym1over2sq;
+  const double xp1over2sq_times_ym1over2sq = xp1over2sq * ym1over2sq;
+  const double xp1over2sq_times_yp1over2sq = xp1over2sq * yp1over2sq;
+  const double xm1over2sq_times_yp1over2sq = xm1over2sq * yp1over2sq;
+
+  const double four_times_1px_times_1py = twice1px * twice1py;
+  const double four_times_1mx_times_1py = twice1mx * twice1py;
+  const double twice_xp1over2_times_1py = xp1over2 * twice1py;
+  const double twice_xm1over2_times_1py = xm1over2 * twice1py;
+
+  const double twice_xm1over2_times_1my = xm1over2 * twice1my;
+  const double twice_xp1over2_times_1my = xp1over2 * twice1my;
+  const double four_times_1mx_times_1my = twice1mx * twice1my;
+  const double four_times_1px_times_1my = twice1px * twice1my;
+
+  const double twice_1px_times_ym1over2 = twice1px * ym1over2;
+  const double twice_1mx_times_ym1over2 = twice1mx * ym1over2;
+  const double xp1over2_times_ym1over2  = xp1over2 * ym1over2;
+  const double xm1over2_times_ym1over2  = xm1over2 * ym1over2;
+
+  const double xm1over2_times_yp1over2  = xm1over2 * yp1over2;
+  const double xp1over2_times_yp1over2  = xp1over2 * yp1over2;
+  const double twice_1mx_times_yp1over2 = twice1mx * yp1over2;
+  const double twice_1px_times_yp1over2 = twice1px * yp1over2;
+
+  c[  0 ] = four_times_1px_times_1py * xm1over2sq_times_ym1over2sq;
+  c[  1 ] = four_times_1mx_times_1py * xp1over2sq_times_ym1over2sq;
+  c[  2 ] = four_times_1px_times_1my * xm1over2sq_times_yp1over2sq;
+  c[  3 ] = four_times_1mx_times_1my * xp1over2sq_times_yp1over2sq;
+
+  c[  4 ] = twice_xp1over2_times_1py * xm1over2sq_times_ym1over2sq;
+  c[  5 ] = twice_xm1over2_times_1py * xp1over2sq_times_ym1over2sq;
+  c[  6 ] = twice_xp1over2_times_1my * xm1over2sq_times_yp1over2sq;
+  c[  7 ] = twice_xm1over2_times_1my * xp1over2sq_times_yp1over2sq;
+
+  c[  8 ] = twice_1px_times_yp1over2 * xm1over2sq_times_ym1over2sq;
+  c[  9 ] = twice_1mx_times_yp1over2 * xp1over2sq_times_ym1over2sq;
+  c[ 10 ] = twice_1px_times_ym1over2 * xm1over2sq_times_yp1over2sq;
+  c[ 11 ] = twice_1mx_times_ym1over2 * xp1over2sq_times_yp1over2sq;
+
+  c[ 12 ] = xp1over2_times_yp1over2 * xm1over2sq_times_ym1over2sq;
+  c[ 13 ] = xm1over2_times_yp1over2 * xp1over2sq_times_ym1over2sq;
+  c[ 14 ] = xp1over2_times_ym1over2 * xm1over2sq_times_yp1over2sq;
+  c[ 15 ] = xm1over2_times_ym1over2 * xp1over2sq_times_yp1over2sq;
+}
+
 /*
  * Call lbb with a type conversion operator as a parameter.
  *
@@ -616,108 +692,31 @@ lbbicubic( const double c00,
     const int tre_fou_shift = tre_two_shift + fou_shift; \
     const int qua_fou_shift = qua_two_shift + fou_shift; \
     \
-    const double xp1over2   = relative_x; \
-    const double xm1over2   = xp1over2 - 1.0; \
-    const double onepx      = 0.5 + xp1over2; \
-    const double onemx      = 1.5 - xp1over2; \
-    const double xp1over2sq = xp1over2 * xp1over2; \
-    \
-    const double yp1over2   = relative_y; \
-    const double ym1over2   = yp1over2 - 1.0; \
-    const double onepy      = 0.5 + yp1over2; \
-    const double onemy      = 1.5 - yp1over2; \
-    const double yp1over2sq = yp1over2 * yp1over2; \
-    \
-    const double xm1over2sq = xm1over2 * xm1over2; \
-    const double ym1over2sq = ym1over2 * ym1over2; \
-    \
-    const double twice1px = onepx + onepx; \
-    const double twice1py = onepy + onepy; \
-    const double twice1mx = onemx + onemx; \
-    const double twice1my = onemy + onemy; \
-    \
-    const double xm1over2sq_times_ym1over2sq = xm1over2sq * ym1over2sq; \
-    const double xp1over2sq_times_ym1over2sq = xp1over2sq * ym1over2sq; \
-    const double xp1over2sq_times_yp1over2sq = xp1over2sq * yp1over2sq; \
-    const double xm1over2sq_times_yp1over2sq = xm1over2sq * yp1over2sq; \
-    \
-    const double four_times_1px_times_1py = twice1px * twice1py; \
-    const double four_times_1mx_times_1py = twice1mx * twice1py; \
-    const double twice_xp1over2_times_1py = xp1over2 * twice1py; \
-    const double twice_xm1over2_times_1py = xm1over2 * twice1py; \
-    \
-    const double twice_xm1over2_times_1my = xm1over2 * twice1my; \
-    const double twice_xp1over2_times_1my = xp1over2 * twice1my; \
-    const double four_times_1mx_times_1my = twice1mx * twice1my; \
-    const double four_times_1px_times_1my = twice1px * twice1my; \
-    \
-    const double twice_1px_times_ym1over2 = twice1px * ym1over2; \
-    const double twice_1mx_times_ym1over2 = twice1mx * ym1over2; \
-    const double xp1over2_times_ym1over2  = xp1over2 * ym1over2; \
-    const double xm1over2_times_ym1over2  = xm1over2 * ym1over2; \
-    \
-    const double xm1over2_times_yp1over2  = xm1over2 * yp1over2; \
-    const double xp1over2_times_yp1over2  = xp1over2 * yp1over2; \
-    const double twice_1mx_times_yp1over2 = twice1mx * yp1over2; \
-    const double twice_1px_times_yp1over2 = twice1px * yp1over2; \
-    \
-    const double c00 = \
-      four_times_1px_times_1py * xm1over2sq_times_ym1over2sq; \
-    const double c00dx = \
-      twice_xp1over2_times_1py * xm1over2sq_times_ym1over2sq; \
-    const double c00dy = \
-      twice_1px_times_yp1over2 * xm1over2sq_times_ym1over2sq; \
-    const double c00dxdy = \
-       xp1over2_times_yp1over2 * xm1over2sq_times_ym1over2sq; \
-    \
-    const double c10 = \
-      four_times_1mx_times_1py * xp1over2sq_times_ym1over2sq; \
-    const double c10dx = \
-      twice_xm1over2_times_1py * xp1over2sq_times_ym1over2sq; \
-    const double c10dy = \
-      twice_1mx_times_yp1over2 * xp1over2sq_times_ym1over2sq; \
-    const double c10dxdy = \
-       xm1over2_times_yp1over2 * xp1over2sq_times_ym1over2sq; \
-    \
-    const double c01 = \
-      four_times_1px_times_1my * xm1over2sq_times_yp1over2sq; \
-    const double c01dx = \
-      twice_xp1over2_times_1my * xm1over2sq_times_yp1over2sq; \
-    const double c01dy = \
-      twice_1px_times_ym1over2 * xm1over2sq_times_yp1over2sq; \
-    const double c01dxdy = \
-       xp1over2_times_ym1over2 * xm1over2sq_times_yp1over2sq; \
+    double c[ 16 ]; \
     \
-    const double c11 = \
-      four_times_1mx_times_1my * xp1over2sq_times_yp1over2sq; \
-    const double c11dx = \
-      twice_xm1over2_times_1my * xp1over2sq_times_yp1over2sq; \
-    const double c11dy = \
-      twice_1mx_times_ym1over2 * xp1over2sq_times_yp1over2sq; \
-    const double c11dxdy = \
-       xm1over2_times_ym1over2 * xp1over2sq_times_yp1over2sq; \
+    lbb_weights( relative_x, relative_y, c ); \
     \
     int band = bands; \
     \
     do \
       { \
         const double double_result =        \
-          lbbicubic( c00,                   \
-                     c10,                   \
-                     c01,                   \
-                     c11,                   \
-                     c00dx,                 \
-                     c10dx,                 \
-                     c01dx,                 \
-                     c11dx,                 \
-                     c00dy,                 \
-                     c10dy,                 \
-                     c01dy,                 \
-                     c11dy,                 \
-                     c00dxdy,               \
-                     c10dxdy,               \
-                     c01dxdy,               \
-                     c11dxdy,               \
+          lbbicubic( c[  0 ],               \
+                     c[  1 ],               \
+                     c[  2 ],               \
+                     c[  3 ],               \
+                     c[  4 ],               \
+                     c[  5 ],               \
+                     c[  6 ],               \
+                     c[  7 ],               \
+                     c[  8 ],               \
+                     c[  9 ],               \
+                     c[ 10 ],               \
+                     c[ 11 ],               \
+                     c[ 12 ],               \
+                     c[ 13 ],               \
+                     c[ 14 ],               \
+                     c[ 15 ],               \
                      in[ uno_one_shift ],   \
                      in[ uno_two_shift ],   \
                      in[ uno_thr_shift ],   \
@@ -753,6 +752,136 @@ LBB_CONVERSION( nosign )
                          relative_x,   \
                          relative_y );
 
+/*
+ * Interpolate a line of pixels. Rather than calling lbbicubic() once
+ * per band per pixel, we gather the weights and stencils for a batch
+ * of up to LBB_LANES pixel-bands into planes, one element per lane,
+ * then run lbbicubic() down the planes. lbbicubic() uses only
+ * selects for its min, max and abs, so the compiler can vectorise
+ * this loop. The result matches vips_interpolate_lbb_interpolate() to
+ * within rounding.
+ */
+#define LBB_LANES (64)
+
+#define LBB_LINE_CONVERSION( conversion )                       \
+  template <typename T> static void                             \
+  lbb_line_ ## conversion(       VipsPel*    restrict pout,     \
+                                 VipsRegion* restrict in,       \
+                           const int                  bands,    \
+                           const int                  lskip,    \
+                           const int                  n,        \
+                                 double               x,        \
+                                 double               y,        \
+                           const double               dx,       \
+                           const double               dy )      \
+  { \
+    T* restrict out = (T *) pout; \
+    \
+    /* \
+     * The stencil, in the order lbbicubic() takes it. \
+     */ \
+    const int shift[ 16 ] = { \
+        -lskip - bands,   -lskip,   -lskip + bands,   -lskip + 2*bands, \
+               - bands,        0,            bands,            2*bands, \
+         lskip - bands,    lskip,    lskip + bands,    lskip + 2*bands, \
+       2*lskip - bands,  2*lskip,  2*lskip + bands,  2*lskip + 2*bands  \
+    }; \
+    \
+    const int pixels = LBB_LANES / bands; \
+    \
+    double c[ 16 ][ LBB_LANES ]; \
+    double z[ 16 ][ LBB_LANES ]; \
+    double result[ LBB_LANES ]; \
+    \
+    /* \
+     * We run lbbicubic() down whole planes, so the loop has a fixed trip \
+     * count and vectorises even at -O2. Zero the lanes the first batch \
+     * won't fill, later batches just recompute stale lanes. \
+     */ \
+    for( int k = 0; k < 16; k++ ) \
+      for( int lane = VIPS_MIN( n, pixels ) * bands; \
+        lane < LBB_LANES; lane++ ) \
+        { \
+          c[ k ][ lane ] = 0.0; \
+          z[ k ][ lane ] = 0.0; \
+        } \
+    \
+    for( int i = 0; i < n; i += pixels ) \
+      { \
+        const int batch = VIPS_MIN( pixels, n - i ); \
+        const int lanes = batch * bands; \
+        \
+        for( int j = 0; j < batch; j++ ) \
+          { \
+            const int ix = (int) x; \
+            const int iy = (int) y; \
+            const T* restrict p = (T *) VIPS_REGION_ADDR( in, ix, iy ); \
+            \
+            double w[ 16 ]; \
+            \
+            lbb_weights( x - ix, y - iy, w ); \
+            \
+            for( int b = 0; b < bands; b++ ) \
+              { \
+                const int lane = j * bands + b; \
+                \
+                for( int k = 0; k < 16; k++ ) \
+                  { \
+                    c[ k ][ lane ] = w[ k ]; \
+                    z[ k ][ lane ] = p[ shift[ k ] + b ]; \
+                  } \
+              } \
+            \
+            x += dx; \
+            y += dy; \
+          } \
+        \
+        for( int lane = 0; lane < LBB_LANES; lane++ ) \
+          result[ lane ] = \
+            lbbicubic( c[  0 ][ lane ], \
+                       c[  1 ][ lane ], \
+                       c[  2 ][ lane ], \
+                       c[  3 ][ lane ], \
+                       c[  4 ][ lane ], \
+                       c[  5 ][ lane ], \
+                       c[  6 ][ lane ], \
+                       c[  7 ][ lane ], \
+                       c[  8 ][ lane ], \
+                       c[  9 ][ lane ], \
+                       c[ 10 ][ lane ], \
+                       c[ 11 ][ lane ], \
+                       c[ 12 ][ lane ], \
+                       c[ 13 ][ lane ], \
+                       c[ 14 ][ lane ], \
+                       c[ 15 ][ lane ], \
+                       z[  0 ][ lane ], \
+                       z[  1 ][ lane ], \
+                       z[  2 ][ lane ], \
+                       z[  3 ][ lane ], \
+                       z[  4 ][ lane ], \
+                       z[  5 ][ lane ], \
+                       z[  6 ][ lane ], \
+                       z[  7 ][ lane ], \
+                       z[  8 ][ lane ], \
+                       z[  9 ][ lane ], \
+                       z[ 10 ][ lane ], \
+                       z[ 11 ][ lane ], \
+                       z[ 12 ][ lane ], \
+                       z[ 13 ][ lane ], \
+                       z[ 14 ][ lane ], \
+                       z[ 15 ][ lane ] ); \
+        \
+        for( int lane = 0; lane < lanes; lane++ ) \
+          out[ lane ] = to_ ## conversion<T>( result[ lane ] ); \
+        \
+        out += lanes; \
+      } \
+  }
+
+LBB_LINE_CONVERSION( fptypes )
+LBB_LINE_CONVERSION( withsign )
+LBB_LINE_CONVERSION( nosign )
+
 /*
  * We need C linkage:
  */
@@ -854,6 +983,105 @@ vips_interpolate_lbb_interpolate( VipsInterpolate* restrict interpolate,
   }
 }
 
+#define CALL_LINE( T, conversion )                   \
+  lbb_line_ ## conversion<T>( out,                   \
+                              in,                    \
+                              bands,                 \
+                              lskip,                 \
+                              n,                     \
+                              x,                     \
+                              y,                     \
+                              dx,                    \
+                              dy );
+
+static void
+vips_interpolate_lbb_line( VipsInterpolate* restrict interpolate,
+                           VipsPel*         restrict out,
+                           VipsRegion*      restrict in,
+                           int                       n,
+                           double                    x,
+                           double                    y,
+                           double                    dx,
+                           double                    dy )
+{
+  const int lskip = VIPS_REGION_LSKIP( in ) / 
+	  VIPS_IMAGE_SIZEOF_ELEMENT( in->im );
+  const int actual_bands = in->im->Bands;
+  const int bands =
+    vips_band_format_iscomplex( in->im->BandFmt ) ? 
+      2 * actual_bands : actual_bands;
+
+  /*
+   * Very many bands won't fit in a batch: do them a pixel at a time.
+   */
+  if( bands > LBB_LANES )
+    {
+      const int ps = VIPS_IMAGE_SIZEOF_PEL( in->im );
+
+      for( int i = 0; i < n; i++ )
+        {
+          vips_interpolate_lbb_interpolate( interpolate,
+            out + i * ps, in, x, y );
+          x += dx;
+          y += dy;
+        }
+
+      return;
+    }
+
+  switch( in->im->BandFmt ) {
+  case VIPS_FORMAT_UCHAR:
+    CALL_LINE( unsigned char, nosign );
+    break;
+
+  case VIPS_FORMAT_CHAR:
+    CALL_LINE( signed char, withsign );
+    break;
+
+  case VIPS_FORMAT_USHORT:
+    CALL_LINE( unsigned short, nosign );
+    break;
+
+  case VIPS_FORMAT_SHORT:
+    CALL_LINE( signed short, withsign );
+    break;
+
+  case VIPS_FORMAT_UINT:
+    CALL_LINE( unsigned int, nosign );
+    break;
+
+  case VIPS_FORMAT_INT:
+    CALL_LINE( signed int, withsign );
+    break;
+
+  case VIPS_FORMAT_FLOAT:
+  case VIPS_FORMAT_COMPLEX:
+    CALL_LINE( float, fptypes );
+    break;
+
+  case VIPS_FORMAT_DOUBLE:
+  case VIPS_FORMAT_DPCOMPLEX:
+    CALL_LINE( double, fptypes );
+    break;
+
+  default:
+    g_assert( 0 );
+    break;
+  }
+}
+
+/* The line function, if this is our lbb, or NULL.
+ */
+VipsInterpolateLineFn
+vips__interpolate_lbb_get_line( VipsInterpolate *interpolate )
+{
+  if( vips_interpolate_get_method( interpolate ) == 
+    vips_interpolate_lbb_interpolate )
+    return( vips_interpolate_lbb_line );
+
+  return( NULL );
+}
+
 static void
 vips_interpolate_lbb_class_init( VipsInterpolateLbbClass *klass )
 {
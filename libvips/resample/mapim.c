@@ -7,6 +7,9 @@
  * 	- a bit quicker
  * 17/12/18
  * 	- we were not offsetting pixel fetches by window_offset
+ * 19/10/19
+ * 	- split output areas with large input footprints, so strong warps 
+ * 	  don't prepare huge input areas
  */
 
 /*
@@ -261,15 +264,24 @@ vips_mapim_region_minmax( VipsRegion *region, VipsRect *r, VipsRect *bounds )
 	} \
 }
 
+/* If the input area we'd need for an output area is more than this many times 
+ * larger, we split the output area and try again. Strong warps (lens 
+ * correction, reprojection) can otherwise need most of the input image for
+ * a single output tile.
+ */
+#define MAPIM_MAX_RATIO (16)
+
+/* Don't split output areas smaller than this.
+ */
+#define MAPIM_MIN_SIZE (8)
+
+/* Generate area @r of @or. The index pixels for @r must be in ir[1].
+ */
 static int
-vips_mapim_gen( VipsRegion *or, void *seq, void *a, void *b, gboolean *stop )
+vips_mapim_gen_area( VipsRegion *or, VipsRect *r, VipsRegion **ir, 
+	const VipsImage *in, const VipsMapim *mapim )
 {
-	VipsRect *r = &or->valid;
-	VipsRegion **ir = (VipsRegion **) seq;
-	const VipsImage **in_array = (const VipsImage **) a;
-	const VipsMapim *mapim = (VipsMapim *) b; 
 	const VipsResample *resample = VIPS_RESAMPLE( mapim );
-	const VipsImage *in = in_array[0];
 	const int window_size = 
 		vips_interpolate_get_window_size( mapim->interpolate );
 	const int window_offset = 
@@ -282,22 +294,9 @@ vips_mapim_gen( VipsRegion *or, void *seq, void *a, void *b, gboolean *stop )
 
 	VipsRect bounds, image, clipped;
 	int x, y, z;
-	
-#ifdef DEBUG_VERBOSE
-	printf( "vips_mapim_gen: "
-		"generating left=%d, top=%d, width=%d, height=%d\n", 
-		r->left,
-		r->top,
-		r->width,
-		r->height );
-#endif /*DEBUG_VERBOSE*/
 
-	/* Fetch the chunk of the mapim image we need, and find the max/min in
-	 * x and y.
+	/* Find the max/min of the index pixels in x and y.
 	 */
-	if( vips_region_prepare( ir[1], r ) )
-		return( -1 );
-
 	VIPS_GATE_START( "vips_mapim_gen: work" ); 
 
 	vips_mapim_region_minmax( ir[1], r, &bounds ); 
@@ -329,9 +328,42 @@ vips_mapim_gen( VipsRegion *or, void *seq, void *a, void *b, gboolean *stop )
 #endif /*DEBUG_VERBOSE*/
 
 	if( vips_rect_isempty( &clipped ) ) {
-		vips_region_black( or );
+		vips_region_paint( or, r, 0 );
+		return( 0 );
+	}
+
+	/* Too large a footprint? Split along the longer axis.
+	 */
+	if( (double) clipped.width * clipped.height > 
+			(double) MAPIM_MAX_RATIO * r->width * r->height &&
+		VIPS_MAX( r->width, r->height ) > MAPIM_MIN_SIZE ) {
+		VipsRect area;
+
+		area = *r;
+		if( r->width > r->height ) {
+			area.width = r->width / 2;
+			if( vips_mapim_gen_area( or, &area, ir, in, mapim ) )
+				return( -1 );
+
+			area.left += area.width;
+			area.width = r->width - area.width;
+			if( vips_mapim_gen_area( or, &area, ir, in, mapim ) )
+				return( -1 );
+		}
+		else {
+			area.height = r->height / 2;
+			if( vips_mapim_gen_area( or, &area, ir, in, mapim ) )
+				return( -1 );
+
+			area.top += area.height;
+			area.height = r->height - area.height;
+			if( vips_mapim_gen_area( or, &area, ir, in, mapim ) )
+				return( -1 );
+		}
+
 		return( 0 );
 	}
+
 	if( vips_region_prepare( ir[0], &clipped ) )
 		return( -1 );
 
@@ -378,6 +410,31 @@ vips_mapim_gen( VipsRegion *or, void *seq, void *a, void *b, gboolean *stop )
 	return( 0 );
 }
 
+static int
+vips_mapim_gen( VipsRegion *or, void *seq, void *a, void *b, gboolean *stop )
+{
+	VipsRect *r = &or->valid;
+	VipsRegion **ir = (VipsRegion **) seq;
+	const VipsImage **in_array = (const VipsImage **) a;
+	const VipsMapim *mapim = (VipsMapim *) b; 
+
+#ifdef DEBUG_VERBOSE
+	printf( "vips_mapim_gen: "
+		"generating left=%d, top=%d, width=%d, height=%d\n", 
+		r->left,
+		r->top,
+		r->width,
+		r->height );
+#endif /*DEBUG_VERBOSE*/
+
+	/* Fetch the chunk of the mapim image we need.
+	 */
+	if( vips_region_prepare( ir[1], r ) )
+		return( -1 );
+
+	return( vips_mapim_gen_area( or, r, ir, in_array[0], mapim ) );
+}
+
 static int
 vips_mapim_build( VipsObject *object )
 {
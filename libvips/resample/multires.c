@@ -0,0 +1,403 @@
+/* load a pyramidal image at any scale
+ *
+ * 19/10/19
+ * 	- from thumbnail.c
+ */
+
+/*
+
+    This file is part of VIPS.
+
+    VIPS is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA
+
+ */
+
+/*
+
+    These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <vips/intl.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+
+/* Should be plenty.
+ */
+#define MAX_LEVELS (256)
+
+typedef struct _VipsMultires {
+	VipsOperation parent_instance;
+
+	char *filename;
+	VipsImage *out;
+	double scale;
+	double vscale;
+	VipsKernel kernel;
+	int level;
+
+	/* The loader, and the size of each level in the pyramid. Non-pyramid
+	 * images have a single level.
+	 */
+	const char *loader;
+	int level_count;
+	int level_width[MAX_LEVELS];
+	int level_height[MAX_LEVELS];
+
+} VipsMultires;
+
+typedef VipsOperationClass VipsMultiresClass;
+
+G_DEFINE_TYPE( VipsMultires, vips_multires, VIPS_TYPE_OPERATION );
+
+/* Fetch an int openslide field from metadata. These are all represented as
+ * strings. Return the default value if there's any problem.
+ */
+static int
+get_int( VipsImage *image, const char *field, int default_value )
+{
+	const char *str;
+
+	if( vips_image_get_typeof( image, field ) &&
+		!vips_image_get_string( image, field, &str ) )
+		return( atoi( str ) );
+
+	return( default_value );
+}
+
+/* Open a level. We open in random mode, and the open goes via the operation
+ * cache, so every request which lands on this level will share the loader
+ * and its tile cache.
+ */
+static VipsImage *
+vips_multires_open( VipsMultires *multires, int level )
+{
+	if( vips_isprefix( "VipsForeignLoadOpenslide", multires->loader ) )
+		return( vips_image_new_from_file( multires->filename,
+			"access", VIPS_ACCESS_RANDOM,
+			"level", level,
+			NULL ) );
+	else if( vips_isprefix( "VipsForeignLoadTiff", multires->loader ) )
+		return( vips_image_new_from_file( multires->filename,
+			"access", VIPS_ACCESS_RANDOM,
+			"page", level,
+			NULL ) );
+	else
+		return( vips_image_new_from_file( multires->filename,
+			"access", VIPS_ACCESS_RANDOM,
+			NULL ) );
+}
+
+/* Read the openslide level structure from the metadata on level 0.
+ */
+static void
+vips_multires_get_openslide_pyramid( VipsMultires *multires,
+	VipsImage *image )
+{
+	int level_count;
+	int level;
+
+	level_count = get_int( image, "openslide.level-count", 1 );
+	level_count = VIPS_CLIP( 1, level_count, MAX_LEVELS );
+
+	for( level = 0; level < level_count; level++ ) {
+		char name[256];
+
+		vips_snprintf( name, 256,
+			"openslide.level[%d].width", level );
+		multires->level_width[level] = get_int( image, name, 0 );
+		vips_snprintf( name, 256,
+			"openslide.level[%d].height", level );
+		multires->level_height[level] = get_int( image, name, 0 );
+
+		/* A level we can't size is no use to us, stop the pyramid
+		 * here.
+		 */
+		if( multires->level_width[level] < 1 ||
+			multires->level_height[level] < 1 )
+			break;
+	}
+
+	multires->level_count = VIPS_MAX( 1, level );
+}
+
+/* This may not be a pyr tiff, so no error if we can't find the layers.
+ * We just look for two or more pages following roughly /2 shrinks, as
+ * vips_thumbnail() does. Opening a page only reads the header.
+ */
+static void
+vips_multires_get_tiff_pyramid( VipsMultires *multires, VipsImage *image )
+{
+	int n_pages = VIPS_CLIP( 1, vips_image_get_n_pages( image ),
+		MAX_LEVELS );
+	int i;
+
+	for( i = 1; i < n_pages; i++ ) {
+		VipsImage *page;
+		int level_width;
+		int level_height;
+		int expected_level_width;
+		int expected_level_height;
+
+		if( !(page = vips_multires_open( multires, i )) ) {
+			vips_error_clear();
+			return;
+		}
+		level_width = page->Xsize;
+		level_height = page->Ysize;
+		VIPS_UNREF( page );
+
+		expected_level_width = image->Xsize / (1 << i);
+		expected_level_height = image->Ysize / (1 << i);
+
+		/* This won't be exact due to rounding etc.
+		 */
+		if( abs( level_width - expected_level_width ) > 5 ||
+			level_width < 2 )
+			return;
+		if( abs( level_height - expected_level_height ) > 5 ||
+			level_height < 2 )
+			return;
+
+		multires->level_width[i] = level_width;
+		multires->level_height[i] = level_height;
+	}
+
+	/* Now set level_count. This signals that we've found a pyramid.
+	 */
+#ifdef DEBUG
+	printf( "vips_multires_get_tiff_pyramid: %d layer pyramid detected\n",
+	     n_pages );
+#endif /*DEBUG*/
+	multires->level_count = n_pages;
+}
+
+/* Find the smallest level which is at least as large as the target on both
+ * axes, so we only ever reduce from the level we pick.
+ */
+static int
+vips_multires_find_pyrlevel( VipsMultires *multires,
+	int target_width, int target_height )
+{
+	int level;
+
+	g_assert( multires->level_count > 0 );
+	g_assert( multires->level_count <= MAX_LEVELS );
+
+	for( level = multires->level_count - 1; level > 0; level-- )
+		if( multires->level_width[level] >= target_width &&
+			multires->level_height[level] >= target_height )
+			return( level );
+
+	return( 0 );
+}
+
+static int
+vips_multires_build( VipsObject *object )
+{
+	VipsMultires *multires = (VipsMultires *) object;
+	VipsImage **t = (VipsImage **) vips_object_local_array( object, 3 );
+
+	VipsImage *in;
+	int target_width;
+	int target_height;
+	int level;
+
+	if( VIPS_OBJECT_CLASS( vips_multires_parent_class )->build( object ) )
+		return( -1 );
+
+	if( !vips_object_argument_isset( object, "vscale" ) )
+		multires->vscale = multires->scale;
+
+	if( !(multires->loader = vips_foreign_find_load( multires->filename )) ||
+		!(t[0] = vips_multires_open( multires, 0 )) )
+		return( -1 );
+	g_info( "selected loader is %s", multires->loader );
+
+	multires->level_count = 1;
+	multires->level_width[0] = t[0]->Xsize;
+	multires->level_height[0] = t[0]->Ysize;
+	if( vips_isprefix( "VipsForeignLoadOpenslide", multires->loader ) )
+		vips_multires_get_openslide_pyramid( multires, t[0] );
+	else if( vips_isprefix( "VipsForeignLoadTiff", multires->loader ) )
+		vips_multires_get_tiff_pyramid( multires, t[0] );
+	g_info( "%d level pyramid", multires->level_count );
+
+	/* Size the output from level 0, so the output size for a scale does
+	 * not depend on the level we pick. Round as vips_resize() does.
+	 */
+	target_width = 
+		VIPS_MAX( 1, VIPS_ROUND_UINT( t[0]->Xsize * multires->scale ) );
+	target_height = 
+		VIPS_MAX( 1, VIPS_ROUND_UINT( t[0]->Ysize * multires->vscale ) );
+
+	level = vips_multires_find_pyrlevel( multires,
+		target_width, target_height );
+	g_info( "serving %d x %d from level %d",
+		target_width, target_height, level );
+
+	in = t[0];
+	if( level > 0 ) {
+		if( !(t[1] = vips_multires_open( multires, level )) )
+			return( -1 );
+		in = t[1];
+	}
+
+	/* The residual is usually less than 2 for a /2 pyramid, so this will
+	 * be a single vips_reduce().
+	 */
+	if( vips_resize( in, &t[2], (double) target_width / in->Xsize,
+		"vscale", (double) target_height / in->Ysize,
+		"kernel", multires->kernel,
+		NULL ) )
+		return( -1 );
+	in = t[2];
+
+	g_object_set( object,
+		"out", vips_image_new(),
+		"level", level,
+		NULL );
+
+	if( vips_image_write( in, multires->out ) )
+		return( -1 );
+
+	return( 0 );
+}
+
+static void
+vips_multires_class_init( VipsMultiresClass *class )
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS( class );
+	VipsObjectClass *vobject_class = VIPS_OBJECT_CLASS( class );
+
+	gobject_class->set_property = vips_object_set_property;
+	gobject_class->get_property = vips_object_get_property;
+
+	vobject_class->nickname = "multires";
+	vobject_class->description = _( "load a pyramidal image at any scale" );
+	vobject_class->build = vips_multires_build;
+
+	VIPS_ARG_STRING( class, "filename", 1,
+		_( "Filename" ),
+		_( "Filename to read from" ),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET( VipsMultires, filename ),
+		NULL );
+
+	VIPS_ARG_IMAGE( class, "out", 2,
+		_( "Output" ),
+		_( "Output image" ),
+		VIPS_ARGUMENT_REQUIRED_OUTPUT,
+		G_STRUCT_OFFSET( VipsMultires, out ) );
+
+	VIPS_ARG_DOUBLE( class, "scale", 3,
+		_( "Scale factor" ),
+		_( "Scale image by this factor" ),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET( VipsMultires, scale ),
+		0, 10000000, 0 );
+
+	VIPS_ARG_DOUBLE( class, "vscale", 113,
+		_( "Vertical scale factor" ),
+		_( "Vertical scale image by this factor" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsMultires, vscale ),
+		0, 10000000, 0 );
+
+	VIPS_ARG_ENUM( class, "kernel", 114,
+		_( "Kernel" ),
+		_( "Resampling kernel" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsMultires, kernel ),
+		VIPS_TYPE_KERNEL, VIPS_KERNEL_LANCZOS3 );
+
+	VIPS_ARG_INT( class, "level", 115,
+		_( "Level" ),
+		_( "Pyramid level the output was made from" ),
+		VIPS_ARGUMENT_OPTIONAL_OUTPUT,
+		G_STRUCT_OFFSET( VipsMultires, level ),
+		0, MAX_LEVELS, 0 );
+
+}
+
+static void
+vips_multires_init( VipsMultires *multires )
+{
+	multires->kernel = VIPS_KERNEL_LANCZOS3;
+}
+
+/**
+ * vips_multires:
+ * @filename: file to read from
+ * @out: (out): output image
+ * @scale: scale factor
+ * @...: %NULL-terminated list of optional named arguments
+ *
+ * Optional arguments:
+ *
+ * * @vscale: %gdouble vertical scale factor
+ * * @kernel: #VipsKernel to reduce with
+ * * @level: (out): %gint pyramid level the output was made from
+ *
+ * Load @filename scaled by @scale, using the pyramid in the file, if there
+ * is one. The output is the same size as vips_resize() would make from the
+ * full-resolution image.
+ *
+ * Pyramidal TIFF and openslide images are detected in the same way as
+ * vips_thumbnail() detects them. The operation picks the smallest level
+ * which is no smaller than the target on either axis, then uses
+ * vips_resize() with @kernel to get from that level to the target. For a
+ * TIFF pyramid, where levels are /2 apart, this is a single vips_reduce() by
+ * less than two. Other images are resized from the full-resolution image.
+ * @level is set to the level the output was made from, with 0 being full
+ * resolution.
+ *
+ * Unlike vips_thumbnail(), levels are opened in random-access mode and
+ * the operation is cached, so it is suitable for tile servers. Requests
+ * which land on the same level share the loader and its cache of decoded
+ * tiles, and coarser levels are only opened when a request needs them.
+ * Crop the output with vips_crop() to fetch a tile.
+ *
+ * This operation does no colour management.
+ *
+ * See also: vips_thumbnail(), vips_resize(), vips_crop().
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int
+vips_multires( const char *filename, VipsImage **out, double scale, ... )
+{
+	va_list ap;
+	int result;
+
+	va_start( ap, scale );
+	result = vips_call_split( "multires", ap, filename, out, scale );
+	va_end( ap );
+
+	return( result );
+}
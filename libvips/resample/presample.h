@@ -73,6 +73,87 @@ int vips_reduce_get_points( VipsKernel kernel, double shrink );
 void vips_reduce_make_mask( double *c, 
 	VipsKernel kernel, double shrink, double x );
 
+/* Some resamplers have hand-written vector paths. On x86 we need gcc or clang,
+ * since we compile each path with a target attribute and pick one at runtime.
+ * NEON is always there on aarch64.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VIPS_RESAMPLE_X86
+#elif defined(__aarch64__)
+#define VIPS_RESAMPLE_NEON
+#endif
+
+typedef enum {
+	VIPS_RESAMPLE_SIMD_NONE = 0,
+	VIPS_RESAMPLE_SIMD_SSE41 = 1,
+	VIPS_RESAMPLE_SIMD_AVX2 = 2,
+	VIPS_RESAMPLE_SIMD_NEON = 4
+} VipsResampleSimd;
+
+int vips__resample_simd( void );
+
+/* A set of reduce masks for a kernel and shrink factor, shared between all
+ * reducers. Masks are read-only.
+ */
+typedef struct _VipsReduceMask {
+	/*< private >*/
+	int ref_count;
+	char *key;
+	size_t size;
+
+	/*< public >*/
+	int n_point;
+
+	/* Double masks, int masks made by truncation (as reduceh uses), 
+	 * int masks made with vips_vector_to_fixed_point() (as reducev uses),
+	 * and 2.6 masks for orc.
+	 */
+	double *matrixf[VIPS_TRANSFORM_SCALE + 1];
+	int *matrixi[VIPS_TRANSFORM_SCALE + 1];
+	int *matrixs[VIPS_TRANSFORM_SCALE + 1];
+	int *matrixo[VIPS_TRANSFORM_SCALE + 1];
+} VipsReduceMask;
+
+VipsReduceMask *vips__reduce_mask_get( VipsKernel kernel, double shrink );
+void vips__reduce_mask_unref( VipsReduceMask *mask );
+
+void vips__shrinkh_line( VipsPel *out, VipsPel *in, int width, 
+	int hshrink, VipsBandFormat format, int bands );
+void vips__shrinkv_add_line( VipsPel *psum, VipsPel *in, int sz, 
+	VipsBandFormat format );
+void vips__shrinkv_write_line( VipsPel *out, VipsPel *psum, int sz, 
+	int vshrink, VipsBandFormat format );
+
+/* Interpolate a run of @n pixels to @out, starting at (@x, @y) and stepping
+ * by (@dx, @dy) for each pixel. Every stencil must be inside @in.
+ */
+typedef void (*VipsInterpolateLineFn)( VipsInterpolate *interpolate,
+	VipsPel *out, VipsRegion *in, int n, 
+	double x, double y, double dx, double dy );
+
+VipsInterpolateLineFn vips__interpolate_get_line( 
+	VipsInterpolate *interpolate );
+VipsInterpolateLineFn vips__interpolate_bicubic_get_line( 
+	VipsInterpolate *interpolate );
+VipsInterpolateLineFn vips__interpolate_lbb_get_line( 
+	VipsInterpolate *interpolate );
+VipsInterpolateLineFn vips__interpolate_nohalo_get_line( 
+	VipsInterpolate *interpolate );
+
+/* Make one pixel of a horizontal reduce with a vector path, using the masks
+ * made by vips__reduceh_vector_mask(). The vector paths can read up to 
+ * REDUCEH_VECTOR_PAD pixels past the end of the mask.
+ */
+typedef void (*VipsReducehVectorFn)( VipsPel *pout, const VipsPel *pin, 
+	const int n_point, const int *ci, const double *cf );
+
+#define REDUCEH_VECTOR_PAD (8)
+
+VipsReducehVectorFn vips__reduceh_vector_pick( VipsImage *in );
+int vips__reduceh_vector_mask( VipsObject *object, VipsImage *in, int n_point,
+	int **matrixi, double **matrixf, 
+	int **matrixi_bands, double **matrixf_bands );
+
 #ifdef __cplusplus
 }
 #endif /*__cplusplus*/
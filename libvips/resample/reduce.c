@@ -1,4 +1,4 @@
-/* 2D reduce ... call reduceh and reducev
+/* docs for reduce, reduceh and reducev
  *
  * 27/1/16
  * 	- from shrink.c 
@@ -6,6 +6,8 @@
  * 	- rename xshrink -> hshrink for greater consistency 
  * 9/9/16
  * 	- add @centre option
+ * 19/10/19
+ * 	- vips_reduce() is now in reducehv.cpp, just the docs here
  */
 
 /*
@@ -126,121 +128,6 @@
  * Returns: 0 on success, -1 on error
  */
 
-typedef struct _VipsReduce {
-	VipsResample parent_instance;
-
-	double hshrink;		/* Shrink factors */
-	double vshrink;
-
-	/* The thing we use to make the kernel.
-	 */
-	VipsKernel kernel;
-
-	/* Use centre rather than corner sampling convention.
-	 */
-	gboolean centre;
-
-} VipsReduce;
-
-typedef VipsResampleClass VipsReduceClass;
-
-G_DEFINE_TYPE( VipsReduce, vips_reduce, VIPS_TYPE_RESAMPLE );
-
-static int
-vips_reduce_build( VipsObject *object )
-{
-	VipsResample *resample = VIPS_RESAMPLE( object );
-	VipsReduce *reduce = (VipsReduce *) object;
-	VipsImage **t = (VipsImage **) 
-		vips_object_local_array( object, 3 );
-
-	if( VIPS_OBJECT_CLASS( vips_reduce_parent_class )->build( object ) )
-		return( -1 );
-
-	if( vips_reducev( resample->in, &t[0], reduce->vshrink, 
-		"kernel", reduce->kernel, 
-		"centre", reduce->centre, 
-		NULL ) ||
-		vips_reduceh( t[0], &t[1], reduce->hshrink, 
-			"kernel", reduce->kernel, 
-			"centre", reduce->centre, 
-			NULL ) ||
-		vips_image_write( t[1], resample->out ) )
-		return( -1 );
-
-	return( 0 );
-}
-
-static void
-vips_reduce_class_init( VipsReduceClass *class )
-{
-	GObjectClass *gobject_class = G_OBJECT_CLASS( class );
-	VipsObjectClass *vobject_class = VIPS_OBJECT_CLASS( class );
-	VipsOperationClass *operation_class = VIPS_OPERATION_CLASS( class );
-
-	VIPS_DEBUG_MSG( "vips_reduce_class_init\n" );
-
-	gobject_class->set_property = vips_object_set_property;
-	gobject_class->get_property = vips_object_get_property;
-
-	vobject_class->nickname = "reduce";
-	vobject_class->description = _( "reduce an image" );
-	vobject_class->build = vips_reduce_build;
-
-	operation_class->flags = VIPS_OPERATION_SEQUENTIAL;
-
-	VIPS_ARG_DOUBLE( class, "hshrink", 8, 
-		_( "Hshrink" ), 
-		_( "Horizontal shrink factor" ),
-		VIPS_ARGUMENT_REQUIRED_INPUT,
-		G_STRUCT_OFFSET( VipsReduce, hshrink ),
-		1.0, 1000000.0, 1.0 );
-
-	VIPS_ARG_DOUBLE( class, "vshrink", 9, 
-		_( "Vshrink" ), 
-		_( "Vertical shrink factor" ),
-		VIPS_ARGUMENT_REQUIRED_INPUT,
-		G_STRUCT_OFFSET( VipsReduce, vshrink ),
-		1.0, 1000000.0, 1.0 );
-
-	VIPS_ARG_ENUM( class, "kernel", 3, 
-		_( "Kernel" ), 
-		_( "Resampling kernel" ),
-		VIPS_ARGUMENT_OPTIONAL_INPUT,
-		G_STRUCT_OFFSET( VipsReduce, kernel ),
-		VIPS_TYPE_KERNEL, VIPS_KERNEL_LANCZOS3 );
-
-	VIPS_ARG_BOOL( class, "centre", 7, 
-		_( "Centre" ), 
-		_( "Use centre sampling convention" ),
-		VIPS_ARGUMENT_OPTIONAL_INPUT,
-		G_STRUCT_OFFSET( VipsReduce, centre ),
-		FALSE );
-
-	/* The old names .. now use h and v everywhere. 
-	 */
-	VIPS_ARG_DOUBLE( class, "xshrink", 8, 
-		_( "Xshrink" ), 
-		_( "Horizontal shrink factor" ),
-		VIPS_ARGUMENT_REQUIRED_INPUT | VIPS_ARGUMENT_DEPRECATED,
-		G_STRUCT_OFFSET( VipsReduce, hshrink ),
-		1.0, 1000000.0, 1.0 );
-
-	VIPS_ARG_DOUBLE( class, "yshrink", 9, 
-		_( "Yshrink" ), 
-		_( "Vertical shrink factor" ),
-		VIPS_ARGUMENT_REQUIRED_INPUT | VIPS_ARGUMENT_DEPRECATED,
-		G_STRUCT_OFFSET( VipsReduce, vshrink ),
-		1.0, 1000000.0, 1.0 );
-
-}
-
-static void
-vips_reduce_init( VipsReduce *reduce )
-{
-	reduce->kernel = VIPS_KERNEL_LANCZOS3;
-}
-
 /**
  * vips_reduce: (method)
  * @in: input image
@@ -253,13 +140,26 @@ vips_reduce_init( VipsReduce *reduce )
  *
  * * @kernel: #VipsKernel to use to interpolate (default: lanczos3)
  * * @centre: %gboolean use centre rather than corner sampling convention
+ * * @linear: %gboolean reduce in linear light
+ * * @premultiply: %gboolean premultiply by alpha during reduce
  *
  * Reduce @in by a pair of factors with a pair of 1D kernels. This 
  * will not work well for shrink factors greater than three.
  *
+ * This is faster than vips_reduceh() followed by vips_reducev(), since each
+ * input line is only reduced horizontally once and there is no intermediate
+ * image, but it gives the same result, to within rounding.
+ *
  * Set @centre to use centre rather than corner sampling convention. Centre
  * convention can be useful to match the behaviour of other systems. 
  *
+ * Set @linear to treat @in as sRGB and reduce in linear light. Set
+ * @premultiply to premultiply by the alpha channel, if there is one, 
+ * before reducing, and unpremultiply afterwards. Both need a uchar image.
+ * Pixels are converted to float as they are read and back to uchar as they
+ * are written, so this is much quicker than vips_colourspace(),
+ * vips_premultiply() and friends around vips_reduce(). 
+ *
  * This is a very low-level operation: see vips_resize() for a more
  * convenient way to resize images. 
  *
@@ -270,16 +170,33 @@ vips_reduce_init( VipsReduce *reduce )
  *
  * Returns: 0 on success, -1 on error
  */
-int
-vips_reduce( VipsImage *in, VipsImage **out, 
-	double hshrink, double vshrink, ... )
-{
-	va_list ap;
-	int result;
-
-	va_start( ap, vshrink );
-	result = vips_call_split( "reduce", ap, in, out, hshrink, vshrink );
-	va_end( ap );
 
-	return( result );
-}
+/**
+ * vips_enlarge: (method)
+ * @in: input image
+ * @out: (out): output image
+ * @hscale: horizontal scale factor
+ * @vscale: vertical scale factor
+ * @...: %NULL-terminated list of optional named arguments
+ *
+ * Optional arguments:
+ *
+ * * @kernel: #VipsKernel to use to interpolate (default: lanczos3)
+ *
+ * Enlarge @in by a pair of factors with a pair of 1D kernels. This is the
+ * counterpart of vips_reduce(): the kernel does not grow with the scale 
+ * factor, so each output pixel is made from a fixed number of input pixels 
+ * with a precomputed table of weights. 
+ *
+ * It always uses the centre sampling convention. 
+ *
+ * This is a very low-level operation: see vips_resize() for a more
+ * convenient way to resize images. 
+ *
+ * This operation does not change xres or yres. The image resolution needs to
+ * be updated by the application. 
+ *
+ * See also: vips_resize(), vips_reduce(), vips_affine().
+ *
+ * Returns: 0 on success, -1 on error
+ */
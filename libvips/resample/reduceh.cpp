@@ -8,6 +8,10 @@
  * 	- rename xshrink as hshrink for consistency
  * 9/9/16
  * 	- add @centre option
+ * 19/10/19
+ * 	- add SSE4.1, AVX2 and NEON paths for 1 - 4 band uchar, ushort and
+ * 	  float
+ * 	- share masks between reducers with vips__reduce_mask_get()
  */
 
 /*
@@ -48,6 +52,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include <vips/vips.h>
@@ -57,6 +62,14 @@
 #include "presample.h"
 #include "templates.h"
 
+#ifdef VIPS_RESAMPLE_X86
+#include <immintrin.h>
+#endif /*VIPS_RESAMPLE_X86*/
+
+#ifdef VIPS_RESAMPLE_NEON
+#include <arm_neon.h>
+#endif /*VIPS_RESAMPLE_NEON*/
+
 typedef struct _VipsReduceh {
 	VipsResample parent_instance;
 
@@ -74,13 +87,25 @@ typedef struct _VipsReduceh {
 	 */
 	int n_point;
 
+	/* The shared masks we use.
+	 */
+	VipsReduceMask *mask;
+
 	/* Precalculated interpolation matrices. int (used for pel
 	 * sizes up to short), and double (for all others). We go to
-	 * scale + 1 so we can round-to-nearest safely.
+	 * scale + 1 so we can round-to-nearest safely. These point into 
+	 * mask.
 	 */
 	int *matrixi[VIPS_TRANSFORM_SCALE + 1];
 	double *matrixf[VIPS_TRANSFORM_SCALE + 1];
 
+	/* The vector path we use, if any, and copies of the matrices made 
+	 * by vips__reduceh_vector_mask().
+	 */
+	VipsReducehVectorFn vector;
+	int *matrixi_bands[VIPS_TRANSFORM_SCALE + 1];
+	double *matrixf_bands[VIPS_TRANSFORM_SCALE + 1];
+
 } VipsReduceh;
 
 typedef VipsResampleClass VipsReducehClass;
@@ -91,6 +116,16 @@ extern "C" {
 G_DEFINE_TYPE( VipsReduceh, vips_reduceh, VIPS_TYPE_RESAMPLE );
 }
 
+static void
+vips_reduceh_finalize( GObject *gobject )
+{
+	VipsReduceh *reduceh = (VipsReduceh *) gobject; 
+
+	VIPS_FREEF( vips__reduce_mask_unref, reduceh->mask );
+
+	G_OBJECT_CLASS( vips_reduceh_parent_class )->finalize( gobject );
+}
+
 /* Get n points. @shrink is the shrink factor, so 2 for a 50% reduction. 
  */
 int
@@ -289,9 +324,506 @@ reduceh_notab( VipsReduceh *reduceh,
 	}
 }
 
-/* Tried a vector path (see reducev) but it was slower. The vectors for
+/* Tried an orc path (see reducev) but it was slower. The vectors for
  * horizontal reduce are just too small to get a useful speedup.
+ *
+ * Instead we have hand-written paths for 1 - 4 band uchar, ushort and float.
+ * We treat the n_point * bands input values for a pixel as a single vector 
+ * and take the dot product with a copy of the mask where each coefficient is 
+ * repeated once per band, so each lane always sums the same band. 
+ *
+ * For the integer paths, the mask copy is padded with zeros to a whole 
+ * number of vectors, and 3 band pixels are spread out to 4 lanes. We can 
+ * read up to REDUCEH_VECTOR_PAD pixels past the end of the mask, so the 
+ * input is made a little wider. The integer arithmetic is exact, so the 
+ * result is the same as the scalar path.
+ *
+ * The float paths sum in double, as the scalar path does, and don't read 
+ * past the end of the mask, since 0 * inf is not zero. 3 band float is left
+ * to the scalar path, since the lanes don't line up with pixels.
+ */
+
+/* Group the lanes of the float paths into steps of a whole number of 
+ * pixels.
+ */
+template <int lanes, int bands>
+struct ReducehStep {
+	enum { 
+		k = bands > lanes ? bands / lanes : 1,
+		step = lanes * k
+	};
+};
+
+/* Add the lanes of a step up into bands.
+ */
+template <int step, int bands>
+static inline void
+reduceh_lanes_double( const double *lanes, double *sum )
+{
+	for( int z = 0; z < bands; z++ )
+		sum[z] = 0.0;
+	for( int j = 0; j < step; j++ )
+		sum[j % bands] += lanes[j];
+}
+
+template <typename T, int max_value, int bands>
+static inline void
+reduceh_unsigned_int_out( VipsPel *pout, const int *sum )
+{
+	T* restrict out = (T *) pout;
+
+	for( int z = 0; z < bands; z++ ) {
+		int v;
+
+		v = unsigned_fixed_round( sum[z] ); 
+		v = VIPS_CLIP( 0, v, max_value ); 
+
+		out[z] = v;
+	}
+}
+
+#ifdef VIPS_RESAMPLE_X86
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+static inline TARGET_SSE41 __m128i
+reduceh_load4_sse41( const unsigned char *p )
+{
+	int v;
+
+	memcpy( &v, p, 4 );
+
+	return( _mm_cvtepu8_epi32( _mm_cvtsi32_si128( v ) ) );
+}
+
+static inline TARGET_SSE41 __m128i
+reduceh_load4_sse41( const unsigned short *p )
+{
+	return( _mm_cvtepu16_epi32( 
+		_mm_loadl_epi64( (const __m128i *) p ) ) );
+}
+
+/* Sum the lanes of @s into bands. Lane i is always band (i % bands), or for 
+ * 3 bands, lane 3 is zero.
+ */
+template <int bands>
+static inline TARGET_SSE41 void
+reduceh_lanes_sse41( __m128i s, int *sum )
+{
+	if( bands == 1 ) {
+		s = _mm_add_epi32( s, 
+			_mm_shuffle_epi32( s, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+		s = _mm_add_epi32( s, 
+			_mm_shuffle_epi32( s, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+	}
+	else if( bands == 2 ) 
+		s = _mm_add_epi32( s, 
+			_mm_shuffle_epi32( s, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+
+	_mm_storeu_si128( (__m128i *) sum, s );
+}
+
+template <typename T, int max_value, int bands>
+static TARGET_SSE41 void
+reduceh_unsigned_int_sse41( VipsPel *pout, const VipsPel *pin, 
+	const int n_point, const int *ci, const double *cf )
+{
+	const T* restrict in = (T *) pin;
+	const int* restrict c = ci;
+	const int n = n_point;
+
+	__m128i acc;
+	int sum[4];
+
+	acc = _mm_setzero_si128();
+	if( bands == 3 )
+		for( int i = 0; i < n; i++ ) 
+			acc = _mm_add_epi32( acc, _mm_mullo_epi32( 
+				reduceh_load4_sse41( in + 3 * i ),
+				_mm_loadu_si128( (__m128i *) (c + 4 * i) ) ) );
+	else
+		for( int i = 0; i < n * bands; i += 4 ) 
+			acc = _mm_add_epi32( acc, _mm_mullo_epi32( 
+				reduceh_load4_sse41( in + i ),
+				_mm_loadu_si128( (__m128i *) (c + i) ) ) );
+
+	reduceh_lanes_sse41<bands>( acc, sum );
+	reduceh_unsigned_int_out<T, max_value, bands>( pout, sum );
+}
+
+template <int bands>
+static TARGET_SSE41 void
+reduceh_float_sse41( VipsPel *pout, const VipsPel *pin, 
+	const int n_point, const int *ci, const double *cf )
+{
+	typedef ReducehStep<2, bands> S;
+
+	float* restrict out = (float *) pout;
+	const float* restrict in = (float *) pin;
+	const double* restrict c = cf;
+	const int n = n_point * bands;
+
+	__m128d acc[S::k];
+	double lanes[S::step];
+	double sum[bands];
+	int i;
+
+	for( int j = 0; j < S::k; j++ )
+		acc[j] = _mm_setzero_pd();
+
+	for( i = 0; i + S::step <= n; i += S::step ) 
+		for( int j = 0; j < S::k; j++ ) {
+			__m128d v = _mm_cvtps_pd( _mm_castsi128_ps( 
+				_mm_loadl_epi64( (__m128i *) 
+					(in + i + 2 * j) ) ) );
+
+			acc[j] = _mm_add_pd( acc[j], 
+				_mm_mul_pd( v, _mm_loadu_pd( c + i + 2 * j ) ) );
+		}
+
+	for( int j = 0; j < S::k; j++ )
+		_mm_storeu_pd( lanes + 2 * j, acc[j] );
+	reduceh_lanes_double<S::step, bands>( lanes, sum );
+
+	for( ; i < n; i++ )
+		sum[i % bands] += c[i] * in[i];
+
+	for( int z = 0; z < bands; z++ )
+		out[z] = sum[z];
+}
+
+static inline TARGET_AVX2 __m256i
+reduceh_load8_avx2( const unsigned char *p )
+{
+	return( _mm256_cvtepu8_epi32( 
+		_mm_loadl_epi64( (__m128i *) p ) ) );
+}
+
+static inline TARGET_AVX2 __m256i
+reduceh_load8_avx2( const unsigned short *p )
+{
+	return( _mm256_cvtepu16_epi32( 
+		_mm_loadu_si128( (__m128i *) p ) ) );
+}
+
+/* Two 3 band pixels, spread out to 4 lanes each.
+ */
+static inline TARGET_AVX2 __m256i
+reduceh_load3x2_avx2( const unsigned char *p )
+{
+	const __m128i spread = _mm_setr_epi8( 
+		0, 1, 2, 3, 3, 4, 5, 6, 
+		-1, -1, -1, -1, -1, -1, -1, -1 );
+
+	return( _mm256_cvtepu8_epi32( _mm_shuffle_epi8( 
+		_mm_loadl_epi64( (__m128i *) p ), spread ) ) );
+}
+
+static inline TARGET_AVX2 __m256i
+reduceh_load3x2_avx2( const unsigned short *p )
+{
+	const __m128i spread = _mm_setr_epi8( 
+		0, 1, 2, 3, 4, 5, 6, 7, 
+		6, 7, 8, 9, 10, 11, 12, 13 );
+
+	return( _mm256_cvtepu16_epi32( _mm_shuffle_epi8( 
+		_mm_loadu_si128( (__m128i *) p ), spread ) ) );
+}
+
+template <typename T, int max_value, int bands>
+static TARGET_AVX2 void
+reduceh_unsigned_int_avx2( VipsPel *pout, const VipsPel *pin, 
+	const int n_point, const int *ci, const double *cf )
+{
+	const T* restrict in = (T *) pin;
+	const int* restrict c = ci;
+	const int n = n_point;
+
+	__m256i acc;
+	int sum[4];
+
+	acc = _mm256_setzero_si256();
+	if( bands == 3 )
+		for( int i = 0; i < n; i += 2 ) 
+			acc = _mm256_add_epi32( acc, _mm256_mullo_epi32( 
+				reduceh_load3x2_avx2( in + 3 * i ),
+				_mm256_loadu_si256( (__m256i *) 
+					(c + 4 * i) ) ) );
+	else
+		for( int i = 0; i < n * bands; i += 8 ) 
+			acc = _mm256_add_epi32( acc, _mm256_mullo_epi32( 
+				reduceh_load8_avx2( in + i ),
+				_mm256_loadu_si256( (__m256i *) (c + i) ) ) );
+
+	/* Each half has the same band layout.
+	 */
+	reduceh_lanes_sse41<bands>( _mm_add_epi32( 
+		_mm256_castsi256_si128( acc ), 
+		_mm256_extracti128_si256( acc, 1 ) ), sum );
+	reduceh_unsigned_int_out<T, max_value, bands>( pout, sum );
+}
+
+template <int bands>
+static TARGET_AVX2 void
+reduceh_float_avx2( VipsPel *pout, const VipsPel *pin, 
+	const int n_point, const int *ci, const double *cf )
+{
+	typedef ReducehStep<4, bands> S;
+
+	float* restrict out = (float *) pout;
+	const float* restrict in = (float *) pin;
+	const double* restrict c = cf;
+	const int n = n_point * bands;
+
+	__m256d acc[S::k];
+	double lanes[S::step];
+	double sum[bands];
+	int i;
+
+	for( int j = 0; j < S::k; j++ )
+		acc[j] = _mm256_setzero_pd();
+
+	/* Multiply then add, not FMA, so we round in the same places as the 
+	 * scalar path.
+	 */
+	for( i = 0; i + S::step <= n; i += S::step ) 
+		for( int j = 0; j < S::k; j++ ) {
+			__m256d v = _mm256_cvtps_pd( 
+				_mm_loadu_ps( in + i + 4 * j ) );
+
+			acc[j] = _mm256_add_pd( acc[j], 
+				_mm256_mul_pd( v, 
+					_mm256_loadu_pd( c + i + 4 * j ) ) );
+		}
+
+	for( int j = 0; j < S::k; j++ )
+		_mm256_storeu_pd( lanes + 4 * j, acc[j] );
+	reduceh_lanes_double<S::step, bands>( lanes, sum );
+
+	for( ; i < n; i++ )
+		sum[i % bands] += c[i] * in[i];
+
+	for( int z = 0; z < bands; z++ )
+		out[z] = sum[z];
+}
+#endif /*VIPS_RESAMPLE_X86*/
+
+#ifdef VIPS_RESAMPLE_NEON
+static inline int32x4_t
+reduceh_load4_neon( const unsigned char *p )
+{
+	guint32 v;
+
+	memcpy( &v, p, 4 );
+
+	return( vreinterpretq_s32_u32( vmovl_u16( 
+		vget_low_u16( vmovl_u8( vcreate_u8( v ) ) ) ) ) );
+}
+
+static inline int32x4_t
+reduceh_load4_neon( const unsigned short *p )
+{
+	return( vreinterpretq_s32_u32( vmovl_u16( vld1_u16( p ) ) ) );
+}
+
+template <typename T, int max_value, int bands>
+static void
+reduceh_unsigned_int_neon( VipsPel *pout, const VipsPel *pin, 
+	const int n_point, const int *ci, const double *cf )
+{
+	const T* restrict in = (T *) pin;
+	const int* restrict c = ci;
+	const int n = n_point;
+
+	int32x4_t acc;
+	int sum[4];
+
+	acc = vdupq_n_s32( 0 );
+	if( bands == 3 )
+		for( int i = 0; i < n; i++ ) 
+			acc = vmlaq_s32( acc, 
+				reduceh_load4_neon( in + 3 * i ),
+				vld1q_s32( c + 4 * i ) );
+	else
+		for( int i = 0; i < n * bands; i += 4 ) 
+			acc = vmlaq_s32( acc, 
+				reduceh_load4_neon( in + i ),
+				vld1q_s32( c + i ) );
+
+	if( bands == 1 ) 
+		acc = vdupq_n_s32( vaddvq_s32( acc ) );
+	else if( bands == 2 ) 
+		acc = vaddq_s32( acc, vextq_s32( acc, acc, 2 ) );
+	vst1q_s32( sum, acc );
+
+	reduceh_unsigned_int_out<T, max_value, bands>( pout, sum );
+}
+
+template <int bands>
+static void
+reduceh_float_neon( VipsPel *pout, const VipsPel *pin, 
+	const int n_point, const int *ci, const double *cf )
+{
+	typedef ReducehStep<2, bands> S;
+
+	float* restrict out = (float *) pout;
+	const float* restrict in = (float *) pin;
+	const double* restrict c = cf;
+	const int n = n_point * bands;
+
+	float64x2_t acc[S::k];
+	double lanes[S::step];
+	double sum[bands];
+	int i;
+
+	for( int j = 0; j < S::k; j++ )
+		acc[j] = vdupq_n_f64( 0.0 );
+
+	/* vmulq then vaddq, not vfmaq, so we round in the same places as the 
+	 * scalar path.
+	 */
+	for( i = 0; i + S::step <= n; i += S::step ) 
+		for( int j = 0; j < S::k; j++ ) 
+			acc[j] = vaddq_f64( acc[j], vmulq_f64( 
+				vcvt_f64_f32( vld1_f32( in + i + 2 * j ) ),
+				vld1q_f64( c + i + 2 * j ) ) );
+
+	for( int j = 0; j < S::k; j++ )
+		vst1q_f64( lanes + 2 * j, acc[j] );
+	reduceh_lanes_double<S::step, bands>( lanes, sum );
+
+	for( ; i < n; i++ )
+		sum[i % bands] += c[i] * in[i];
+
+	for( int z = 0; z < bands; z++ )
+		out[z] = sum[z];
+}
+#endif /*VIPS_RESAMPLE_NEON*/
+
+/* Tables of vector paths, indexed by format and bands.
  */
+#define UINT_TABLE( ISA, TYPE, MAX ) { \
+	NULL, \
+	reduceh_unsigned_int_##ISA<TYPE, MAX, 1>, \
+	reduceh_unsigned_int_##ISA<TYPE, MAX, 2>, \
+	reduceh_unsigned_int_##ISA<TYPE, MAX, 3>, \
+	reduceh_unsigned_int_##ISA<TYPE, MAX, 4> \
+}
+
+#define FLOAT_TABLE( ISA ) { \
+	NULL, \
+	reduceh_float_##ISA<1>, \
+	reduceh_float_##ISA<2>, \
+	NULL, \
+	reduceh_float_##ISA<4> \
+}
+
+#define VECTOR_TABLE( ISA ) { \
+	UINT_TABLE( ISA, unsigned char, UCHAR_MAX ), \
+	UINT_TABLE( ISA, unsigned short, USHRT_MAX ), \
+	FLOAT_TABLE( ISA ) \
+}
+
+#ifdef VIPS_RESAMPLE_X86
+static const VipsReducehVectorFn reduceh_avx2[3][5] = VECTOR_TABLE( avx2 );
+static const VipsReducehVectorFn reduceh_sse41[3][5] = VECTOR_TABLE( sse41 );
+#endif /*VIPS_RESAMPLE_X86*/
+
+#ifdef VIPS_RESAMPLE_NEON
+static const VipsReducehVectorFn reduceh_neon[3][5] = VECTOR_TABLE( neon );
+#endif /*VIPS_RESAMPLE_NEON*/
+
+/* Pick a vector path for this image, or NULL for none.
+ */
+VipsReducehVectorFn
+vips__reduceh_vector_pick( VipsImage *in )
+{
+#if defined( VIPS_RESAMPLE_X86 ) || defined( VIPS_RESAMPLE_NEON )
+	int simd;
+	int format;
+
+	simd = vips__resample_simd();
+
+	switch( in->BandFmt ) {
+	case VIPS_FORMAT_UCHAR:
+		format = 0;
+		break;
+
+	case VIPS_FORMAT_USHORT:
+		format = 1;
+		break;
+
+	case VIPS_FORMAT_FLOAT:
+		format = 2;
+		break;
+
+	default:
+		return( NULL );
+	}
+
+	if( in->Bands > 4 )
+		return( NULL );
+
+#ifdef VIPS_RESAMPLE_X86
+	if( simd & VIPS_RESAMPLE_SIMD_AVX2 ) 
+		return( reduceh_avx2[format][in->Bands] );
+	if( simd & VIPS_RESAMPLE_SIMD_SSE41 ) 
+		return( reduceh_sse41[format][in->Bands] );
+#endif /*VIPS_RESAMPLE_X86*/
+
+#ifdef VIPS_RESAMPLE_NEON
+	if( simd & VIPS_RESAMPLE_SIMD_NEON ) 
+		return( reduceh_neon[format][in->Bands] );
+#endif /*VIPS_RESAMPLE_NEON*/
+#endif /*defined( VIPS_RESAMPLE_X86 ) || defined( VIPS_RESAMPLE_NEON )*/
+
+	return( NULL );
+}
+
+/* Make the copies of the masks the vector paths need. Each coefficient is
+ * repeated once per band. The int masks are zero padded to a whole number 
+ * of vectors, and 3 band masks are spread out to 4 lanes.
+ */
+int
+vips__reduceh_vector_mask( VipsObject *object, VipsImage *in, int n_point,
+	int **matrixi, double **matrixf, 
+	int **matrixi_bands, double **matrixf_bands )
+{
+	const int bands = in->Bands;
+
+	for( int x = 0; x < VIPS_TRANSFORM_SCALE + 1; x++ ) 
+		if( in->BandFmt == VIPS_FORMAT_FLOAT ) {
+			const int n = n_point * bands;
+
+			if( !(matrixf_bands[x] = 
+				VIPS_ARRAY( object, n, double )) )
+				return( -1 );
+
+			for( int i = 0; i < n; i++ )
+				matrixf_bands[x][i] = matrixf[x][i / bands];
+		}
+		else {
+			/* Enough for 8 lanes of 4 bands, zero padded.
+			 */
+			const int n = 4 * VIPS_ROUND_UP( n_point, 8 );
+
+			int *c;
+
+			if( !(c = VIPS_ARRAY( object, n, int )) )
+				return( -1 );
+			memset( c, 0, n * sizeof( int ) );
+			matrixi_bands[x] = c;
+
+			for( int i = 0; i < n_point; i++ )
+				for( int z = 0; z < bands; z++ ) 
+					if( bands == 3 )
+						c[i * 4 + z] = matrixi[x][i];
+					else
+						c[i * bands + z] = matrixi[x][i];
+		}
+
+	return( 0 );
+}
 
 static int
 vips_reduceh_gen( VipsRegion *out_region, void *seq, 
@@ -321,6 +853,8 @@ vips_reduceh_gen( VipsRegion *out_region, void *seq,
 	s.height = r->height;
 	if( reduceh->centre )
 		s.width += 1;
+	if( reduceh->vector )
+		s.width += REDUCEH_VECTOR_PAD;
 	if( vips_region_prepare( ir, &s ) )
 		return( -1 );
 
@@ -359,7 +893,11 @@ vips_reduceh_gen( VipsRegion *out_region, void *seq,
 			const int *cxi = reduceh->matrixi[tx];
 			const double *cxf = reduceh->matrixf[tx];
 
-			switch( in->BandFmt ) {
+			if( reduceh->vector )
+				reduceh->vector( q, p, reduceh->n_point, 
+					reduceh->matrixi_bands[tx],
+					reduceh->matrixf_bands[tx] );
+			else switch( in->BandFmt ) {
 			case VIPS_FORMAT_UCHAR:
 				reduceh_unsigned_int_tab
 					<unsigned char, UCHAR_MAX>(
@@ -467,22 +1005,12 @@ vips_reduceh_build( VipsObject *object )
 			"%s", _( "reduce factor too large" ) );
 		return( -1 );
 	}
+	if( !(reduceh->mask = vips__reduce_mask_get( 
+		reduceh->kernel, reduceh->hshrink )) )
+		return( -1 );
 	for( int x = 0; x < VIPS_TRANSFORM_SCALE + 1; x++ ) {
-		reduceh->matrixf[x] = 
-			VIPS_ARRAY( object, reduceh->n_point, double ); 
-		reduceh->matrixi[x] = 
-			VIPS_ARRAY( object, reduceh->n_point, int ); 
-		if( !reduceh->matrixf[x] ||
-			!reduceh->matrixi[x] )
-			return( -1 ); 
-
-		vips_reduce_make_mask( reduceh->matrixf[x], 
-			reduceh->kernel, reduceh->hshrink, 
-			(float) x / VIPS_TRANSFORM_SCALE );
-
-		for( int i = 0; i < reduceh->n_point; i++ )
-			reduceh->matrixi[x][i] = reduceh->matrixf[x][i] * 
-				VIPS_INTERPOLATE_SCALE;
+		reduceh->matrixf[x] = reduceh->mask->matrixf[x];
+		reduceh->matrixi[x] = reduceh->mask->matrixi[x];
 
 #ifdef DEBUG
 		printf( "vips_reduceh_build: mask %d\n    ", x ); 
@@ -498,13 +1026,24 @@ vips_reduceh_build( VipsObject *object )
 		return( -1 );
 	in = t[0];
 
+	/* Set up a vector path, if we can.
+	 */
+	if( (reduceh->vector = vips__reduceh_vector_pick( in )) &&
+		vips__reduceh_vector_mask( object, in, reduceh->n_point,
+			reduceh->matrixi, reduceh->matrixf,
+			reduceh->matrixi_bands, reduceh->matrixf_bands ) )
+		return( -1 );
+
 	/* Add new pixels around the input so we can interpolate at the edges.
 	 * In centre mode, we read 0.5 pixels more to the right, so we must
-	 * enlarge a little further.
+	 * enlarge a little further. The vector paths can read a little past
+	 * the end of the mask. 
 	 */
 	width = in->Xsize + reduceh->n_point - 1;
 	if( reduceh->centre )
 		width += 1;
+	if( reduceh->vector )
+		width += REDUCEH_VECTOR_PAD;
 	if( vips_embed( in, &t[1], 
 		reduceh->n_point / 2 - 1, 0, 
 		width, in->Ysize,
@@ -558,6 +1097,7 @@ vips_reduceh_class_init( VipsReducehClass *reduceh_class )
 
 	VIPS_DEBUG_MSG( "vips_reduceh_class_init\n" );
 
+	gobject_class->finalize = vips_reduceh_finalize;
 	gobject_class->set_property = vips_object_set_property;
 	gobject_class->get_property = vips_object_get_property;
 
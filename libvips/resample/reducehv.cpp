@@ -0,0 +1,1065 @@
+/* 2D reduce by a pair of float factors with a kernel
+ *
+ * 27/1/16
+ * 	- from shrink.c
+ * 15/8/16
+ * 	- rename xshrink -> hshrink for greater consistency
+ * 9/9/16
+ * 	- add @centre option
+ * 19/10/19
+ * 	- move here from reduce.c
+ * 	- fuse reduceh and reducev: we keep a ring of horizontally reduced
+ * 	  lines per thread and run the vertical mask down that, so each
+ * 	  input line is only reduced horizontally once
+ * 	- share masks between reducers with vips__reduce_mask_get()
+ * 	- add @linear and @premultiply: uchar pixels are decoded to float
+ * 	  through a LUT as lines are read and encoded again as output lines
+ * 	  are written, so we don't need a separate float pipeline
+ */
+
+/*
+
+    This file is part of VIPS.
+
+    VIPS is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA
+
+ */
+
+/*
+
+    These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <vips/intl.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <vips/vips.h>
+#include <vips/debug.h>
+#include <vips/internal.h>
+
+#include "presample.h"
+#include "templates.h"
+
+typedef struct _VipsReduce {
+	VipsResample parent_instance;
+
+	double hshrink;		/* Shrink factors */
+	double vshrink;
+
+	/* The thing we use to make the kernel.
+	 */
+	VipsKernel kernel;
+
+	/* Use centre rather than corner sampling convention.
+	 */
+	gboolean centre;
+
+	/* Reduce in linear light, and premultiply by alpha, if there is one.
+	 */
+	gboolean linear;
+	gboolean premultiply;
+
+	/* Set if we are doing either of the above. We decode uchar input 
+	 * lines to float as we read them, keep float lines in the ring, and
+	 * encode output lines back to uchar.
+	 */
+	gboolean convert;
+
+	/* Index of the alpha band for premultiply, or -1 for none.
+	 */
+	int alpha;
+
+	/* sRGB to linear light, indexed by pixel value.
+	 */
+	float lut[256];
+
+	/* Number of points in each kernel.
+	 */
+	int n_hpoint;
+	int n_vpoint;
+
+	/* The shared masks we use.
+	 */
+	VipsReduceMask *hmask;
+	VipsReduceMask *vmask;
+
+	/* Precalculated interpolation matrices, picked from the masks in the 
+	 * same way as reduceh and reducev, so we get the same result. int 
+	 * (used for pel sizes up to short), and double (for all others). We 
+	 * go to scale + 1 so we can round-to-nearest safely.
+	 */
+	int *hmatrixi[VIPS_TRANSFORM_SCALE + 1];
+	double *hmatrixf[VIPS_TRANSFORM_SCALE + 1];
+	int *vmatrixi[VIPS_TRANSFORM_SCALE + 1];
+	double *vmatrixf[VIPS_TRANSFORM_SCALE + 1];
+
+	/* The reduceh vector path we use, if any, and its matrices.
+	 */
+	VipsReducehVectorFn vector;
+	int *hmatrixi_bands[VIPS_TRANSFORM_SCALE + 1];
+	double *hmatrixf_bands[VIPS_TRANSFORM_SCALE + 1];
+
+} VipsReduce;
+
+typedef VipsResampleClass VipsReduceClass;
+
+/* We need C linkage for this.
+ */
+extern "C" {
+G_DEFINE_TYPE( VipsReduce, vips_reduce, VIPS_TYPE_RESAMPLE );
+}
+
+static void
+vips_reduce_finalize( GObject *gobject )
+{
+	VipsReduce *reduce = (VipsReduce *) gobject; 
+
+	VIPS_FREEF( vips__reduce_mask_unref, reduce->hmask );
+	VIPS_FREEF( vips__reduce_mask_unref, reduce->vmask );
+
+	G_OBJECT_CLASS( vips_reduce_parent_class )->finalize( gobject );
+}
+
+/* Our per-thread state.
+ */
+typedef struct {
+	VipsRegion *ir;		/* Input region */
+
+	/* A ring of n_vpoint horizontally reduced lines. Input line y is
+	 * in slot y % n_vpoint, and ring_y[] records which line each slot
+	 * holds, or -1 for empty. All the lines span output columns
+	 * left to left + width.
+	 */
+	VipsPel *ring;
+	int *ring_y;
+	int left;
+	int width;
+
+	/* Sum the vertical mask here.
+	 */
+	double *sum;
+
+	/* In convert mode, the decoded input line, and the output line
+	 * before encode.
+	 */
+	float *decode;
+	float *line;
+} Sequence;
+
+static int
+vips_reduce_stop( void *vseq, void *a, void *b )
+{
+	Sequence *seq = (Sequence *) vseq;
+
+	VIPS_UNREF( seq->ir );
+	VIPS_FREE( seq->ring );
+	VIPS_FREE( seq->ring_y );
+	VIPS_FREE( seq->sum );
+	VIPS_FREE( seq->decode );
+	VIPS_FREE( seq->line );
+
+	return( 0 );
+}
+
+/* Size of a line in the ring: lines are float in convert mode.
+ */
+static size_t
+vips_reduce_sizeof_ring_line( VipsReduce *reduce, VipsImage *out )
+{
+	if( reduce->convert )
+		return( VIPS_IMAGE_N_ELEMENTS( out ) * sizeof( float ) );
+	else
+		return( VIPS_IMAGE_SIZEOF_LINE( out ) );
+}
+
+static void *
+vips_reduce_start( VipsImage *out, void *a, void *b )
+{
+	VipsImage *in = (VipsImage *) a;
+	VipsReduce *reduce = (VipsReduce *) b;
+	const int n = reduce->n_vpoint;
+
+	Sequence *seq;
+
+	if( !(seq = VIPS_NEW( out, Sequence )) )
+		return( NULL );
+
+	/* Init!
+	 */
+	seq->ir = NULL;
+	seq->ring = NULL;
+	seq->ring_y = NULL;
+	seq->left = 0;
+	seq->width = 0;
+	seq->sum = NULL;
+	seq->decode = NULL;
+	seq->line = NULL;
+
+	/* Attach region and arrays. Double the elements for complex.
+	 */
+	seq->ir = vips_region_new( in );
+	seq->ring = VIPS_ARRAY( NULL,
+		n * vips_reduce_sizeof_ring_line( reduce, out ), VipsPel );
+	seq->ring_y = VIPS_ARRAY( NULL, n, int );
+	seq->sum = VIPS_ARRAY( NULL, 2 * VIPS_IMAGE_N_ELEMENTS( out ), double );
+	if( !seq->ir ||
+		!seq->ring ||
+		!seq->ring_y ||
+		!seq->sum ) {
+		vips_reduce_stop( seq, NULL, NULL );
+		return( NULL );
+	}
+
+	if( reduce->convert ) {
+		seq->decode = VIPS_ARRAY( NULL, 
+			VIPS_IMAGE_N_ELEMENTS( in ), float );
+		seq->line = VIPS_ARRAY( NULL, 
+			VIPS_IMAGE_N_ELEMENTS( out ), float );
+		if( !seq->decode ||
+			!seq->line ) {
+			vips_reduce_stop( seq, NULL, NULL );
+			return( NULL );
+		}
+	}
+
+	for( int i = 0; i < n; i++ )
+		seq->ring_y[i] = -1;
+
+	return( seq );
+}
+
+/* Round and clip an int sum to the output type.
+ */
+template <typename T, int min_value, int max_value>
+static T inline
+reduce_out( const int sum )
+{
+	int v;
+
+	if( min_value == 0 )
+		v = unsigned_fixed_round( sum );
+	else
+		v = signed_fixed_round( sum );
+
+	return( VIPS_CLIP( min_value, v, max_value ) );
+}
+
+/* And a double sum. max_value of zero means a float output, so no clip.
+ */
+template <typename T, int min_value, int max_value>
+static T inline
+reduce_out( double sum )
+{
+	if( max_value != 0 )
+		sum = VIPS_CLIP( min_value, sum, max_value );
+
+	return( sum );
+}
+
+/* Reduce an input line horizontally, exactly as reduceh does. @p0 is x == 0
+ * in the input line, we write @width pixels starting at output column @left.
+ */
+template <typename T, typename IT, int min_value, int max_value>
+static void
+reduce_hline( VipsReduce *reduce, VipsPel *pout, const VipsPel *p0,
+	const int bands, IT **matrix, const int left, const int width )
+{
+	T* restrict out = (T *) pout;
+	const int n = reduce->n_hpoint;
+
+	double X;
+
+	X = left * reduce->hshrink;
+	if( reduce->centre )
+		X += 0.5;
+
+	for( int x = 0; x < width; x++ ) {
+		const int ix = (int) X;
+		const T* restrict in = (T *) p0 + ix * bands;
+		const int sx = X * VIPS_TRANSFORM_SCALE * 2;
+		const int six = sx & (VIPS_TRANSFORM_SCALE * 2 - 1);
+		const int tx = (six + 1) >> 1;
+		const IT* restrict cx = matrix[tx];
+
+		for( int z = 0; z < bands; z++ )
+			out[z] = reduce_out<T, min_value, max_value>(
+				reduce_sum<T, IT>( in + z, bands, cx, n ) );
+
+		X += reduce->hshrink;
+		out += bands;
+	}
+}
+
+/* Ultra-high-quality version for double images.
+ */
+template <typename T>
+static void
+reduce_hline_notab( VipsReduce *reduce, VipsPel *pout, const VipsPel *p0,
+	const int bands, const int left, const int width )
+{
+	T* restrict out = (T *) pout;
+	const int n = reduce->n_hpoint;
+
+	double cx[MAX_POINT];
+	double X;
+
+	X = left * reduce->hshrink;
+	if( reduce->centre )
+		X += 0.5;
+
+	for( int x = 0; x < width; x++ ) {
+		const int ix = (int) X;
+		const T* restrict in = (T *) p0 + ix * bands;
+
+		vips_reduce_make_mask( cx,
+			reduce->kernel, reduce->hshrink, X - ix );
+
+		for( int z = 0; z < bands; z++ )
+			out[z] = reduce_sum<T, double>( in + z, bands, cx, n );
+
+		X += reduce->hshrink;
+		out += bands;
+	}
+}
+
+/* And with the reduceh vector path.
+ */
+static void
+reduce_hline_vector( VipsReduce *reduce, VipsPel *pout, const VipsPel *p0,
+	const int ps, const int left, const int width )
+{
+	const int n = reduce->n_hpoint;
+
+	double X;
+
+	X = left * reduce->hshrink;
+	if( reduce->centre )
+		X += 0.5;
+
+	for( int x = 0; x < width; x++ ) {
+		const int ix = (int) X;
+		const int sx = X * VIPS_TRANSFORM_SCALE * 2;
+		const int six = sx & (VIPS_TRANSFORM_SCALE * 2 - 1);
+		const int tx = (six + 1) >> 1;
+
+		reduce->vector( pout, p0 + ix * ps, n,
+			reduce->hmatrixi_bands[tx],
+			reduce->hmatrixf_bands[tx] );
+
+		X += reduce->hshrink;
+		pout += ps;
+	}
+}
+
+static void
+vips_reduce_hline( VipsReduce *reduce, VipsImage *in,
+	VipsPel *q, const VipsPel *p0, const int left, const int width )
+{
+	const int ps = VIPS_IMAGE_SIZEOF_PEL( in );
+
+	/* Double bands for complex.
+	 */
+	const int bands = in->Bands *
+		(vips_band_format_iscomplex( in->BandFmt ) ?  2 : 1);
+
+	int **mi = reduce->hmatrixi;
+	double **mf = reduce->hmatrixf;
+
+	if( reduce->vector ) {
+		reduce_hline_vector( reduce, q, p0, ps, left, width );
+		return;
+	}
+
+	switch( in->BandFmt ) {
+	case VIPS_FORMAT_UCHAR:
+		reduce_hline<unsigned char, int, 0, UCHAR_MAX>(
+			reduce, q, p0, bands, mi, left, width );
+		break;
+
+	case VIPS_FORMAT_CHAR:
+		reduce_hline<signed char, int, SCHAR_MIN, SCHAR_MAX>(
+			reduce, q, p0, bands, mi, left, width );
+		break;
+
+	case VIPS_FORMAT_USHORT:
+		reduce_hline<unsigned short, int, 0, USHRT_MAX>(
+			reduce, q, p0, bands, mi, left, width );
+		break;
+
+	case VIPS_FORMAT_SHORT:
+		reduce_hline<signed short, int, SHRT_MIN, SHRT_MAX>(
+			reduce, q, p0, bands, mi, left, width );
+		break;
+
+	case VIPS_FORMAT_UINT:
+		reduce_hline<unsigned int, double, 0, INT_MAX>(
+			reduce, q, p0, bands, mf, left, width );
+		break;
+
+	case VIPS_FORMAT_INT:
+		reduce_hline<signed int, double, INT_MIN, INT_MAX>(
+			reduce, q, p0, bands, mf, left, width );
+		break;
+
+	case VIPS_FORMAT_FLOAT:
+	case VIPS_FORMAT_COMPLEX:
+		reduce_hline<float, double, 0, 0>(
+			reduce, q, p0, bands, mf, left, width );
+		break;
+
+	case VIPS_FORMAT_DOUBLE:
+	case VIPS_FORMAT_DPCOMPLEX:
+		reduce_hline_notab<double>(
+			reduce, q, p0, bands, left, width );
+		break;
+
+	default:
+		g_assert_not_reached();
+		break;
+	}
+}
+
+/* Decode @n uchar pixels to float for convert mode: to linear light, then
+ * premultiply by alpha. Alpha stays in 0 - 255.
+ */
+static void
+vips_reduce_decode( VipsReduce *reduce, float *out, const VipsPel *in, 
+	const int bands, const int n )
+{
+	const int alpha = reduce->alpha;
+
+	for( int x = 0; x < n; x++ ) {
+		const float nalpha = alpha >= 0 ? in[alpha] / 255.0f : 1.0f;
+
+		for( int z = 0; z < bands; z++ ) {
+			float v;
+
+			if( z == alpha ) 
+				v = in[z];
+			else {
+				v = reduce->linear ? reduce->lut[in[z]] : in[z];
+				v *= nalpha;
+			}
+
+			out[z] = v;
+		}
+
+		in += bands;
+		out += bands;
+	}
+}
+
+/* And encode @n reduced float pixels back to uchar again.
+ */
+static void
+vips_reduce_encode( VipsReduce *reduce, VipsPel *out, float *in, 
+	const int bands, const int n )
+{
+	const int alpha = reduce->alpha;
+
+	for( int x = 0; x < n; x++ ) {
+		if( alpha >= 0 ) {
+			const float clip_alpha = VIPS_CLIP( 0, in[alpha], 255 );
+			const float nalpha = clip_alpha / 255.0f;
+
+			for( int z = 0; z < bands; z++ )
+				if( z != alpha ) {
+					if( nalpha == 0 )
+						in[z] = 0;
+					else
+						in[z] /= nalpha;
+				}
+
+			in[alpha] = clip_alpha;
+		}
+
+		if( reduce->linear ) {
+			int z;
+
+			/* Run through the sRGB encoder three bands at a
+			 * time, then one at a time for anything left over.
+			 */
+			for( z = 0; z + 2 < bands; z += 3 ) {
+				int r, g, b;
+
+				if( z == alpha ||
+					z + 1 == alpha ||
+					z + 2 == alpha )
+					break;
+
+				vips_col_scRGB2sRGB_8( in[z], in[z + 1], in[z + 2], 
+					&r, &g, &b, NULL );
+				out[z] = r;
+				out[z + 1] = g;
+				out[z + 2] = b;
+			}
+
+			for( ; z < bands; z++ ) {
+				int r, g, b;
+
+				if( z == alpha ) {
+					out[z] = VIPS_RINT( in[z] );
+					continue;
+				}
+
+				vips_col_scRGB2sRGB_8( in[z], in[z], in[z], 
+					&r, &g, &b, NULL );
+				out[z] = r;
+			}
+		}
+		else 
+			for( int z = 0; z < bands; z++ ) {
+				const float v = VIPS_CLIP( 0, in[z], 255 );
+
+				out[z] = VIPS_RINT( v );
+			}
+
+		in += bands;
+		out += bands;
+	}
+}
+
+/* Run the vertical mask down a set of lines. We sum a line at a time,
+ * rather than a pixel at a time like reducev, since that vectorises well,
+ * but the arithmetic is the same.
+ */
+template <typename T, typename IT, int min_value, int max_value>
+static void
+reduce_vline( VipsReduce *reduce, VipsPel *pout, VipsPel **lines,
+	const int ne, const IT * restrict cy, IT * restrict sum )
+{
+	T* restrict out = (T *) pout;
+	const int n = reduce->n_vpoint;
+	const T* restrict in;
+
+	in = (T *) lines[0];
+	for( int z = 0; z < ne; z++ )
+		sum[z] = cy[0] * in[z];
+
+	for( int i = 1; i < n; i++ ) {
+		const IT c = cy[i];
+
+		in = (T *) lines[i];
+		for( int z = 0; z < ne; z++ )
+			sum[z] += c * in[z];
+	}
+
+	for( int z = 0; z < ne; z++ )
+		out[z] = reduce_out<T, min_value, max_value>( sum[z] );
+}
+
+static void
+vips_reduce_vline( VipsReduce *reduce, VipsImage *in,
+	VipsPel *q, VipsPel **lines, const int ne, double Y,
+	double *sum )
+{
+	const int py = (int) Y;
+	const int sy = Y * VIPS_TRANSFORM_SCALE * 2;
+	const int siy = sy & (VIPS_TRANSFORM_SCALE * 2 - 1);
+	const int ty = (siy + 1) >> 1;
+	const int *cyi = reduce->vmatrixi[ty];
+	const double *cyf = reduce->vmatrixf[ty];
+
+	double cy[MAX_POINT];
+
+	switch( in->BandFmt ) {
+	case VIPS_FORMAT_UCHAR:
+		reduce_vline<unsigned char, int, 0, UCHAR_MAX>(
+			reduce, q, lines, ne, cyi, (int *) sum );
+		break;
+
+	case VIPS_FORMAT_CHAR:
+		reduce_vline<signed char, int, SCHAR_MIN, SCHAR_MAX>(
+			reduce, q, lines, ne, cyi, (int *) sum );
+		break;
+
+	case VIPS_FORMAT_USHORT:
+		reduce_vline<unsigned short, int, 0, USHRT_MAX>(
+			reduce, q, lines, ne, cyi, (int *) sum );
+		break;
+
+	case VIPS_FORMAT_SHORT:
+		reduce_vline<signed short, int, SHRT_MIN, SHRT_MAX>(
+			reduce, q, lines, ne, cyi, (int *) sum );
+		break;
+
+	case VIPS_FORMAT_UINT:
+		reduce_vline<unsigned int, double, 0, INT_MAX>(
+			reduce, q, lines, ne, cyf, sum );
+		break;
+
+	case VIPS_FORMAT_INT:
+		reduce_vline<signed int, double, INT_MIN, INT_MAX>(
+			reduce, q, lines, ne, cyf, sum );
+		break;
+
+	case VIPS_FORMAT_FLOAT:
+	case VIPS_FORMAT_COMPLEX:
+		reduce_vline<float, double, 0, 0>(
+			reduce, q, lines, ne, cyf, sum );
+		break;
+
+	case VIPS_FORMAT_DOUBLE:
+	case VIPS_FORMAT_DPCOMPLEX:
+		vips_reduce_make_mask( cy,
+			reduce->kernel, reduce->vshrink, Y - py );
+		reduce_vline<double, double, 0, 0>(
+			reduce, q, lines, ne, cy, sum );
+		break;
+
+	default:
+		g_assert_not_reached();
+		break;
+	}
+}
+
+static int
+vips_reduce_gen( VipsRegion *out_region, void *vseq,
+	void *a, void *b, gboolean *stop )
+{
+	VipsImage *in = (VipsImage *) a;
+	VipsReduce *reduce = (VipsReduce *) b;
+	Sequence *seq = (Sequence *) vseq;
+	VipsRegion *ir = seq->ir;
+	VipsRect *r = &out_region->valid;
+	const int ps = VIPS_IMAGE_SIZEOF_PEL( in );
+	const size_t ls = 
+		vips_reduce_sizeof_ring_line( reduce, out_region->im );
+	const int n = reduce->n_vpoint;
+	const double offset = reduce->centre ? 0.5 : 0.0;
+
+	/* Double bands for complex.
+	 */
+	const int bands = in->Bands *
+		(vips_band_format_iscomplex( in->BandFmt ) ?  2 : 1);
+	const int ne = r->width * bands;
+
+	VipsPel *lines[MAX_POINT];
+	int top;
+	int bottom;
+	int first;
+
+#ifdef DEBUG
+	printf( "vips_reduce_gen: generating %d x %d at %d x %d\n",
+		r->width, r->height, r->left, r->top );
+#endif /*DEBUG*/
+
+	/* Lines left in the ring by the previous region are only useful if
+	 * they span the same columns.
+	 */
+	if( r->left != seq->left ||
+		r->width != seq->width ) {
+		for( int i = 0; i < n; i++ )
+			seq->ring_y[i] = -1;
+		seq->left = r->left;
+		seq->width = r->width;
+	}
+
+	/* The input lines we need, and the first of those we don't have.
+	 */
+	top = (int) (r->top * reduce->vshrink + offset);
+	bottom = (int) ((VIPS_RECT_BOTTOM( r ) - 1) * reduce->vshrink +
+		offset) + n;
+	for( first = top; first < bottom; first++ )
+		if( seq->ring_y[first % n] != first )
+			break;
+
+	if( first < bottom ) {
+		VipsRect s;
+
+		s.left = r->left * reduce->hshrink;
+		s.top = first;
+		s.width = r->width * reduce->hshrink + reduce->n_hpoint;
+		s.height = bottom - first;
+		if( reduce->centre )
+			s.width += 1;
+		if( reduce->vector )
+			s.width += REDUCEH_VECTOR_PAD;
+		if( vips_region_prepare( ir, &s ) )
+			return( -1 );
+	}
+
+	VIPS_GATE_START( "vips_reduce_gen: work" );
+
+	for( int y = 0; y < r->height; y++ ) {
+		const double Y = (r->top + y) * reduce->vshrink + offset;
+		const int py = (int) Y;
+
+		VipsPel *q;
+
+		/* Reduce any lines we don't have yet into the ring. We fill
+		 * in order, so we only overwrite lines above the mask.
+		 */
+		for( int i = 0; i < n; i++ ) {
+			const int iy = py + i;
+			const int slot = iy % n;
+
+			lines[i] = seq->ring + slot * ls;
+
+			if( seq->ring_y[slot] != iy ) {
+				/* We want p0 to be x == 0 of the input line.
+				 * It could be outside valid, so get the
+				 * leftmost pixel in valid and subtract a bit.
+				 */
+				VipsPel *p0 = VIPS_REGION_ADDR( ir,
+					ir->valid.left, iy ) -
+					ir->valid.left * ps;
+
+				if( reduce->convert ) {
+					/* decode is a whole input line, so
+					 * we can index it by input x.
+					 */
+					vips_reduce_decode( reduce, 
+						seq->decode + 
+							ir->valid.left * bands, 
+						p0 + ir->valid.left * ps,
+						bands, ir->valid.width );
+					reduce_hline<float, double, 0, 0>(
+						reduce, lines[i], 
+						(VipsPel *) seq->decode, 
+						bands, reduce->hmatrixf, 
+						r->left, r->width );
+				}
+				else
+					vips_reduce_hline( reduce, in,
+						lines[i], p0, 
+						r->left, r->width );
+				seq->ring_y[slot] = iy;
+			}
+		}
+
+		q = VIPS_REGION_ADDR( out_region, r->left, r->top + y );
+		if( reduce->convert ) {
+			const int sy = Y * VIPS_TRANSFORM_SCALE * 2;
+			const int siy = sy & (VIPS_TRANSFORM_SCALE * 2 - 1);
+			const int ty = (siy + 1) >> 1;
+
+			reduce_vline<float, double, 0, 0>( reduce, 
+				(VipsPel *) seq->line, lines, ne, 
+				reduce->vmatrixf[ty], seq->sum );
+			vips_reduce_encode( reduce, 
+				q, seq->line, bands, r->width );
+		}
+		else
+			vips_reduce_vline( reduce, in, 
+				q, lines, ne, Y, seq->sum );
+	}
+
+	VIPS_GATE_STOP( "vips_reduce_gen: work" );
+
+	VIPS_COUNT_PIXELS( out_region, "vips_reduce_gen" );
+
+	return( 0 );
+}
+
+static int
+vips_reduce_build( VipsObject *object )
+{
+	VipsObjectClass *object_class = VIPS_OBJECT_GET_CLASS( object );
+	VipsResample *resample = VIPS_RESAMPLE( object );
+	VipsReduce *reduce = (VipsReduce *) object;
+	VipsImage **t = (VipsImage **)
+		vips_object_local_array( object, 5 );
+
+	VipsImage *in;
+	int width;
+	int height;
+
+	if( VIPS_OBJECT_CLASS( vips_reduce_parent_class )->build( object ) )
+		return( -1 );
+
+	in = resample->in;
+
+	if( reduce->hshrink < 1 ||
+		reduce->vshrink < 1 ) {
+		vips_error( object_class->nickname,
+			"%s", _( "reduce factors should be >= 1" ) );
+		return( -1 );
+	}
+
+	reduce->convert = reduce->linear || reduce->premultiply;
+
+	/* With only one axis to do, there's nothing to fuse. Unless we
+	 * are converting, since only this path can do that.
+	 */
+	if( !reduce->convert &&
+		(reduce->hshrink == 1 ||
+		 reduce->vshrink == 1) ) {
+		if( vips_reducev( in, &t[0], reduce->vshrink,
+			"kernel", reduce->kernel,
+			"centre", reduce->centre,
+			NULL ) ||
+			vips_reduceh( t[0], &t[1], reduce->hshrink,
+				"kernel", reduce->kernel,
+				"centre", reduce->centre,
+				NULL ) ||
+			vips_image_write( t[1], resample->out ) )
+			return( -1 );
+
+		return( 0 );
+	}
+
+	reduce->n_hpoint =
+		vips_reduce_get_points( reduce->kernel, reduce->hshrink );
+	reduce->n_vpoint =
+		vips_reduce_get_points( reduce->kernel, reduce->vshrink );
+	g_info( "reduce: %d x %d point mask",
+		reduce->n_hpoint, reduce->n_vpoint );
+	if( reduce->n_hpoint > MAX_POINT ||
+		reduce->n_vpoint > MAX_POINT ) {
+		vips_error( object_class->nickname,
+			"%s", _( "reduce factor too large" ) );
+		return( -1 );
+	}
+
+	/* Get the tables of pre-computed coefficients. The horizontal int
+	 * mask is the one reduceh uses, the vertical the one reducev uses.
+	 */
+	if( !(reduce->hmask = vips__reduce_mask_get( 
+		reduce->kernel, reduce->hshrink )) ||
+		!(reduce->vmask = vips__reduce_mask_get( 
+		reduce->kernel, reduce->vshrink )) )
+		return( -1 );
+	for( int x = 0; x < VIPS_TRANSFORM_SCALE + 1; x++ ) {
+		reduce->hmatrixf[x] = reduce->hmask->matrixf[x];
+		reduce->hmatrixi[x] = reduce->hmask->matrixi[x];
+		reduce->vmatrixf[x] = reduce->vmask->matrixf[x];
+		reduce->vmatrixi[x] = reduce->vmask->matrixs[x];
+	}
+
+	/* Unpack for processing.
+	 */
+	if( vips_image_decode( in, &t[0] ) )
+		return( -1 );
+	in = t[0];
+
+	/* We decode sRGB and alpha with 8-bit tables.
+	 */
+	if( reduce->convert ) {
+		if( vips_check_format( object_class->nickname, 
+			in, VIPS_FORMAT_UCHAR ) )
+			return( -1 );
+
+		reduce->alpha = reduce->premultiply && 
+			vips_image_hasalpha( in ) ? in->Bands - 1 : -1;
+
+		for( int i = 0; i < 256; i++ ) {
+			float R, G, B;
+
+			vips_col_sRGB2scRGB_8( i, i, i, &R, &G, &B );
+			reduce->lut[i] = R;
+		}
+	}
+
+	/* Use the reduceh vector path, if we can. Not in convert mode: the
+	 * ring holds float there.
+	 */
+	if( !reduce->convert &&
+		(reduce->vector = vips__reduceh_vector_pick( in )) &&
+		vips__reduceh_vector_mask( object, in, reduce->n_hpoint,
+			reduce->hmatrixi, reduce->hmatrixf,
+			reduce->hmatrixi_bands, reduce->hmatrixf_bands ) )
+		return( -1 );
+
+	/* Add new pixels around the input so we can interpolate at the edges.
+	 * In centre mode, we read 0.5 pixels more to the right and down, so
+	 * we must enlarge a little further. The vector paths can read a
+	 * little past the end of the mask.
+	 */
+	width = in->Xsize + reduce->n_hpoint - 1;
+	height = in->Ysize + reduce->n_vpoint - 1;
+	if( reduce->centre ) {
+		width += 1;
+		height += 1;
+	}
+	if( reduce->vector )
+		width += REDUCEH_VECTOR_PAD;
+	if( vips_embed( in, &t[1],
+		reduce->n_hpoint / 2 - 1, reduce->n_vpoint / 2 - 1,
+		width, height,
+		"extend", VIPS_EXTEND_COPY,
+		(void *) NULL ) )
+		return( -1 );
+	in = t[1];
+
+	t[2] = vips_image_new();
+	if( vips_image_pipelinev( t[2],
+		VIPS_DEMAND_STYLE_FATSTRIP, in, (void *) NULL ) )
+		return( -1 );
+
+	/* Size output. We need to always round to nearest, so round(), not
+	 * rint().
+	 *
+	 * Don't change xres/yres, leave that to the application layer. For
+	 * example, vipsthumbnail knows the true reduce factor (including the
+	 * fractional part), we just see the integer part here.
+	 */
+	t[2]->Xsize = VIPS_ROUND_UINT( resample->in->Xsize / reduce->hshrink );
+	t[2]->Ysize = VIPS_ROUND_UINT( resample->in->Ysize / reduce->vshrink );
+	if( t[2]->Xsize <= 0 ||
+		t[2]->Ysize <= 0 ) {
+		vips_error( object_class->nickname,
+			"%s", _( "image has shrunk to nothing" ) );
+		return( -1 );
+	}
+
+#ifdef DEBUG
+	printf( "vips_reduce_build: reducing %d x %d image to %d x %d\n",
+		in->Xsize, in->Ysize,
+		t[2]->Xsize, t[2]->Ysize );
+#endif /*DEBUG*/
+
+	if( vips_image_generate( t[2],
+		vips_reduce_start, vips_reduce_gen, vips_reduce_stop,
+		in, reduce ) )
+		return( -1 );
+	in = t[2];
+
+	vips_reorder_margin_hint( in, reduce->n_vpoint );
+
+	/* As reducev, a large vertical reduce can throw off sequential mode,
+	 * so keep the previous few lines of output.
+	 */
+	if( vips_image_get_typeof( in, VIPS_META_SEQUENTIAL ) ) {
+		g_info( "reduce sequential line cache" );
+
+		if( vips_sequential( in, &t[3],
+			"tile_height", 10,
+			(void *) NULL ) )
+			return( -1 );
+		in = t[3];
+	}
+
+	if( vips_image_write( in, resample->out ) )
+		return( -1 );
+
+	return( 0 );
+}
+
+static void
+vips_reduce_class_init( VipsReduceClass *reduce_class )
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS( reduce_class );
+	VipsObjectClass *vobject_class = VIPS_OBJECT_CLASS( reduce_class );
+	VipsOperationClass *operation_class =
+		VIPS_OPERATION_CLASS( reduce_class );
+
+	VIPS_DEBUG_MSG( "vips_reduce_class_init\n" );
+
+	gobject_class->finalize = vips_reduce_finalize;
+	gobject_class->set_property = vips_object_set_property;
+	gobject_class->get_property = vips_object_get_property;
+
+	vobject_class->nickname = "reduce";
+	vobject_class->description = _( "reduce an image" );
+	vobject_class->build = vips_reduce_build;
+
+	operation_class->flags = VIPS_OPERATION_SEQUENTIAL;
+
+	VIPS_ARG_DOUBLE( reduce_class, "hshrink", 8,
+		_( "Hshrink" ),
+		_( "Horizontal shrink factor" ),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET( VipsReduce, hshrink ),
+		1.0, 1000000.0, 1.0 );
+
+	VIPS_ARG_DOUBLE( reduce_class, "vshrink", 9,
+		_( "Vshrink" ),
+		_( "Vertical shrink factor" ),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET( VipsReduce, vshrink ),
+		1.0, 1000000.0, 1.0 );
+
+	VIPS_ARG_ENUM( reduce_class, "kernel", 3,
+		_( "Kernel" ),
+		_( "Resampling kernel" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsReduce, kernel ),
+		VIPS_TYPE_KERNEL, VIPS_KERNEL_LANCZOS3 );
+
+	VIPS_ARG_BOOL( reduce_class, "centre", 7,
+		_( "Centre" ),
+		_( "Use centre sampling convention" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsReduce, centre ),
+		FALSE );
+
+	VIPS_ARG_BOOL( reduce_class, "linear", 10,
+		_( "Linear" ),
+		_( "Reduce in linear light" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsReduce, linear ),
+		FALSE );
+
+	VIPS_ARG_BOOL( reduce_class, "premultiply", 11,
+		_( "Premultiply" ),
+		_( "Premultiply by alpha during reduce" ),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET( VipsReduce, premultiply ),
+		FALSE );
+
+	/* The old names .. now use h and v everywhere.
+	 */
+	VIPS_ARG_DOUBLE( reduce_class, "xshrink", 8,
+		_( "Xshrink" ),
+		_( "Horizontal shrink factor" ),
+		VIPS_ARGUMENT_REQUIRED_INPUT | VIPS_ARGUMENT_DEPRECATED,
+		G_STRUCT_OFFSET( VipsReduce, hshrink ),
+		1.0, 1000000.0, 1.0 );
+
+	VIPS_ARG_DOUBLE( reduce_class, "yshrink", 9,
+		_( "Yshrink" ),
+		_( "Vertical shrink factor" ),
+		VIPS_ARGUMENT_REQUIRED_INPUT | VIPS_ARGUMENT_DEPRECATED,
+		G_STRUCT_OFFSET( VipsReduce, vshrink ),
+		1.0, 1000000.0, 1.0 );
+
+}
+
+static void
+vips_reduce_init( VipsReduce *reduce )
+{
+	reduce->kernel = VIPS_KERNEL_LANCZOS3;
+	reduce->alpha = -1;
+}
+
+/* See reduce.c for the doc comment.
+ */
+
+int
+vips_reduce( VipsImage *in, VipsImage **out,
+	double hshrink, double vshrink, ... )
+{
+	va_list ap;
+	int result;
+
+	va_start( ap, vshrink );
+	result = vips_call_split( "reduce", ap, in, out, hshrink, vshrink );
+	va_end( ap );
+
+	return( result );
+}
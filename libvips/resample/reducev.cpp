@@ -17,6 +17,8 @@
  * 	- add @centre option
  * 7/3/17
  * 	- add a seq line cache
+ * 19/10/19
+ * 	- share masks and orc programs between reducers
  */
 
 /*
@@ -59,6 +61,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include <vips/vips.h>
@@ -112,9 +115,14 @@ typedef struct _VipsReducev {
 	 */
 	int n_point;
 
+	/* The shared masks we use.
+	 */
+	VipsReduceMask *mask;
+
 	/* Precalculated interpolation matrices. int (used for pel
 	 * sizes up to short), and double (for all others). We go to
-	 * scale + 1 so we can round-to-nearest safely.
+	 * scale + 1 so we can round-to-nearest safely. These point into
+	 * mask.
 	 */
 	int *matrixi[VIPS_TRANSFORM_SCALE + 1];
 	double *matrixf[VIPS_TRANSFORM_SCALE + 1];
@@ -123,7 +131,8 @@ typedef struct _VipsReducev {
 	 */
 	int *matrixo[VIPS_TRANSFORM_SCALE + 1];
 
-	/* The passes we generate for this mask.
+	/* The passes we generate for this mask. The vectors are shared, see
+	 * vips_reducev_program_get().
 	 */
 	int n_pass;	
 	Pass pass[MAX_PASS];
@@ -143,14 +152,7 @@ vips_reducev_finalize( GObject *gobject )
 {
 	VipsReducev *reducev = (VipsReducev *) gobject; 
 
-	for( int i = 0; i < reducev->n_pass; i++ )
-		VIPS_FREEF( vips_vector_free, reducev->pass[i].vector );
-	reducev->n_pass = 0;
-	for( int i = 0; i < VIPS_TRANSFORM_SCALE + 1; i++ ) {
-		VIPS_FREE( reducev->matrixf[i] );
-		VIPS_FREE( reducev->matrixi[i] );
-		VIPS_FREE( reducev->matrixo[i] );
-	}
+	VIPS_FREEF( vips__reduce_mask_unref, reducev->mask );
 
 	G_OBJECT_CLASS( vips_reducev_parent_class )->finalize( gobject );
 }
@@ -322,6 +324,70 @@ vips_reducev_compile( VipsReducev *reducev )
 	return( 0 );
 }
 
+/* Compiled passes depend only on n_point, so we share them between all 
+ * reducev in a process-wide table. Compiling is slow, and thumbnailers make
+ * the same few reducers over and over. There are only a few likely values 
+ * of n_point, so we never free programs.
+ */
+typedef struct {
+	int n_pass;		/* Zero means we could not compile */
+	Pass pass[MAX_PASS];
+} VipsReducevProgram;
+
+static GMutex *vips_reducev_program_lock = NULL;
+static GHashTable *vips_reducev_program_table = NULL;
+
+static void *
+vips_reducev_program_init( void *data )
+{
+	vips_reducev_program_lock = vips_g_mutex_new();
+	vips_reducev_program_table = 
+		g_hash_table_new( g_direct_hash, g_direct_equal );
+
+	return( NULL );
+}
+
+/* Fill reducev->pass from the table, compiling if necessary.
+ *
+ * 0 for success, -1 if we can't make a vector path.
+ */
+static int
+vips_reducev_program_get( VipsReducev *reducev )
+{
+	static GOnce once = G_ONCE_INIT;
+
+	VipsReducevProgram *program;
+
+	VIPS_ONCE( &once, vips_reducev_program_init, NULL );
+
+	g_mutex_lock( vips_reducev_program_lock );
+
+	if( (program = (VipsReducevProgram *) g_hash_table_lookup( 
+		vips_reducev_program_table, 
+		GINT_TO_POINTER( reducev->n_point ) )) ) {
+		reducev->n_pass = program->n_pass;
+		memcpy( reducev->pass, program->pass, sizeof( reducev->pass ) );
+	}
+	else {
+		if( vips_reducev_compile( reducev ) ) {
+			for( int i = 0; i < reducev->n_pass; i++ )
+				VIPS_FREEF( vips_vector_free, 
+					reducev->pass[i].vector );
+			reducev->n_pass = 0;
+		}
+
+		program = g_new( VipsReducevProgram, 1 );
+		program->n_pass = reducev->n_pass;
+		memcpy( program->pass, reducev->pass, sizeof( reducev->pass ) );
+		g_hash_table_insert( vips_reducev_program_table,
+			GINT_TO_POINTER( reducev->n_point ), program );
+	}
+
+	g_mutex_unlock( vips_reducev_program_lock );
+
+	return( reducev->n_pass > 0 ? 0 : -1 );
+}
+
 /* Our sequence value.
  */
 typedef struct {
@@ -726,17 +792,16 @@ vips_reducev_raw( VipsReducev *reducev, VipsImage *in, VipsImage **out )
 
 	VipsGenerateFn generate;
 
-	/* Build masks.
+	/* Get masks. uchar and ushort use the int version, and we need a 2.6 
+	 * version if we will use the vector path.
 	 */
+	if( !(reducev->mask = vips__reduce_mask_get( 
+		reducev->kernel, reducev->vshrink )) )
+		return( -1 );
 	for( int y = 0; y < VIPS_TRANSFORM_SCALE + 1; y++ ) {
-		reducev->matrixf[y] = 
-			VIPS_ARRAY( NULL, reducev->n_point, double ); 
-		if( !reducev->matrixf[y] )
-			return( -1 ); 
-
-		vips_reduce_make_mask( reducev->matrixf[y],
-			reducev->kernel, reducev->vshrink, 
-			(float) y / VIPS_TRANSFORM_SCALE ); 
+		reducev->matrixf[y] = reducev->mask->matrixf[y];
+		reducev->matrixi[y] = reducev->mask->matrixs[y];
+		reducev->matrixo[y] = reducev->mask->matrixo[y];
 
 #ifdef DEBUG
 		printf( "%6.2g", (double) y / VIPS_TRANSFORM_SCALE ); 
@@ -746,41 +811,12 @@ vips_reducev_raw( VipsReducev *reducev, VipsImage *in, VipsImage **out )
 #endif /*DEBUG*/
 	}
 
-	/* uchar and ushort need an int version of the masks.
-	 */
-	if( VIPS_IMAGE_SIZEOF_ELEMENT( in ) <= 2 ) 
-		for( int y = 0; y < VIPS_TRANSFORM_SCALE + 1; y++ ) {
-			reducev->matrixi[y] = 
-				VIPS_ARRAY( NULL, reducev->n_point, int ); 
-			if( !reducev->matrixi[y] )
-				return( -1 ); 
-
-			vips_vector_to_fixed_point( 
-				reducev->matrixf[y], reducev->matrixi[y], 
-				reducev->n_point, VIPS_INTERPOLATE_SCALE );
-		}
-
-	/* And we need an 2.6 version if we will use the vector path.
-	 */
-	if( in->BandFmt == VIPS_FORMAT_UCHAR &&
-		vips_vector_isenabled() ) 
-		for( int y = 0; y < VIPS_TRANSFORM_SCALE + 1; y++ ) {
-			reducev->matrixo[y] = 
-				VIPS_ARRAY( NULL, reducev->n_point, int ); 
-			if( !reducev->matrixo[y] )
-				return( -1 ); 
-
-			vips_vector_to_fixed_point( 
-				reducev->matrixf[y], reducev->matrixo[y], 
-				reducev->n_point, 64 );
-		}
-
 	/* Try to build a vector version, if we can.
 	 */
 	generate = vips_reducev_gen;
 	if( in->BandFmt == VIPS_FORMAT_UCHAR &&
 		vips_vector_isenabled() &&
-		!vips_reducev_compile( reducev ) ) {
+		!vips_reducev_program_get( reducev ) ) {
 		g_info( "reducev: using vector path" ); 
 		generate = vips_reducev_vector_gen;
 	}
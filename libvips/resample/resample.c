@@ -48,6 +48,7 @@
 #include <math.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 #include <vips/internal.h>
 
 #include "presample.h"
@@ -69,6 +70,8 @@
  * vips_reduce() is like vips_affine(), but it can only shrink images, it can't
  * enlarge, rotate, or skew. It's very fast and uses an adaptive kernel for
  * interpolation. Again, it will give poor results for large size reductions.
+ * vips_enlarge() is the matching enlarger: it uses the same separable 
+ * kernels, but they do not grow with the scale factor.
  *
  * vips_shrink() is a fast block shrinker. It can quickly reduce images by
  * large integer factors. It will give poor results for small size reductions:
@@ -76,8 +79,9 @@
  *
  * Next, vips_resize() specialises in the common task of image reduce and 
  * enlarge. It strings together combinations of vips_shrink(), vips_reduce(),
- * vips_affine() and others to implement a general, high-quality image
- * resizer.
+ * vips_enlarge() and others to implement a general, high-quality image
+ * resizer. vips_multires() uses vips_resize() to serve any scale from the
+ * nearest level of a pyramidal image.
  *
  * Finally, vips_mapim() can apply arbitrary 2D image transforms to an image.
  */
@@ -148,6 +152,198 @@ vips_resample_init( VipsResample *resample )
 {
 }
 
+static void *
+vips_resample_simd_init( void *data )
+{
+	int simd;
+
+	simd = VIPS_RESAMPLE_SIMD_NONE;
+
+	/* vips_vector_init() only checks this if we have orc.
+	 */
+	if( g_getenv( "VIPS_NOVECTOR" ) || 
+		g_getenv( "IM_NOVECTOR" ) ) 
+		return( GINT_TO_POINTER( simd ) );
+
+#ifdef VIPS_RESAMPLE_X86
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports( "sse4.1" ) )
+		simd |= VIPS_RESAMPLE_SIMD_SSE41;
+	if( __builtin_cpu_supports( "avx2" ) )
+		simd |= VIPS_RESAMPLE_SIMD_AVX2;
+#endif /*VIPS_RESAMPLE_X86*/
+
+#ifdef VIPS_RESAMPLE_NEON
+	simd |= VIPS_RESAMPLE_SIMD_NEON;
+#endif /*VIPS_RESAMPLE_NEON*/
+
+	g_info( "resample: vector paths 0x%x", simd );
+
+	return( GINT_TO_POINTER( simd ) );
+}
+
+/* The set of VipsResampleSimd paths we can use on this CPU. These are turned
+ * off by --vips-novector and vips_vector_set_enabled(), just like orc.
+ */
+int
+vips__resample_simd( void )
+{
+	static GOnce once = G_ONCE_INIT;
+
+	int simd;
+
+	simd = GPOINTER_TO_INT( 
+		g_once( &once, vips_resample_simd_init, NULL ) );
+
+	return( vips__vector_enabled ? simd : VIPS_RESAMPLE_SIMD_NONE );
+}
+
+/* Thumbnailers make the same few reducers over and over, so we keep a
+ * process-wide cache of recent masks. Entries are refcounted: the cache 
+ * holds one ref, and each reducer using a mask holds another.
+ *
+ * Large shrinks make large masks, so we limit the cache by size, in bytes.
+ */
+#define VIPS_REDUCE_MASK_CACHE_MAX (4 * 1024 * 1024)
+
+static GMutex *vips_reduce_mask_lock = NULL;
+static GHashTable *vips_reduce_mask_table = NULL;
+static GQueue vips_reduce_mask_lru = G_QUEUE_INIT;
+static size_t vips_reduce_mask_size = 0;
+
+static void *
+vips_reduce_mask_init( void *data )
+{
+	vips_reduce_mask_lock = vips_g_mutex_new();
+	vips_reduce_mask_table = g_hash_table_new( g_str_hash, g_str_equal );
+
+	return( NULL );
+}
+
+static void
+vips_reduce_mask_free( VipsReduceMask *mask )
+{
+	int i;
+
+	for( i = 0; i < VIPS_TRANSFORM_SCALE + 1; i++ ) {
+		VIPS_FREE( mask->matrixf[i] );
+		VIPS_FREE( mask->matrixi[i] );
+		VIPS_FREE( mask->matrixs[i] );
+		VIPS_FREE( mask->matrixo[i] );
+	}
+	VIPS_FREE( mask->key );
+	g_free( mask );
+}
+
+static VipsReduceMask *
+vips_reduce_mask_new( VipsKernel kernel, double shrink )
+{
+	VipsReduceMask *mask;
+	int i, x;
+
+	mask = g_new0( VipsReduceMask, 1 );
+	mask->ref_count = 1;
+	mask->n_point = vips_reduce_get_points( kernel, shrink );
+	mask->size = (size_t) (VIPS_TRANSFORM_SCALE + 1) * mask->n_point * 
+		(sizeof( double ) + 3 * sizeof( int ));
+
+	for( x = 0; x < VIPS_TRANSFORM_SCALE + 1; x++ ) {
+		mask->matrixf[x] = VIPS_ARRAY( NULL, mask->n_point, double );
+		mask->matrixi[x] = VIPS_ARRAY( NULL, mask->n_point, int );
+		mask->matrixs[x] = VIPS_ARRAY( NULL, mask->n_point, int );
+		mask->matrixo[x] = VIPS_ARRAY( NULL, mask->n_point, int );
+		if( !mask->matrixf[x] ||
+			!mask->matrixi[x] ||
+			!mask->matrixs[x] ||
+			!mask->matrixo[x] ) {
+			vips_reduce_mask_free( mask );
+			return( NULL );
+		}
+
+		vips_reduce_make_mask( mask->matrixf[x], kernel, shrink, 
+			(float) x / VIPS_TRANSFORM_SCALE );
+
+		for( i = 0; i < mask->n_point; i++ )
+			mask->matrixi[x][i] = mask->matrixf[x][i] * 
+				VIPS_INTERPOLATE_SCALE;
+		vips_vector_to_fixed_point( mask->matrixf[x], mask->matrixs[x],
+			mask->n_point, VIPS_INTERPOLATE_SCALE );
+		vips_vector_to_fixed_point( mask->matrixf[x], mask->matrixo[x],
+			mask->n_point, 64 );
+	}
+
+	return( mask );
+}
+
+/* Get a ref to the set of masks for a kernel and shrink. Unref with
+ * vips__reduce_mask_unref(). The caller must have checked n_point against
+ * MAX_POINT.
+ */
+VipsReduceMask *
+vips__reduce_mask_get( VipsKernel kernel, double shrink )
+{
+	static GOnce once = G_ONCE_INIT;
+
+	char key[256];
+	VipsReduceMask *mask;
+
+	VIPS_ONCE( &once, vips_reduce_mask_init, NULL );
+
+	/* %.17g is enough to round-trip a double.
+	 */
+	vips_snprintf( key, 256, "%d %.17g", kernel, shrink );
+
+	g_mutex_lock( vips_reduce_mask_lock );
+
+	if( (mask = g_hash_table_lookup( vips_reduce_mask_table, key )) ) 
+		g_queue_remove( &vips_reduce_mask_lru, mask );
+	else if( (mask = vips_reduce_mask_new( kernel, shrink )) ) {
+		/* Drop the cache's ref to least recently used masks until 
+		 * this one will fit. 
+		 */
+		while( vips_reduce_mask_size + mask->size > 
+				VIPS_REDUCE_MASK_CACHE_MAX &&
+			!g_queue_is_empty( &vips_reduce_mask_lru ) ) {
+			VipsReduceMask *old = 
+				g_queue_pop_tail( &vips_reduce_mask_lru );
+
+			g_hash_table_remove( vips_reduce_mask_table, old->key );
+			vips_reduce_mask_size -= old->size;
+			old->ref_count -= 1;
+			if( old->ref_count == 0 ) 
+				vips_reduce_mask_free( old );
+		}
+
+		mask->key = g_strdup( key );
+		g_hash_table_insert( vips_reduce_mask_table, mask->key, mask );
+		vips_reduce_mask_size += mask->size;
+	}
+
+	if( mask ) {
+		g_queue_push_head( &vips_reduce_mask_lru, mask );
+		mask->ref_count += 1;
+	}
+
+	g_mutex_unlock( vips_reduce_mask_lock );
+
+	if( !mask )
+		vips_error( "reduce", "%s", _( "unable to make mask" ) );
+
+	return( mask );
+}
+
+void
+vips__reduce_mask_unref( VipsReduceMask *mask )
+{
+	g_mutex_lock( vips_reduce_mask_lock );
+
+	mask->ref_count -= 1;
+	if( mask->ref_count == 0 ) 
+		vips_reduce_mask_free( mask );
+
+	g_mutex_unlock( vips_reduce_mask_lock );
+}
+
 /* Called from iofuncs to init all operations in this dir. Use a plugin system
  * instead?
  */
@@ -158,6 +354,7 @@ vips_resample_operation_init( void )
 	extern GType vips_thumbnail_buffer_get_type( void ); 
 	extern GType vips_thumbnail_image_get_type( void ); 
 	extern GType vips_thumbnail_stream_get_type( void ); 
+	extern GType vips_multires_get_type( void ); 
 	extern GType vips_mapim_get_type( void ); 
 	extern GType vips_shrink_get_type( void ); 
 	extern GType vips_shrinkh_get_type( void ); 
@@ -165,6 +362,7 @@ vips_resample_operation_init( void )
 	extern GType vips_reduce_get_type( void ); 
 	extern GType vips_reduceh_get_type( void ); 
 	extern GType vips_reducev_get_type( void ); 
+	extern GType vips_enlarge_get_type( void ); 
 	extern GType vips_quadratic_get_type( void ); 
 	extern GType vips_affine_get_type( void ); 
 	extern GType vips_similarity_get_type( void ); 
@@ -175,6 +373,7 @@ vips_resample_operation_init( void )
 	vips_thumbnail_buffer_get_type(); 
 	vips_thumbnail_image_get_type(); 
 	vips_thumbnail_stream_get_type(); 
+	vips_multires_get_type(); 
 	vips_mapim_get_type(); 
 	vips_shrink_get_type(); 
 	vips_shrinkh_get_type(); 
@@ -182,6 +381,7 @@ vips_resample_operation_init( void )
 	vips_reduceh_get_type(); 
 	vips_reducev_get_type(); 
 	vips_reduce_get_type(); 
+	vips_enlarge_get_type(); 
 	vips_quadratic_get_type(); 
 	vips_affine_get_type(); 
 	vips_similarity_get_type(); 
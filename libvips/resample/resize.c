@@ -33,6 +33,10 @@
  * 	  affine nearest interpolator is always centre 
  * 7/7/19 [lovell]
  * 	- don't let either axis drop below 1px
+ * 19/10/19
+ * 	- use the fused vips_reduce() when we reduce on both axes
+ * 	- and the fused vips_shrink() when we shrink on both axes
+ * 	- upsize with vips_enlarge() rather than vips_affine()
  */
 
 /*
@@ -144,34 +148,13 @@ vips_resize_int_shrink( VipsResize *resize, double scale )
 	return( shrink );
 }
 
-/* Suggest a VipsInterpolate which corresponds to a VipsKernel. We use
- * this to pick a thing for affine().
- */
-static const char *
-vips_resize_interpolate( VipsKernel kernel )
-{
-	switch( kernel ) {
-	case VIPS_KERNEL_NEAREST:
-	     return( "nearest" ); 
-
-	case VIPS_KERNEL_LINEAR:
-	     return( "bilinear" ); 
-
-	/* Use cubic for everything else. There are other interpolators, like
-	 * nohalo, but they don't really correspond well to any kernel.
-	 */
-	default:
-	     return( "bicubic" ); 
-	}
-}
-
 static int
 vips_resize_build( VipsObject *object )
 {
 	VipsResample *resample = VIPS_RESAMPLE( object );
 	VipsResize *resize = (VipsResize *) object;
 
-	VipsImage **t = (VipsImage **) vips_object_local_array( object, 7 );
+	VipsImage **t = (VipsImage **) vips_object_local_array( object, 8 );
 
 	VipsImage *in;
 	double hscale;
@@ -197,7 +180,19 @@ vips_resize_build( VipsObject *object )
 	int_hshrink = vips_resize_int_shrink( resize, hscale );
 	int_vshrink = vips_resize_int_shrink( resize, vscale );
 
-	if( int_vshrink > 1 ) { 
+	/* Shrinking on both axes, we can do both in one pass.
+	 */
+	if( int_vshrink > 1 &&
+		int_hshrink > 1 ) { 
+		g_info( "shrink by %d x %d", int_hshrink, int_vshrink );
+		if( vips_shrink( in, &t[0], int_hshrink, int_vshrink, NULL ) )
+			return( -1 );
+		in = t[0];
+
+		hscale *= int_hshrink;
+		vscale *= int_vshrink;
+	}
+	else if( int_vshrink > 1 ) { 
 		g_info( "shrinkv by %d", int_vshrink );
 		if( vips_shrinkv( in, &t[0], int_vshrink, NULL ) )
 			return( -1 );
@@ -205,8 +200,7 @@ vips_resize_build( VipsObject *object )
 
 		vscale *= int_vshrink;
 	}
-
-	if( int_hshrink > 1 ) { 
+	else if( int_hshrink > 1 ) { 
 		g_info( "shrinkh by %d", int_hshrink );
 		if( vips_shrinkh( in, &t[1], int_hshrink, NULL ) )
 			return( -1 );
@@ -220,9 +214,20 @@ vips_resize_build( VipsObject *object )
 	hscale = VIPS_MAX( hscale, 1.0 / in->Xsize );
 	vscale = VIPS_MAX( vscale, 1.0 / in->Ysize );
 
-	/* Any residual downsizing.
+	/* Any residual downsizing. If we reduce on both axes, the fused
+	 * reduce saves an intermediate image.
 	 */
-	if( vscale < 1.0 ) { 
+	if( vscale < 1.0 &&
+		hscale < 1.0 ) { 
+		g_info( "residual reduce by %g x %g", hscale, vscale );
+		if( vips_reduce( in, &t[2], 1.0 / hscale, 1.0 / vscale, 
+			"kernel", resize->kernel, 
+			"centre", TRUE, 
+			NULL ) )  
+			return( -1 );
+		in = t[2];
+	}
+	else if( vscale < 1.0 ) { 
 		g_info( "residual reducev by %g", vscale );
 		if( vips_reducev( in, &t[2], 1.0 / vscale, 
 			"kernel", resize->kernel, 
@@ -231,8 +236,7 @@ vips_resize_build( VipsObject *object )
 			return( -1 );
 		in = t[2];
 	}
-
-	if( hscale < 1.0 ) { 
+	else if( hscale < 1.0 ) { 
 		g_info( "residual reduceh by %g", 
 			hscale );
 		if( vips_reduceh( in, &t[3], 1.0 / hscale, 
@@ -247,23 +251,6 @@ vips_resize_build( VipsObject *object )
 	 */
 	if( hscale > 1.0 ||
 		vscale > 1.0 ) { 
-		const char *nickname = 
-			vips_resize_interpolate( resize->kernel );
-
-		/* Input displacement. For centre sampling, shift by 0.5 down
-		 * and right. Except if this is nearest, which is always
-		 * centre.
-		 */
-		const double id = 
-			resize->kernel == VIPS_KERNEL_NEAREST ? 
-			0.0 : 0.5;
-
-		VipsInterpolate *interpolate;
-
-		if( !(interpolate = vips_interpolate_new( nickname )) )
-			return( -1 ); 
-		vips_object_local( object, interpolate );
-
 		if( resize->kernel == VIPS_KERNEL_NEAREST &&
 			hscale == VIPS_FLOOR( hscale ) &&
 			vscale == VIPS_FLOOR( vscale ) ) {
@@ -274,40 +261,41 @@ vips_resize_build( VipsObject *object )
 				return( -1 );
 			in = t[4];
 		}
-		else if( hscale > 1.0 &&
-			vscale > 1.0 ) { 
-			g_info( "residual scale %g x %g", hscale, vscale );
-			if( vips_affine( in, &t[4], 
-				hscale, 0.0, 0.0, vscale, 
-				"interpolate", interpolate, 
-				"idx", id, 
-				"idy", id, 
-				"extend", VIPS_EXTEND_COPY, 
-				NULL ) )  
-				return( -1 );
-			in = t[4];
-		}
-		else if( hscale > 1.0 ) { 
-			g_info( "residual scale %g", hscale );
-			if( vips_affine( in, &t[4], hscale, 0.0, 0.0, 1.0, 
-				"interpolate", interpolate, 
-				"idx", id, 
-				"idy", id, 
-				"extend", VIPS_EXTEND_COPY, 
-				NULL ) )  
-				return( -1 );
-			in = t[4];
-		}
-		else { 
-			g_info( "residual scale %g", vscale );
-			if( vips_affine( in, &t[4], 1.0, 0.0, 0.0, vscale, 
-				"interpolate", interpolate, 
-				"idx", id, 
-				"idy", id, 
-				"extend", VIPS_EXTEND_COPY, 
+		else {
+			/* If there's an alpha, we have to premultiply before 
+			 * resampling, as vips_affine() does. 
+			 */
+			gboolean have_premultiplied;
+			VipsBandFormat unpremultiplied_format;
+
+			have_premultiplied = FALSE;
+			if( vips_image_hasalpha( in ) ) { 
+				if( vips_premultiply( in, &t[5], NULL ) ) 
+					return( -1 );
+				have_premultiplied = TRUE;
+				unpremultiplied_format = in->BandFmt;
+				in = t[5];
+			}
+
+			g_info( "residual enlarge %g x %g", 
+				VIPS_MAX( 1.0, hscale ), 
+				VIPS_MAX( 1.0, vscale ) );
+			if( vips_enlarge( in, &t[4], 
+				VIPS_MAX( 1.0, hscale ), 
+				VIPS_MAX( 1.0, vscale ), 
+				"kernel", resize->kernel, 
 				NULL ) )  
 				return( -1 );
 			in = t[4];
+
+			if( have_premultiplied ) {
+				if( vips_unpremultiply( in, &t[6], NULL ) || 
+					vips_cast( t[6], &t[7], 
+						unpremultiplied_format, 
+						NULL ) )
+					return( -1 );
+				in = t[7];
+			}
 		}
 	}
 
@@ -422,10 +410,8 @@ vips_resize_init( VipsResize *resize )
  * vips_resize() normally uses #VIPS_KERNEL_LANCZOS3 for the final reduce, you
  * can change this with @kernel.
  *
- * When upsizing (@scale > 1), the operation uses vips_affine() with
- * a #VipsInterpolate selected depending on @kernel. It will use
- * #VipsInterpolateBicubic for #VIPS_KERNEL_CUBIC and above. It adds a
- * 0.5 pixel displacement to the input pixels to get centre convention scaling.
+ * When upsizing (@scale > 1), the operation uses vips_enlarge() with 
+ * @kernel. Upsizing is also done with centre convention. 
  *
  * vips_resize() normally maintains the image aspect ratio. If you set
  * @vscale, that factor is used for the vertical scale and @scale for the
@@ -438,7 +424,7 @@ vips_resize_init( VipsResize *resize )
  * This operation does not change xres or yres. The image resolution needs to
  * be updated by the application. 
  *
- * See also: vips_shrink(), vips_reduce().
+ * See also: vips_shrink(), vips_reduce(), vips_enlarge().
  *
  * Returns: 0 on success, -1 on error
  */
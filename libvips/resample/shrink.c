@@ -10,6 +10,8 @@
  * 9/2/17
  * 	- use reduce, not affine, for any residual shrink
  * 	- expand cache hint
+ * 19/10/19
+ * 	- fuse shrinkv and shrinkh when we shrink on both axes
  */
 
 /*
@@ -50,6 +52,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include <vips/vips.h>
@@ -64,48 +67,243 @@ typedef struct _VipsShrink {
 	double hshrink;		/* Shrink factors */
 	double vshrink;
 
+	/* The integer parts we box shrink by.
+	 */
+	int hshrink_int;
+	int vshrink_int;
+	size_t sizeof_line_buffer;
+
 } VipsShrink;
 
 typedef VipsResampleClass VipsShrinkClass;
 
 G_DEFINE_TYPE( VipsShrink, vips_shrink, VIPS_TYPE_RESAMPLE );
 
+/* Our per-sequence parameter struct. Somewhere to sum band elements, and a
+ * line of vertically shrunk pixels.
+ */
+typedef struct {
+	VipsRegion *ir;
+
+	VipsPel *sum;
+	VipsPel *line;
+} VipsShrinkSequence;
+
+static int
+vips_shrink_stop( void *vseq, void *a, void *b )
+{
+	VipsShrinkSequence *seq = (VipsShrinkSequence *) vseq;
+
+	VIPS_FREEF( g_object_unref, seq->ir );
+
+	return( 0 );
+}
+
+static void *
+vips_shrink_start( VipsImage *out, void *a, void *b )
+{
+	VipsImage *in = (VipsImage *) a;
+	VipsShrink *shrink = (VipsShrink *) b;
+	VipsShrinkSequence *seq;
+
+	if( !(seq = VIPS_NEW( out, VipsShrinkSequence )) )
+		return( NULL );
+
+	seq->ir = vips_region_new( in );
+	seq->sum = VIPS_ARRAY( out, shrink->sizeof_line_buffer, VipsPel );
+	seq->line = VIPS_ARRAY( out, VIPS_IMAGE_SIZEOF_LINE( in ), VipsPel );
+	if( !seq->ir ||
+		!seq->sum ||
+		!seq->line ) {
+		vips_shrink_stop( seq, NULL, NULL );
+		return( NULL );
+	}
+
+	return( (void *) seq );
+}
+
+/* Sum vshrink lines, average to a line of vertically shrunk pixels, then
+ * shrink that horizontally straight to the output. The arithmetic is the
+ * same as shrinkv then shrinkh, but we have no intermediate image and
+ * the line we shrink horizontally is always in cache.
+ */
+static int
+vips_shrink_gen( VipsRegion *or, void *vseq, 
+	void *a, void *b, gboolean *stop )
+{
+	VipsShrinkSequence *seq = (VipsShrinkSequence *) vseq;
+	VipsImage *in = (VipsImage *) a;
+	VipsShrink *shrink = (VipsShrink *) b;
+	VipsRegion *ir = seq->ir;
+	VipsRect *r = &or->valid;
+	const int bands = in->Bands * 
+		(vips_band_format_iscomplex( in->BandFmt ) ? 2 : 1);
+	const int sz = r->width * shrink->hshrink_int * bands;
+
+	int y, y1;
+
+#ifdef DEBUG
+	printf( "vips_shrink_gen: generating %d x %d at %d x %d\n",
+		r->width, r->height, r->left, r->top ); 
+#endif /*DEBUG*/
+
+	for( y = 0; y < r->height; y++ ) { 
+		/* The largest intermediate is double.
+		 */
+		memset( seq->sum, 0, sz * sizeof( double ) ); 
+
+		/* Request input a line at a time, as shrinkv does.
+		 */
+		for( y1 = 0; y1 < shrink->vshrink_int; y1++ ) { 
+			VipsRect s;
+
+			s.left = r->left * shrink->hshrink_int;
+			s.top = y1 + (y + r->top) * shrink->vshrink_int;
+			s.width = r->width * shrink->hshrink_int;
+			s.height = 1;
+			if( vips_region_prepare( ir, &s ) )
+				return( -1 );
+
+			VIPS_GATE_START( "vips_shrink_gen: work" ); 
+
+			vips__shrinkv_add_line( seq->sum, 
+				VIPS_REGION_ADDR( ir, s.left, s.top ), 
+				sz, in->BandFmt );
+
+			VIPS_GATE_STOP( "vips_shrink_gen: work" ); 
+		}
+
+		VIPS_GATE_START( "vips_shrink_gen: work" ); 
+
+		vips__shrinkv_write_line( seq->line, seq->sum, 
+			sz, shrink->vshrink_int, in->BandFmt );
+		vips__shrinkh_line( 
+			VIPS_REGION_ADDR( or, r->left, r->top + y ), 
+			seq->line, r->width, shrink->hshrink_int, 
+			in->BandFmt, bands );
+
+		VIPS_GATE_STOP( "vips_shrink_gen: work" ); 
+	}
+
+	VIPS_COUNT_PIXELS( or, "vips_shrink_gen" ); 
+
+	return( 0 );
+}
+
+/* Box shrink by the integer part of the factors.
+ */
+static int
+vips_shrink_box( VipsShrink *shrink, VipsImage *in, VipsImage **out )
+{
+	VipsObject *object = VIPS_OBJECT( shrink );
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS( object );
+	VipsImage **t = (VipsImage **) 
+		vips_object_local_array( object, 5 );
+
+	/* Nothing to fuse if we only shrink in one direction.
+	 */
+	if( shrink->hshrink_int == 1 ||
+		shrink->vshrink_int == 1 ) {
+		if( vips_shrinkv( in, &t[0], shrink->vshrink_int, NULL ) ||
+			vips_shrinkh( t[0], out, shrink->hshrink_int, NULL ) )
+			return( -1 );
+
+		return( 0 );
+	}
+
+	/* Unpack for processing.
+	 */
+	if( vips_image_decode( in, &t[1] ) )
+		return( -1 );
+	in = t[1];
+
+	/* Extend right and bottom, as shrinkh and shrinkv do.
+	 */
+	if( vips_embed( in, &t[2], 
+		0, 0, 
+		in->Xsize + shrink->hshrink_int, 
+		VIPS_ROUND_UP( in->Ysize, shrink->vshrink_int ), 
+		"extend", VIPS_EXTEND_COPY,
+		NULL ) )
+		return( -1 );
+	in = t[2];
+
+	shrink->sizeof_line_buffer = 
+		in->Xsize * in->Bands * 
+		vips_format_sizeof( VIPS_FORMAT_DPCOMPLEX );
+
+	t[3] = vips_image_new();
+	if( vips_image_pipelinev( t[3],
+		VIPS_DEMAND_STYLE_THINSTRIP, in, NULL ) )
+		return( -1 );
+
+	/* Size output, as shrinkh and shrinkv do.
+	 */
+	t[3]->Xsize = VIPS_ROUND_UINT( 
+		(double) t[1]->Xsize / shrink->hshrink_int );
+	t[3]->Ysize = VIPS_ROUND_UINT( 
+		(double) t[1]->Ysize / shrink->vshrink_int );
+	if( t[3]->Xsize <= 0 ||
+		t[3]->Ysize <= 0 ) {
+		vips_error( class->nickname, 
+			"%s", _( "image has shrunk to nothing" ) );
+		return( -1 );
+	}
+
+	if( vips_image_generate( t[3],
+		vips_shrink_start, vips_shrink_gen, vips_shrink_stop, 
+		in, shrink ) )
+		return( -1 );
+	in = t[3];
+
+	/* Large vshrinks will throw off sequential mode, see shrinkv.
+	 */
+	if( vips_image_is_sequential( in ) ) { 
+		g_info( "shrink sequential line cache" ); 
+
+		if( vips_sequential( in, &t[4], 
+			"tile_height", 10,
+			NULL ) )
+			return( -1 );
+		in = t[4];
+	}
+
+	*out = in;
+	g_object_ref( *out );
+
+	return( 0 );
+}
+
 static int
 vips_shrink_build( VipsObject *object )
 {
 	VipsResample *resample = VIPS_RESAMPLE( object );
 	VipsShrink *shrink = (VipsShrink *) object;
 	VipsImage **t = (VipsImage **) 
-		vips_object_local_array( object, 3 );
-
-	int hshrink_int;
-	int vshrink_int;
+		vips_object_local_array( object, 2 );
 
 	if( VIPS_OBJECT_CLASS( vips_shrink_parent_class )->build( object ) )
 		return( -1 );
 
-	hshrink_int = (int) shrink->hshrink;
-	vshrink_int = (int) shrink->vshrink;
+	shrink->hshrink_int = (int) shrink->hshrink;
+	shrink->vshrink_int = (int) shrink->vshrink;
 
-	if( hshrink_int != shrink->hshrink || 
-		vshrink_int != shrink->vshrink ) {
-		/* Shrink by int factors, reduce to final size.
-		 */
-		double xresidual = shrink->hshrink / hshrink_int; 
-		double yresidual = shrink->vshrink / vshrink_int;
+	if( vips_shrink_box( shrink, resample->in, &t[0] ) )
+		return( -1 );
 
-		if( vips_shrinkv( resample->in, &t[0], vshrink_int, NULL ) ||
-			vips_shrinkh( t[0], &t[1], hshrink_int, NULL ) )
-			return( -1 ); 
+	if( shrink->hshrink_int != shrink->hshrink || 
+		shrink->vshrink_int != shrink->vshrink ) {
+		/* Reduce to final size.
+		 */
+		double xresidual = shrink->hshrink / shrink->hshrink_int; 
+		double yresidual = shrink->vshrink / shrink->vshrink_int;
 
-		if( vips_reduce( t[1], &t[2], xresidual, yresidual, NULL ) ||
-			vips_image_write( t[2], resample->out ) )
+		if( vips_reduce( t[0], &t[1], xresidual, yresidual, NULL ) ||
+			vips_image_write( t[1], resample->out ) )
 			return( -1 );
 	}
 	else {
-		if( vips_shrinkv( resample->in, &t[0], shrink->vshrink, NULL ) ||
-			vips_shrinkh( t[0], &t[1], shrink->hshrink, NULL ) ||
-			vips_image_write( t[1], resample->out ) )
+		if( vips_image_write( t[0], resample->out ) )
 			return( -1 );
 	}
 
@@ -183,6 +381,9 @@ vips_shrink_init( VipsShrink *shrink )
  * filter, then use vips_reduce() to shrink by the
  * remaining fractional part. 
  *
+ * The box shrink gives the same result as vips_shrinkv() followed by
+ * vips_shrinkh(), but is done in a single pass. 
+ *
  * This is a very low-level operation: see vips_resize() for a more
  * convenient way to resize images. 
  *
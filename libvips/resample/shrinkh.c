@@ -8,6 +8,10 @@
  * 	- rename xshrink -> hshrink for greater consistency 
  * 6/8/19
  * 	- use a double sum buffer for int32 types
+ * 19/10/19
+ * 	- add fixed-factor paths for shrinks of 2, 4 and 8 of 1 - 4 band uchar
+ * 	  and ushort
+ * 	- split out vips__shrinkh_line() for shrink.c
  */
 
 /*
@@ -83,9 +87,8 @@ G_DEFINE_TYPE( VipsShrinkh, vips_shrinkh, VIPS_TYPE_RESAMPLE );
 			\
 			sum = 0; \
 			x1 = b; \
-			VIPS_UNROLL( shrink->hshrink, INNER( BANDS ) ); \
-			q[b] = (sum + shrink->hshrink / 2) / \
-				shrink->hshrink; \
+			VIPS_UNROLL( hshrink, INNER( BANDS ) ); \
+			q[b] = (sum + hshrink / 2) / hshrink; \
 		} \
 		p += ne; \
 		q += BANDS; \
@@ -104,55 +107,89 @@ G_DEFINE_TYPE( VipsShrinkh, vips_shrinkh, VIPS_TYPE_RESAMPLE );
 			\
 			sum = 0.0; \
 			x1 = b; \
-			VIPS_UNROLL( shrink->hshrink, INNER( bands ) ); \
-			q[b] = sum / shrink->hshrink; \
+			VIPS_UNROLL( hshrink, INNER( bands ) ); \
+			q[b] = sum / hshrink; \
 		} \
 		p += ne; \
 		q += bands; \
 	} \
 } 
 
-/* Generate an area of @or. @ir is large enough.
+/* Integer shrink by a fixed factor. The compiler can unroll and vectorise
+ * the inner loop, and divide with a shift. 
  */
-static void
-vips_shrinkh_gen2( VipsShrinkh *shrink, VipsRegion *or, VipsRegion *ir,
-	int left, int top, int width )
+#define ISHRINK_FIXED( ACC_TYPE, TYPE, BANDS, FACTOR ) { \
+	TYPE * restrict p = (TYPE *) in; \
+	TYPE * restrict q = (TYPE *) out; \
+	\
+	for( x = 0; x < width; x++ ) { \
+		for( b = 0; b < BANDS; b++ ) { \
+			ACC_TYPE sum; \
+			\
+			sum = 0; \
+			for( x1 = b; x1 < FACTOR * BANDS; x1 += BANDS ) \
+				sum += p[x1]; \
+			q[b] = (sum + FACTOR / 2) / FACTOR; \
+		} \
+		p += FACTOR * BANDS; \
+		q += BANDS; \
+	} \
+}
+
+/* Pick a fixed-factor path for the common shrinks.
+ */
+#define ISHRINK_FACTOR( ACC_TYPE, TYPE, BANDS ) { \
+	switch( hshrink ) { \
+	case 2: \
+		ISHRINK_FIXED( ACC_TYPE, TYPE, BANDS, 2 ); break; \
+	case 4: \
+		ISHRINK_FIXED( ACC_TYPE, TYPE, BANDS, 4 ); break; \
+	case 8: \
+		ISHRINK_FIXED( ACC_TYPE, TYPE, BANDS, 8 ); break; \
+	default: \
+		ISHRINK( ACC_TYPE, TYPE, BANDS ); break; \
+	} \
+}
+
+/* Generate a special path for 1 - 4 band data. The compiler will be able to
+ * vectorise these.
+ */
+#define ISHRINK_BANDS( ACC_TYPE, TYPE ) { \
+	switch( bands ) { \
+	case 1: \
+		ISHRINK_FACTOR( ACC_TYPE, TYPE, 1 ); break; \
+	case 2: \
+		ISHRINK_FACTOR( ACC_TYPE, TYPE, 2 ); break; \
+	case 3: \
+		ISHRINK_FACTOR( ACC_TYPE, TYPE, 3 ); break; \
+	case 4: \
+		ISHRINK_FACTOR( ACC_TYPE, TYPE, 4 ); break; \
+	default: \
+		ISHRINK( ACC_TYPE, TYPE, bands ); break; \
+	} \
+}
+
+/* Shrink @width pixels of @out from @in. @bands is doubled for complex. 
+ */
+void
+vips__shrinkh_line( VipsPel *out, VipsPel *in, int width, 
+	int hshrink, VipsBandFormat format, int bands )
 {
-	VipsResample *resample = VIPS_RESAMPLE( shrink );
-	const int bands = resample->in->Bands * 
-		(vips_band_format_iscomplex( resample->in->BandFmt ) ? 
-		 	2 : 1);
-	const int ne = shrink->hshrink * bands; 
-	VipsPel *out = VIPS_REGION_ADDR( or, left, top ); 
-	VipsPel *in = VIPS_REGION_ADDR( ir, left * shrink->hshrink, top ); 
+	const int ne = hshrink * bands; 
 
 	int x;
 	int x1, b;
 
-	switch( resample->in->BandFmt ) {
+	switch( format ) {
+	/* Vectorisation doesn't help much for signed, 32-bit or float data,
+	 * don't bother with them.
+	 */
 	case VIPS_FORMAT_UCHAR: 	
-		/* Generate a special path for 1, 3 and 4 band uchar data. The
-		 * compiler will be able to vectorise these.
-		 *
-		 * Vectorisation doesn't help much for 16, 32-bit or float
-		 * data, don't bother with them.
-		 */
-		switch( bands ) {
-		case 1:
-			ISHRINK( int, unsigned char, 1 ); break;
-		case 3:
-			ISHRINK( int, unsigned char, 3 ); break;
-		case 4:
-			ISHRINK( int, unsigned char, 4 ); break;
-		default:
-			ISHRINK( int, unsigned char, bands ); break;
-		}
-		break;
-
+		ISHRINK_BANDS( int, unsigned char ); break;
 	case VIPS_FORMAT_CHAR: 	
 		ISHRINK( int, char, bands ); break; 
 	case VIPS_FORMAT_USHORT: 
-		ISHRINK( int, unsigned short, bands ); break;
+		ISHRINK_BANDS( int, unsigned short ); break;
 	case VIPS_FORMAT_SHORT: 	
 		ISHRINK( int, short, bands ); break; 
 	case VIPS_FORMAT_UINT: 	
@@ -177,9 +214,12 @@ static int
 vips_shrinkh_gen( VipsRegion *or, void *seq, 
 	void *a, void *b, gboolean *stop )
 {
+	VipsImage *in = (VipsImage *) a;
 	VipsShrinkh *shrink = (VipsShrinkh *) b;
 	VipsRegion *ir = (VipsRegion *) seq;
 	VipsRect *r = &or->valid;
+	const int bands = in->Bands * 
+		(vips_band_format_iscomplex( in->BandFmt ) ? 2 : 1);
 
 	int y;
 
@@ -216,8 +256,11 @@ vips_shrinkh_gen( VipsRegion *or, void *seq,
 
 		VIPS_GATE_START( "vips_shrinkh_gen: work" ); 
 
-		vips_shrinkh_gen2( shrink, or, ir, 
-			r->left, r->top + y, r->width );
+		vips__shrinkh_line( 
+			VIPS_REGION_ADDR( or, r->left, r->top + y ), 
+			VIPS_REGION_ADDR( ir, s.left, s.top ), 
+			r->width, shrink->hshrink, 
+			in->BandFmt, bands );
 
 		VIPS_GATE_STOP( "vips_shrinkh_gen: work" ); 
 	}
@@ -47,6 +47,11 @@
  * 	- add a seq line cache
  * 6/8/19
  * 	- use a double sum buffer for int32 types
+ * 19/10/19
+ * 	- add fixed-factor averages for shrinks of 2, 4 and 8 of uchar and 
+ * 	  ushort
+ * 	- split out vips__shrinkv_add_line() and vips__shrinkv_write_line()
+ * 	  for shrink.c
  */
 
 /*
@@ -150,29 +155,22 @@ vips_shrinkv_start( VipsImage *out, void *a, void *b )
 }
 
 #define ADD( ACC_TYPE, TYPE ) { \
-	ACC_TYPE * restrict sum = (ACC_TYPE *) seq->sum; \
+	ACC_TYPE * restrict sum = (ACC_TYPE *) psum; \
 	TYPE * restrict p = (TYPE *) in; \
 	\
 	for( x = 0; x < sz; x++ ) \
 		sum[x] += p[x]; \
 } 
 
-/* Add a line of pixels to sum. 
+/* Add @sz band elements from @in to @psum. 
  */
-static void
-vips_shrinkv_add_line( VipsShrinkv *shrink, VipsShrinkvSequence *seq,
-	VipsRegion *ir, int left, int top, int width )
+void
+vips__shrinkv_add_line( VipsPel *psum, VipsPel *in, int sz, 
+	VipsBandFormat format )
 {
-	VipsResample *resample = VIPS_RESAMPLE( shrink );
-	const int bands = resample->in->Bands * 
-		(vips_band_format_iscomplex( resample->in->BandFmt ) ? 
-		 	2 : 1);
-	const int sz = bands * width; 
-
 	int x;
 
-	VipsPel *in = VIPS_REGION_ADDR( ir, left, top ); 
-	switch( resample->in->BandFmt ) {
+	switch( format ) {
 	case VIPS_FORMAT_UCHAR: 	
 		ADD( int, unsigned char ); break;
 	case VIPS_FORMAT_CHAR: 	
@@ -202,45 +200,62 @@ vips_shrinkv_add_line( VipsShrinkv *shrink, VipsShrinkvSequence *seq,
 /* Integer average. 
  */
 #define IAVG( ACC_TYPE, TYPE ) { \
-	ACC_TYPE * restrict sum = (ACC_TYPE *) seq->sum; \
+	ACC_TYPE * restrict sum = (ACC_TYPE *) psum; \
 	TYPE * restrict q = (TYPE *) out; \
 	\
 	for( x = 0; x < sz; x++ ) \
-		q[x] = (sum[x] + shrink->vshrink / 2) / shrink->vshrink; \
+		q[x] = (sum[x] + vshrink / 2) / vshrink; \
 } 
 
+/* Integer average by a fixed factor, so the compiler can divide with a 
+ * shift and vectorise.
+ */
+#define IAVG_FIXED( ACC_TYPE, TYPE, FACTOR ) { \
+	ACC_TYPE * restrict sum = (ACC_TYPE *) psum; \
+	TYPE * restrict q = (TYPE *) out; \
+	\
+	for( x = 0; x < sz; x++ ) \
+		q[x] = (sum[x] + FACTOR / 2) / FACTOR; \
+} 
+
+#define IAVG_FACTOR( ACC_TYPE, TYPE ) { \
+	switch( vshrink ) { \
+	case 2: \
+		IAVG_FIXED( ACC_TYPE, TYPE, 2 ); break; \
+	case 4: \
+		IAVG_FIXED( ACC_TYPE, TYPE, 4 ); break; \
+	case 8: \
+		IAVG_FIXED( ACC_TYPE, TYPE, 8 ); break; \
+	default: \
+		IAVG( ACC_TYPE, TYPE ); break; \
+	} \
+}
+
 /* Float average. 
  */
 #define FAVG( TYPE ) { \
-	double * restrict sum = (double *) seq->sum; \
+	double * restrict sum = (double *) psum; \
 	TYPE * restrict q = (TYPE *) out; \
 	\
 	for( x = 0; x < sz; x++ ) \
-		q[x] = sum[x] / shrink->vshrink; \
+		q[x] = sum[x] / vshrink; \
 } 
 
-/* Average the line of sums to out. 
+/* Average @sz band elements of sums in @psum to @out. 
  */
-static void
-vips_shrinkv_write_line( VipsShrinkv *shrink, VipsShrinkvSequence *seq,
-	VipsRegion *or, int left, int top, int width )
+void
+vips__shrinkv_write_line( VipsPel *out, VipsPel *psum, int sz, 
+	int vshrink, VipsBandFormat format )
 {
-	VipsResample *resample = VIPS_RESAMPLE( shrink );
-	const int bands = resample->in->Bands * 
-		(vips_band_format_iscomplex( resample->in->BandFmt ) ? 
-		 	2 : 1);
-	const int sz = bands * width; 
-
 	int x;
 
-	VipsPel *out = VIPS_REGION_ADDR( or, left, top ); 
-	switch( resample->in->BandFmt ) {
+	switch( format ) {
 	case VIPS_FORMAT_UCHAR:
-		IAVG( int, unsigned char ); break;
+		IAVG_FACTOR( int, unsigned char ); break;
 	case VIPS_FORMAT_CHAR:
 		IAVG( int, char ); break; 
 	case VIPS_FORMAT_USHORT:
-		IAVG( int, unsigned short ); break;
+		IAVG_FACTOR( int, unsigned short ); break;
 	case VIPS_FORMAT_SHORT: 	
 		IAVG( int, short ); break; 
 	case VIPS_FORMAT_UINT: 	
@@ -266,9 +281,12 @@ vips_shrinkv_gen( VipsRegion *or, void *vseq,
 	void *a, void *b, gboolean *stop )
 {
 	VipsShrinkvSequence *seq = (VipsShrinkvSequence *) vseq;
+	VipsImage *in = (VipsImage *) a;
 	VipsShrinkv *shrink = (VipsShrinkv *) b;
 	VipsRegion *ir = seq->ir;
 	VipsRect *r = &or->valid;
+	const int sz = r->width * in->Bands * 
+		(vips_band_format_iscomplex( in->BandFmt ) ? 2 : 1);
 
 	int y, y1;
 
@@ -301,16 +319,18 @@ vips_shrinkv_gen( VipsRegion *or, void *vseq,
 
 			VIPS_GATE_START( "vips_shrinkv_gen: work" ); 
 
-			vips_shrinkv_add_line( shrink, seq, ir, 
-				s.left, s.top, s.width );
+			vips__shrinkv_add_line( seq->sum, 
+				VIPS_REGION_ADDR( ir, s.left, s.top ), 
+				sz, in->BandFmt );
 
 			VIPS_GATE_STOP( "vips_shrinkv_gen: work" ); 
 		}
 
 		VIPS_GATE_START( "vips_shrinkv_gen: work" ); 
 
-		vips_shrinkv_write_line( shrink, seq, or, 
-			r->left, r->top + y, r->width );  
+		vips__shrinkv_write_line( 
+			VIPS_REGION_ADDR( or, r->left, r->top + y ), 
+			seq->sum, sz, shrink->vshrink, in->BandFmt );
 
 		VIPS_GATE_STOP( "vips_shrinkv_gen: work" ); 
 	}
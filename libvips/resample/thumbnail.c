@@ -28,6 +28,10 @@
  * 	- smarter heif thumbnail selection
  * 12/10/19
  * 	- add thumbnail_stream
+ * 19/10/19
+ * 	- implement shrink-on-load for png
+ * 	- for uchar sRGB images, let vips_reduce() do linear light and
+ * 	  premultiply as it reduces, rather than running a float pipeline
  */
 
 /*
@@ -91,6 +95,12 @@
  */
 #define MAX_LEVELS (256)
 
+/* Above this shrink we don't ask vips_reduce() to do linear light and
+ * premultiply for us, since the input regions it needs get too large. We
+ * go via vips_resize() instead, which will block shrink first.
+ */
+#define MAX_REDUCE_CONVERT_SHRINK (8.0)
+
 typedef struct _VipsThumbnail {
 	VipsOperation parent_instance;
 
@@ -114,6 +124,7 @@ typedef struct _VipsThumbnail {
 	int input_width;
 	int input_height;
 	int page_height;
+	gboolean input_has_alpha;
 	VipsAngle angle; 		/* From vips_autorot_get_angle() */
 	int n_pages;			/* Pages in file */
 	int n_loaded_pages;		/* Pages we've loaded from file */
@@ -196,6 +207,7 @@ vips_thumbnail_read_header( VipsThumbnail *thumbnail, VipsImage *image )
 {
 	thumbnail->input_width = image->Xsize;
 	thumbnail->input_height = image->Ysize;
+	thumbnail->input_has_alpha = vips_image_hasalpha( image );
 	thumbnail->angle = vips_autorot_get_angle( image );
 	thumbnail->page_height = vips_image_get_page_height( image );
 	thumbnail->n_pages = vips_image_get_n_pages( image );
@@ -477,7 +489,13 @@ vips_thumbnail_open( VipsThumbnail *thumbnail )
 
 	factor = 1.0;
 
-	if( vips_isprefix( "VipsForeignLoadJpeg", thumbnail->loader ) ) 
+	/* png shrink-on-load is a box filter in sRGB, so it has the same
+	 * limits as jpeg. It also runs before we premultiply, so we can't 
+	 * use it for images with alpha.
+	 */
+	if( vips_isprefix( "VipsForeignLoadJpeg", thumbnail->loader ) ||
+		(vips_isprefix( "VipsForeignLoadPng", thumbnail->loader ) &&
+		 !thumbnail->input_has_alpha) ) 
 		factor = vips_thumbnail_find_jpegshrink( thumbnail, 
 			thumbnail->input_width, thumbnail->input_height );
 	else if( vips_isprefix( "VipsForeignLoadTiff", thumbnail->loader ) ||
@@ -521,8 +539,8 @@ vips_thumbnail_build( VipsObject *object )
 {
 	VipsThumbnail *thumbnail = VIPS_THUMBNAIL( object );
 	VipsImage **t = (VipsImage **) vips_object_local_array( object, 14 );
-	VipsInterpretation interpretation = thumbnail->linear ?
-		VIPS_INTERPRETATION_scRGB : VIPS_INTERPRETATION_sRGB; 
+
+	VipsInterpretation interpretation;
 
 	VipsImage *in;
 	int preshrunk_page_height;
@@ -540,6 +558,11 @@ vips_thumbnail_build( VipsObject *object )
 	gboolean have_premultiplied;
 	VipsBandFormat unpremultiplied_format;
 
+	/* TRUE if vips_reduce() will go to linear light and premultiply for
+	 * us.
+	 */
+	gboolean reduce_convert;
+
 #ifdef DEBUG
 	printf( "vips_thumbnail_build: " );
 	vips_object_print_name( object );
@@ -583,6 +606,44 @@ vips_thumbnail_build( VipsObject *object )
 		in = t[12];
 	}
 
+	/* Shrink to preshrunk_page_height, so we work for multi-page images.
+	 */
+	vips_thumbnail_calculate_shrink( thumbnail, 
+		in->Xsize, preshrunk_page_height, &hshrink, &vshrink );
+
+	/* In toilet-roll mode, we must adjust vshrink so that we exactly hit
+	 * page_height or we'll have pixels straddling page boundaries.
+	 */
+	if( in->Ysize > preshrunk_page_height ) {
+		int target_page_height = VIPS_RINT( 
+			preshrunk_page_height / vshrink );
+		int target_image_height = target_page_height * 
+			thumbnail->n_loaded_pages;
+
+		vshrink = (double) in->Ysize / target_image_height;
+	}
+
+	/* For 8-bit sRGB and mono images, vips_reduce() can go to linear 
+	 * light and premultiply as it reads pixels, which is much faster 
+	 * than a float pipeline. We can't use it if we'll need an ICC 
+	 * import, or if we're upsizing.
+	 */
+	reduce_convert = 
+		(thumbnail->linear || vips_image_hasalpha( in )) &&
+		in->Coding == VIPS_CODING_NONE &&
+		in->BandFmt == VIPS_FORMAT_UCHAR &&
+		(in->Type == VIPS_INTERPRETATION_sRGB ||
+		 in->Type == VIPS_INTERPRETATION_B_W) &&
+		!(thumbnail->linear &&
+		  (vips_image_get_typeof( in, VIPS_META_ICC_NAME ) || 
+		   thumbnail->import_profile)) &&
+		hshrink >= 1.0 &&
+		vshrink >= 1.0 &&
+		hshrink <= MAX_REDUCE_CONVERT_SHRINK &&
+		vshrink <= MAX_REDUCE_CONVERT_SHRINK;
+	interpretation = thumbnail->linear && !reduce_convert ?
+		VIPS_INTERPRETATION_scRGB : VIPS_INTERPRETATION_sRGB; 
+
 	/* In linear mode, we import right at the start. 
 	 *
 	 * We also have to import the whole image if it's CMYK, since
@@ -595,6 +656,7 @@ vips_thumbnail_build( VipsObject *object )
 	 */
 	have_imported = FALSE;
 	if( thumbnail->linear &&
+		!reduce_convert &&
 		in->Coding == VIPS_CODING_NONE &&
 		(in->BandFmt == VIPS_FORMAT_UCHAR ||
 		 in->BandFmt == VIPS_FORMAT_USHORT) &&
@@ -636,7 +698,8 @@ vips_thumbnail_build( VipsObject *object )
 	 * https://github.com/libvips/libvips/issues/291
 	 */
 	have_premultiplied = FALSE;
-	if( vips_image_hasalpha( in ) ) { 
+	if( !reduce_convert &&
+		vips_image_hasalpha( in ) ) { 
 		g_info( "premultiplying alpha" ); 
 		if( vips_premultiply( in, &t[3], NULL ) ) 
 			return( -1 );
@@ -650,27 +713,22 @@ vips_thumbnail_build( VipsObject *object )
 		in = t[3];
 	}
 
-	/* Shrink to preshrunk_page_height, so we work for multi-page images.
-	 */
-	vips_thumbnail_calculate_shrink( thumbnail, 
-		in->Xsize, preshrunk_page_height, &hshrink, &vshrink );
-
-	/* In toilet-roll mode, we must adjust vshrink so that we exactly hit
-	 * page_height or we'll have pixels straddling page boundaries.
-	 */
-	if( in->Ysize > preshrunk_page_height ) {
-		int target_page_height = VIPS_RINT( 
-			preshrunk_page_height / vshrink );
-		int target_image_height = target_page_height * 
-			thumbnail->n_loaded_pages;
-
-		vshrink = (double) in->Ysize / target_image_height;
+	if( reduce_convert ) {
+		g_info( "reducing in %s with premultiply",
+			thumbnail->linear ? "linear light" : "sRGB" ); 
+		if( vips_reduce( in, &t[4], hshrink, vshrink, 
+			"centre", TRUE, 
+			"linear", thumbnail->linear,
+			"premultiply", TRUE,
+			NULL ) ) 
+			return( -1 );
+	}
+	else {
+		if( vips_resize( in, &t[4], 1.0 / hshrink, 
+			"vscale", 1.0 / vshrink, 
+			NULL ) ) 
+			return( -1 );
 	}
-
-	if( vips_resize( in, &t[4], 1.0 / hshrink, 
-		"vscale", 1.0 / vshrink, 
-		NULL ) ) 
-		return( -1 );
 	in = t[4];
 
 	if( vips_copy( in, &t[13], NULL ) )
@@ -929,7 +987,8 @@ vips_thumbnail_file_open( VipsThumbnail *thumbnail, double factor )
 {
 	VipsThumbnailFile *file = (VipsThumbnailFile *) thumbnail;
 
-	if( vips_isprefix( "VipsForeignLoadJpeg", thumbnail->loader ) ) {
+	if( vips_isprefix( "VipsForeignLoadJpeg", thumbnail->loader ) ||
+		vips_isprefix( "VipsForeignLoadPng", thumbnail->loader ) ) {
 		return( vips_image_new_from_file( file->filename, 
 			"access", VIPS_ACCESS_SEQUENTIAL,
 			"shrink", (int) factor,
@@ -1121,7 +1180,8 @@ vips_thumbnail_buffer_open( VipsThumbnail *thumbnail, double factor )
 {
 	VipsThumbnailBuffer *buffer = (VipsThumbnailBuffer *) thumbnail;
 
-	if( vips_isprefix( "VipsForeignLoadJpeg", thumbnail->loader ) ) {
+	if( vips_isprefix( "VipsForeignLoadJpeg", thumbnail->loader ) ||
+		vips_isprefix( "VipsForeignLoadPng", thumbnail->loader ) ) {
 		return( vips_image_new_from_buffer( 
 			buffer->buf->data, buffer->buf->length, 
 			buffer->option_string,
@@ -1297,7 +1357,8 @@ vips_thumbnail_stream_open( VipsThumbnail *thumbnail, double factor )
 {
 	VipsThumbnailStream *stream = (VipsThumbnailStream *) thumbnail;
 
-	if( vips_isprefix( "VipsForeignLoadJpeg", thumbnail->loader ) ) {
+	if( vips_isprefix( "VipsForeignLoadJpeg", thumbnail->loader ) ||
+		vips_isprefix( "VipsForeignLoadPng", thumbnail->loader ) ) {
 		return( vips_image_new_from_stream( 
 			stream->streami, 
 			stream->option_string,
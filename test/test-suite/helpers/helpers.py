@@ -22,6 +22,7 @@ FITS_FILE = os.path.join(IMAGES, "WFPC2u5780205r_c0fx.fits")
 OPENSLIDE_FILE = os.path.join(IMAGES, "CMU-1-Small-Region.svs")
 PDF_FILE = os.path.join(IMAGES, "ISO_12233-reschart.pdf")
 CMYK_PDF_FILE = os.path.join(IMAGES, "cmyktest.pdf")
+MULTIPAGE_PDF_FILE = os.path.join(IMAGES, "multipage.pdf")
 SVG_FILE = os.path.join(IMAGES, "logo.svg")
 SVGZ_FILE = os.path.join(IMAGES, "logo.svgz")
 SVG_GZ_FILE = os.path.join(IMAGES, "logo.svg.gz")
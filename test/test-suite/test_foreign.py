@@ -3,7 +3,9 @@
 import sys
 import os
 import shutil
+import struct
 import tempfile
+import zipfile
 import pytest
 
 import pyvips
@@ -11,7 +13,7 @@ from helpers import \
     JPEG_FILE, SRGB_FILE, MATLAB_FILE, PNG_FILE, TIF_FILE, OME_FILE, \
     ANALYZE_FILE, GIF_FILE, WEBP_FILE, EXR_FILE, FITS_FILE, OPENSLIDE_FILE, \
     PDF_FILE, SVG_FILE, SVGZ_FILE, SVG_GZ_FILE, GIF_ANIM_FILE, DICOM_FILE, \
-    BMP_FILE, NIFTI_FILE, ICO_FILE, HEIC_FILE, \
+    BMP_FILE, NIFTI_FILE, ICO_FILE, HEIC_FILE, MULTIPAGE_PDF_FILE, \
     temp_filename, assert_almost_equal_objects, have, skip_if_no
 
 
@@ -120,6 +122,23 @@ class TestForeign:
 
         x = None
 
+        # tiled and compressed files, with partial edge tiles
+        self.save_load_file(".v", "[tile]", self.colour, 0)
+        self.save_load_file(".v", "[compression=deflate]", self.colour, 0)
+        self.save_load_file(".v", "[tile,tile_width=100,tile_height=60]",
+                            self.mono, 0)
+
+        # metadata and random access should work for tiled files too
+        filename = temp_filename(self.tempdir, ".v")
+        self.colour.write_to_file(filename, compression="deflate")
+        x = pyvips.Image.new_from_file(filename)
+        assert len(x.get("exif-data")) == len(before_exif)
+        a = x.crop(200, 300, 50, 50)
+        b = self.colour.crop(200, 300, 50, 50)
+        assert (a - b).abs().max() == 0
+
+        x = None
+
     @skip_if_no("jpegload")
     def test_jpeg(self):
         def jpeg_valid(im):
@@ -234,6 +253,16 @@ class TestForeign:
             # format area at the end
             assert y.startswith("hello world")
 
+        # scans stops progressive decode early, but the size is unchanged
+        filename = temp_filename(self.tempdir, '.jpg')
+        self.colour.write_to_file(filename, interlace=True)
+        full = pyvips.Image.new_from_file(filename)
+        preview = pyvips.Image.new_from_file(filename, scans=1)
+        assert preview.width == full.width
+        assert preview.height == full.height
+        assert abs(preview.avg() - full.avg()) < 5
+        assert (preview - full).abs().max() > 0
+
     @skip_if_no("pngload")
     def test_png(self):
         def png_valid(im):
@@ -250,6 +279,29 @@ class TestForeign:
         self.save_load("%s.png", self.colour)
         self.save_load_file(".png", "[interlace]", self.colour, 0)
         self.save_load_file(".png", "[interlace]", self.mono, 0)
+        self.save_load_file(".png", "[parallel]", self.colour, 0)
+        self.save_load_file(".png", "[parallel]", self.mono, 0)
+
+        # after one pass, each 8x8 block is a copy of its top-left pixel
+        filename = temp_filename(self.tempdir, '.png')
+        self.colour.write_to_file(filename, interlace=True)
+        full = pyvips.Image.new_from_file(filename)
+        preview = pyvips.Image.new_from_file(filename, passes=1)
+        assert preview.width == full.width
+        assert preview.height == full.height
+        assert_almost_equal_objects(preview(0, 0), full(0, 0))
+        assert_almost_equal_objects(preview(7, 7), full(0, 0))
+        assert_almost_equal_objects(preview(8, 8), full(8, 8))
+
+        # shrink-on-load rounds down, and should match a box shrink
+        for filename in [PNG_FILE, filename]:
+            full = pyvips.Image.new_from_file(filename)
+            im = pyvips.Image.new_from_file(filename, shrink=4)
+            assert im.width == full.width // 4
+            assert im.height == full.height // 4
+            assert abs(im.avg() - full.avg()) < full.avg() / 100
+            box = full.crop(0, 0, im.width * 4, im.height * 4).shrink(4, 4)
+            assert (im - box).abs().max() <= 1
 
     @skip_if_no("tiffload")
     def test_tiff(self):
@@ -287,6 +339,69 @@ class TestForeign:
         self.save_load_file(".tif",
                             "[tile,tile-width=256]", self.colour, 10)
 
+        # uncompressed strip images are mapped directly, so random access
+        # should work and match the original pixels
+        filename = temp_filename(self.tempdir, '.tif')
+        self.colour.write_to_file(filename, compression="none")
+        x = pyvips.Image.new_from_file(filename, access="random")
+        assert (x - self.colour).abs().max() == 0
+        assert (x.flip("vertical") -
+                self.colour.flip("vertical")).abs().max() == 0
+        a = x.crop(10, 20, 30, 40)
+        b = self.colour.crop(10, 20, 30, 40)
+        assert (a - b).abs().max() == 0
+
+        # mapped images must have the same header as ones read by libtiff
+        for fmt in ["ushort", "float"]:
+            im = (self.colour * 100).cast(fmt)
+            filename = temp_filename(self.tempdir, '.tif')
+            im.write_to_file(filename, compression="none")
+            x = pyvips.Image.new_from_file(filename, access="random")
+            filename = temp_filename(self.tempdir, '.tif')
+            im.write_to_file(filename, compression="lzw")
+            y = pyvips.Image.new_from_file(filename)
+            assert x.format == fmt
+            assert x.bands == im.bands
+            assert x.interpretation == y.interpretation
+            assert abs(x.xres - y.xres) < 0.01
+            assert abs(x.yres - y.yres) < 0.01
+            assert (x - im).abs().max() == 0
+
+        # a big-endian, 16-bit, uncompressed strip image
+        width = 16
+        height = 8
+        offset = 8
+        pixels = [x * 1000 + y * 100
+                  for y in range(height) for x in range(width)]
+        # tags must be in order, shorts are left-justified in the value
+        entries = [
+            struct.pack(">HHIHH", 256, 3, 1, width, 0),
+            struct.pack(">HHIHH", 257, 3, 1, height, 0),
+            struct.pack(">HHIHH", 258, 3, 1, 16, 0),
+            struct.pack(">HHIHH", 259, 3, 1, 1, 0),
+            struct.pack(">HHIHH", 262, 3, 1, 1, 0),
+            struct.pack(">HHII", 273, 4, 1, offset),
+            struct.pack(">HHIHH", 277, 3, 1, 1, 0),
+            struct.pack(">HHIHH", 278, 3, 1, height, 0),
+            struct.pack(">HHII", 279, 4, 1, width * height * 2),
+        ]
+        data = struct.pack(">%dH" % len(pixels), *pixels)
+        filename = temp_filename(self.tempdir, '.tif')
+        with open(filename, 'wb') as f:
+            f.write(b"MM" + struct.pack(">HI", 42, offset + len(data)))
+            f.write(data)
+            f.write(struct.pack(">H", len(entries)))
+            f.write(b"".join(entries))
+            f.write(struct.pack(">I", 0))
+        x = pyvips.Image.new_from_file(filename, access="random")
+        assert x.width == width
+        assert x.height == height
+        assert x.bands == 1
+        assert x.format == "ushort"
+        assert x(0, 0) == [0]
+        assert x(3, 2) == [3200]
+        assert x(15, 7) == [15700]
+
         filename = temp_filename(self.tempdir, '.tif')
         x = pyvips.Image.new_from_file(TIF_FILE)
         x = x.copy()
@@ -552,6 +667,22 @@ class TestForeign:
             assert x1.get("page-height") == x2.get("page-height")
             assert x1.get("gif-loop") == x2.get("gif-loop")
 
+            # single pages must match the same page from a full load
+            page_height = x2.get("page-height")
+            for page in range(x2.get("n-pages")):
+                x3 = pyvips.Image.new_from_buffer(w1, "", page=page)
+                x4 = x2.crop(0, page * page_height, x2.width, page_height)
+                assert (x3 - x4).abs().max() == 0
+
+            # frame-parallel encode should make an equivalent animation
+            w2 = x1.webpsave_buffer(Q=10, frame_parallel=True)
+            x5 = pyvips.Image.new_from_buffer(w2, "", n=-1)
+            assert x1.width == x5.width
+            assert x1.height == x5.height
+            assert x1.get("delay") == x5.get("delay")
+            assert x1.get("page-height") == x5.get("page-height")
+            assert x1.get("gif-loop") == x5.get("gif-loop")
+
     @skip_if_no("analyzeload")
     def test_analyzeload(self):
         def analyze_valid(im):
@@ -623,6 +754,16 @@ class TestForeign:
 
         self.file_loader("openslideload", OPENSLIDE_FILE, openslide_valid)
 
+        # tiles from the shared cache must match a fresh decode
+        im = pyvips.Image.openslideload(OPENSLIDE_FILE, cache=False)
+        openslide_valid(im)
+        x = pyvips.Image.openslideload(OPENSLIDE_FILE)
+        assert (im - x).abs().max() == 0
+        x = pyvips.Image.openslideload(OPENSLIDE_FILE, autocrop=True)
+        y = pyvips.Image.openslideload(OPENSLIDE_FILE, autocrop=True,
+                                       cache=False)
+        assert (x - y).abs().max() == 0
+
     @skip_if_no("pdfload")
     def test_pdfload(self):
         def pdf_valid(im):
@@ -645,6 +786,21 @@ class TestForeign:
         assert abs(im.width * 2 - x.width) < 2
         assert abs(im.height * 2 - x.height) < 2
 
+        # pages render on many threads, but metadata must still be attached
+        im = pyvips.Image.new_from_file(MULTIPAGE_PDF_FILE, n=-1)
+        assert im.width == 100
+        assert im.height == 100
+        assert im.get("n-pages") == 2
+        assert im.get("pdf-title") == "vips multipage test"
+        assert im.get("pdf-author") == "libvips"
+        assert_almost_equal_objects(im(50, 25), [255, 0, 0, 255])
+        assert_almost_equal_objects(im(50, 75), [0, 0, 255, 255])
+
+        x = pyvips.Image.new_from_file(MULTIPAGE_PDF_FILE, page=1)
+        assert x.height == 50
+        assert x.get("pdf-title") == "vips multipage test"
+        assert (x - im.crop(0, 50, 100, 50)).abs().max() == 0
+
     @skip_if_no("gifload")
     def test_gifload(self):
         def gif_valid(im):
@@ -673,6 +829,14 @@ class TestForeign:
             x2 = pyvips.Image.new_from_file(GIF_ANIM_FILE, page=1, n=-1)
             assert x2.height == 4 * x1.height
 
+            # single pages must match the same page from a full load,
+            # whether or not we can skip to a keyframe
+            x2 = pyvips.Image.new_from_file(GIF_ANIM_FILE, n=-1)
+            for page in range(5):
+                x3 = pyvips.Image.new_from_file(GIF_ANIM_FILE, page=page)
+                x4 = x2.crop(0, page * x1.height, x1.width, x1.height)
+                assert (x3 - x4).abs().max() == 0
+
     @skip_if_no("svgload")
     def test_svgload(self):
         def svg_valid(im):
@@ -703,6 +867,26 @@ class TestForeign:
     def test_csv(self):
         self.save_load("%s.csv", self.mono)
 
+        # enough lines to be parsed on several threads, with quoted fields,
+        # DOS linebreaks and no final newline
+        filename = temp_filename(self.tempdir, ".csv")
+        with open(filename, "w", newline="") as f:
+            f.write("x,y,label,value\n")
+            for y in range(5000):
+                f.write("{},{},\"a\\\"b\",{:g}".format(y, 2 * y, y * 0.25))
+                if y < 4999:
+                    f.write("\r\n" if y % 2 else "\n")
+
+        im = pyvips.Image.csvload(filename, skip=1)
+        assert im.width == 4
+        assert im.height == 5000
+        assert im(1, 10) == [20]
+        assert im(0, 4999) == [4999]
+        assert im(3, 4999) == [4999 * 0.25]
+
+        x = pyvips.Image.csvload(filename, skip=1, access="sequential")
+        assert (im - x).abs().max() == 0
+
     def test_matrix(self):
         self.save_load("%s.mat", self.mono)
 
@@ -822,6 +1006,15 @@ class TestForeign:
         assert os.path.exists(filename2)
         assert os.path.getsize(filename2) < os.path.getsize(filename)
 
+        # the zip should be readable and every member should pass its crc
+        # check
+        with zipfile.ZipFile(filename2) as z:
+            assert z.testzip() is None
+            root, ext = os.path.splitext(os.path.basename(filename2))
+            names = z.namelist()
+            assert root + "/" + root + ".dzi" in names
+            assert root + "/" + root + "_files/0/0_0.jpeg" in names
+
         # test suffix
         filename = temp_filename(self.tempdir, '')
         self.colour.dzsave(filename, suffix=".png")
@@ -863,6 +1056,79 @@ class TestForeign:
         buf = self.colour.dzsave_buffer(region_shrink="mode")
         buf = self.colour.dzsave_buffer(region_shrink="median")
 
+        # update in place ... only tiles touched by the dirty rect should
+        # be written
+        filename = temp_filename(self.tempdir, '')
+        self.colour.dzsave(filename, suffix=".png")
+        os.remove(filename + "_files/9/0_0.png")
+        changed = self.colour.draw_rect(0, 270, 400, 10, 10, fill=True)
+        changed.dzsave(filename, suffix=".png",
+                       dirty_left=270, dirty_top=400,
+                       dirty_width=10, dirty_height=10)
+        assert not os.path.exists(filename + "_files/9/0_0.png")
+
+        filename2 = temp_filename(self.tempdir, '')
+        changed.dzsave(filename2, suffix=".png")
+        for tile in ["9/1_1.png", "0/0_0.png"]:
+            x = pyvips.Image.new_from_file(filename + "_files/" + tile)
+            y = pyvips.Image.new_from_file(filename2 + "_files/" + tile)
+            assert (x - y).abs().max() == 0
+
+        # the checkpoint is removed on successful completion
+        filename = temp_filename(self.tempdir, '')
+        self.colour.dzsave(filename, checkpoint=True)
+        assert os.path.exists(filename + ".dzi")
+        assert os.path.exists(filename + "_files/9/1_1.jpeg")
+        assert not os.path.exists(filename + ".checkpoint")
+
+        # resume from a partial checkpoint ... fake an interrupted save
+        # that wrote the top strip of the largest layer and nothing else
+        ref = temp_filename(self.tempdir, '')
+        self.colour.dzsave(ref)
+
+        filename = temp_filename(self.tempdir, '')
+        self.colour.dzsave(filename)
+        n_layers = 1
+        size = max(self.colour.width, self.colour.height)
+        while size > 1:
+            size = (size + 1) // 2
+            n_layers += 1
+        with open(filename + ".checkpoint", "w") as f:
+            f.write("vips-dzsave-checkpoint {} {} 254 1 0 {}\n".format(
+                self.colour.width, self.colour.height, n_layers))
+            f.write("254\n")
+            f.write("0\n" * (n_layers - 1))
+
+        # a tile above the checkpoint should not be written again, a tile
+        # below it should
+        top = "{}/1_0.jpeg".format(n_layers - 1)
+        bottom = "{}/1_1.jpeg".format(n_layers - 1)
+        os.remove(filename + "_files/" + top)
+        os.remove(filename + "_files/" + bottom)
+        os.remove(filename + "_files/0/0_0.jpeg")
+
+        self.colour.dzsave(filename, checkpoint=True)
+        assert not os.path.exists(filename + ".checkpoint")
+        assert not os.path.exists(filename + "_files/" + top)
+        shutil.copy(ref + "_files/" + top, filename + "_files/" + top)
+
+        # and the result should match an uninterrupted save
+        for dirpath, dirnames, filenames in os.walk(ref + "_files"):
+            for name in filenames:
+                tile = os.path.relpath(os.path.join(dirpath, name),
+                                       ref + "_files")
+                x = pyvips.Image.new_from_file(ref + "_files/" + tile)
+                y = pyvips.Image.new_from_file(filename + "_files/" + tile)
+                assert (x - y).abs().max() == 0
+
+        # repeated tiles should be written once and linked
+        filename = temp_filename(self.tempdir, '')
+        im = (pyvips.Image.black(1024, 1024) + 128).cast("uchar")
+        im.dzsave(filename, dedup=True)
+        a = os.stat(filename + "_files/10/1_2.jpeg")
+        b = os.stat(filename + "_files/10/2_2.jpeg")
+        assert a.st_ino == b.st_ino
+
     @skip_if_no("heifload")
     def test_heifload(self):
         def heif_valid(im):
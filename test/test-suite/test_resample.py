@@ -1,8 +1,11 @@
 # vim: set fileencoding=utf-8 :
+import shutil
+import tempfile
 import pytest
 
 import pyvips
-from helpers import JPEG_FILE, all_formats, have
+from helpers import JPEG_FILE, OPENSLIDE_FILE, all_formats, have, \
+    skip_if_no, temp_filename
 
 
 # Run a function expecting a complex image on a two-band image
@@ -62,6 +65,16 @@ def to_rectangular(image):
 
 
 class TestResample:
+    tempdir = None
+
+    @classmethod
+    def setup_class(cls):
+        cls.tempdir = tempfile.mkdtemp()
+
+    @classmethod
+    def teardown_class(cls):
+        shutil.rmtree(cls.tempdir, ignore_errors=True)
+
     def test_affine(self):
         im = pyvips.Image.new_from_file(JPEG_FILE)
 
@@ -74,6 +87,42 @@ class TestResample:
 
             assert (x - im).abs().max() == 0
 
+    def test_affine_translate(self):
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+
+        # integer translates should move pixels exactly
+        for fmt in all_formats:
+            x = im.cast(fmt)
+            w = x.width - 10
+            h = x.height - 5
+            for name in ["nearest", "bilinear", "bicubic"]:
+                interpolate = pyvips.Interpolate.new(name)
+                y = x.affine([1, 0, 0, 1], odx=10, ody=5,
+                             interpolate=interpolate)
+                a = y.crop(10, 5, w, h)
+                b = x.crop(0, 0, w, h)
+                assert (a - b).abs().max() == 0
+
+    def test_affine_line(self):
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+
+        # affine interpolates a line of pixels at a time, mapim a pixel at
+        # a time ... they should agree, apart from rounding
+        index = pyvips.Image.xyz(im.width, im.height) + [0.3, 0.6]
+        w = im.width - 10
+        h = im.height - 10
+        for fmt in ["uchar", "short", "float", "double"]:
+            x = im.cast(fmt)
+            for name in ["bicubic", "lbb", "nohalo"]:
+                interpolate = pyvips.Interpolate.new(name)
+                a = x.affine([1, 0, 0, 1], idx=-0.3, idy=-0.6,
+                             oarea=[0, 0, x.width, x.height],
+                             interpolate=interpolate)
+                b = x.mapim(index, interpolate=interpolate)
+                a = a.crop(5, 5, w, h)
+                b = b.crop(5, 5, w, h)
+                assert (a - b).abs().max() <= 1
+
     def test_reduce(self):
         im = pyvips.Image.new_from_file(JPEG_FILE)
         # cast down to 0-127, the smallest range, so we aren't messed up by
@@ -100,6 +149,67 @@ class TestResample:
                 d = abs(shr.avg() - im.avg())
                 assert d == 0
 
+    def test_reduce_fused(self):
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+
+        # reduce should match reduceh then reducev ... skip uchar, since
+        # reducev has a lower-precision orc path for that
+        for fmt in all_formats:
+            if fmt == pyvips.BandFormat.UCHAR:
+                continue
+
+            x = im.cast(fmt)
+            for kernel in ["linear", "lanczos3"]:
+                for centre in [False, True]:
+                    a = x.reduce(1.7, 2.3, kernel=kernel, centre=centre)
+                    b = x.reduceh(1.7, kernel=kernel, centre=centre)
+                    b = b.reducev(2.3, kernel=kernel, centre=centre)
+                    assert a.width == b.width
+                    assert a.height == b.height
+                    assert (a - b).abs().max() == 0
+
+    def test_reduce_convert(self):
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+
+        # linear should match a trip through scRGB, to within rounding
+        a = im.reduce(1.7, 2.3, linear=True)
+        b = im.colourspace("scrgb").reduce(1.7, 2.3).colourspace("srgb")
+        assert a.width == b.width
+        assert a.height == b.height
+        assert a.format == pyvips.BandFormat.UCHAR
+        assert (a - b).abs().max() <= 1
+
+        # premultiply should match premultiply / unpremultiply
+        alpha = pyvips.Image.xyz(im.width, im.height)[0] % 256
+        x = im.bandjoin(alpha.cast("uchar"))
+        a = x.reduce(1.7, 2.3, premultiply=True)
+        b = x.premultiply().reduce(1.7, 2.3).unpremultiply().cast("uchar")
+        assert a.bands == 4
+        assert (a - b).abs().max() <= 1
+
+    def test_enlarge(self):
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+
+        for fmt in all_formats:
+            x = im.cast(fmt)
+            im2 = x.enlarge(2.5, 1.5)
+            assert im2.width == int(im.width * 2.5 + 0.5)
+            assert im2.height == int(im.height * 1.5 + 0.5)
+            assert abs(x.avg() - im2.avg()) < 2
+
+            # scale 1 is the identity
+            im2 = x.enlarge(1, 1)
+            assert (x - im2).abs().max() == 0
+
+        # try constant images ... should not change the constant
+        for const in [0, 1, 2, 254, 255]:
+            im = (pyvips.Image.black(10, 10) + const).cast("uchar")
+            for kernel in ["nearest", "linear",
+                           "cubic", "mitchell", "lanczos2", "lanczos3"]:
+                im2 = im.enlarge(2.7, 3.1, kernel=kernel)
+                assert im2.min() == const
+                assert im2.max() == const
+
     def test_resize(self):
         im = pyvips.Image.new_from_file(JPEG_FILE)
         im2 = im.resize(0.25)
@@ -128,6 +238,19 @@ class TestResample:
         assert im2.height == int(im.height / 2.5 + 0.5)
         assert abs(im.avg() - im2.avg()) < 1
 
+    def test_shrink_fused(self):
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+
+        # shrink should match shrinkv then shrinkh exactly
+        for fmt in all_formats:
+            x = im.cast(fmt)
+            for factor in [2, 3, 4, 8]:
+                a = x.shrink(factor, factor + 1)
+                b = x.shrinkv(factor + 1).shrinkh(factor)
+                assert a.width == b.width
+                assert a.height == b.height
+                assert (a - b).abs().max() == 0
+
     @pytest.mark.skipif(not pyvips.at_least_libvips(8, 5),
                         reason="requires libvips >= 8.5")
     def test_thumbnail(self):
@@ -166,6 +289,49 @@ class TestResample:
         im2 = pyvips.Image.thumbnail_buffer(buf, 100)
         assert abs(im1.avg() - im2.avg()) < 1
 
+    @skip_if_no("multires")
+    @skip_if_no("tiffsave")
+    def test_multires(self):
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+        filename = temp_filename(self.tempdir, '.tif')
+        im.tiffsave(filename, tile=True, pyramid=True,
+                    tile_width=64, tile_height=64)
+
+        # full resolution comes straight from level 0
+        x, opts = pyvips.Image.multires(filename, 1, level=True)
+        assert opts['level'] == 0
+        assert x.width == im.width
+        assert x.height == im.height
+        assert (x - im).abs().max() == 0
+
+        # other scales come from the nearest larger level ... the size must
+        # not depend on the level we pick
+        last_level = 0
+        for scale in [0.7, 0.5, 0.3, 0.2, 0.1]:
+            x, opts = pyvips.Image.multires(filename, scale, level=True)
+            assert x.width == int(im.width * scale + 0.5)
+            assert x.height == int(im.height * scale + 0.5)
+            assert opts['level'] >= last_level
+            assert abs(x.avg() - im.avg()) < 2
+            last_level = opts['level']
+        assert last_level > 0
+
+        x, opts = pyvips.Image.multires(filename, 0.5, level=True)
+        assert opts['level'] == 1
+
+        x = pyvips.Image.multires(filename, 0.5, vscale=0.25)
+        assert x.width == int(im.width * 0.5 + 0.5)
+        assert x.height == int(im.height * 0.25 + 0.5)
+
+    @skip_if_no("multires")
+    @skip_if_no("openslideload")
+    def test_multires_openslide(self):
+        im = pyvips.Image.new_from_file(OPENSLIDE_FILE)
+        x = pyvips.Image.multires(OPENSLIDE_FILE, 0.25)
+        assert x.width == int(im.width * 0.25 + 0.5)
+        assert x.height == int(im.height * 0.25 + 0.5)
+        assert x.bands == im.bands
+
     def test_similarity(self):
         im = pyvips.Image.new_from_file(JPEG_FILE)
         im2 = im.similarity(angle=90)
@@ -208,6 +374,24 @@ class TestResample:
         interp = pyvips.Interpolate.new('bicubic')
         assert im.mapim(mp, interpolate=interp).avg() == im.avg()
 
+    def test_mapim_split(self):
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+
+        # swap the left and right halves ... tiles on the seam need both
+        # edges of the input, so mapim has to split them
+        half = im.width // 2
+        xy = pyvips.Image.xyz(im.width, im.height)
+        x = xy[0] + half
+        x = (x >= im.width).ifthenelse(x - im.width, x)
+        index = x.bandjoin(xy[1])
+
+        swapped = im.crop(half, 0, im.width - half, im.height) \
+            .join(im.crop(0, 0, half, im.height), "horizontal")
+        for name in ["nearest", "bilinear"]:
+            interp = pyvips.Interpolate.new(name)
+            a = im.mapim(index, interpolate=interp)
+            assert (a - swapped).abs().max() == 0
+
 
 if __name__ == '__main__':
     pytest.main()
@@ -96,3 +96,48 @@ test_thumbnail "100x100<" 290 442
 test_thumbnail "2000<" 1312 2000
 test_thumbnail "100x100>" 66 100
 test_thumbnail "2000>" 290 442
+
+test_fast_header() {
+	im=$1
+
+	printf "testing vipsheader --fast with $(basename $im) ... "
+
+	for field in width height bands format; do
+		slow=$($vipsheader -f $field $im)
+		fast=$($vipsheader --fast -f $field $im)
+		if [ "$slow" != "$fast" ]; then
+			echo $field is $fast, not $slow
+			exit 1
+		fi
+	done
+
+	echo "ok"
+}
+
+test_fast_header $image
+test_fast_header $test_images/sample.png
+test_fast_header $test_images/sample.tif
+
+# the SIMD paths in reduceh should match the C path exactly for int formats
+test_reduceh_vector() {
+	im=$1
+	format=$2
+
+	printf "testing reduceh vector path with $format ... "
+
+	for bands in 1 2 3 4; do
+		$vips bandjoin "$im $im" $tmp/t1.v
+		$vips extract_band $tmp/t1.v $tmp/t2.v 0 --n $bands
+		$vips cast $tmp/t2.v $tmp/t1.v $format
+		for hshrink in 1.5 2.7 5; do
+			$vips reduceh $tmp/t1.v $tmp/t2.v $hshrink
+			$vips reduceh $tmp/t1.v $tmp/t3.v $hshrink --vips-novector
+			test_difference $tmp/t2.v $tmp/t3.v 0
+		done
+	done
+
+	echo "ok"
+}
+
+test_reduceh_vector $image uchar
+test_reduceh_vector $image ushort
@@ -38,6 +38,8 @@
  * 	  functions, so "header" is now obsolete
  * 27/2/13
  * 	- convert to vips8 API
+ * 19/10/19
+ * 	- add --fast
  */
 
 /*
@@ -82,6 +84,7 @@
 
 static char *main_option_field = NULL;
 static gboolean main_option_all = FALSE;
+static gboolean main_option_fast = FALSE;
 
 static GOptionEntry main_option[] = {
 	{ "all", 'a', 0, G_OPTION_ARG_NONE, &main_option_all, 
@@ -90,6 +93,9 @@ static GOptionEntry main_option[] = {
 		N_( "print value of FIELD (\"getext\" reads extension block, "
 			"\"Hist\" reads image history)" ),
 		"FIELD" },
+	{ "fast", 0, 0, G_OPTION_ARG_NONE, &main_option_fast, 
+		N_( "only read width, height, bands, format, orientation, "
+			"icc and loader, and probe many files at once" ), NULL },
 	{ NULL }
 };
 
@@ -158,6 +164,51 @@ print_header( VipsImage *im, gboolean many )
 	return( 0 );
 }
 
+/* Print the fields vips_foreign_probe() found.
+ */
+static int
+print_probe( const char *filename, VipsForeignProbe *probe, gboolean many )
+{
+	const char *format = vips_enum_nick( VIPS_TYPE_BAND_FORMAT, 
+		probe->format );
+
+	if( !main_option_field ) 
+		printf( "%s: %dx%d %s, %d band%s, orientation %d, %s%s\n", 
+			filename, 
+			probe->width, probe->height, format, 
+			probe->bands, probe->bands > 1 ? "s" : "", 
+			probe->orientation, 
+			probe->icc ? "icc, " : "",
+			probe->loader );
+	else {
+		if( many )
+			printf( "%s: ", filename );
+
+		if( strcmp( main_option_field, "width" ) == 0 ) 
+			printf( "%d\n", probe->width );
+		else if( strcmp( main_option_field, "height" ) == 0 ) 
+			printf( "%d\n", probe->height );
+		else if( strcmp( main_option_field, "bands" ) == 0 ) 
+			printf( "%d\n", probe->bands );
+		else if( strcmp( main_option_field, "format" ) == 0 ) 
+			printf( "%s\n", format );
+		else if( strcmp( main_option_field, "orientation" ) == 0 ) 
+			printf( "%d\n", probe->orientation );
+		else if( strcmp( main_option_field, "icc" ) == 0 ) 
+			printf( "%d\n", probe->icc );
+		else if( strcmp( main_option_field, "loader" ) == 0 ) 
+			printf( "%s\n", probe->loader );
+		else {
+			vips_error( g_get_prgname(), 
+				_( "field \"%s\" not available with --fast" ),
+				main_option_field );
+			return( -1 );
+		}
+	}
+
+	return( 0 );
+}
+
 int
 main( int argc, char *argv[] )
 {
@@ -204,22 +255,48 @@ main( int argc, char *argv[] )
 
 	result = 0;
 
-	for( i = 1; argv[i]; i++ ) {
-		VipsImage *im;
+	if( main_option_fast ) {
+		VipsForeignProbe *probe;
+		int n;
 
-		if( !(im = vips_image_new_from_file( argv[i], NULL )) ) {
-			print_error();
-			result = 1;
-		}
+		for( n = 0; argv[n + 1]; n++ )
+			;
+		probe = VIPS_ARRAY( NULL, VIPS_MAX( 1, n ), VipsForeignProbe );
 
-		if( im && 
-			print_header( im, argv[2] != NULL ) ) {
+		if( vips_foreign_probe_many( (const char **) argv + 1, 
+			n, probe ) ) {
 			print_error();
 			result = 1;
 		}
 
-		if( im )
-			g_object_unref( im );
+		for( i = 0; i < n; i++ )
+			if( probe[i].loader &&
+				print_probe( argv[i + 1], &probe[i], n > 1 ) ) {
+				print_error();
+				result = 1;
+			}
+
+		g_free( probe );
+	}
+	else {
+		for( i = 1; argv[i]; i++ ) {
+			VipsImage *im;
+
+			if( !(im = vips_image_new_from_file( argv[i], 
+				NULL )) ) {
+				print_error();
+				result = 1;
+			}
+
+			if( im && 
+				print_header( im, argv[2] != NULL ) ) {
+				print_error();
+				result = 1;
+			}
+
+			if( im )
+				g_object_unref( im );
+		}
 	}
 
 	/* We don't free this on error exit, sadly.